@@ -120,6 +120,20 @@ enum menc_event {
 	MENC_EVENT_PEER_VERIFIED,
 };
 
+/** Call setup milestones */
+enum call_mark {
+	CALL_MARK_START = 0,   /**< Call object allocated              */
+	CALL_MARK_MNAT,        /**< Media NAT gathering complete       */
+	CALL_MARK_INVITE,      /**< INVITE sent or received            */
+	CALL_MARK_PROGRESS,    /**< Provisional response sent or recvd */
+	CALL_MARK_ANSWER,      /**< Call established                   */
+	CALL_MARK_SECURE,      /**< Media encryption established       */
+	CALL_MARK_RTP_TX,      /**< First RTP packet sent              */
+	CALL_MARK_RTP_RX,      /**< First RTP packet received          */
+
+	CALL_MARK_MAX
+};
+
 struct call;
 
 typedef void (call_event_h)(struct call *call, enum call_event ev,
@@ -155,8 +169,12 @@ bool          call_is_outgoing(const struct call *call);
 void          call_enable_rtp_timeout(struct call *call, uint32_t timeout_ms);
 uint32_t      call_linenum(const struct call *call);
 struct call  *call_find_linenum(const struct list *calls, uint32_t linenum);
+struct call  *call_find_id(const struct list *calls, const char *id);
 void call_set_current(struct list *calls, struct call *call);
 const struct list *call_get_custom_hdrs(const struct call *call);
+int32_t       call_mark_elapsed(const struct call *call, enum call_mark mark);
+const char   *call_mark_name(enum call_mark mark);
+int           call_timeline(struct re_printf *pf, const struct call *call);
 
 
 /*
@@ -180,6 +198,7 @@ int custom_hdrs_apply(const struct list *hdrs,
 typedef int (confline_h)(const struct pl *addr, void *arg);
 
 int  conf_configure(void);
+int  conf_configure_buf(const uint8_t *buf, size_t sz);
 int  conf_modules(void);
 void conf_path_set(const char *path);
 int  conf_path_get(char *path, size_t sz);
@@ -190,6 +209,49 @@ int  conf_get_sa(const struct conf *conf, const char *name, struct sa *sa);
 bool conf_fileexist(const char *path);
 void conf_close(void);
 struct conf *conf_cur(void);
+struct confidx *conf_cur_index(void);
+
+
+/*
+ * Config index
+ */
+
+struct confidx;
+struct range;
+struct conf_watch;
+
+/** Defines the config change handler, called after a reload */
+typedef void (conf_change_h)(const struct confidx *idx, void *arg);
+
+int  confidx_alloc(struct confidx **idxp, const char *filename);
+int  confidx_alloc_buf(struct confidx **idxp, const uint8_t *buf, size_t sz);
+int  confidx_get(const struct confidx *idx, const char *name,
+		 struct pl *val);
+int  confidx_get_str(const struct confidx *idx, const char *name,
+		     char *str, size_t size);
+int  confidx_get_u32(const struct confidx *idx, const char *name,
+		     uint32_t *num);
+int  confidx_get_bool(const struct confidx *idx, const char *name,
+		      bool *val);
+int  confidx_get_float(const struct confidx *idx, const char *name,
+		       double *val);
+int  confidx_get_range(const struct confidx *idx, const char *name,
+		       struct range *rng);
+int  confidx_get_csv(const struct confidx *idx, const char *name,
+		     char *str1, size_t sz1, char *str2, size_t sz2);
+int  confidx_get_vidsz(const struct confidx *idx, const char *name,
+		       struct vidsz *sz);
+int  confidx_get_sa(const struct confidx *idx, const char *name,
+		    struct sa *sa);
+int  confidx_apply(const struct confidx *idx, const char *name,
+		   conf_h *ch, void *arg);
+uint32_t confidx_count(const struct confidx *idx);
+bool confidx_changed(const struct confidx *old, const struct confidx *idx,
+		     const char *key);
+struct conf *confidx_conf(struct confidx *idx);
+int  conf_watch_alloc(struct conf_watch **watchp,
+		      const char * const *keyv, size_t keyc,
+		      conf_change_h *h, void *arg);
 
 
 /*
@@ -220,6 +282,9 @@ struct config_sip {
 	char uuid[64];          /**< Universally Unique Identifier  */
 	char local[64];         /**< Local SIP Address              */
 	char cert[256];         /**< SIP Certificate                */
+	uint32_t reg_rate;      /**< Max REGISTER rate [1/sec]      */
+	uint32_t reg_inflight;  /**< Max REGISTERs in progress      */
+	uint32_t reg_window;    /**< REGISTER spread window [sec]   */
 };
 
 /** Call config */
@@ -262,6 +327,10 @@ struct config_video {
 	double fps;             /**< Video framerate                */
 	bool fullscreen;        /**< Enable fullscreen display      */
 	int enc_fmt;            /**< Encoder pixelfmt (enum vidfmt) */
+	uint32_t fec_key;       /**< FEC level for key frames [%]   */
+	uint32_t fec_delta;     /**< FEC level for delta frames [%] */
+	bool adapt;             /**< Adapt to the encoder CPU load  */
+	bool bwe;               /**< Adapt the bitrate to feedback  */
 };
 #endif
 
@@ -275,6 +344,8 @@ struct config_avt {
 	struct range jbuf_del;  /**< Delay, number of frames        */
 	bool rtp_stats;         /**< Enable RTP statistics          */
 	uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
+	char rec_path[256];     /**< Directory for RTP recordings   */
+	double mos_threshold;   /**< Call quality alarm, 0 is off   */
 };
 
 /* Network */
@@ -322,7 +393,7 @@ struct config {
 	struct config_sdp sdp;
 };
 
-int config_parse_conf(struct config *cfg, const struct conf *conf);
+int config_parse_conf(struct config *cfg, const struct confidx *idx);
 int config_print(struct re_printf *pf, const struct config *cfg);
 int config_write_template(const char *file, const struct config *cfg);
 struct config *conf_config(void);
@@ -371,6 +442,27 @@ const char      *contact_str(const struct contact *c);
 const char      *contact_presence_str(enum presence_status status);
 
 
+/*
+ * Latency histogram
+ */
+
+enum {
+	LATHIST_BUCKETS = 18
+};
+
+/** Latency histogram with power-of-two buckets in [ms] */
+struct lathist {
+	uint32_t bucketv[LATHIST_BUCKETS];
+	uint32_t n;
+	uint64_t sum;
+	uint32_t max;
+};
+
+void     lathist_add(struct lathist *h, uint32_t ms);
+uint32_t lathist_percentile(const struct lathist *h, unsigned pct);
+int      lathist_debug(struct re_printf *pf, const struct lathist *h);
+
+
 /*
  * Media Context
  */
@@ -423,18 +515,31 @@ int  message_send(struct ua *ua, const char *peer, const char *msg,
 
 struct ausrc;
 struct ausrc_st;
+struct aucodec;
 
-/** Audio Source parameters */
+typedef void (ausrc_read_h)(const void *sampv, size_t sampc, void *arg);
+typedef void (ausrc_error_h)(int err, const char *str, void *arg);
+typedef void (ausrc_payload_h)(const uint8_t *buf, size_t len,
+			       uint32_t dur, void *arg);
+
+/**
+ * Audio Source parameters
+ *
+ * If payloadh is set, the source may send frames that are already
+ * encoded with the given codec, instead of samples. The duration of
+ * a frame is in RTP clock units, and a frame without payload is not
+ * sent.
+ */
 struct ausrc_prm {
 	uint32_t   srate;       /**< Sampling rate in [Hz]      */
 	uint8_t    ch;          /**< Number of channels         */
 	uint32_t   ptime;       /**< Wanted packet-time in [ms] */
 	int        fmt;         /**< Sample format (enum aufmt) */
+	const struct aucodec *ac;   /**< Encoder (optional)          */
+	const char *fmtp;           /**< Encoder parameters          */
+	ausrc_payload_h *payloadh;  /**< Pre-encoded frame handler   */
 };
 
-typedef void (ausrc_read_h)(const void *sampv, size_t sampc, void *arg);
-typedef void (ausrc_error_h)(int err, const char *str, void *arg);
-
 typedef int  (ausrc_alloc_h)(struct ausrc_st **stp, const struct ausrc *ausrc,
 			     struct media_ctx **ctx,
 			     struct ausrc_prm *prm, const char *device,
@@ -575,6 +680,33 @@ void debug(const char *fmt, ...);
 void info(const char *fmt, ...);
 void warning(const char *fmt, ...);
 void error_msg(const char *fmt, ...);
+int  log_enable_async(bool enable);
+int  log_debug(struct re_printf *pf, void *unused);
+
+/** Rate limit for the messages from one call site */
+struct log_ratelimit {
+	uint64_t ts;          /**< Start of the current interval [ms] */
+	uint32_t count;       /**< Messages in the current interval   */
+	uint32_t suppressed;  /**< Suppressed in the current interval */
+};
+
+bool log_ratelimit(struct log_ratelimit *rl, enum log_level level);
+
+/** Print a WARNING message, with a rate limit per call site */
+#define warning_ratelimit(...)						\
+	do {								\
+		static struct log_ratelimit rl_;			\
+		if (log_ratelimit(&rl_, LEVEL_WARN))			\
+			warning(__VA_ARGS__);				\
+	} while (0)
+
+/** Print a DEBUG message, with a rate limit per call site */
+#define debug_ratelimit(...)						\
+	do {								\
+		static struct log_ratelimit rl_;			\
+		if (log_ratelimit(&rl_, LEVEL_DEBUG))			\
+			debug(__VA_ARGS__);				\
+	} while (0)
 
 
 /*
@@ -612,6 +744,25 @@ void menc_unregister(struct menc *menc);
 const struct menc *menc_find(const struct list *mencl, const char *id);
 
 
+/*
+ * SRTP fast path
+ */
+
+struct srtpfast;
+
+int  srtpfast_alloc(struct srtpfast **sfp, enum srtp_suite suite,
+		    const uint8_t *key, size_t key_bytes);
+int  srtpfast_encrypt(struct srtpfast *sf, struct mbuf *mb);
+int  srtpfast_decrypt(struct srtpfast *sf, struct mbuf *mb);
+int  srtcpfast_encrypt(struct srtpfast *sf, struct mbuf *mb);
+int  srtcpfast_decrypt(struct srtpfast *sf, struct mbuf *mb);
+size_t srtpfast_encrypt_batch(struct srtpfast *sf, struct mbuf **mbv,
+			      int *errv, size_t n);
+size_t srtpfast_decrypt_batch(struct srtpfast *sf, struct mbuf **mbv,
+			      int *errv, size_t n);
+const char *srtpfast_backend(const struct srtpfast *sf);
+
+
 /*
  * Net - Networking
  */
@@ -678,6 +829,9 @@ enum ua_event {
 	UA_EVENT_CALL_MENC,
 	UA_EVENT_VU_TX,
 	UA_EVENT_VU_RX,
+	UA_EVENT_CALL_VIDEO_ADAPT,
+	UA_EVENT_CALL_SETUP,
+	UA_EVENT_CALL_QUALITY,
 
 	UA_EVENT_MAX,
 };
@@ -688,9 +842,29 @@ enum vidmode {
 	VIDMODE_ON,         /**< Video enabled                 */
 };
 
+/** Event mask of one User-Agent event */
+#define UA_EVENT_MASK(ev) (1ULL << (ev))
+
+/** Event mask of all User-Agent events */
+#define UA_EVENT_MASK_ALL (UA_EVENT_MASK(UA_EVENT_MAX) - 1)
+
+/** Event subscription flags */
+enum ua_event_flags {
+	UA_EVENT_ASYNC = 1 << 0,  /**< Deliver from the async queue */
+};
+
+/** User-Agent event, the parameter text is read with ua_event_prm() */
+struct ua_event_data {
+	struct ua *ua;            /**< User-Agent (optional)        */
+	const char *aor;          /**< AOR of the User-Agent        */
+	struct call *call;        /**< Call object (optional)       */
+	enum ua_event ev;         /**< Event id                     */
+};
+
 /** Defines the User-Agent event handler */
 typedef void (ua_event_h)(struct ua *ua, enum ua_event ev,
 			  struct call *call, const char *prm, void *arg);
+typedef void (ua_event_data_h)(struct ua_event_data *evd, void *arg);
 typedef void (options_resp_h)(int err, const struct sip_msg *msg, void *arg);
 
 typedef void (ua_exit_h)(void *arg);
@@ -748,6 +922,10 @@ void uag_set_exit_handler(ua_exit_h *exith, void *arg);
 int  uag_reset_transp(bool reg, bool reinvite);
 int  uag_event_register(ua_event_h *eh, void *arg);
 void uag_event_unregister(ua_event_h *eh);
+int  uag_event_subscribe(ua_event_data_h *h, uint64_t mask, int flags,
+			 void *arg);
+void uag_event_unsubscribe(ua_event_data_h *h);
+int  uag_event_debug(struct re_printf *pf, void *unused);
 void uag_set_sub_handler(sip_msg_h *subh);
 int  ua_print_sip_status(struct re_printf *pf, void *unused);
 int  uag_set_extra_params(const char *eprm);
@@ -756,6 +934,7 @@ struct ua   *uag_find_aor(const char *aor);
 struct ua   *uag_find_param(const char *name, const char *val);
 struct sip  *uag_sip(void);
 const char  *uag_event_str(enum ua_event ev);
+const char  *uag_event_class(enum ua_event ev);
 struct list *uag_list(void);
 void         uag_current_set(struct ua *ua);
 struct ua   *uag_current(void);
@@ -1098,6 +1277,7 @@ struct vidfilt {
 	vidfilt_encode_h *ench;
 	vidfilt_decupd_h *decupdh;
 	vidfilt_decode_h *dech;
+	bool dec_rdonly;        /* The decoder does not modify the frame */
 };
 
 void vidfilt_register(struct list *vidfiltl, struct vidfilt *vf);
@@ -1114,6 +1294,15 @@ int vidfilt_dec_append(struct list *filtl, void **ctx,
 
 struct audio;
 
+/** Audio buffer statistics */
+struct audio_stats {
+	uint64_t tx_overrun;    /**< Source faster than the encoder   */
+	uint64_t tx_underrun;   /**< Encoder faster than the source   */
+	uint64_t rx_overrun;    /**< Decoder faster than the player   */
+	uint64_t rx_underrun;   /**< Player faster than the decoder   */
+	uint64_t rx_discard;    /**< Discarded incoming frames        */
+};
+
 void audio_mute(struct audio *a, bool muted);
 bool audio_ismuted(const struct audio *a);
 void audio_set_devicename(struct audio *a, const char *src, const char *play);
@@ -1125,6 +1314,7 @@ int  audio_debug(struct re_printf *pf, const struct audio *a);
 struct stream *audio_strm(const struct audio *au);
 int  audio_set_bitrate(struct audio *au, uint32_t bitrate);
 bool audio_rxaubuf_started(const struct audio *au);
+int  audio_stats_get(const struct audio *au, struct audio_stats *stats);
 void audio_stop(struct audio *a);
 void audio_set_hold(struct audio *au, bool hold);
 
@@ -1141,6 +1331,9 @@ int   video_set_fullscreen(struct video *v, bool fs);
 int   video_set_orient(struct video *v, int orient);
 void  video_vidsrc_set_device(struct video *v, const char *dev);
 int   video_set_source(struct video *v, const char *name, const char *dev);
+int   video_set_bitrate(struct video *v, uint32_t bitrate);
+uint32_t video_bwe_calc(uint32_t bitrate, uint32_t max, unsigned loss,
+			uint32_t remb);
 void  video_set_devicename(struct video *v, const char *src, const char *disp);
 void  video_encoder_cycle(struct video *video);
 int   video_debug(struct re_printf *pf, const struct video *v);
@@ -1151,6 +1344,30 @@ double video_timestamp_to_seconds(uint64_t timestamp);
 uint64_t video_calc_timebase_timestamp(uint64_t rtp_ts);
 
 
+/*
+ * Video frame pool
+ */
+
+struct vidpool;
+
+/** Video frame pool statistics */
+struct vidpool_stats {
+	unsigned n_frames;      /**< Frames in the pool          */
+	unsigned n_busy;        /**< Frames in use               */
+	uint64_t n_alloc;       /**< Frames allocated            */
+	uint64_t n_reuse;       /**< Frames reused from the pool */
+	uint64_t n_copy;        /**< Full frame copies           */
+};
+
+int vidpool_alloc(struct vidpool **poolp, unsigned max);
+int vidpool_get(struct vidpool *pool, struct vidframe **framep,
+		enum vidfmt fmt, const struct vidsz *sz);
+int vidpool_copy(struct vidpool *pool, struct vidframe **framep,
+		 const struct vidframe *src);
+int vidpool_stats(const struct vidpool *pool, struct vidpool_stats *stats);
+int vidpool_debug(struct re_printf *pf, const struct vidpool *pool);
+
+
 /*
  * Generic stream
  */
@@ -1164,6 +1381,8 @@ uint32_t stream_metric_get_tx_n_err(const struct stream *strm);
 uint32_t stream_metric_get_rx_n_packets(const struct stream *strm);
 uint32_t stream_metric_get_rx_n_bytes(const struct stream *strm);
 uint32_t stream_metric_get_rx_n_err(const struct stream *strm);
+int stream_jbuf_stats(const struct stream *strm, struct jbuf_stat *stat);
+const struct quality_summary *stream_quality(const struct stream *strm);
 
 /*
  * Media NAT
@@ -1200,6 +1419,62 @@ int mnat_register(struct mnat **mnatp, struct list *mnatl,
 int realtime_enable(bool enable, int fps);
 
 
+/*
+ * RTP recorder
+ */
+
+/** Record types in an RTP recording */
+enum rtprec_type {
+	RTPREC_INFO = 1,  /**< Call information, "name: value" */
+	RTPREC_STREAM,    /**< Media stream, by SDP media name */
+	RTPREC_SDP,       /**< Negotiated SDP                  */
+	RTPREC_RTP,       /**< RTP payload                     */
+};
+
+/** Record flags */
+enum {
+	RTPREC_TX     = 1<<0,  /**< Sent RTP, otherwise received   */
+	RTPREC_LOCAL  = 1<<1,  /**< Local SDP, otherwise remote    */
+	RTPREC_MARKER = 1<<2,  /**< RTP marker bit is set          */
+};
+
+/** One record of an RTP recording */
+struct rtprec_rec {
+	enum rtprec_type type;  /**< Record type                     */
+	uint8_t flags;          /**< Record flags                    */
+	uint8_t stream;         /**< Stream index                    */
+	uint8_t pt;             /**< RTP payload type                */
+	uint64_t ts;            /**< Arrival time in [us]            */
+	uint32_t ssrc;          /**< RTP synchronization source      */
+	uint16_t seq;           /**< RTP sequence number             */
+	uint32_t rtp_ts;        /**< RTP timestamp                   */
+	const uint8_t *buf;     /**< RTP payload, SDP or text        */
+	size_t len;             /**< Length of buf in bytes          */
+};
+
+struct rtprec;
+
+typedef int (rtprec_h)(const struct rtprec_rec *r, void *arg);
+
+int  rtprec_alloc(struct rtprec **recp, const char *file);
+int  rtprec_stream(struct rtprec *rec, const char *name);
+void rtprec_info(struct rtprec *rec, const char *name, const char *value);
+void rtprec_sdp(struct rtprec *rec, bool local, const struct mbuf *mb);
+void rtprec_rtp(struct rtprec *rec, int stream, bool tx, bool ext,
+		const struct rtp_header *hdr, const struct mbuf *mb);
+int  rtprec_debug(struct re_printf *pf, const struct rtprec *rec);
+int  rtprec_decode(const struct mbuf *mb, rtprec_h *h, void *arg);
+void rtprec_close(void);
+
+struct rtpmix;
+
+int  rtpmix_alloc(struct rtpmix **mixp, uint32_t srate, uint8_t ch);
+int  rtpmix_decode(struct rtpmix *mix, const struct mbuf *mb);
+const int16_t *rtpmix_sampv(const struct rtpmix *mix, size_t *framec);
+uint32_t rtpmix_srate(const struct rtpmix *mix);
+int  rtpmix_debug(struct re_printf *pf, const struct rtpmix *mix);
+
+
 /*
  * SDP
  */
@@ -1311,15 +1586,83 @@ static inline bool h264_is_keyframe(int type)
 
 int module_preload(const char *module);
 int  module_load(const char *name);
+int  module_load_path(const char *path, const char *name);
 void module_unload(const char *name);
 
 
+/** Expensive module init that can be deferred to first use */
+struct mod_lazy {
+	const char *name;       /**< Module name                     */
+	int (*inith)(void);     /**< Init handler                    */
+	bool done;              /**< Init handler was called         */
+	int err;                /**< Result of the init handler      */
+};
+
+#define MOD_LAZY_INIT(name, inith) {(name), (inith), false, 0}
+
+bool module_lazy(void);
+void module_lazy_set(bool enable);
+int  module_lazy_init(struct mod_lazy *ml);
+int  module_lazy_use(struct mod_lazy *ml);
+void module_lazy_reset(struct mod_lazy *ml);
+
+
+/*
+ * Forward Error Correction (FEC)
+ */
+
+struct fec_enc;
+struct fec_dec;
+
+typedef int  (fec_send_h)(uint32_t ts, struct mbuf *mb, void *arg);
+typedef void (fec_recv_h)(const struct rtp_header *hdr, struct mbuf *mb,
+			  void *arg);
+
+int  fec_enc_alloc(struct fec_enc **encp, size_t headroom,
+		   fec_send_h *sendh, void *arg);
+void fec_enc_set_level(struct fec_enc *enc, unsigned level);
+int  fec_enc_packet(struct fec_enc *enc, const struct rtp_header *hdr,
+		    const uint8_t *pld, size_t len);
+int  fec_enc_flush(struct fec_enc *enc);
+int  fec_enc_debug(struct re_printf *pf, const struct fec_enc *enc);
+int  fec_dec_alloc(struct fec_dec **decp, fec_recv_h *recvh, void *arg);
+int  fec_dec_media(struct fec_dec *dec, const struct rtp_header *hdr,
+		   struct mbuf *mb);
+int  fec_dec_fec(struct fec_dec *dec, const struct rtp_header *hdr,
+		 struct mbuf *mb);
+uint64_t fec_dec_recovered(const struct fec_dec *dec);
+int  fec_dec_debug(struct re_printf *pf, const struct fec_dec *dec);
+
+
 /*
  * MOS (Mean Opinion Score)
  */
 
+/** Input of the E-model, for one interval */
+struct quality_input {
+	uint32_t expected;      /**< Packets expected                  */
+	uint32_t lost;          /**< Packets lost in the network       */
+	uint32_t bursts;        /**< Runs of lost packets              */
+	uint32_t discarded;     /**< Packets discarded by the receiver */
+	double rtt;             /**< Round-trip time in [ms]           */
+	double jitter;          /**< Interarrival jitter in [ms]       */
+};
+
+/** Quality of a stream over all intervals */
+struct quality_summary {
+	uint32_t n;             /**< Number of intervals               */
+	double r_min;           /**< Lowest R-factor                   */
+	double r_avg;           /**< Average R-factor                  */
+	double r_max;           /**< Highest R-factor                  */
+	double mos_min;         /**< Lowest MOS                        */
+	double mos_avg;         /**< Average MOS                       */
+	double mos_max;         /**< Highest MOS                       */
+};
+
 double mos_calculate(double *r_factor, double rtt,
 		     double jitter, uint32_t num_packets_lost);
+double mos_emodel(double *r_factor, const char *codec,
+		  const struct quality_input *in);
 
 
 /*
@@ -1328,6 +1671,48 @@ double mos_calculate(double *r_factor, double rtt,
 
 int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		      struct call *call, const char *prm);
+int event_encode_json(struct re_printf *pf, struct ua *ua, enum ua_event ev,
+		      struct call *call, const char *prm);
+int event_encode_members(struct re_printf *pf, const char *aor,
+			 enum ua_event ev, struct call *call, const char *prm);
+const char *ua_event_prm(struct ua_event_data *evd);
+
+
+/*
+ * Event batching
+ */
+
+struct evbatch;
+
+/** Event batching configuration */
+struct evbatch_conf {
+	uint32_t window;        /**< Coalescing window in [ms], 0 is off */
+	uint32_t max_batch;     /**< Maximum events in one message       */
+	uint32_t max_pending;   /**< Maximum queued events per topic     */
+};
+
+/** Event batching statistics */
+struct evbatch_stats {
+	uint64_t n_in;          /**< Events added                        */
+	uint64_t n_coalesced;   /**< Events replaced by a newer value    */
+	uint64_t n_out;         /**< Events sent                         */
+	uint64_t n_msg;         /**< Messages sent                       */
+	uint64_t n_err;         /**< Messages that failed to send        */
+	uint64_t n_drop;        /**< Queued events dropped, oldest first */
+	uint32_t n_pending;     /**< Events waiting to be sent           */
+	uint32_t max_pending;   /**< Peak of pending events              */
+};
+
+typedef int (evbatch_send_h)(const char *topic, const char *buf,
+			     size_t len, void *arg);
+
+int  evbatch_alloc(struct evbatch **ebp, const struct evbatch_conf *conf,
+		   evbatch_send_h *sendh, void *arg);
+int  evbatch_add(struct evbatch *eb, const char *topic, const char *key,
+		 const char *json, size_t len);
+int  evbatch_flush(struct evbatch *eb);
+void evbatch_stats_get(const struct evbatch *eb, struct evbatch_stats *st);
+int  evbatch_debug(struct re_printf *pf, const struct evbatch *eb);
 
 
 /*
@@ -1359,6 +1744,7 @@ struct list   *baresip_vidsrcl(void);
 struct list   *baresip_vidispl(void);
 struct list   *baresip_vidfiltl(void);
 struct ui_sub *baresip_uis(void);
+uint64_t baresip_uptime(void);
 
 
 #ifdef __cplusplus
@@ -274,6 +274,7 @@ MODULES   += uuid
 MODULES   += debug_cmd
 MODULES   += ctrl_tcp
 MODULES   += b2bua
+MODULES   += loadgen
 
 ifneq ($(HAVE_LIBMQTT),)
 MODULES   += mqtt
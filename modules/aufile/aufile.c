@@ -6,28 +6,46 @@
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
 #include <pthread.h>
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
+#include "aufile.h"
 
 
 /**
  * @defgroup aufile aufile
  *
  * Audio module for using a WAV-file as audio input
+ *
+ * The decoded files are shared by all calls playing them, and kept in
+ * a cache with a memory limit. A file that is changed on disk is loaded
+ * again. If the core takes encoded frames, a file is also encoded once
+ * for each codec, and the calls send the shared frames.
+ *
+ \verbatim
+  aufile_cache_size     16384   # [kB], 0 to disable
+ \endverbatim
  */
 
 
+enum {
+	CACHE_SIZE = 16384,  /* default cache size in [kB] */
+};
+
+
 struct ausrc_st {
 	const struct ausrc *as;  /* base class */
 	struct tmr tmr;
-	struct aufile *aufile;
-	struct aubuf *aubuf;
+	struct prompt *prompt;
+	struct prompt_enc *enc;
+	volatile size_t pos;
 	uint32_t ptime;
 	size_t sampc;
 	bool run;
 	pthread_t thread;
 	ausrc_read_h *rh;
+	ausrc_payload_h *payloadh;
 	ausrc_error_h *errh;
 	void *arg;
 };
@@ -47,8 +65,45 @@ static void destructor(void *arg)
 
 	tmr_cancel(&st->tmr);
 
-	mem_deref(st->aufile);
-	mem_deref(st->aubuf);
+	mem_deref(st->enc);
+	mem_deref(st->prompt);
+}
+
+
+static void read_samp(struct ausrc_st *st, int16_t *sampv)
+{
+	const struct prompt *p = st->prompt;
+	size_t n = 0;
+
+	if (st->pos < p->sampc) {
+		n = min(st->sampc, p->sampc - st->pos);
+		memcpy(sampv, &p->sampv[st->pos], n * sizeof(int16_t));
+	}
+
+	/* silence after the end of file */
+	if (n < st->sampc)
+		memset(&sampv[n], 0, (st->sampc - n) * sizeof(int16_t));
+
+	st->pos += n;
+}
+
+
+static void send_frame(struct ausrc_st *st)
+{
+	const struct prompt_enc *pe = st->enc;
+	size_t i = st->pos / st->sampc;
+
+	/* nothing is sent after the end of file */
+	if (i < pe->framec) {
+		st->payloadh(pe->mb->buf + pe->offv[i],
+			     pe->offv[i + 1] - pe->offv[i],
+			     pe->dur, st->arg);
+	}
+	else {
+		st->payloadh(NULL, 0, pe->dur, st->arg);
+	}
+
+	st->pos += st->sampc;
 }
 
 
@@ -78,9 +133,14 @@ static void *play_thread(void *arg)
 		}
 #endif
 
-		aubuf_read_samp(st->aubuf, sampv, st->sampc);
+		if (st->enc) {
+			send_frame(st);
+		}
+		else {
+			read_samp(st, sampv);
 
-		st->rh(sampv, st->sampc, st->arg);
+			st->rh(sampv, st->sampc, st->arg);
+		}
 
 		ts += st->ptime;
 	}
@@ -99,8 +159,8 @@ static void timeout(void *arg)
 
 	tmr_start(&st->tmr, 1000, timeout, st);
 
-	/* check if audio buffer is empty */
-	if (aubuf_cur_size(st->aubuf) < (2 * st->sampc)) {
+	/* check if the prompt is played */
+	if (st->pos + st->sampc > st->prompt->sampc) {
 
 		info("aufile: end of file\n");
 
@@ -111,55 +171,12 @@ static void timeout(void *arg)
 }
 
 
-static int read_file(struct ausrc_st *st)
-{
-	struct mbuf *mb;
-	int err;
-
-	for (;;) {
-		uint16_t *sampv;
-		size_t i;
-
-		mb = mbuf_alloc(4096);
-		if (!mb)
-			return ENOMEM;
-
-		mb->end = mb->size;
-
-		err = aufile_read(st->aufile, mb->buf, &mb->end);
-		if (err)
-			break;
-
-		if (mb->end == 0) {
-			info("aufile: end of file\n");
-			break;
-		}
-
-		/* convert from Little-Endian to Native-Endian */
-		sampv = (void *)mb->buf;
-		for (i=0; i<mb->end/2; i++) {
-			sampv[i] = sys_ltohs(sampv[i]);
-		}
-
-		aubuf_append(st->aubuf, mb);
-
-		mb = mem_deref(mb);
-	}
-
-	info("aufile: loaded %zu bytes\n", aubuf_cur_size(st->aubuf));
-
-	mem_deref(mb);
-	return err;
-}
-
-
 static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 			 struct media_ctx **ctx,
 			 struct ausrc_prm *prm, const char *dev,
 			 ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
 {
 	struct ausrc_st *st;
-	struct aufile_prm fprm;
 	int err;
 	(void)ctx;
 
@@ -172,8 +189,6 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 		return ENOTSUP;
 	}
 
-	info("aufile: loading input file '%s'\n", dev);
-
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
@@ -183,52 +198,29 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	st->errh = errh;
 	st->arg  = arg;
 
-	err = aufile_open(&st->aufile, &fprm, dev, AUFILE_READ);
-	if (err) {
-		warning("aufile: failed to open file '%s' (%m)\n", dev, err);
+	err = prompt_get(&st->prompt, dev, prm);
+	if (err)
 		goto out;
-	}
 
-	info("aufile: %s: %u Hz, %d channels\n",
-	     dev, fprm.srate, fprm.channels);
+	/* the shared frames are sent, if the core takes them */
+	if (prm->payloadh && prm->ac) {
 
-	if (fprm.srate != prm->srate) {
-		warning("aufile: input file (%s) must have sample-rate"
-			" %u Hz\n", dev, prm->srate);
-		err = ENODEV;
-		goto out;
-	}
-	if (fprm.channels != prm->ch) {
-		warning("aufile: input file (%s) must have channels = %d\n",
-			dev, prm->ch);
-		err = ENODEV;
-		goto out;
-	}
-	if (fprm.fmt != AUFMT_S16LE) {
-		warning("aufile: input file must have format S16LE\n");
-		err = ENODEV;
-		goto out;
+		err = prompt_encode(&st->enc, st->prompt, prm->ac,
+				    prm->ptime, prm->fmtp);
+		if (err) {
+			info("aufile: %s: sending samples, could not encode"
+			     " with %s (%m)\n", dev, prm->ac->name, err);
+			err = 0;
+		}
+
+		st->payloadh = prm->payloadh;
 	}
 
 	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
 
 	st->ptime = prm->ptime;
 
-	info("aufile: audio ptime=%u sampc=%zu aubuf=[%u:%u]\n",
-	     st->ptime, st->sampc,
-	     prm->srate * prm->ch * 2,
-	     prm->srate * prm->ch * 40);
-
-	/* 1 - inf seconds of audio */
-	err = aubuf_alloc(&st->aubuf,
-			  prm->srate * prm->ch * 2,
-			  0);
-	if (err)
-		goto out;
-
-	err = read_file(st);
-	if (err)
-		goto out;
+	info("aufile: audio ptime=%u sampc=%zu\n", st->ptime, st->sampc);
 
 	tmr_start(&st->tmr, 1000, timeout, st);
 
@@ -249,8 +241,26 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 }
 
 
+static const struct cmd cmdv[] = {
+	{"aufile_stat", 0, 0, "Prompt cache status", prompt_cache_debug},
+};
+
+
 static int module_init(void)
 {
+	uint32_t size = CACHE_SIZE;
+	int err;
+
+	confidx_get_u32(conf_cur_index(), "aufile_cache_size", &size);
+
+	err = prompt_cache_init((size_t)size * 1024);
+	if (err)
+		return err;
+
+	err = cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+	if (err)
+		return err;
+
 	return ausrc_register(&ausrc, baresip_ausrcl(),
 			      "aufile", alloc_handler);
 }
@@ -260,6 +270,9 @@ static int module_close(void)
 {
 	ausrc = mem_deref(ausrc);
 
+	cmd_unregister(baresip_commands(), cmdv);
+	prompt_cache_close();
+
 	return 0;
 }
 
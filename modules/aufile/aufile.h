@@ -0,0 +1,45 @@
+/**
+ * @file aufile.h WAV Audio Source -- internal API
+ *
+ * Copyright (C) 2015 Creytiv.com
+ */
+
+
+/* prompt.c */
+
+/** A decoded audio file, shared by all calls playing it */
+struct prompt {
+	struct le he;        /**< Hash entry in the prompt cache     */
+	struct le le;        /**< Entry in the LRU list              */
+	char *file;          /**< Filename                           */
+	uint32_t srate;      /**< Sampling rate in [Hz]              */
+	uint8_t ch;          /**< Number of channels                 */
+	int16_t *sampv;      /**< Samples in native byte order       */
+	size_t sampc;        /**< Number of samples                  */
+	uint64_t ino;        /**< Inode number of the file           */
+	uint64_t size;       /**< Size of the file in [bytes]        */
+	time_t mtime;        /**< Modification time of the file      */
+	struct list encl;    /**< Encoded prompts (struct prompt_enc) */
+	size_t encsz;        /**< Size of the encoded prompts        */
+};
+
+/** A prompt encoded with one codec, shared by all calls playing it */
+struct prompt_enc {
+	struct le le;               /**< Entry in the list of the prompt */
+	const struct aucodec *ac;   /**< Audio codec                     */
+	char *fmtp;                 /**< Encoder parameters              */
+	uint32_t ptime;             /**< Packet time in [ms]             */
+	uint32_t dur;               /**< Frame duration in RTP units     */
+	struct mbuf *mb;            /**< Payloads of all frames          */
+	size_t *offv;               /**< Offsets of the frames, and end  */
+	size_t framec;              /**< Number of frames                */
+};
+
+int  prompt_get(struct prompt **pp, const char *file,
+		const struct ausrc_prm *prm);
+int  prompt_encode(struct prompt_enc **pep, struct prompt *p,
+		   const struct aucodec *ac, uint32_t ptime,
+		   const char *fmtp);
+int  prompt_cache_init(size_t maxsz);
+void prompt_cache_close(void);
+int  prompt_cache_debug(struct re_printf *pf, void *unused);
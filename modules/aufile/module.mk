@@ -5,7 +5,7 @@
 #
 
 MOD		:= aufile
-$(MOD)_SRCS	+= aufile.c
+$(MOD)_SRCS	+= aufile.c prompt.c
 $(MOD)_LFLAGS	+=
 
 include mk/mod.mk
@@ -0,0 +1,578 @@
+/**
+ * @file prompt.c WAV Audio Source -- shared prompt cache
+ *
+ * Copyright (C) 2015 Creytiv.com
+ */
+#include <string.h>
+#include <sys/stat.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aufile.h"
+
+
+/*
+ * Many calls often play the same announcement. The file is read and
+ * decoded once into a prompt, and all calls playing it share the
+ * samples. The prompts are kept in a cache with a memory limit,
+ * and the least recently used prompts are evicted first. A prompt
+ * that is evicted while calls are still playing it is freed when
+ * the last call is done.
+ *
+ * A cached prompt is checked against the inode, size and modification
+ * time of the file, and a changed file is loaded again. Calls that
+ * are playing the old prompt keep playing it.
+ *
+ * A prompt is also encoded once for each codec, packet time and
+ * encoder parameters that it is played with. The calls share the
+ * encoded frames, and only add their own RTP header. A call that
+ * needs the samples, e.g. with an audio filter, still has its own
+ * resampler and encoder in the core.
+ */
+
+
+enum {
+	HASH_SIZE  = 64,
+	READ_SIZE  = 4096,
+	FRAME_SIZE = 4096,   /* maximum size of an encoded frame */
+};
+
+static struct {
+	struct hash *ht;     /**< Prompts by file and format          */
+	struct list lru;     /**< Prompts, least recently used first  */
+	size_t maxsz;        /**< Memory limit in [bytes]             */
+	size_t cursz;        /**< Memory used in [bytes]              */
+	uint64_t hits;       /**< Number of cache hits                */
+	uint64_t misses;     /**< Number of cache misses              */
+	uint64_t evictions;  /**< Number of evicted prompts           */
+	uint64_t reloads;    /**< Number of prompts of changed files  */
+	uint64_t enc_hits;   /**< Number of encoded prompts reused    */
+	uint64_t enc_misses; /**< Number of prompts encoded           */
+} cache;
+
+
+static void destructor(void *arg)
+{
+	struct prompt *p = arg;
+
+	list_flush(&p->encl);
+	mem_deref(p->sampv);
+	mem_deref(p->file);
+}
+
+
+static void enc_destructor(void *arg)
+{
+	struct prompt_enc *pe = arg;
+
+	list_unlink(&pe->le);
+	mem_deref(pe->fmtp);
+	mem_deref(pe->mb);
+	mem_deref(pe->offv);
+}
+
+
+static uint32_t prompt_hash(const char *file, uint32_t srate, uint8_t ch)
+{
+	return hash_joaat_str(file) ^ srate ^ ((uint32_t)ch << 24);
+}
+
+
+static bool prompt_cmp_handler(struct le *le, void *arg)
+{
+	const struct prompt *p = le->data;
+	const struct prompt *key = arg;
+
+	return p->srate == key->srate && p->ch == key->ch &&
+		0 == str_cmp(p->file, key->file);
+}
+
+
+static size_t prompt_size(const struct prompt *p)
+{
+	return p->sampc * sizeof(int16_t) + p->encsz;
+}
+
+
+static size_t enc_size(const struct prompt_enc *pe)
+{
+	return pe->mb->size + (pe->framec + 1) * sizeof(size_t);
+}
+
+
+static bool fmtp_equal(const char *p1, const char *p2)
+{
+	if (!str_isset(p1) || !str_isset(p2))
+		return str_isset(p1) == str_isset(p2);
+
+	return 0 == str_cmp(p1, p2);
+}
+
+
+static void prompt_remove(struct prompt *p)
+{
+	hash_unlink(&p->he);
+	list_unlink(&p->le);
+
+	cache.cursz -= prompt_size(p);
+
+	mem_deref(p);
+}
+
+
+/* the prompt has the contents of the file as it is now */
+static bool prompt_isvalid(const struct prompt *p, const struct stat *st)
+{
+	return p->ino == (uint64_t)st->st_ino &&
+		p->size == (uint64_t)st->st_size &&
+		p->mtime == st->st_mtime;
+}
+
+
+static int load_file(struct prompt *p, const struct ausrc_prm *prm)
+{
+	struct aufile *af = NULL;
+	struct aufile_prm fprm;
+	struct mbuf *mb;
+	size_t i, n;
+	int err;
+
+	mb = mbuf_alloc(READ_SIZE);
+	if (!mb)
+		return ENOMEM;
+
+	err = aufile_open(&af, &fprm, p->file, AUFILE_READ);
+	if (err) {
+		warning("aufile: failed to open file '%s' (%m)\n",
+			p->file, err);
+		goto out;
+	}
+
+	info("aufile: %s: %u Hz, %d channels\n",
+	     p->file, fprm.srate, fprm.channels);
+
+	if (fprm.srate != prm->srate) {
+		warning("aufile: input file (%s) must have sample-rate"
+			" %u Hz\n", p->file, prm->srate);
+		err = ENODEV;
+		goto out;
+	}
+	if (fprm.channels != prm->ch) {
+		warning("aufile: input file (%s) must have channels = %d\n",
+			p->file, prm->ch);
+		err = ENODEV;
+		goto out;
+	}
+	if (fprm.fmt != AUFMT_S16LE) {
+		warning("aufile: input file must have format S16LE\n");
+		err = ENODEV;
+		goto out;
+	}
+
+	for (;;) {
+		err = mbuf_resize(mb, mb->end + READ_SIZE);
+		if (err)
+			goto out;
+
+		n = READ_SIZE;
+
+		err = aufile_read(af, mb->buf + mb->end, &n);
+		if (err)
+			goto out;
+
+		if (n == 0)
+			break;
+
+		mb->end += n;
+	}
+
+	p->sampc = mb->end / 2;
+	if (!p->sampc)
+		goto out;
+
+	p->sampv = mem_alloc(p->sampc * sizeof(int16_t), NULL);
+	if (!p->sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* convert from Little-Endian to Native-Endian */
+	for (i=0; i<p->sampc; i++) {
+		p->sampv[i] = sys_ltohs(((uint16_t *)(void *)mb->buf)[i]);
+	}
+
+	info("aufile: loaded %zu bytes\n", prompt_size(p));
+
+ out:
+	mem_deref(af);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Get a decoded prompt from the cache, or load it from file
+ *
+ * @param pp   Pointer to allocated prompt
+ * @param file Filename of the WAV file
+ * @param prm  Audio source parameters
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int prompt_get(struct prompt **pp, const char *file,
+	       const struct ausrc_prm *prm)
+{
+	struct prompt key, *p;
+	struct stat st;
+	struct le *le;
+	int err;
+
+	if (!pp || !file || !prm)
+		return EINVAL;
+
+	if (stat(file, &st) < 0) {
+		err = errno;
+		warning("aufile: %s: %m\n", file, err);
+		return err;
+	}
+
+	key.file  = (char *)file;
+	key.srate = prm->srate;
+	key.ch    = prm->ch;
+
+	le = hash_lookup(cache.ht, prompt_hash(file, prm->srate, prm->ch),
+			 prompt_cmp_handler, &key);
+	if (le && !prompt_isvalid(le->data, &st)) {
+
+		info("aufile: '%s' was changed, loading it again\n", file);
+
+		prompt_remove(le->data);
+		++cache.reloads;
+		le = NULL;
+	}
+
+	if (le) {
+		p = le->data;
+
+		/* move to the end of the LRU list */
+		list_unlink(&p->le);
+		list_append(&cache.lru, &p->le, p);
+
+		++cache.hits;
+
+		*pp = mem_ref(p);
+		return 0;
+	}
+
+	++cache.misses;
+
+	info("aufile: loading input file '%s'\n", file);
+
+	p = mem_zalloc(sizeof(*p), destructor);
+	if (!p)
+		return ENOMEM;
+
+	p->srate = prm->srate;
+	p->ch    = prm->ch;
+	p->ino   = st.st_ino;
+	p->size  = st.st_size;
+	p->mtime = st.st_mtime;
+
+	err = str_dup(&p->file, file);
+	if (err)
+		goto out;
+
+	err = load_file(p, prm);
+	if (err)
+		goto out;
+
+	if (!cache.ht || prompt_size(p) > cache.maxsz)
+		goto out;
+
+	while (cache.lru.head && cache.cursz + prompt_size(p) > cache.maxsz) {
+
+		struct prompt *old = cache.lru.head->data;
+
+		debug("aufile: evicting prompt '%s'\n", old->file);
+
+		prompt_remove(old);
+		++cache.evictions;
+	}
+
+	hash_append(cache.ht, prompt_hash(file, p->srate, p->ch),
+		    &p->he, p);
+	list_append(&cache.lru, &p->le, p);
+
+	cache.cursz += prompt_size(p);
+
+	/* one reference for the cache, one for the caller */
+	mem_ref(p);
+
+ out:
+	if (err)
+		mem_deref(p);
+	else
+		*pp = p;
+
+	return err;
+}
+
+
+static int enc_alloc(struct prompt_enc **pep, const struct prompt *p,
+		     const struct aucodec *ac, uint32_t ptime,
+		     const char *fmtp)
+{
+	struct auenc_state *enc = NULL;
+	struct prompt_enc *pe;
+	int16_t *sampv = NULL;
+	size_t sampc, i;
+	int err = 0;
+
+	sampc = p->srate * p->ch * ptime / 1000;
+	if (!sampc || !p->sampc)
+		return EINVAL;
+
+	pe = mem_zalloc(sizeof(*pe), enc_destructor);
+	if (!pe)
+		return ENOMEM;
+
+	pe->ac     = ac;
+	pe->ptime  = ptime;
+	pe->framec = (p->sampc + sampc - 1) / sampc;
+
+	/* the same as the timestamps of the encoder in the core */
+	pe->dur = (uint32_t)(sampc * ac->crate / ac->srate / ac->pch);
+
+	if (str_isset(fmtp)) {
+		err = str_dup(&pe->fmtp, fmtp);
+		if (err)
+			goto out;
+	}
+
+	pe->offv = mem_alloc((pe->framec + 1) * sizeof(size_t), NULL);
+	pe->mb   = mbuf_alloc(FRAME_SIZE);
+	sampv    = mem_alloc(sampc * sizeof(int16_t), NULL);
+	if (!pe->offv || !pe->mb || !sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	if (ac->encupdh) {
+		struct auenc_param prm;
+
+		prm.ptime   = ptime;
+		prm.bitrate = 0;        /* auto */
+
+		err = ac->encupdh(&enc, ac, &prm, fmtp);
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<pe->framec; i++) {
+
+		size_t n = min(sampc, p->sampc - i * sampc);
+		size_t len = FRAME_SIZE;
+
+		/* the last frame is filled up with silence */
+		memcpy(sampv, &p->sampv[i * sampc], n * sizeof(int16_t));
+		memset(&sampv[n], 0, (sampc - n) * sizeof(int16_t));
+
+		if (mbuf_get_space(pe->mb) < FRAME_SIZE) {
+			err = mbuf_resize(pe->mb, pe->mb->size * 2);
+			if (err)
+				goto out;
+		}
+
+		err = ac->ench(enc, mbuf_buf(pe->mb), &len, AUFMT_S16LE,
+			       sampv, sampc);
+		if (err)
+			goto out;
+
+		pe->offv[i] = pe->mb->end;
+		pe->mb->end += len;
+		pe->mb->pos  = pe->mb->end;
+	}
+
+	pe->offv[pe->framec] = pe->mb->end;
+
+	info("aufile: %s: encoded with %s, %zu frames in %zu bytes\n",
+	     p->file, ac->name, pe->framec, pe->mb->end);
+
+ out:
+	mem_deref(sampv);
+	mem_deref(enc);
+
+	if (err)
+		mem_deref(pe);
+	else
+		*pep = pe;
+
+	return err;
+}
+
+
+/**
+ * Get a prompt encoded with an audio codec, or encode it
+ *
+ * The encoded frames are kept with the prompt, and counted in the
+ * memory limit of the cache.
+ *
+ * @param pep   Pointer to allocated encoded prompt
+ * @param p     Decoded prompt
+ * @param ac    Audio codec
+ * @param ptime Packet time in [ms]
+ * @param fmtp  Encoder parameters (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int prompt_encode(struct prompt_enc **pep, struct prompt *p,
+		  const struct aucodec *ac, uint32_t ptime,
+		  const char *fmtp)
+{
+	struct prompt_enc *pe;
+	struct le *le;
+	size_t sz;
+	int err;
+
+	if (!pep || !p || !ac || !ac->ench)
+		return EINVAL;
+
+	if (ac->srate != p->srate || ac->ch != p->ch)
+		return ENOTSUP;
+
+	for (le = p->encl.head; le; le = le->next) {
+
+		pe = le->data;
+
+		if (pe->ac == ac && pe->ptime == ptime &&
+		    fmtp_equal(pe->fmtp, fmtp)) {
+
+			++cache.enc_hits;
+
+			*pep = mem_ref(pe);
+			return 0;
+		}
+	}
+
+	++cache.enc_misses;
+
+	err = enc_alloc(&pe, p, ac, ptime, fmtp);
+	if (err)
+		return err;
+
+	list_append(&p->encl, &pe->le, pe);
+
+	sz = enc_size(pe);
+	p->encsz += sz;
+
+	/* a prompt that is not in the cache is freed with its calls */
+	if (p->he.list) {
+
+		cache.cursz += sz;
+
+		while (cache.lru.head && cache.lru.head->data != p &&
+		       cache.cursz > cache.maxsz) {
+
+			struct prompt *old = cache.lru.head->data;
+
+			debug("aufile: evicting prompt '%s'\n", old->file);
+
+			prompt_remove(old);
+			++cache.evictions;
+		}
+	}
+
+	/* one reference for the prompt, one for the caller */
+	*pep = mem_ref(pe);
+
+	return 0;
+}
+
+
+/**
+ * Initialise the prompt cache
+ *
+ * @param maxsz Memory limit in [bytes], 0 to disable the cache
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int prompt_cache_init(size_t maxsz)
+{
+	cache.maxsz = maxsz;
+
+	if (!maxsz)
+		return 0;
+
+	return hash_alloc(&cache.ht, HASH_SIZE);
+}
+
+
+/**
+ * Remove all prompts from the cache
+ */
+void prompt_cache_close(void)
+{
+	while (cache.lru.head)
+		prompt_remove(cache.lru.head->data);
+
+	cache.ht = mem_deref(cache.ht);
+
+	memset(&cache, 0, sizeof(cache));
+}
+
+
+/**
+ * Print the prompt cache statistics
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int prompt_cache_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err;
+
+	(void)unused;
+
+	err = re_hprintf(pf, "--- aufile prompt cache ---\n");
+
+	if (!cache.ht)
+		return err | re_hprintf(pf, " disabled\n");
+
+	err |= re_hprintf(pf, " prompts:   %u (%zu of %zu kB)\n",
+			  list_count(&cache.lru),
+			  cache.cursz / 1024, cache.maxsz / 1024);
+	err |= re_hprintf(pf, " hits:      %llu\n", cache.hits);
+	err |= re_hprintf(pf, " misses:    %llu\n", cache.misses);
+	err |= re_hprintf(pf, " evictions: %llu\n", cache.evictions);
+	err |= re_hprintf(pf, " reloads:   %llu\n", cache.reloads);
+	err |= re_hprintf(pf, " encoded:   %llu (%llu reused)\n",
+			  cache.enc_misses, cache.enc_hits);
+
+	for (le = cache.lru.tail; le; le = le->prev) {
+		const struct prompt *p = le->data;
+
+		struct le *lee;
+
+		err |= re_hprintf(pf, "  %s: %u Hz, %u ch, %zu kB,"
+				  " %u users\n",
+				  p->file, p->srate, p->ch,
+				  prompt_size(p) / 1024,
+				  mem_nrefs(p) - 1);
+
+		for (lee = p->encl.head; lee; lee = lee->next) {
+			const struct prompt_enc *pe = lee->data;
+
+			err |= re_hprintf(pf, "    %s/%ums: %zu kB,"
+					  " %u users\n",
+					  pe->ac->name, pe->ptime,
+					  enc_size(pe) / 1024,
+					  mem_nrefs(pe) - 1);
+		}
+	}
+
+	return err;
+}
@@ -263,6 +263,7 @@ static int auloop_reset(struct audio_loop *al, uint32_t srate, uint32_t ch)
 		return err;
 	}
 
+	memset(&ausrc_prm, 0, sizeof(ausrc_prm));
 	ausrc_prm.srate      = al->srate;
 	ausrc_prm.ch         = al->ch;
 	ausrc_prm.ptime      = PTIME;
@@ -363,7 +364,8 @@ static const struct cmd cmdv[] = {
 
 static int module_init(void)
 {
-	conf_get_str(conf_cur(), "auloop_codec", aucodec, sizeof(aucodec));
+	confidx_get_str(conf_cur_index(), "auloop_codec",
+			aucodec, sizeof(aucodec));
 
 	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
@@ -201,8 +201,8 @@ static int module_init(void)
 	avcodec_register_all();
 #endif
 
-	if (0 == conf_get_str(conf_cur(), "avcodec_h264dec",
-			      h264dec, sizeof(h264dec))) {
+	if (0 == confidx_get_str(conf_cur_index(), "avcodec_h264dec",
+				 h264dec, sizeof(h264dec))) {
 
 		info("avcodec: using h264 decoder by name (%s)\n", h264dec);
 
@@ -225,8 +225,8 @@ static int module_init(void)
 	if (avcodec_find_decoder(AV_CODEC_ID_MPEG4))
 		vidcodec_register(vidcodecl, &mpg4);
 
-	if (0 == conf_get_str(conf_cur(), "avcodec_h264enc",
-			      h264enc, sizeof(h264enc))) {
+	if (0 == confidx_get_str(conf_cur_index(), "avcodec_h264enc",
+				 h264enc, sizeof(h264enc))) {
 
 		info("avcodec: using h264 encoder by name (%s)\n", h264enc);
 
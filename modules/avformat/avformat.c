@@ -70,6 +70,8 @@ struct vidsrc_st {
 
 
 static struct vidsrc *mod_avf;
+static int av_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("avformat", av_init);
 
 
 static void destructor(void *arg)
@@ -259,6 +261,10 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 	if (!stp || !vs || !prm || !size || !frameh)
 		return EINVAL;
 
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
 	debug("avformat: alloc dev='%s'\n", dev);
 
 	st = mem_zalloc(sizeof(*st), destructor);
@@ -419,7 +425,7 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 }
 
 
-static int module_init(void)
+static int av_init(void)
 {
 	/* register all codecs, demux and protocols */
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
@@ -435,6 +441,19 @@ static int module_init(void)
 	av_register_all();
 #endif
 
+	return 0;
+}
+
+
+static int module_init(void)
+{
+	int err;
+
+	/* device and network init is done on first use */
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
 	return vidsrc_register(&mod_avf, baresip_vidsrcl(),
 			       "avformat", alloc, NULL);
 }
@@ -445,9 +464,12 @@ static int module_close(void)
 	mod_avf = mem_deref(mod_avf);
 
 #if LIBAVFORMAT_VERSION_INT >= ((53<<16) + (13<<8) + 0)
-	avformat_network_deinit();
+	if (lazy.done)
+		avformat_network_deinit();
 #endif
 
+	module_lazy_reset(&lazy);
+
 	return 0;
 }
 
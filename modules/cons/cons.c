@@ -240,7 +240,7 @@ static int cons_init(void)
 	struct sa laddr;
 	int err;
 
-	if (conf_get_sa(conf_cur(), "cons_listen", &laddr)) {
+	if (confidx_get_sa(conf_cur_index(), "cons_listen", &laddr)) {
 		sa_set_str(&laddr, "0.0.0.0", CONS_PORT);
 	}
 
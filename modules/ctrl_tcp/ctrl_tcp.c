@@ -23,6 +23,8 @@
  * - command : Command to be executed.
  * - params  : Command parameters.
  * - token   : Optional. Included in the response if present.
+ * - callid  : Optional. The call with this Call-ID is made the current
+ *             call before the command is executed.
  *
  * Command message example:
  *
@@ -79,24 +81,89 @@
  \endverbatim
  *
  *
+ * Many clients may be connected at the same time. Each client may send
+ * several commands without waiting for the responses, the responses are
+ * sent in the same order and carry the token of their command.
+ *
+ * A client receives all events, unless it sends a "subscribe" command.
+ * Its params are a list of filters, all of them must match:
+ *
+ * - events : Comma separated event classes or types, e.g. "call,MWI_NOTIFY"
+ * - ua     : Only events of the User-Agent with this AOR
+ * - call   : Only events of the call with this Call-ID
+ *
+ \verbatim
+ {
+  "command" : "subscribe",
+  "params"  : "events=call,register ua=sip:alice@atlanta.com",
+  "token"   : "qwerasdf"
+ }
+ \endverbatim
+ *
+ * The command "unsubscribe" stops all events to the client.
+ *
+ * A client that does not read its events is a slow consumer. When more than
+ * ctrl_tcp_queue bytes are waiting to be sent to it, its events are dropped
+ * and later replaced by one EVENTS_DROPPED event in the "ctrl" class, with
+ * the number of dropped events as param. If ctrl_tcp_slow is "close", the
+ * connection is closed instead.
+ *
  * Sample config:
  *
  \verbatim
   ctrl_tcp_listen     0.0.0.0:4444         # IP-address and port to listen on
+  ctrl_tcp_clients    16                   # Max number of clients
+  ctrl_tcp_queue      262144               # Max send queue per client [bytes]
+  ctrl_tcp_slow       drop                 # Slow consumers: drop or close
  \endverbatim
  */
 
 
-enum {CTRL_PORT = 4444};
+enum {
+	CTRL_PORT    = 4444,
+	MAX_CLIENTS  = 16,
+	QUEUE_SIZE   = 262144,
+	RESP_SIZE    = 2048,
+	QUEUE_CLOSE  = 4,          /* Close at this many queue sizes */
+};
 
 struct ctrl_st {
 	struct tcp_sock *ts;
+	struct list connl;         /* Connected clients (struct ctrl_conn) */
+	struct mbuf *evmb;         /* Encoded event, shared by all clients */
+	uint32_t max_clients;
+	size_t queue_size;
+	bool slow_close;
+	uint64_t n_conn;
+	uint64_t n_reject;
+};
+
+struct ctrl_conn {
+	struct le le;
+	struct ctrl_st *st;
 	struct tcp_conn *tc;
 	struct netstring *ns;
+	struct sa peer;
+	struct mbuf *outmb;        /* Command output, reused */
+	struct mbuf *respmb;       /* Response, reused */
+	struct tmr tmr_close;
+	uint64_t mask;             /* Subscribed events */
+	char *ua;                  /* Only events of this UA (optional) */
+	char *call;                /* Only events of this call (optional) */
+	uint64_t ts_conn;
+	uint64_t n_cmd;
+	uint64_t n_evt;
+	uint64_t n_drop;
+	uint64_t bytes_rx;
+	uint64_t bytes_tx;
+	uint32_t drop_pending;     /* Dropped events not yet reported */
+	size_t txq_max;
+	bool closing;
 };
 
 static struct ctrl_st *ctrl = NULL;  /* allow only one instance */
 
+
 static int print_handler(const char *p, size_t size, void *arg)
 {
 	struct mbuf *mb = arg;
@@ -105,75 +172,224 @@ static int print_handler(const char *p, size_t size, void *arg)
 }
 
 
-static int encode_response(int cmd_error, struct mbuf *resp, const char *token)
+static void conn_destructor(void *arg)
 {
-	struct re_printf pf = {print_handler, resp};
-	struct odict *od = NULL;
-	char *buf = NULL;
-	char m[256];
+	struct ctrl_conn *conn = arg;
+
+	tmr_cancel(&conn->tmr_close);
+	list_unlink(&conn->le);
+
+	mem_deref(conn->ns);
+	mem_deref(conn->tc);
+	mem_deref(conn->outmb);
+	mem_deref(conn->respmb);
+	mem_deref(conn->ua);
+	mem_deref(conn->call);
+}
+
+
+static void close_handler(void *arg)
+{
+	struct ctrl_conn *conn = arg;
+
+	mem_deref(conn);
+}
+
+
+/* never close from a TCP handler, the connection is still in use */
+static void conn_close(struct ctrl_conn *conn)
+{
+	if (conn->closing)
+		return;
+
+	conn->closing = true;
+	tmr_start(&conn->tmr_close, 0, close_handler, conn);
+}
+
+
+static int conn_send(struct ctrl_conn *conn, struct mbuf *mb)
+{
+	const size_t pos = mb->pos;
+	const size_t end = mb->end;
+	size_t txq;
 	int err;
 
-	/* Empty response. */
-	if (resp->pos == NETSTRING_HEADER_SIZE)
-	{
-		buf = mem_alloc(1, NULL);
-		buf[0] = '\0';
-	}
-	else
-	{
-		resp->pos = NETSTRING_HEADER_SIZE;
-		err = mbuf_strdup(resp, &buf,
-			resp->end - NETSTRING_HEADER_SIZE);
+	/* the netstring trailer is written after the end */
+	if (mb->size <= end) {
+		err = mbuf_resize(mb, end + 1);
 		if (err)
 			return err;
 	}
 
-	err = odict_alloc(&od, 8);
-	if (err)
+	err = tcp_send(conn->tc, mb);
+
+	mb->pos = pos;
+	mb->end = end;
+
+	if (err) {
+		warning("ctrl_tcp: %J: failed to send the message (%m)\n",
+			&conn->peer, err);
 		return err;
+	}
 
-	err |= odict_entry_add(od, "response", ODICT_BOOL, true);
-	err |= odict_entry_add(od, "ok", ODICT_BOOL, (bool)!cmd_error);
+	conn->bytes_tx += end - pos;
 
-	if (cmd_error && str_len(buf) == 0)
-		err |= odict_entry_add(od, "data", ODICT_STRING,
-			str_error(cmd_error, m, sizeof(m)));
-	else
-		err |= odict_entry_add(od, "data", ODICT_STRING, buf);
+	txq = tcp_conn_txqsz(conn->tc);
+	conn->txq_max = max(conn->txq_max, txq);
 
-	if (token)
-		err |= odict_entry_add(od, "token", ODICT_STRING, token);
+	return 0;
+}
 
+
+static int encode_response(struct mbuf *resp, int cmd_error,
+			   struct mbuf *out, const char *token)
+{
+	const char *data;
+	char m[256];
+	int err;
+
+	/* the command output as a string */
+	err = mbuf_write_u8(out, 0);
 	if (err)
-		goto out;
+		return err;
+
+	data = (const char *)out->buf;
+
+	if (cmd_error && !str_isset(data))
+		data = str_error(cmd_error, m, sizeof(m));
+
+	mbuf_rewind(resp);
+	resp->pos = resp->end = NETSTRING_HEADER_SIZE;
+
+	err = mbuf_printf(resp, "{\"response\":true,\"ok\":%s,"
+			  "\"data\":\"%H\"",
+			  cmd_error ? "false" : "true", utf8_encode, data);
+	if (token)
+		err |= mbuf_printf(resp, ",\"token\":\"%H\"",
+				   utf8_encode, token);
+	err |= mbuf_write_str(resp, "}");
 
-	mbuf_reset(resp);
-	mbuf_init(resp);
 	resp->pos = NETSTRING_HEADER_SIZE;
 
-	err = json_encode_odict(&pf, od);
-	if (err)
-		warning("ctrl_tcp: failed to encode response JSON (%m)\n",
-			err);
+	return err;
+}
+
+
+static int decode_events(uint64_t *maskp, const struct pl *val)
+{
+	struct pl v = *val;
+	uint64_t mask = 0;
+
+	while (v.l) {
+
+		const char *comma = pl_strchr(&v, ',');
+		struct pl item;
+		uint64_t m = 0;
+		int ev;
+
+		item.p = v.p;
+		item.l = comma ? (size_t)(comma - v.p) : v.l;
+		pl_advance(&v, comma ? item.l + 1 : item.l);
+
+		for (ev=0; ev<UA_EVENT_MAX; ev++) {
+
+			if (!pl_strcasecmp(&item, uag_event_class(ev)) ||
+			    !pl_strcasecmp(&item, uag_event_str(ev)))
+				m |= UA_EVENT_MASK(ev);
+		}
+
+		if (!m)
+			return EINVAL;
+
+		mask |= m;
+	}
+
+	*maskp = mask;
+
+	return 0;
+}
+
+
+static int subscribe(struct re_printf *pf, struct ctrl_conn *conn,
+		     const char *params)
+{
+	uint64_t mask = UA_EVENT_MASK_ALL;
+	char *ua = NULL, *call = NULL;
+	struct pl p, key, val;
+	int err = 0;
+
+	pl_set_str(&p, params);
+
+	while (!re_regex(p.p, p.l, "[ ]*[^ =]+=[^ ]+", NULL, &key, &val)) {
+
+		if (!pl_strcasecmp(&key, "events"))
+			err = decode_events(&mask, &val);
+		else if (!pl_strcasecmp(&key, "ua"))
+			err = pl_strdup(&ua, &val);
+		else if (!pl_strcasecmp(&key, "call"))
+			err = pl_strdup(&call, &val);
+		else
+			err = EINVAL;
+
+		if (err) {
+			(void)re_hprintf(pf, "invalid filter: %r=%r",
+					 &key, &val);
+			goto out;
+		}
+
+		pl_advance(&p, val.p + val.l - p.p);
+	}
+
+	conn->mask = mask;
+
+	mem_deref(conn->ua);
+	mem_deref(conn->call);
+	conn->ua   = ua;
+	conn->call = call;
+	ua = call = NULL;
 
  out:
-	mem_deref(buf);
-	mem_deref(od);
+	mem_deref(ua);
+	mem_deref(call);
 
 	return err;
 }
 
 
+/* Make the call with this Call-ID the current call */
+static int call_select(const char *id)
+{
+	struct call *call = call_find_id(NULL, id);
+	struct ua *ua;
+
+	if (!call)
+		return ENOENT;
+
+	ua = call_get_ua(call);
+
+	uag_current_set(ua);
+	call_set_current(ua_calls(ua), call);
+
+	return 0;
+}
+
+
 static bool command_handler(struct mbuf *mb, void *arg)
 {
-	struct ctrl_st *st = arg;
-	struct mbuf *resp = mbuf_alloc(2048);
-	struct re_printf pf = {print_handler, resp};
+	struct ctrl_conn *conn = arg;
+	struct re_printf pf = {print_handler, conn->outmb};
 	struct odict *od = NULL;
-	const struct odict_entry *oe_cmd, *oe_prm, *oe_tok;
+	const struct odict_entry *oe_cmd, *oe_prm, *oe_tok, *oe_call;
 	char buf[256];
+	size_t txq;
 	int err;
 
+	if (conn->closing)
+		return true;
+
+	conn->bytes_rx += mb->end;
+	++conn->n_cmd;
+
 	err = json_decode_odict(&od, 32, (const char*)mb->buf, mb->end, 16);
 	if (err) {
 		warning("ctrl_tcp: failed to decode JSON (%m)\n", err);
@@ -183,6 +399,7 @@ static bool command_handler(struct mbuf *mb, void *arg)
 	oe_cmd = odict_lookup(od, "command");
 	oe_prm = odict_lookup(od, "params");
 	oe_tok = odict_lookup(od, "token");
+	oe_call = odict_lookup(od, "callid");
 	if (!oe_cmd) {
 		warning("ctrl_tcp: missing json entries\n");
 		goto out;
@@ -193,36 +410,54 @@ static bool command_handler(struct mbuf *mb, void *arg)
 	      oe_prm ? oe_prm->u.str : "",
 	      oe_tok ? oe_tok->u.str : "");
 
-	re_snprintf(buf, sizeof(buf), "%s%s%s",
-		    oe_cmd->u.str,
-		    oe_prm ? " " : "",
-		    oe_prm ? oe_prm->u.str : "");
+	mbuf_rewind(conn->outmb);
 
-	resp->pos = NETSTRING_HEADER_SIZE;
-
-	/* Relay message to long commands */
-	err = cmd_process_long(baresip_commands(),
-			       buf,
-			       str_len(buf),
-			       &pf, NULL);
-	if (err) {
-		warning("ctrl_tcp: error processing command (%m)\n", err);
+	if (!str_casecmp(oe_cmd->u.str, "subscribe")) {
+		err = subscribe(&pf, conn, oe_prm ? oe_prm->u.str : "");
+	}
+	else if (!str_casecmp(oe_cmd->u.str, "unsubscribe")) {
+		conn->mask = 0;
+	}
+	else if (oe_call && call_select(oe_call->u.str)) {
+		err = ENOENT;
+		(void)re_hprintf(&pf, "call not found: %s", oe_call->u.str);
+	}
+	else {
+		re_snprintf(buf, sizeof(buf), "%s%s%s",
+			    oe_cmd->u.str,
+			    oe_prm ? " " : "",
+			    oe_prm ? oe_prm->u.str : "");
+
+		/* Relay message to long commands */
+		err = cmd_process_long(baresip_commands(),
+				       buf,
+				       str_len(buf),
+				       &pf, NULL);
+		if (err) {
+			warning("ctrl_tcp: error processing command (%m)\n",
+				err);
+		}
 	}
 
-	err = encode_response(err, resp, oe_tok ? oe_tok->u.str : NULL);
+	err = encode_response(conn->respmb, err, conn->outmb,
+			      oe_tok ? oe_tok->u.str : NULL);
 	if (err) {
 		warning("ctrl_tcp: failed to encode response (%m)\n", err);
 		goto out;
 	}
 
-	resp->pos = NETSTRING_HEADER_SIZE;
-	err = tcp_send(st->tc, resp);
-	if (err) {
-		warning("ctrl_tcp: failed to send the message (%m)\n", err);
+	/* a client that does not read its responses is closed */
+	txq = tcp_conn_txqsz(conn->tc);
+	if (txq > QUEUE_CLOSE * conn->st->queue_size) {
+		warning("ctrl_tcp: %J: not reading, closing (%zu bytes"
+			" queued)\n", &conn->peer, txq);
+		conn_close(conn);
+		goto out;
 	}
 
+	(void)conn_send(conn, conn->respmb);
+
  out:
-	mem_deref(resp);
 	mem_deref(od);
 
 	return true;  /* always handled */
@@ -231,86 +466,263 @@ static bool command_handler(struct mbuf *mb, void *arg)
 
 static void tcp_close_handler(int err, void *arg)
 {
-	struct ctrl_st *st = arg;
+	struct ctrl_conn *conn = arg;
 
-	(void)err;
+	debug("ctrl_tcp: %J: connection closed (%m)\n", &conn->peer, err);
 
-	st->tc = mem_deref(st->tc);
+	conn_close(conn);
 }
 
 
 static void tcp_conn_handler(const struct sa *peer, void *arg)
 {
 	struct ctrl_st *st = arg;
+	struct ctrl_conn *conn;
+	int err;
+
+	if (list_count(&st->connl) >= st->max_clients) {
+		warning("ctrl_tcp: %J: max %u clients, rejected\n",
+			peer, st->max_clients);
+		++st->n_reject;
+		tcp_reject(st->ts);
+		return;
+	}
+
+	conn = mem_zalloc(sizeof(*conn), conn_destructor);
+	if (!conn) {
+		tcp_reject(st->ts);
+		return;
+	}
 
-	(void)peer;
+	conn->st      = st;
+	conn->peer    = *peer;
+	conn->mask    = UA_EVENT_MASK_ALL;
+	conn->ts_conn = tmr_jiffies();
 
-	/* only one connection allowed */
-	st->tc = mem_deref(st->tc);
-	st->ns = mem_deref(st->ns);
+	conn->outmb  = mbuf_alloc(RESP_SIZE);
+	conn->respmb = mbuf_alloc(RESP_SIZE);
+	if (!conn->outmb || !conn->respmb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = tcp_accept(&conn->tc, st->ts, NULL, NULL,
+			 tcp_close_handler, conn);
+	if (err)
+		goto out;
+
+	err = netstring_insert(&conn->ns, conn->tc, 0,
+			       command_handler, conn);
+	if (err)
+		goto out;
+
+	list_append(&st->connl, &conn->le, conn);
+	++st->n_conn;
 
-	(void)tcp_accept(&st->tc, st->ts, NULL, NULL, tcp_close_handler, st);
-	(void)netstring_insert(&st->ns, st->tc, 0, command_handler, st);
+	debug("ctrl_tcp: %J: connected\n", peer);
+
+ out:
+	if (err) {
+		warning("ctrl_tcp: %J: accept failed (%m)\n", peer, err);
+		if (!conn->tc)
+			tcp_reject(st->ts);
+		mem_deref(conn);
+	}
 }
 
 
-/*
- * Relay UA events
- */
-static void ua_event_handler(struct ua *ua, enum ua_event ev,
-			     struct call *call, const char *prm, void *arg)
+static bool conn_match(const struct ctrl_conn *conn,
+		       const struct ua_event_data *evd)
 {
-	struct ctrl_st *st = arg;
-	struct mbuf *buf = mbuf_alloc(1024);
-	struct re_printf pf = {print_handler, buf};
-	struct odict *od = NULL;
-	int err;
+	if (conn->closing)
+		return false;
 
-	buf->pos = NETSTRING_HEADER_SIZE;
+	if (!(conn->mask & UA_EVENT_MASK(evd->ev)))
+		return false;
 
-	err = odict_alloc(&od, 8);
-	if (err)
+	if (conn->ua && (!evd->aor || str_casecmp(conn->ua, evd->aor)))
+		return false;
+
+	if (conn->call && (!evd->call || str_cmp(conn->call,
+						   call_id(evd->call))))
+		return false;
+
+	return true;
+}
+
+
+static void send_dropped(struct ctrl_conn *conn)
+{
+	struct mbuf *mb = conn->respmb;
+
+	mbuf_rewind(mb);
+	mb->pos = mb->end = NETSTRING_HEADER_SIZE;
+
+	if (mbuf_printf(mb, "{\"event\":true,\"class\":\"ctrl\","
+			"\"type\":\"EVENTS_DROPPED\",\"param\":\"%u\"}",
+			conn->drop_pending))
 		return;
 
-	err = odict_entry_add(od, "event", ODICT_BOOL, true);
-	err |= event_encode_dict(od, ua, ev, call, prm);
-	if (err)
-		goto out;
+	mb->pos = NETSTRING_HEADER_SIZE;
+
+	if (!conn_send(conn, mb))
+		conn->drop_pending = 0;
+}
+
+
+static void conn_event(struct ctrl_conn *conn, struct mbuf *mb)
+{
+	const struct ctrl_st *st = conn->st;
+	size_t txq = tcp_conn_txqsz(conn->tc);
+
+	/* slow consumer, drop until half of the queue is free */
+	if (txq > st->queue_size ||
+	    (conn->drop_pending && txq > st->queue_size / 2)) {
+
+		if (st->slow_close) {
+			warning("ctrl_tcp: %J: slow consumer, closing"
+				" (%zu bytes queued)\n", &conn->peer, txq);
+			conn_close(conn);
+			return;
+		}
+
+		if (!conn->drop_pending)
+			warning("ctrl_tcp: %J: slow consumer, dropping"
+				" events (%zu bytes queued)\n",
+				&conn->peer, txq);
+
+		++conn->n_drop;
+		++conn->drop_pending;
+		return;
+	}
+
+	if (conn->drop_pending)
+		send_dropped(conn);
+
+	if (!conn_send(conn, mb))
+		++conn->n_evt;
+}
+
 
-	err = json_encode_odict(&pf, od);
+static int encode_event(struct mbuf *mb, struct ua_event_data *evd)
+{
+	struct re_printf pf = {print_handler, mb};
+	int err;
+
+	mbuf_rewind(mb);
+	mb->pos = mb->end = NETSTRING_HEADER_SIZE;
+
+	err  = mbuf_write_str(mb, "{\"event\":true,");
+	err |= event_encode_members(&pf, evd->aor, evd->ev, evd->call,
+				    ua_event_prm(evd));
+	err |= mbuf_write_str(mb, "}");
 	if (err) {
 		warning("ctrl_tcp: failed to encode json (%m)\n", err);
-		goto out;
+		return err;
 	}
 
-	if (st->tc) {
-		buf->pos = NETSTRING_HEADER_SIZE;
-		err = tcp_send(st->tc, buf);
-		if (err) {
-			warning("ctrl_tcp: failed to send the message (%m)\n",
-				err);
+	mb->pos = NETSTRING_HEADER_SIZE;
+
+	return 0;
+}
+
+
+/*
+ * Relay UA events, each event is encoded once for all clients
+ */
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
+{
+	struct ctrl_st *st = arg;
+	bool encoded = false;
+	struct le *le;
+
+	for (le = st->connl.head; le; le = le->next) {
+
+		struct ctrl_conn *conn = le->data;
+
+		if (!conn_match(conn, evd))
+			continue;
+
+		if (!encoded) {
+			if (encode_event(st->evmb, evd))
+				return;
+
+			encoded = true;
 		}
+
+		conn_event(conn, st->evmb);
 	}
+}
 
- out:
-	mem_deref(buf);
-	mem_deref(od);
+
+static int print_conn(struct re_printf *pf, const struct ctrl_conn *conn)
+{
+	const uint64_t ms = max(tmr_jiffies() - conn->ts_conn, 1);
+	int err;
+
+	err = re_hprintf(pf, "  %J: %llus cmd=%llu evt=%llu drop=%llu"
+			 " rx=%llu (%llu B/s) tx=%llu (%llu B/s)"
+			 " txq=%zu (max %zu)",
+			 &conn->peer, ms / 1000,
+			 conn->n_cmd, conn->n_evt, conn->n_drop,
+			 conn->bytes_rx, conn->bytes_rx * 1000 / ms,
+			 conn->bytes_tx, conn->bytes_tx * 1000 / ms,
+			 tcp_conn_txqsz(conn->tc), conn->txq_max);
+
+	if (conn->mask != UA_EVENT_MASK_ALL)
+		err |= re_hprintf(pf, " mask=0x%llx", conn->mask);
+	if (conn->ua)
+		err |= re_hprintf(pf, " ua=%s", conn->ua);
+	if (conn->call)
+		err |= re_hprintf(pf, " call=%s", conn->call);
+
+	err |= re_hprintf(pf, " [%H]\n", netstring_debug, conn->ns);
+
+	return err;
 }
 
 
+static int ctrl_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err;
+	(void)unused;
+
+	if (!ctrl)
+		return 0;
+
+	err = re_hprintf(pf, "ctrl_tcp: %u of %u clients"
+			 " (%llu accepted, %llu rejected)\n",
+			 list_count(&ctrl->connl), ctrl->max_clients,
+			 ctrl->n_conn, ctrl->n_reject);
+
+	for (le = ctrl->connl.head; le; le = le->next)
+		err |= print_conn(pf, le->data);
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"ctrlstat", 0, 0, "ctrl_tcp client statistics", ctrl_debug},
+};
+
+
 static void ctrl_destructor(void *arg)
 {
 	struct ctrl_st *st = arg;
 
-	mem_deref(st->tc);
+	list_flush(&st->connl);
 	mem_deref(st->ts);
-	mem_deref(st->ns);
+	mem_deref(st->evmb);
 }
 
 
 static int ctrl_alloc(struct ctrl_st **stp, const struct sa *laddr)
 {
 	struct ctrl_st *st;
+	char slow[16] = "drop";
+	uint32_t v;
 	int err;
 
 	if (!stp)
@@ -320,6 +732,23 @@ static int ctrl_alloc(struct ctrl_st **stp, const struct sa *laddr)
 	if (!st)
 		return ENOMEM;
 
+	st->max_clients = MAX_CLIENTS;
+	st->queue_size  = QUEUE_SIZE;
+
+	(void)confidx_get_u32(conf_cur_index(), "ctrl_tcp_clients",
+			      &st->max_clients);
+	if (0 == confidx_get_u32(conf_cur_index(), "ctrl_tcp_queue", &v) && v)
+		st->queue_size = v;
+	(void)confidx_get_str(conf_cur_index(), "ctrl_tcp_slow",
+			      slow, sizeof(slow));
+	st->slow_close = !str_casecmp(slow, "close");
+
+	st->evmb = mbuf_alloc(1024);
+	if (!st->evmb) {
+		err = ENOMEM;
+		goto out;
+	}
+
 	err = tcp_listen(&st->ts, laddr, tcp_conn_handler, st);
 	if (err) {
 		warning("ctrl_tcp: failed to listen on TCP %J (%m)\n",
@@ -344,7 +773,7 @@ static int ctrl_init(void)
 	struct sa laddr;
 	int err;
 
-	if (conf_get_sa(conf_cur(), "ctrl_tcp_listen", &laddr)) {
+	if (confidx_get_sa(conf_cur_index(), "ctrl_tcp_listen", &laddr)) {
 		sa_set_str(&laddr, "0.0.0.0", CTRL_PORT);
 	}
 
@@ -352,17 +781,19 @@ static int ctrl_init(void)
 	if (err)
 		return err;
 
-	err = uag_event_register(ua_event_handler, ctrl);
+	err = uag_event_subscribe(ua_event_handler, UA_EVENT_MASK_ALL,
+				  UA_EVENT_ASYNC, ctrl);
 	if (err)
 		return err;
 
-	return 0;
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int ctrl_close(void)
 {
-	uag_event_unregister(ua_event_handler);
+	cmd_unregister(baresip_commands(), cmdv);
+	uag_event_unsubscribe(ua_event_handler);
 	ctrl = mem_deref(ctrl);
 
 	return 0;
@@ -21,6 +21,8 @@ struct vidisp_st {
 
 static IDirectFB *dfb;
 static struct vidisp *vid;
+static int dfb_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("directfb", dfb_init);
 
 
 static void destructor(void *arg)
@@ -49,6 +51,10 @@ static int alloc(struct vidisp_st **stp, const struct vidisp *vd,
 	(void) resizeh;
 	(void) arg;
 
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
@@ -143,9 +149,8 @@ static void hide(struct vidisp_st *st)
 }
 
 
-static int module_init(void)
+static int dfb_init(void)
 {
-	int err = 0;
 	DFBResult ret;
 
 	ret = DirectFBInit(NULL, NULL);
@@ -160,6 +165,19 @@ static int module_init(void)
 		return (int) ret;
 	}
 
+	return 0;
+}
+
+
+static int module_init(void)
+{
+	int err = 0;
+
+	/* the DirectFB interface is made on the first display */
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
 	err = vidisp_register(&vid, baresip_vidispl(),
 			      "directfb", alloc, NULL, display, hide);
 	if (err)
@@ -178,6 +196,8 @@ static int module_close(void)
 		dfb = NULL;
 	}
 
+	module_lazy_reset(&lazy);
+
 	return 0;
 }
 
@@ -66,6 +66,8 @@ struct dtls_srtp {
 };
 
 static struct tls *tls;
+static int tls_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("dtls_srtp", tls_init);
 static const char* srtp_profiles =
 	"SRTP_AES128_CM_SHA1_80:"
 	"SRTP_AES128_CM_SHA1_32";
@@ -161,6 +163,10 @@ static int session_alloc(struct menc_sess **sessp,
 	if (!sessp || !sdp)
 		return EINVAL;
 
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
 	sess = mem_zalloc(sizeof(*sess), sess_destructor);
 	if (!sess)
 		return ENOMEM;
@@ -463,23 +469,22 @@ static struct menc dtls_srtp2 = {
 };
 
 
-static int module_init(void)
+static int tls_init(void)
 {
-	struct list *mencl = baresip_mencl();
 	int err;
 
 	err = tls_alloc(&tls, TLS_METHOD_DTLSV1, NULL, NULL);
 	if (err) {
 		warning("dtls_srtp: failed to create DTLS context (%m)\n",
 			err);
-		return err;
+		goto out;
 	}
 
 	err = tls_set_selfsigned(tls, "dtls@baresip");
 	if (err) {
 		warning("dtls_srtp: failed to self-sign certificate (%m)\n",
 			err);
-		return err;
+		goto out;
 	}
 
 	tls_set_verify_client(tls);
@@ -488,15 +493,33 @@ static int module_init(void)
 	if (err) {
 		warning("dtls_srtp: failed to enable SRTP profile (%m)\n",
 			err);
-		return err;
+		goto out;
 	}
 
+	debug("DTLS-SRTP ready with profiles %s\n", srtp_profiles);
+
+ out:
+	if (err)
+		tls = mem_deref(tls);
+
+	return err;
+}
+
+
+static int module_init(void)
+{
+	struct list *mencl = baresip_mencl();
+	int err;
+
+	/* the self-signed certificate is made on first use */
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
 	menc_register(mencl, &dtls_srtpf);
 	menc_register(mencl, &dtls_srtp);
 	menc_register(mencl, &dtls_srtp2);
 
-	debug("DTLS-SRTP ready with profiles %s\n", srtp_profiles);
-
 	return 0;
 }
 
@@ -507,6 +530,7 @@ static int module_close(void)
 	menc_unregister(&dtls_srtpf);
 	menc_unregister(&dtls_srtp2);
 	tls = mem_deref(tls);
+	module_lazy_reset(&lazy);
 
 	return 0;
 }
@@ -10,7 +10,7 @@
 
 
 struct srtp_stream {
-	struct srtp *srtp;
+	struct srtpfast *srtp;
 };
 
 
@@ -69,15 +69,15 @@ static bool send_handler(int *err, struct sa *dst, struct mbuf *mb, void *arg)
 		return false;
 
 	if (is_rtcp_packet(mb)) {
-		*err = srtcp_encrypt(comp->tx->srtp, mb);
+		*err = srtcpfast_encrypt(comp->tx->srtp, mb);
 		if (*err) {
-			warning("srtp: srtcp_encrypt failed (%m)\n", *err);
+			warning("srtp: srtcpfast_encrypt failed (%m)\n", *err);
 		}
 	}
 	else {
-		*err = srtp_encrypt(comp->tx->srtp, mb);
+		*err = srtpfast_encrypt(comp->tx->srtp, mb);
 		if (*err) {
-			warning("srtp: srtp_encrypt failed (%m)\n", *err);
+			warning("srtp: srtpfast_encrypt failed (%m)\n", *err);
 		}
 	}
 
@@ -96,10 +96,10 @@ static bool recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 		return false;
 
 	if (is_rtcp_packet(mb)) {
-		err = srtcp_decrypt(comp->rx->srtp, mb);
+		err = srtcpfast_decrypt(comp->rx->srtp, mb);
 	}
 	else {
-		err = srtp_decrypt(comp->rx->srtp, mb);
+		err = srtpfast_decrypt(comp->rx->srtp, mb);
 	}
 
 	if (err) {
@@ -126,9 +126,9 @@ int srtp_stream_add(struct srtp_stream **sp, enum srtp_suite suite,
 	if (!s)
 		return ENOMEM;
 
-	err = srtp_alloc(&s->srtp, suite, key, key_size, 0);
+	err = srtpfast_alloc(&s->srtp, suite, key, key_size);
 	if (err) {
-		warning("srtp: srtp_alloc() failed (%m)\n", err);
+		warning("srtp: srtpfast_alloc() failed (%m)\n", err);
 		goto out;
 	}
 
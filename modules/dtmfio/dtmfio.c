@@ -81,23 +81,17 @@ static void dtmf_handler(struct call *call, char key, void *arg)
 }
 
 
-static void ua_event_handler(struct ua *ua,
-			     enum ua_event ev,
-			     struct call *call,
-			     const char *prm,
-			     void *arg )
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
 {
-	(void)ua;
-	(void)prm;
 	(void)arg;
 
-	if ( ev == UA_EVENT_CALL_ESTABLISHED ) {
+	if ( evd->ev == UA_EVENT_CALL_ESTABLISHED ) {
 		fprintf(fd, "E");
 		fflush(fd);
-		call_set_handlers( call, NULL, dtmf_handler, NULL);
+		call_set_handlers( evd->call, NULL, dtmf_handler, NULL);
 	}
 
-	if (ev == UA_EVENT_CALL_CLOSED ) {
+	if (evd->ev == UA_EVENT_CALL_CLOSED ) {
 		fprintf(fd, "F");
 		fflush(fd);
 	}
@@ -120,7 +114,9 @@ static int module_init(void)
 		      " This might cause issues.\n");
 	}
 
-	uag_event_register( ua_event_handler, NULL );
+	uag_event_subscribe(ua_event_handler,
+			    UA_EVENT_MASK(UA_EVENT_CALL_ESTABLISHED) |
+			    UA_EVENT_MASK(UA_EVENT_CALL_CLOSED), 0, NULL);
 
 	return 0;
 }
@@ -128,7 +124,7 @@ static int module_init(void)
 
 static int module_close(void)
 {
-	uag_event_unregister(ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
 
 	if (fd) {
 		fclose(fd);
@@ -319,8 +319,8 @@ static int module_init(void)
 {
 	int err;
 
-	conf_get_str(conf_cur(), "evdev_device",
-		     evdev_device, sizeof(evdev_device));
+	confidx_get_str(conf_cur_index(), "evdev_device",
+			evdev_device, sizeof(evdev_device));
 
 	err = evdev_alloc(&evdev, evdev_device);
 	if (err)
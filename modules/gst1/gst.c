@@ -66,6 +66,8 @@ struct ausrc_st {
 typedef struct _GstFakeSink GstFakeSink;
 static char gst_uri[256] = "http://relay1.slayradio.org:8000/";
 static struct ausrc *ausrc;
+static int gst_lib_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("gst1", gst_lib_init);
 
 
 static void *thread(void *arg)
@@ -390,6 +392,10 @@ static int gst_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		return ENOTSUP;
 	}
 
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
 	st = mem_zalloc(sizeof(*st), gst_destructor);
 	if (!st)
 		return ENOMEM;
@@ -433,7 +439,7 @@ static int gst_alloc(struct ausrc_st **stp, const struct ausrc *as,
 }
 
 
-static int mod_gst_init(void)
+static int gst_lib_init(void)
 {
 	gchar *s;
 
@@ -445,13 +451,28 @@ static int mod_gst_init(void)
 
 	g_free(s);
 
+	return 0;
+}
+
+
+static int mod_gst_init(void)
+{
+	int err;
+
+	/* the gstreamer library is loaded on the first source */
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
 	return ausrc_register(&ausrc, baresip_ausrcl(), "gst", gst_alloc);
 }
 
 
 static int mod_gst_close(void)
 {
-	gst_deinit();
+	if (lazy.done)
+		gst_deinit();
+	module_lazy_reset(&lazy);
 	ausrc = mem_deref(ausrc);
 	return 0;
 }
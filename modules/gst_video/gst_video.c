@@ -26,31 +26,64 @@
  */
 
 
+static int gst_lib_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("gst_video", gst_lib_init);
+
+
+/* the gstreamer library is loaded on the first encoder */
+static int encode_update(struct videnc_state **vesp,
+			 const struct vidcodec *vc,
+			 struct videnc_param *prm, const char *fmtp,
+			 videnc_packet_h *pkth, void *arg)
+{
+	int err;
+
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
+	return gst_video_encode_update(vesp, vc, prm, fmtp, pkth, arg);
+}
+
+
 static struct vidcodec h264 = {
 	.name      = "H264",
 	.variant   = "packetization-mode=0",
-	.encupdh   = gst_video_encode_update,
+	.encupdh   = encode_update,
 	.ench      = gst_video_encode,
 	.fmtp_ench = gst_video_fmtp_enc,
 	.fmtp_cmph = gst_video_fmtp_cmp,
 };
 
 
-static int module_init(void)
+static int gst_lib_init(void)
 {
 	gst_init(NULL, NULL);
 
-	vidcodec_register(baresip_vidcodecl(), &h264);
-
 	info("gst_video: using gstreamer H.264 encoder\n");
 
 	return 0;
 }
 
 
+static int module_init(void)
+{
+	int err;
+
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
+	vidcodec_register(baresip_vidcodecl(), &h264);
+
+	return 0;
+}
+
+
 static int module_close(void)
 {
 	vidcodec_unregister(&h264);
+	module_lazy_reset(&lazy);
 
 	return 0;
 }
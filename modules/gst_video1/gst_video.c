@@ -26,33 +26,67 @@
  */
 
 
+static int gst_lib_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("gst_video1", gst_lib_init);
+
+
+/* the gstreamer library is loaded on the first encoder */
+static int encoder_set(struct videnc_state **vesp,
+		       const struct vidcodec *vc,
+		       struct videnc_param *prm, const char *fmtp,
+		       videnc_packet_h *pkth, void *arg)
+{
+	int err;
+
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
+	return gst_video1_encoder_set(vesp, vc, prm, fmtp, pkth, arg);
+}
+
+
 static struct vidcodec h264 = {
 	.name      = "H264",
 	.variant   = "packetization-mode=0",
-	.encupdh   = gst_video1_encoder_set,
+	.encupdh   = encoder_set,
 	.ench      = gst_video1_encode,
 	.fmtp_ench = gst_video1_fmtp_enc,
 	.fmtp_cmph = gst_video1_fmtp_cmp,
 };
 
 
-static int module_init(void)
+static int gst_lib_init(void)
 {
 	gst_init(NULL, NULL);
 
-	vidcodec_register(baresip_vidcodecl(), &h264);
-
 	info("gst_video: using gstreamer (%s)\n", gst_version_string());
 
 	return 0;
 }
 
 
+static int module_init(void)
+{
+	int err;
+
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
+	vidcodec_register(baresip_vidcodecl(), &h264);
+
+	return 0;
+}
+
+
 static int module_close(void)
 {
 	vidcodec_unregister(&h264);
 
-	gst_deinit();
+	if (lazy.done)
+		gst_deinit();
+	module_lazy_reset(&lazy);
 
 	return 0;
 }
@@ -0,0 +1,10 @@
+/**
+ * @file httpd.h  Webserver UI module -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/* OpenMetrics */
+int  metrics_print(struct mbuf *mb);
+void metrics_close(void);
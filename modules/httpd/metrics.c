@@ -0,0 +1,490 @@
+/**
+ * @file metrics.c  Webserver UI module -- OpenMetrics exposition
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+#include <re.h>
+#include <baresip.h>
+#include "httpd.h"
+
+
+/*
+ * The metrics are rendered from the live state. All streams are read once
+ * into a table of samples, and the families are then printed from that
+ * table. The table and the buffers are kept between the scrapes, so that
+ * a scrape does not allocate once the number of streams is stable.
+ */
+
+
+enum sample_flags {
+	S_AUDIO = 1<<0,            /* Audio stream, has aubuf stats */
+	S_JBUF  = 1<<1,            /* Has jitter buffer stats       */
+	S_RTCP  = 1<<2,            /* Has RTCP stats                */
+};
+
+/** One stream, read from the live state */
+struct sample {
+	size_t lbl_pos;            /* Labels in the label buffer */
+	size_t lbl_len;
+	unsigned flags;
+
+	uint64_t rx_packets;
+	uint64_t tx_packets;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t rx_err;
+	uint64_t tx_err;
+
+	double rx_lost;
+	double tx_lost;
+	double rx_jitter;          /* [s] */
+	double tx_jitter;          /* [s] */
+	double rtt;                /* [s] */
+	double mos;
+
+	uint64_t jb_put;
+	uint64_t jb_get;
+	uint64_t jb_lost;
+	uint64_t jb_late;
+	uint64_t jb_overflow;
+	uint64_t jb_underflow;
+
+	uint64_t ab_tx_overrun;
+	uint64_t ab_tx_underrun;
+	uint64_t ab_rx_overrun;
+	uint64_t ab_rx_underrun;
+};
+
+enum value_type {
+	V_U64,
+	V_DBL,
+};
+
+/** A stream metric, families with the same name must be adjacent */
+struct family {
+	const char *name;
+	const char *type;
+	const char *help;
+	const char *dir;           /* Value of the "dir" label (optional) */
+	size_t off;                /* Offset of the value in the sample   */
+	enum value_type vt;
+	unsigned flags;            /* Only samples with these flags       */
+};
+
+#define U64(n, t, h, d, f, fl) {n, t, h, d, offsetof(struct sample, f), \
+		V_U64, fl}
+#define DBL(n, t, h, d, f, fl) {n, t, h, d, offsetof(struct sample, f), \
+		V_DBL, fl}
+
+static const struct family famv[] = {
+
+	U64("baresip_stream_packets", "counter", "RTP packets",
+	    "rx", rx_packets, 0),
+	U64("baresip_stream_packets", "counter", "RTP packets",
+	    "tx", tx_packets, 0),
+	U64("baresip_stream_bytes", "counter", "RTP payload bytes",
+	    "rx", rx_bytes, 0),
+	U64("baresip_stream_bytes", "counter", "RTP payload bytes",
+	    "tx", tx_bytes, 0),
+	U64("baresip_stream_errors", "counter", "RTP errors",
+	    "rx", rx_err, 0),
+	U64("baresip_stream_errors", "counter", "RTP errors",
+	    "tx", tx_err, 0),
+
+	DBL("baresip_stream_packets_lost", "gauge",
+	    "Cumulative packets lost, from RTCP", "rx", rx_lost, S_RTCP),
+	DBL("baresip_stream_packets_lost", "gauge",
+	    "Cumulative packets lost, from RTCP", "tx", tx_lost, S_RTCP),
+	DBL("baresip_stream_jitter_seconds", "gauge",
+	    "Interarrival jitter, from RTCP", "rx", rx_jitter, S_RTCP),
+	DBL("baresip_stream_jitter_seconds", "gauge",
+	    "Interarrival jitter, from RTCP", "tx", tx_jitter, S_RTCP),
+	DBL("baresip_stream_rtt_seconds", "gauge",
+	    "Round-trip time, from RTCP", NULL, rtt, S_RTCP),
+	DBL("baresip_stream_mos", "gauge",
+	    "Pseudo mean opinion score", NULL, mos, S_RTCP | S_AUDIO),
+
+	U64("baresip_jbuf_put", "counter", "Jitter buffer frames put",
+	    NULL, jb_put, S_JBUF),
+	U64("baresip_jbuf_get", "counter", "Jitter buffer frames got",
+	    NULL, jb_get, S_JBUF),
+	U64("baresip_jbuf_lost", "counter", "Jitter buffer frames lost",
+	    NULL, jb_lost, S_JBUF),
+	U64("baresip_jbuf_late", "counter", "Jitter buffer late frames",
+	    NULL, jb_late, S_JBUF),
+	U64("baresip_jbuf_overflows", "counter", "Jitter buffer overflows",
+	    NULL, jb_overflow, S_JBUF),
+	U64("baresip_jbuf_underflows", "counter", "Jitter buffer underflows",
+	    NULL, jb_underflow, S_JBUF),
+
+	U64("baresip_aubuf_overruns", "counter", "Audio buffer overruns",
+	    "tx", ab_tx_overrun, S_AUDIO),
+	U64("baresip_aubuf_overruns", "counter", "Audio buffer overruns",
+	    "rx", ab_rx_overrun, S_AUDIO),
+	U64("baresip_aubuf_underruns", "counter", "Audio buffer underruns",
+	    "tx", ab_tx_underrun, S_AUDIO),
+	U64("baresip_aubuf_underruns", "counter", "Audio buffer underruns",
+	    "rx", ab_rx_underrun, S_AUDIO),
+};
+
+
+static struct {
+	struct sample *samplev;
+	size_t samplec;
+	size_t samplesz;
+	struct mbuf *lblmb;        /* Escaped labels of all streams */
+} metrics;
+
+
+/* label values are escaped as in the OpenMetrics text format */
+static int label_escape(struct re_printf *pf, const char *str)
+{
+	const char *p, *run;
+	int err = 0;
+
+	if (!str)
+		return 0;
+
+	for (p = run = str; *p && !err; p++) {
+
+		const char *esc;
+
+		switch (*p) {
+
+		case '\\': esc = "\\\\"; break;
+		case '"':  esc = "\\\""; break;
+		case '\n': esc = "\\n";  break;
+		default:   continue;
+		}
+
+		err  = pf->vph(run, p - run, pf->arg);
+		err |= pf->vph(esc, 2, pf->arg);
+		run = p + 1;
+	}
+
+	if (!err && p > run)
+		err = pf->vph(run, p - run, pf->arg);
+
+	return err;
+}
+
+
+static struct sample *sample_get(void)
+{
+	if (metrics.samplec >= metrics.samplesz) {
+
+		size_t sz = max(metrics.samplesz * 2, 64);
+		struct sample *v;
+
+		v = mem_realloc(metrics.samplev, sz * sizeof(*v));
+		if (!v)
+			return NULL;
+
+		metrics.samplev  = v;
+		metrics.samplesz = sz;
+	}
+
+	return &metrics.samplev[metrics.samplec++];
+}
+
+
+static int sample_read(const struct ua *ua, const struct call *call,
+		       const struct stream *strm)
+{
+	const struct rtcp_stats *rtcp = stream_rtcp_stats(strm);
+	struct audio_stats as;
+	struct jbuf_stat js;
+	struct sample *s;
+	int err;
+
+	s = sample_get();
+	if (!s)
+		return ENOMEM;
+
+	memset(s, 0, sizeof(*s));
+
+	s->lbl_pos = metrics.lblmb->end;
+
+	err = mbuf_printf(metrics.lblmb, "ua=\"%H\",call=\"%H\","
+			  "media=\"%H\"",
+			  label_escape, ua_aor(ua),
+			  label_escape, call_id(call),
+			  label_escape, sdp_media_name(stream_sdp(strm)));
+	if (err)
+		return err;
+
+	s->lbl_len = metrics.lblmb->end - s->lbl_pos;
+
+	s->rx_packets = stream_metric_get_rx_n_packets(strm);
+	s->tx_packets = stream_metric_get_tx_n_packets(strm);
+	s->rx_bytes   = stream_metric_get_rx_n_bytes(strm);
+	s->tx_bytes   = stream_metric_get_tx_n_bytes(strm);
+	s->rx_err     = stream_metric_get_rx_n_err(strm);
+	s->tx_err     = stream_metric_get_tx_n_err(strm);
+
+	if (rtcp && (rtcp->rx.sent || rtcp->tx.sent)) {
+
+		s->flags    |= S_RTCP;
+		s->rx_lost   = rtcp->rx.lost;
+		s->tx_lost   = rtcp->tx.lost;
+		s->rx_jitter = rtcp->rx.jit / 1000000.0;
+		s->tx_jitter = rtcp->tx.jit / 1000000.0;
+		s->rtt       = rtcp->rtt / 1000000.0;
+		s->mos       = mos_calculate(NULL, rtcp->rtt / 1000.0,
+					     rtcp->rx.jit / 1000.0,
+					     max(rtcp->rx.lost, 0));
+	}
+
+	if (0 == stream_jbuf_stats(strm, &js)) {
+
+		s->flags       |= S_JBUF;
+		s->jb_put       = js.n_put;
+		s->jb_get       = js.n_get;
+		s->jb_lost      = js.n_lost;
+		s->jb_late      = js.n_late;
+		s->jb_overflow  = js.n_overflow;
+		s->jb_underflow = js.n_underflow;
+	}
+
+	if (strm == audio_strm(call_audio(call)) &&
+	    0 == audio_stats_get(call_audio(call), &as)) {
+
+		s->flags         |= S_AUDIO;
+		s->ab_tx_overrun  = as.tx_overrun;
+		s->ab_tx_underrun = as.tx_underrun;
+		s->ab_rx_overrun  = as.rx_overrun;
+		s->ab_rx_underrun = as.rx_underrun;
+	}
+
+	return 0;
+}
+
+
+static int print_family(struct mbuf *mb, const struct family *fam)
+{
+	const uint8_t *lbl = metrics.lblmb->buf;
+	const bool counter = !str_cmp(fam->type, "counter");
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<metrics.samplec && !err; i++) {
+
+		const struct sample *s = &metrics.samplev[i];
+		const void *v = (const uint8_t *)s + fam->off;
+
+		if ((s->flags & fam->flags) != fam->flags)
+			continue;
+
+		err  = mbuf_printf(mb, "%s%s{%b", fam->name,
+				   counter ? "_total" : "",
+				   lbl + s->lbl_pos, s->lbl_len);
+		if (fam->dir)
+			err |= mbuf_printf(mb, ",dir=\"%s\"", fam->dir);
+
+		if (fam->vt == V_U64)
+			err |= mbuf_printf(mb, "} %llu\n",
+					   *(const uint64_t *)v);
+		else
+			err |= mbuf_printf(mb, "} %f\n", *(const double *)v);
+	}
+
+	return err;
+}
+
+
+static int print_header(struct mbuf *mb, const char *name,
+			const char *type, const char *help)
+{
+	return mbuf_printf(mb, "# TYPE %s %s\n# HELP %s %s.\n",
+			   name, type, name, help);
+}
+
+
+static int print_streams(struct mbuf *mb)
+{
+	const char *name = NULL;
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(famv) && !err; i++) {
+
+		const struct family *fam = &famv[i];
+
+		if (!name || str_cmp(name, fam->name)) {
+			name = fam->name;
+			err = print_header(mb, fam->name, fam->type,
+					   fam->help);
+		}
+
+		err |= print_family(mb, fam);
+	}
+
+	return err;
+}
+
+
+static int print_uas(struct mbuf *mb, uint32_t *ncallp)
+{
+	struct le *le;
+	uint32_t ncall = 0;
+	int err;
+
+	err = print_header(mb, "baresip_ua_registered", "gauge",
+			   "1 if the User-Agent is registered");
+
+	for (le = list_head(uag_list()); le && !err; le = le->next) {
+
+		const struct ua *ua = le->data;
+
+		err = mbuf_printf(mb, "baresip_ua_registered{ua=\"%H\"} %d\n",
+				  label_escape, ua_aor(ua),
+				  ua_isregistered(ua));
+	}
+
+	err |= print_header(mb, "baresip_ua_calls", "gauge",
+			    "Active calls of the User-Agent");
+
+	for (le = list_head(uag_list()); le && !err; le = le->next) {
+
+		const struct ua *ua = le->data;
+		const uint32_t n = list_count(ua_calls(ua));
+
+		err = mbuf_printf(mb, "baresip_ua_calls{ua=\"%H\"} %u\n",
+				  label_escape, ua_aor(ua), n);
+		ncall += n;
+	}
+
+	*ncallp = ncall;
+
+	return err;
+}
+
+
+static int print_process(struct mbuf *mb, uint32_t ncall)
+{
+	const uint64_t uptime = baresip_uptime();
+	struct memstat mstat;
+	int err;
+
+	err  = print_header(mb, "baresip_calls", "gauge", "Active calls");
+	err |= mbuf_printf(mb, "baresip_calls %u\n", ncall);
+
+	err |= print_header(mb, "baresip_user_agents", "gauge",
+			    "User-Agents");
+	err |= mbuf_printf(mb, "baresip_user_agents %u\n",
+			   list_count(uag_list()));
+
+	err |= print_header(mb, "baresip_uptime_seconds", "gauge",
+			    "Time since baresip was started");
+	err |= mbuf_printf(mb, "baresip_uptime_seconds %.3f\n",
+			   uptime / 1000.0);
+
+	err |= print_header(mb, "process_start_time_seconds", "gauge",
+			    "Start time of the process since the epoch");
+	err |= mbuf_printf(mb, "process_start_time_seconds %llu\n",
+			   (uint64_t)time(NULL) - uptime / 1000);
+
+#ifndef WIN32
+	{
+		struct rusage ru;
+
+		if (0 == getrusage(RUSAGE_SELF, &ru)) {
+
+			const double cpu =
+				ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+				(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)
+				/ 1000000.0;
+
+			err |= print_header(mb, "process_cpu_seconds",
+					    "counter",
+					    "User and system CPU time");
+			err |= mbuf_printf(mb,
+					   "process_cpu_seconds_total %f\n",
+					   cpu);
+		}
+	}
+#endif
+
+	/* only with a libre that tracks its allocations */
+	if (0 == mem_get_stat(&mstat)) {
+
+		err |= print_header(mb, "baresip_mem_bytes", "gauge",
+				    "Memory allocated by libre");
+		err |= mbuf_printf(mb, "baresip_mem_bytes %zu\n",
+				   mstat.bytes_cur);
+		err |= print_header(mb, "baresip_mem_blocks", "gauge",
+				    "Memory blocks allocated by libre");
+		err |= mbuf_printf(mb, "baresip_mem_blocks %zu\n",
+				   mstat.blocks_cur);
+	}
+
+	return err;
+}
+
+
+/**
+ * Print all metrics in the OpenMetrics text format
+ *
+ * @param mb Buffer to print to
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_print(struct mbuf *mb)
+{
+	struct le *le, *lec, *les;
+	uint32_t ncall = 0;
+	int err = 0;
+
+	if (!mb)
+		return EINVAL;
+
+	if (!metrics.lblmb) {
+		metrics.lblmb = mbuf_alloc(4096);
+		if (!metrics.lblmb)
+			return ENOMEM;
+	}
+
+	mbuf_rewind(metrics.lblmb);
+	metrics.samplec = 0;
+
+	/* one pass over the live state */
+	for (le = list_head(uag_list()); le && !err; le = le->next) {
+
+		const struct ua *ua = le->data;
+
+		for (lec = list_head(ua_calls(ua)); lec && !err;
+		     lec = lec->next) {
+
+			const struct call *call = lec->data;
+
+			for (les = list_head(call_streaml(call)); les && !err;
+			     les = les->next)
+				err = sample_read(ua, call, les->data);
+		}
+	}
+
+	if (err)
+		return err;
+
+	err  = print_uas(mb, &ncall);
+	err |= print_streams(mb);
+	err |= print_process(mb, ncall);
+	err |= mbuf_write_str(mb, "# EOF\n");
+
+	return err;
+}
+
+
+void metrics_close(void)
+{
+	metrics.samplev  = mem_deref(metrics.samplev);
+	metrics.lblmb    = mem_deref(metrics.lblmb);
+	metrics.samplec  = 0;
+	metrics.samplesz = 0;
+}
@@ -5,6 +5,6 @@
 #
 
 MOD		:= httpd
-$(MOD)_SRCS	+= httpd.c
+$(MOD)_SRCS	+= httpd.c metrics.c
 
 include mk/mod.mk
@@ -942,10 +942,10 @@ static int module_init(void)
 #ifdef MODULE_CONF
 	struct pl pl;
 
-	conf_get_bool(conf_cur(), "ice_turn", &ice.turn);
-	conf_get_bool(conf_cur(), "ice_debug", &ice.debug);
+	confidx_get_bool(conf_cur_index(), "ice_turn", &ice.turn);
+	confidx_get_bool(conf_cur_index(), "ice_debug", &ice.debug);
 
-	if (!conf_get(conf_cur(), "ice_nomination", &pl)) {
+	if (!confidx_get(conf_cur_index(), "ice_nomination", &pl)) {
 		if (0 == pl_strcasecmp(&pl, "regular"))
 			ice.nom = ICE_NOMINATION_REGULAR;
 		else if (0 == pl_strcasecmp(&pl, "aggressive"))
@@ -955,7 +955,7 @@ static int module_init(void)
 			return EINVAL;
 		}
 	}
-	if (!conf_get(conf_cur(), "ice_mode", &pl)) {
+	if (!confidx_get(conf_cur_index(), "ice_mode", &pl)) {
 		if (!pl_strcasecmp(&pl, "full"))
 			ice.mode = ICE_MODE_FULL;
 		else if (!pl_strcasecmp(&pl, "lite"))
@@ -0,0 +1,719 @@
+/**
+ * @file loadgen.c  SIP load generator
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+
+
+/**
+ * @defgroup loadgen loadgen
+ *
+ * SIP load generator, for capacity testing
+ *
+ * The load generator places calls from the current User-Agent to a list
+ * of SIP URIs, with a target call rate and a max number of concurrent
+ * calls. Each call is hung up after the call duration.
+ *
+ * For each call the module measures the setup latency from the INVITE
+ * to the first provisional response, the 200 OK and the first received
+ * RTP packet, the failure code, and the RTP packet loss and jitter.
+ * The results are printed as percentile summaries, and can be written
+ * to a CSV file with one line per call.
+ *
+ * Commands:
+ *
+ \verbatim
+  loadgen <uri>[,<uri>..] [rate=<cps>] [conc=<n>] [dur=<sec>]
+          [calls=<n>] [csv=<file>]
+  loadgen_stop          Stop the load generator and print the summary
+  loadgen_stat          Print the summary
+ \endverbatim
+ *
+ * Example, calls between two local User-Agents without any network:
+ *
+ \verbatim
+  accounts:
+    <sip:a@127.0.0.1>;regint=0
+    <sip:b@127.0.0.1>;regint=0;answermode=auto
+
+  config:
+    audio_source        aufile,/usr/share/baresip/ring.wav
+    audio_player        aubridge,loadgen
+
+  /uafind sip:a@127.0.0.1
+  /loadgen sip:b@127.0.0.1 rate=10 conc=50 dur=5 calls=500 csv=lg.csv
+ \endverbatim
+ */
+
+
+enum {
+	TICK_MS      = 10,
+	DEFAULT_RATE = 1,
+	DEFAULT_CONC = 10,
+	DEFAULT_DUR  = 10,
+	HASH_SIZE    = 256,
+	MAX_SCODE    = 700,
+};
+
+
+/** Latency samples */
+struct samples {
+	uint32_t *v;
+	size_t n;
+	size_t sz;
+};
+
+/** Load generator */
+struct loadgen {
+	struct list calll;           /**< Active calls (struct lgcall)      */
+	struct hash *ht_call;        /**< Active calls by call object       */
+	struct tmr tmr;              /**< Call rate timer                   */
+	struct ua *ua;               /**< User-Agent placing the calls      */
+	char **uriv;                 /**< Target URIs                       */
+	size_t uric;                 /**< Number of target URIs             */
+	size_t uri_ix;               /**< Next target URI                   */
+	double rate;                 /**< Target call rate [calls/sec]      */
+	uint32_t conc;               /**< Max concurrent calls              */
+	uint32_t dur;                /**< Call duration [sec]               */
+	uint32_t max_calls;          /**< Number of calls, 0 for no limit   */
+	double credit;               /**< Calls that may be started         */
+	uint64_t ts_start;           /**< Start time [ms]                   */
+	uint64_t ts_last;            /**< Time of last tick [ms]            */
+	FILE *csv;                   /**< CSV output file (optional)        */
+
+	/* results: */
+	uint32_t n_started;
+	uint32_t n_ok;
+	uint32_t n_fail;
+	uint32_t scodev[MAX_SCODE];  /**< Failure codes, 0 for local error  */
+	struct samples lat_ring;     /**< INVITE to 18x [ms]                */
+	struct samples lat_answer;   /**< INVITE to 200 [ms]                */
+	struct samples lat_rtp;      /**< INVITE to first RTP [ms]          */
+	struct samples jitter;       /**< RTP jitter [ms]                   */
+	uint64_t rx_packets;
+	int64_t rx_lost;
+};
+
+/** Call placed by the load generator */
+struct lgcall {
+	struct le le;
+	struct le he;
+	struct loadgen *lg;
+	struct call *call;           /**< Call object (ref)                 */
+	struct tmr tmr;              /**< Call duration timer               */
+	const char *uri;
+	uint64_t ts_start;
+	uint64_t ts_ring;
+	uint64_t ts_answer;
+	uint64_t ts_rtp;
+};
+
+
+static struct loadgen *gloadgen;
+
+
+static int samples_add(struct samples *s, uint32_t val)
+{
+	if (s->n >= s->sz) {
+		size_t sz = s->sz ? s->sz * 2 : 256;
+		uint32_t *v;
+
+		v = mem_realloc(s->v, sz * sizeof(*v));
+		if (!v)
+			return ENOMEM;
+
+		s->v  = v;
+		s->sz = sz;
+	}
+
+	s->v[s->n++] = val;
+
+	return 0;
+}
+
+
+static int sample_cmp(const void *p1, const void *p2)
+{
+	const uint32_t v1 = *(const uint32_t *)p1;
+	const uint32_t v2 = *(const uint32_t *)p2;
+
+	return (v1 > v2) - (v1 < v2);
+}
+
+
+static int samples_print(struct re_printf *pf, const char *name,
+			 const struct samples *s)
+{
+	uint32_t *v;
+	size_t n = s->n;
+	int err;
+
+	if (!n)
+		return re_hprintf(pf, " %-10s -\n", name);
+
+	v = mem_alloc(n * sizeof(*v), NULL);
+	if (!v)
+		return ENOMEM;
+
+	memcpy(v, s->v, n * sizeof(*v));
+	qsort(v, n, sizeof(*v), sample_cmp);
+
+	err = re_hprintf(pf, " %-10s p50=%u p95=%u p99=%u max=%u ms"
+			 " (%zu calls)\n", name,
+			 v[n * 50 / 100], v[n * 95 / 100], v[n * 99 / 100],
+			 v[n - 1], n);
+
+	mem_deref(v);
+
+	return err;
+}
+
+
+static void lgcall_destructor(void *arg)
+{
+	struct lgcall *lc = arg;
+
+	tmr_cancel(&lc->tmr);
+	list_unlink(&lc->le);
+	hash_unlink(&lc->he);
+	mem_deref(lc->call);
+}
+
+
+static void loadgen_destructor(void *arg)
+{
+	struct loadgen *lg = arg;
+	size_t i;
+
+	tmr_cancel(&lg->tmr);
+	list_flush(&lg->calll);
+	mem_deref(lg->ht_call);
+	mem_deref(lg->ua);
+
+	for (i=0; i<lg->uric; i++)
+		mem_deref(lg->uriv[i]);
+	mem_deref(lg->uriv);
+
+	mem_deref(lg->lat_ring.v);
+	mem_deref(lg->lat_answer.v);
+	mem_deref(lg->lat_rtp.v);
+	mem_deref(lg->jitter.v);
+
+	if (lg->csv)
+		(void)fclose(lg->csv);
+}
+
+
+static uint32_t call_key(const struct call *call)
+{
+	return hash_joaat((const uint8_t *)&call, sizeof(call));
+}
+
+
+static bool call_cmp_handler(struct le *le, void *arg)
+{
+	const struct lgcall *lc = le->data;
+
+	return lc->call == arg;
+}
+
+
+static struct lgcall *lgcall_find(const struct loadgen *lg,
+				  const struct call *call)
+{
+	return list_ledata(hash_lookup(lg->ht_call, call_key(call),
+				       call_cmp_handler, (void *)call));
+}
+
+
+static struct stream *call_astream(const struct call *call)
+{
+	return audio_strm(call_audio(call));
+}
+
+
+static int64_t elapsed(const struct lgcall *lc, uint64_t ts)
+{
+	return ts ? (int64_t)(ts - lc->ts_start) : -1;
+}
+
+
+static void lgcall_finish(struct lgcall *lc)
+{
+	struct loadgen *lg = lc->lg;
+	const struct stream *strm = call_astream(lc->call);
+	const struct rtcp_stats *rtcp = stream_rtcp_stats(strm);
+	uint16_t scode = call_scode(lc->call);
+	uint32_t rx_packets = stream_metric_get_rx_n_packets(strm);
+	uint64_t now = tmr_jiffies();
+	bool ok = lc->ts_answer != 0;
+
+	if (ok) {
+		++lg->n_ok;
+	}
+	else {
+		++lg->n_fail;
+		++lg->scodev[scode < MAX_SCODE ? scode : 0];
+	}
+
+	lg->rx_packets += rx_packets;
+
+	if (rtcp) {
+		lg->rx_lost += rtcp->rx.lost;
+		(void)samples_add(&lg->jitter, rtcp->rx.jit / 1000);
+	}
+
+	if (lg->csv) {
+		(void)re_fprintf(lg->csv,
+				 "%llu,%s,%s,%u,%lli,%lli,%lli,"
+				 "%llu,%u,%d,%.1f\n",
+				 lc->ts_start - lg->ts_start, lc->uri,
+				 ok ? "ok" : "fail", scode,
+				 elapsed(lc, lc->ts_ring),
+				 elapsed(lc, lc->ts_answer),
+				 elapsed(lc, lc->ts_rtp),
+				 now - lc->ts_start, rx_packets,
+				 rtcp ? rtcp->rx.lost : 0,
+				 rtcp ? rtcp->rx.jit / 1000.0 : 0.0);
+	}
+
+	mem_deref(lc);
+}
+
+
+static void hangup_handler(void *arg)
+{
+	struct lgcall *lc = arg;
+	struct call *call = lc->call;
+
+	/* the call is finished from the CALL_CLOSED event */
+	ua_hangup(call_get_ua(call), call, 0, NULL);
+}
+
+
+static int lgcall_start(struct loadgen *lg)
+{
+	struct lgcall *lc;
+	struct call *call = NULL;
+	const char *uri;
+	int err;
+
+	uri = lg->uriv[lg->uri_ix++ % lg->uric];
+
+	++lg->n_started;
+
+	err = ua_connect(lg->ua, &call, NULL, uri, VIDMODE_OFF);
+	if (err) {
+		warning("loadgen: connect to %s failed (%m)\n", uri, err);
+		++lg->n_fail;
+		++lg->scodev[0];
+		return err;
+	}
+
+	lc = mem_zalloc(sizeof(*lc), lgcall_destructor);
+	if (!lc) {
+		ua_hangup(lg->ua, call, 0, NULL);
+		return ENOMEM;
+	}
+
+	lc->lg       = lg;
+	lc->call     = mem_ref(call);
+	lc->uri      = uri;
+	lc->ts_start = tmr_jiffies();
+
+	list_append(&lg->calll, &lc->le, lc);
+	hash_append(lg->ht_call, call_key(call), &lc->he, lc);
+
+	return 0;
+}
+
+
+static int print_summary(struct re_printf *pf, const struct loadgen *lg)
+{
+	uint64_t wall = tmr_jiffies() - lg->ts_start;
+	unsigned i;
+	int err = 0;
+
+	err |= re_hprintf(pf, "\nloadgen: %u calls in %.1f sec"
+			  " (ok=%u fail=%u active=%u)\n",
+			  lg->n_started, wall / 1000.0, lg->n_ok, lg->n_fail,
+			  list_count(&lg->calll));
+
+	err |= samples_print(pf, "ringing", &lg->lat_ring);
+	err |= samples_print(pf, "answer", &lg->lat_answer);
+	err |= samples_print(pf, "first rtp", &lg->lat_rtp);
+	err |= samples_print(pf, "jitter", &lg->jitter);
+
+	err |= re_hprintf(pf, " rtp:       packets=%llu lost=%lli\n",
+			  lg->rx_packets, lg->rx_lost);
+
+	if (lg->n_fail) {
+		err |= re_hprintf(pf, " failures: ");
+
+		for (i=0; i<MAX_SCODE; i++) {
+
+			if (!lg->scodev[i])
+				continue;
+
+			if (i)
+				err |= re_hprintf(pf, " %u=%u",
+						  i, lg->scodev[i]);
+			else
+				err |= re_hprintf(pf, " error=%u",
+						  lg->scodev[i]);
+		}
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	return err;
+}
+
+
+static void loadgen_stop_all(struct loadgen *lg)
+{
+	struct le *le;
+
+	tmr_cancel(&lg->tmr);
+
+	le = lg->calll.head;
+	while (le) {
+		struct lgcall *lc = le->data;
+		le = le->next;
+
+		ua_hangup(call_get_ua(lc->call), lc->call, 0, NULL);
+	}
+}
+
+
+static void tmr_handler(void *arg)
+{
+	struct loadgen *lg = arg;
+	uint64_t now = tmr_jiffies();
+	struct le *le;
+
+	tmr_start(&lg->tmr, TICK_MS, tmr_handler, lg);
+
+	/* detect the first RTP packet of each call */
+	for (le = lg->calll.head; le; le = le->next) {
+
+		struct lgcall *lc = le->data;
+
+		if (lc->ts_rtp)
+			continue;
+
+		if (stream_metric_get_rx_n_packets(call_astream(lc->call))) {
+			lc->ts_rtp = now;
+			(void)samples_add(&lg->lat_rtp,
+					  (uint32_t)(now - lc->ts_start));
+		}
+	}
+
+	lg->credit += lg->rate * (double)(now - lg->ts_last) / 1000;
+	lg->credit  = min(lg->credit, max(1.0, lg->rate));
+	lg->ts_last = now;
+
+	while (lg->credit >= 1) {
+
+		if (lg->max_calls && lg->n_started >= lg->max_calls)
+			break;
+
+		if (list_count(&lg->calll) >= lg->conc)
+			break;
+
+		lg->credit -= 1;
+
+		(void)lgcall_start(lg);
+	}
+
+	if (lg->max_calls && lg->n_started >= lg->max_calls &&
+	    list_isempty(&lg->calll)) {
+
+		tmr_cancel(&lg->tmr);
+
+		info("loadgen: done\n");
+		(void)re_printf("%H", print_summary, lg);
+
+		gloadgen = mem_deref(gloadgen);
+	}
+}
+
+
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
+{
+	struct loadgen *lg = gloadgen;
+	struct lgcall *lc;
+	uint64_t now = tmr_jiffies();
+	(void)arg;
+
+	if (!lg)
+		return;
+
+	lc = lgcall_find(lg, evd->call);
+	if (!lc)
+		return;
+
+	switch (evd->ev) {
+
+	case UA_EVENT_CALL_RINGING:
+	case UA_EVENT_CALL_PROGRESS:
+		if (!lc->ts_ring) {
+			lc->ts_ring = now;
+			(void)samples_add(&lg->lat_ring,
+					  (uint32_t)(now - lc->ts_start));
+		}
+		break;
+
+	case UA_EVENT_CALL_ESTABLISHED:
+		lc->ts_answer = now;
+		(void)samples_add(&lg->lat_answer,
+				  (uint32_t)(now - lc->ts_start));
+
+		tmr_start(&lc->tmr, lg->dur * 1000, hangup_handler, lc);
+		break;
+
+	case UA_EVENT_CALL_CLOSED:
+		lgcall_finish(lc);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static int add_uris(struct loadgen *lg, const struct pl *pl)
+{
+	struct pl rest = *pl, uri, sep;
+	int err = 0;
+
+	while (!re_regex(rest.p, rest.l, "[^,]+[,]*", &uri, &sep)) {
+
+		char **uriv;
+
+		uriv = mem_realloc(lg->uriv, (lg->uric + 1) * sizeof(*uriv));
+		if (!uriv)
+			return ENOMEM;
+
+		lg->uriv = uriv;
+		lg->uriv[lg->uric] = NULL;
+
+		err = pl_strdup(&lg->uriv[lg->uric], &uri);
+		if (err)
+			return err;
+
+		++lg->uric;
+
+		pl_advance(&rest, uri.p + uri.l + sep.l - rest.p);
+	}
+
+	return 0;
+}
+
+
+static int parse_args(struct loadgen *lg, const char *prm)
+{
+	struct pl rest, ws, tok, v;
+	char path[256];
+	int err = 0;
+
+	pl_set_str(&rest, prm);
+
+	while (!re_regex(rest.p, rest.l, "[ ]*[^ ]+", &ws, &tok)) {
+
+		if (!re_regex(tok.p, tok.l, "rate=[0-9.]+", &v)) {
+			lg->rate = pl_float(&v);
+		}
+		else if (!re_regex(tok.p, tok.l, "conc=[0-9]+", &v)) {
+			lg->conc = pl_u32(&v);
+		}
+		else if (!re_regex(tok.p, tok.l, "dur=[0-9]+", &v)) {
+			lg->dur = pl_u32(&v);
+		}
+		else if (!re_regex(tok.p, tok.l, "calls=[0-9]+", &v)) {
+			lg->max_calls = pl_u32(&v);
+		}
+		else if (!re_regex(tok.p, tok.l, "csv=[^ ]+", &v)) {
+
+			(void)pl_strcpy(&v, path, sizeof(path));
+
+			lg->csv = fopen(path, "w");
+			if (!lg->csv) {
+				err = errno;
+				warning("loadgen: %s: %m\n", path, err);
+				return err;
+			}
+
+			(void)re_fprintf(lg->csv,
+					 "start_ms,uri,result,scode,"
+					 "ringing_ms,answer_ms,rtp_ms,"
+					 "duration_ms,rx_packets,rx_lost,"
+					 "rx_jitter_ms\n");
+		}
+		else {
+			err = add_uris(lg, &tok);
+			if (err)
+				return err;
+		}
+
+		pl_advance(&rest, ws.l + tok.l);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Start the load generator
+ *
+ * Usage:
+ *   loadgen <uri>[,<uri>..] [rate=<cps>] [conc=<n>] [dur=<sec>]
+ *           [calls=<n>] [csv=<file>]
+ *
+ * @param pf  Print handler
+ * @param arg Command argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int loadgen_start(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct loadgen *lg;
+	int err;
+
+	if (gloadgen)
+		return re_hprintf(pf, "loadgen already running\n");
+
+	if (!uag_current())
+		return re_hprintf(pf, "loadgen: no User-Agent\n");
+
+	lg = mem_zalloc(sizeof(*lg), loadgen_destructor);
+	if (!lg)
+		return ENOMEM;
+
+	lg->ua   = mem_ref(uag_current());
+	lg->rate = DEFAULT_RATE;
+	lg->conc = DEFAULT_CONC;
+	lg->dur  = DEFAULT_DUR;
+
+	err = hash_alloc(&lg->ht_call, HASH_SIZE);
+	if (err)
+		goto out;
+
+	err = parse_args(lg, carg->prm);
+	if (err)
+		goto out;
+
+	if (!lg->uric || lg->rate <= 0 || !lg->conc) {
+		err = EINVAL;
+		goto out;
+	}
+
+	lg->ts_start = lg->ts_last = tmr_jiffies();
+	lg->credit   = 1;
+
+	tmr_start(&lg->tmr, 0, tmr_handler, lg);
+
+	err = re_hprintf(pf, "loadgen: %s: %zu uri(s), rate=%.1f/s conc=%u"
+			 " dur=%us calls=%u\n",
+			 ua_aor(lg->ua), lg->uric, lg->rate, lg->conc,
+			 lg->dur, lg->max_calls);
+
+ out:
+	if (err) {
+		(void)re_hprintf(pf, "usage: loadgen <uri>[,<uri>..]"
+				 " [rate=<cps>] [conc=<n>] [dur=<sec>]"
+				 " [calls=<n>] [csv=<file>]\n");
+		mem_deref(lg);
+	}
+	else {
+		gloadgen = lg;
+	}
+
+	return err;
+}
+
+
+static int loadgen_stop(struct re_printf *pf, void *arg)
+{
+	struct loadgen *lg = gloadgen;
+	int err;
+	(void)arg;
+
+	if (!lg)
+		return re_hprintf(pf, "loadgen not running\n");
+
+	loadgen_stop_all(lg);
+
+	err = print_summary(pf, lg);
+
+	gloadgen = mem_deref(lg);
+
+	return err;
+}
+
+
+static int loadgen_stat(struct re_printf *pf, void *arg)
+{
+	(void)arg;
+
+	if (!gloadgen)
+		return re_hprintf(pf, "loadgen not running\n");
+
+	return print_summary(pf, gloadgen);
+}
+
+
+static const struct cmd cmdv[] = {
+	{"loadgen",      0, CMD_PRM, "Start SIP load generator <uri>",
+	 loadgen_start },
+	{"loadgen_stop", 0, 0,       "Stop SIP load generator",
+	 loadgen_stop  },
+	{"loadgen_stat", 0, 0,       "SIP load generator summary",
+	 loadgen_stat  },
+};
+
+
+static int module_init(void)
+{
+	int err;
+
+	err = uag_event_subscribe(ua_event_handler,
+				  UA_EVENT_MASK(UA_EVENT_CALL_RINGING) |
+				  UA_EVENT_MASK(UA_EVENT_CALL_PROGRESS) |
+				  UA_EVENT_MASK(UA_EVENT_CALL_ESTABLISHED) |
+				  UA_EVENT_MASK(UA_EVENT_CALL_CLOSED),
+				  0, NULL);
+	if (err)
+		return err;
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+}
+
+
+static int module_close(void)
+{
+	if (gloadgen) {
+		loadgen_stop_all(gloadgen);
+		gloadgen = mem_deref(gloadgen);
+	}
+
+	cmd_unregister(baresip_commands(), cmdv);
+	uag_event_unsubscribe(ua_event_handler);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(loadgen) = {
+	"loadgen",
+	"application",
+	module_init,
+	module_close
+};
@@ -42,9 +42,19 @@ static struct {
 	uint32_t redial_delay;        /**< Redial delay in [seconds]      */
 	uint32_t redial_attempts;     /**< Number of re-dial attempts     */
 	uint32_t current_attempts;    /**< Current number of re-dials     */
+	struct conf_watch *watch;     /**< Watch of the config keys       */
 } menu;
 
 
+/** Config keys of the menu, reloaded when they change */
+static const char * const confkeyv[] = {
+	"menu_bell",
+	"ringback_disabled",
+	"redial_*",
+	"statmode_default",
+};
+
+
 static int  menu_set_incall(bool incall);
 static void update_callstatus(void);
 static void alert_stop(void);
@@ -1282,27 +1292,28 @@ static void message_handler(struct ua *ua, const struct pl *peer,
 }
 
 
-static int module_init(void)
+static void read_config(const struct confidx *idx, void *arg)
 {
 	struct pl val;
-	int err;
+	(void)arg;
 
-	/*
-	 * Read the config values
-	 */
-	conf_get_bool(conf_cur(), "menu_bell", &menu.bell);
-	conf_get_bool(conf_cur(), "ringback_disabled",
-		      &menu.ringback_disabled);
+	menu.bell = false;
+	menu.ringback_disabled = false;
+	menu.redial_attempts = 0;
+	menu.redial_delay = 0;
+
+	confidx_get_bool(idx, "menu_bell", &menu.bell);
+	confidx_get_bool(idx, "ringback_disabled", &menu.ringback_disabled);
 
-	if (0 == conf_get(conf_cur(), "redial_attempts", &val) &&
+	if (0 == confidx_get(idx, "redial_attempts", &val) &&
 	    0 == pl_strcasecmp(&val, "inf")) {
 		menu.redial_attempts = (uint32_t)-1;
 	}
 	else {
-		conf_get_u32(conf_cur(), "redial_attempts",
-			     &menu.redial_attempts);
+		confidx_get_u32(idx, "redial_attempts",
+				&menu.redial_attempts);
 	}
-	conf_get_u32(conf_cur(), "redial_delay", &menu.redial_delay);
+	confidx_get_u32(idx, "redial_delay", &menu.redial_delay);
 
 	if (menu.redial_attempts) {
 		info("menu: redial enabled with %u attempts and"
@@ -1311,19 +1322,36 @@ static int module_init(void)
 		     menu.redial_delay);
 	}
 
-	menu.dialbuf = mbuf_alloc(64);
-	if (!menu.dialbuf)
-		return ENOMEM;
-
-	start_ticks = tmr_jiffies();
-	tmr_init(&tmr_alert);
-	if (0 == conf_get(conf_cur(), "statmode_default", &val) &&
+	if (0 == confidx_get(idx, "statmode_default", &val) &&
 	    0 == pl_strcasecmp(&val, "off")) {
 		statmode = STATMODE_OFF;
 	}
 	else {
 		statmode = STATMODE_CALL;
 	}
+}
+
+
+static int module_init(void)
+{
+	int err;
+
+	/*
+	 * Read the config values, and again when they are changed
+	 */
+	read_config(conf_cur_index(), NULL);
+
+	err = conf_watch_alloc(&menu.watch, confkeyv, ARRAY_SIZE(confkeyv),
+			       read_config, NULL);
+	if (err)
+		return err;
+
+	menu.dialbuf = mbuf_alloc(64);
+	if (!menu.dialbuf)
+		return ENOMEM;
+
+	start_ticks = tmr_jiffies();
+	tmr_init(&tmr_alert);
 
 	err  = cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 	err |= cmd_register(baresip_commands(), dialcmdv,
@@ -1349,6 +1377,7 @@ static int module_close(void)
 	debug("menu: close (redial current_attempts=%d)\n",
 	      menu.current_attempts);
 
+	menu.watch = mem_deref(menu.watch);
 	menu.message = mem_deref(menu.message);
 	uag_event_unregister(ua_event_handler);
 	cmd_unregister(baresip_commands(), cmdv);
@@ -96,7 +96,7 @@ static struct aucodec mpa = {
 
 static int module_init(void)
 {
-	struct conf *conf = conf_cur();
+	const struct confidx *conf = conf_cur_index();
 	uint32_t value;
 	static char fmtp[256];
 	static char mode[30];
@@ -106,7 +106,7 @@ static int module_init(void)
 
 	strcpy(mode,mpa.fmtp);
 
-	if (0 == conf_get_u32(conf, "mpa_bitrate", &value)) {
+	if (0 == confidx_get_u32(conf, "mpa_bitrate", &value)) {
 		if (value<8000 || value>384000) {
 			warning("MPA bitrate between 8000 and "
 				"384000 are allowed.\n");
@@ -117,7 +117,7 @@ static int module_init(void)
 			sizeof(fmtp)-strlen(fmtp),
 			"; bitrate=%d", value);
 	}
-	if (0 == conf_get_u32(conf, "mpa_layer", &value)) {
+	if (0 == confidx_get_u32(conf, "mpa_layer", &value)) {
 		if (value<1 || value>4) {
 			warning("MPA layer 1, 2 or 3 are allowed.");
 			return -1;
@@ -126,7 +126,7 @@ static int module_init(void)
 			sizeof(fmtp)-strlen(fmtp),
 			"; layer=%d", value);
 	}
-	if (0 == conf_get_u32(conf, "mpa_samplerate", &value)) {
+	if (0 == confidx_get_u32(conf, "mpa_samplerate", &value)) {
 		switch (value) {
 		case 32000:
 		case 44100:
@@ -144,7 +144,7 @@ static int module_init(void)
 			sizeof(fmtp)-strlen(fmtp),
 			"; samplerate=%d", value);
 	}
-	if (0 == conf_get_str(conf, "mpa_mode", mode, sizeof(mode))) {
+	if (0 == confidx_get_str(conf, "mpa_mode", mode, sizeof(mode))) {
 		char *p = mode;
 		while (*p) {
 			*p = tolower(*p);
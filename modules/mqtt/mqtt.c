@@ -77,9 +77,9 @@ static int module_init(void)
 
 	mosquitto_lib_init();
 
-	conf_get_str(conf_cur(), "mqtt_broker_host",
-		     broker_host, sizeof(broker_host));
-	conf_get_u32(conf_cur(), "mqtt_broker_port", &broker_port);
+	confidx_get_str(conf_cur_index(), "mqtt_broker_host",
+			broker_host, sizeof(broker_host));
+	confidx_get_u32(conf_cur_index(), "mqtt_broker_port", &broker_port);
 
 	s_mqtt.mosq = mosquitto_new("baresip", true, &s_mqtt);
 	if (!s_mqtt.mosq) {
@@ -127,7 +127,7 @@ static int module_close(void)
 {
 	fd_close(s_mqtt.fd);
 
-	mqtt_publish_close();
+	mqtt_publish_close(&s_mqtt);
 
 	mqtt_subscribe_close();
 
@@ -4,6 +4,10 @@ struct mqtt {
 	struct mosquitto *mosq;
 	struct tmr tmr;
 	int fd;
+	struct evbatch *evb;       /* Batching of outgoing events     */
+	struct mbuf *mb;           /* Encoded event, reused           */
+	struct tmr tmr_stats;
+	uint32_t stats_interval;   /* Statistics interval in [s]      */
 };
 
 
@@ -21,6 +25,6 @@ void mqtt_subscribe_close(void);
  */
 
 int  mqtt_publish_init(struct mqtt *mqtt);
-void mqtt_publish_close(void);
+void mqtt_publish_close(struct mqtt *mqtt);
 int  mqtt_publish_message(struct mqtt *mqtt, const char *topic,
 			  const char *fmt, ...);
@@ -16,33 +16,229 @@
  */
 
 
+/* gauge-like events, only the last value in a window is sent */
+static const char *event_key(char *buf, size_t sz, struct ua_event_data *evd)
+{
+	switch (evd->ev) {
+
+	case UA_EVENT_VU_TX:
+	case UA_EVENT_VU_RX:
+	case UA_EVENT_CALL_RTCP:
+		break;
+
+	default:
+		return NULL;
+	}
+
+	if (re_snprintf(buf, sz, "%s/%s/%s/%s",
+			evd->aor ? evd->aor : "",
+			evd->call ? call_id(evd->call) : "",
+			uag_event_str(evd->ev),
+			evd->ev == UA_EVENT_CALL_RTCP ?
+			ua_event_prm(evd) : "") < 0)
+		return NULL;
+
+	return buf;
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	struct mbuf *mb = arg;
+
+	return mbuf_write_mem(mb, (uint8_t *)p, size);
+}
+
+
+static int publish_odict(struct mqtt *mqtt, const char *topic,
+			 const char *key, const struct odict *od)
+{
+	struct re_printf pf = {print_handler, mqtt->mb};
+	int err;
+
+	mbuf_rewind(mqtt->mb);
+
+	err = json_encode_odict(&pf, od);
+	if (err)
+		return err;
+
+	return evbatch_add(mqtt->evb, topic, key,
+			   (char *)mqtt->mb->buf, mqtt->mb->end);
+}
+
+
 /*
  * Relay UA events as publish messages to the Broker
  */
-static void ua_event_handler(struct ua *ua, enum ua_event ev,
-			     struct call *call, const char *prm, void *arg)
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
 {
 	struct mqtt *mqtt = arg;
-	struct odict *od = NULL;
+	struct re_printf pf = {print_handler, mqtt->mb};
+	char key[256];
 	int err;
 
-	err = odict_alloc(&od, 8);
+	mbuf_rewind(mqtt->mb);
+
+	err  = mbuf_write_str(mqtt->mb, "{");
+	err |= event_encode_members(&pf, evd->aor, evd->ev, evd->call,
+				    ua_event_prm(evd));
+	err |= mbuf_write_str(mqtt->mb, "}");
 	if (err)
 		return;
 
-	err = event_encode_dict(od, ua, ev, call, prm);
+	err = evbatch_add(mqtt->evb, "/baresip/event",
+			  event_key(key, sizeof(key), evd),
+			  (char *)mqtt->mb->buf, mqtt->mb->end);
+	if (err) {
+		warning("mqtt: failed to publish message (%m)\n", err);
+	}
+}
+
+
+static int add_stream(struct odict *od_parent, const struct stream *strm)
+{
+	const struct rtcp_stats *rtcp = stream_rtcp_stats(strm);
+	struct odict *od;
+	int err;
+
+	err = odict_alloc(&od, 16);
+	if (err)
+		return err;
+
+	err  = odict_entry_add(od, "rx_packets", ODICT_INT,
+			       (int64_t)stream_metric_get_rx_n_packets(strm));
+	err |= odict_entry_add(od, "tx_packets", ODICT_INT,
+			       (int64_t)stream_metric_get_tx_n_packets(strm));
+	err |= odict_entry_add(od, "rx_bytes", ODICT_INT,
+			       (int64_t)stream_metric_get_rx_n_bytes(strm));
+	err |= odict_entry_add(od, "tx_bytes", ODICT_INT,
+			       (int64_t)stream_metric_get_tx_n_bytes(strm));
+
+	if (rtcp) {
+		err |= odict_entry_add(od, "rx_lost", ODICT_INT,
+				       (int64_t)rtcp->rx.lost);
+		err |= odict_entry_add(od, "tx_lost", ODICT_INT,
+				       (int64_t)rtcp->tx.lost);
+		err |= odict_entry_add(od, "rx_jit", ODICT_INT,
+				       (int64_t)rtcp->rx.jit);
+		err |= odict_entry_add(od, "rtt", ODICT_INT,
+				       (int64_t)rtcp->rtt);
+	}
+
+	if (!err)
+		err = odict_entry_add(od_parent,
+				      sdp_media_name(stream_sdp(strm)),
+				      ODICT_OBJECT, od);
+
+	mem_deref(od);
+
+	return err;
+}
+
+
+static int publish_call_stats(struct mqtt *mqtt, struct ua *ua,
+			      struct call *call)
+{
+	struct odict *od = NULL, *streams = NULL;
+	struct le *le;
+	int err;
+
+	err  = odict_alloc(&od, 8);
+	err |= odict_alloc(&streams, 4);
 	if (err)
 		goto out;
 
-	err = mqtt_publish_message(mqtt, "/baresip/event", "%H",
-				   json_encode_odict, od);
-	if (err) {
-		warning("mqtt: failed to publish message (%m)\n", err);
+	err  = odict_entry_add(od, "accountaor", ODICT_STRING, ua_aor(ua));
+	err |= odict_entry_add(od, "id", ODICT_STRING, call_id(call));
+	err |= odict_entry_add(od, "peeruri", ODICT_STRING,
+			       call_peeruri(call));
+	err |= odict_entry_add(od, "direction", ODICT_STRING,
+			       call_is_outgoing(call) ? "outgoing"
+			       : "incoming");
+	err |= odict_entry_add(od, "duration", ODICT_INT,
+			       (int64_t)call_duration(call));
+	if (err)
 		goto out;
-	}
+
+	for (le = list_head(call_streaml(call)); le && !err; le = le->next)
+		err = add_stream(streams, le->data);
+
+	err |= odict_entry_add(od, "streams", ODICT_OBJECT, streams);
+	if (err)
+		goto out;
+
+	/* a newer report of the same call replaces a queued one */
+	err = publish_odict(mqtt, "/baresip/call_stats", call_id(call), od);
 
  out:
+	mem_deref(streams);
 	mem_deref(od);
+
+	return err;
+}
+
+
+static int publish_queue_stats(struct mqtt *mqtt)
+{
+	struct evbatch_stats st;
+
+	evbatch_stats_get(mqtt->evb, &st);
+
+	return mqtt_publish_message(mqtt, "/baresip/mqtt_stats",
+				    "{\"in\":%llu,\"coalesced\":%llu,"
+				    "\"out\":%llu,\"messages\":%llu,"
+				    "\"errors\":%llu,\"dropped\":%llu,"
+				    "\"pending\":%u,\"max_pending\":%u}",
+				    st.n_in, st.n_coalesced, st.n_out,
+				    st.n_msg, st.n_err, st.n_drop,
+				    st.n_pending, st.max_pending);
+}
+
+
+static void stats_handler(void *arg)
+{
+	struct mqtt *mqtt = arg;
+	struct le *le, *lec;
+	int err = 0;
+
+	tmr_start(&mqtt->tmr_stats, mqtt->stats_interval * 1000,
+		  stats_handler, mqtt);
+
+	for (le = list_head(uag_list()); le; le = le->next) {
+
+		struct ua *ua = le->data;
+
+		for (lec = list_head(ua_calls(ua)); lec; lec = lec->next)
+			err |= publish_call_stats(mqtt, ua, lec->data);
+	}
+
+	err |= publish_queue_stats(mqtt);
+	if (err) {
+		warning("mqtt: failed to publish statistics (%m)\n", err);
+	}
+}
+
+
+static int send_handler(const char *topic, const char *buf, size_t len,
+			void *arg)
+{
+	struct mqtt *mqtt = arg;
+	int ret;
+
+	ret = mosquitto_publish(mqtt->mosq,
+				NULL,
+				topic,
+				(int)len,
+				buf,
+				0,
+				false);
+	if (ret != MOSQ_ERR_SUCCESS) {
+		warning("mqtt: failed to publish (%s)\n",
+			mosquitto_strerror(ret));
+		return EINVAL;
+	}
+
+	return 0;
 }
 
 
@@ -86,17 +282,49 @@ int mqtt_publish_message(struct mqtt *mqtt, const char *topic,
 
 int mqtt_publish_init(struct mqtt *mqtt)
 {
+	struct evbatch_conf conf = {0, 0, 0};
 	int err;
 
-	err = uag_event_register(ua_event_handler, mqtt);
+	tmr_init(&mqtt->tmr_stats);
+
+	(void)confidx_get_u32(conf_cur_index(), "mqtt_batch_window",
+			      &conf.window);
+	(void)confidx_get_u32(conf_cur_index(), "mqtt_batch_max",
+			      &conf.max_batch);
+	(void)confidx_get_u32(conf_cur_index(), "mqtt_batch_pending",
+			      &conf.max_pending);
+	(void)confidx_get_u32(conf_cur_index(), "mqtt_stats_interval",
+			      &mqtt->stats_interval);
+
+	mqtt->mb = mbuf_alloc(1024);
+	if (!mqtt->mb)
+		return ENOMEM;
+
+	err = evbatch_alloc(&mqtt->evb, &conf, send_handler, mqtt);
 	if (err)
 		return err;
 
+	err = uag_event_subscribe(ua_event_handler, UA_EVENT_MASK_ALL,
+				  UA_EVENT_ASYNC, mqtt);
+	if (err)
+		return err;
+
+	if (mqtt->stats_interval) {
+		tmr_start(&mqtt->tmr_stats, mqtt->stats_interval * 1000,
+			  stats_handler, mqtt);
+	}
+
 	return err;
 }
 
 
-void mqtt_publish_close(void)
+void mqtt_publish_close(struct mqtt *mqtt)
 {
-	uag_event_unregister(&ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
+
+	tmr_cancel(&mqtt->tmr_stats);
+
+	/* send the queued events before the disconnect */
+	mqtt->evb = mem_deref(mqtt->evb);
+	mqtt->mb  = mem_deref(mqtt->mb);
 }
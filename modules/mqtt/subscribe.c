@@ -21,12 +21,30 @@ static int print_handler(const char *p, size_t size, void *arg)
 }
 
 
+/* Make the call with this Call-ID the current call */
+static int call_select(const char *id)
+{
+	struct call *call = call_find_id(NULL, id);
+	struct ua *ua;
+
+	if (!call)
+		return ENOENT;
+
+	ua = call_get_ua(call);
+
+	uag_current_set(ua);
+	call_set_current(ua_calls(ua), call);
+
+	return 0;
+}
+
+
 static void handle_command(struct mqtt *mqtt, const struct pl *msg)
 {
 	struct mbuf *resp = mbuf_alloc(1024);
 	struct re_printf pf = {print_handler, resp};
 	struct odict *od = NULL;
-	const struct odict_entry *oe_cmd, *oe_prm, *oe_tok;
+	const struct odict_entry *oe_cmd, *oe_prm, *oe_tok, *oe_call;
 	char buf[256], resp_topic[256];
 	int err;
 
@@ -42,6 +60,7 @@ static void handle_command(struct mqtt *mqtt, const struct pl *msg)
 	oe_cmd = odict_lookup(od, "command");
 	oe_prm = odict_lookup(od, "params");
 	oe_tok = odict_lookup(od, "token");
+	oe_call = odict_lookup(od, "callid");
 	if (!oe_cmd) {
 		warning("mqtt: missing json entries\n");
 		goto out;
@@ -56,13 +75,20 @@ static void handle_command(struct mqtt *mqtt, const struct pl *msg)
 		    oe_prm ? " " : "",
 		    oe_prm ? oe_prm->u.str : "");
 
-	/* Relay message to long commands */
-	err = cmd_process_long(baresip_commands(),
-			       buf,
-			       str_len(buf),
-			       &pf, NULL);
-	if (err) {
-		warning("mqtt: error processing command (%m)\n", err);
+	if (oe_call && call_select(oe_call->u.str)) {
+		warning("mqtt: call not found: %s\n", oe_call->u.str);
+		(void)re_hprintf(&pf, "call not found: %s", oe_call->u.str);
+	}
+	else {
+		/* Relay message to long commands */
+		err = cmd_process_long(baresip_commands(),
+				       buf,
+				       str_len(buf),
+				       &pf, NULL);
+		if (err) {
+			warning("mqtt: error processing command (%m)\n",
+				err);
+		}
 	}
 
 	/* NOTE: the command will now write the response
@@ -140,23 +140,18 @@ static struct mwi *mwi_find(const struct ua *ua)
 }
 
 
-static void ua_event_handler(struct ua *ua,
-			     enum ua_event ev,
-			     struct call *call,
-			     const char *prm,
-			     void *arg )
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
 {
-	(void)call;
-	(void)prm;
+	struct ua *ua = evd->ua;
 	(void)arg;
 
-	if (ev == UA_EVENT_REGISTER_OK) {
+	if (evd->ev == UA_EVENT_REGISTER_OK) {
 
 		if (!mwi_find(ua) &&
 		    (str_casecmp(account_mwi(ua_account(ua)), "yes") == 0))
 			mwi_subscribe(ua);
 	}
-	else if (ev == UA_EVENT_SHUTDOWN) {
+	else if (evd->ev == UA_EVENT_SHUTDOWN) {
 
 		struct mwi *mwi = mwi_find(ua);
 
@@ -194,13 +189,15 @@ static int module_init(void)
 	list_init(&mwil);
 	tmr_start(&tmr, 1, tmr_handler, 0);
 
-	return uag_event_register(ua_event_handler, NULL);
+	return uag_event_subscribe(ua_event_handler,
+				   UA_EVENT_MASK(UA_EVENT_REGISTER_OK) |
+				   UA_EVENT_MASK(UA_EVENT_SHUTDOWN), 0, NULL);
 }
 
 
 static int module_close(void)
 {
-	uag_event_unregister(ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
 	tmr_cancel(&tmr);
 	list_flush(&mwil);
 
@@ -467,8 +467,9 @@ static int module_init(void)
 	if (err)
 		return err;
 
-	(void)conf_get_u32(conf_cur(), "natbd_interval", &interval);
-	(void)conf_get_str(conf_cur(), "natbd_server", server, sizeof(server));
+	(void)confidx_get_u32(conf_cur_index(), "natbd_interval", &interval);
+	(void)confidx_get_str(conf_cur_index(), "natbd_server",
+			      server, sizeof(server));
 
 	if (!server[0]) {
 		warning("natbd: missing config 'natbd_server'\n");
@@ -356,7 +356,7 @@ static int module_init(void)
 
 	net_rt_list(net_rt_handler, NULL);
 
-	conf_get_sa(conf_cur(), "natpmp_server", &natpmp_srv);
+	confidx_get_sa(conf_cur_index(), "natpmp_server", &natpmp_srv);
 
 	info("natpmp: using NAT-PMP server at %J\n", &natpmp_srv);
 
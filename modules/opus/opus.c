@@ -88,14 +88,14 @@ void opus_mirror_params(const char *x)
 
 static int module_init(void)
 {
-	struct conf *conf = conf_cur();
+	const struct confidx *conf = conf_cur_index();
 	uint32_t value;
 	char *p = fmtp + str_len(fmtp);
 	bool b, stereo = true, sprop_stereo = true;
 	int n = 0;
 
-	conf_get_bool(conf, "opus_stereo", &stereo);
-	conf_get_bool(conf, "opus_sprop_stereo", &sprop_stereo);
+	confidx_get_bool(conf, "opus_stereo", &stereo);
+	confidx_get_bool(conf, "opus_sprop_stereo", &sprop_stereo);
 
 	/* always set stereo parameter first */
 	n = re_snprintf(p, sizeof(fmtp) - str_len(p),
@@ -105,7 +105,7 @@ static int module_init(void)
 
 	p += n;
 
-	if (0 == conf_get_u32(conf, "opus_bitrate", &value)) {
+	if (0 == confidx_get_u32(conf, "opus_bitrate", &value)) {
 
 		n = re_snprintf(p, sizeof(fmtp) - str_len(p),
 				";maxaveragebitrate=%d", value);
@@ -115,7 +115,7 @@ static int module_init(void)
 		p += n;
 	}
 
-	if (0 == conf_get_bool(conf, "opus_cbr", &b)) {
+	if (0 == confidx_get_bool(conf, "opus_cbr", &b)) {
 
 		n = re_snprintf(p, sizeof(fmtp) - str_len(p),
 				";cbr=%d", b);
@@ -125,7 +125,7 @@ static int module_init(void)
 		p += n;
 	}
 
-	if (0 == conf_get_bool(conf, "opus_inbandfec", &b)) {
+	if (0 == confidx_get_bool(conf, "opus_inbandfec", &b)) {
 
 		n = re_snprintf(p, sizeof(fmtp) - str_len(p),
 				";useinbandfec=%d", b);
@@ -135,7 +135,7 @@ static int module_init(void)
 		p += n;
 	}
 
-	if (0 == conf_get_bool(conf, "opus_dtx", &b)) {
+	if (0 == confidx_get_bool(conf, "opus_dtx", &b)) {
 
 		n = re_snprintf(p, sizeof(fmtp) - str_len(p),
 				";usedtx=%d", b);
@@ -145,7 +145,7 @@ static int module_init(void)
 		p += n;
 	}
 
-	(void)conf_get_bool(conf, "opus_mirror", &opus_mirror);
+	(void)confidx_get_bool(conf, "opus_mirror", &opus_mirror);
 
 	if (opus_mirror) {
 		opus.fmtp = NULL;
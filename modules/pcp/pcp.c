@@ -321,7 +321,7 @@ static int module_init(void)
 	struct pl pl;
 	int err;
 
-	if (0 == conf_get(conf_cur(), "pcp_server", &pl)) {
+	if (0 == confidx_get(conf_cur_index(), "pcp_server", &pl)) {
 		err = sa_decode(&pcp_srv, pl.p, pl.l);
 		if (err)
 			return err;
@@ -58,20 +58,16 @@ static void printRtcpSummaryLine(const struct stream *s)
 }
 
 
-static void ua_event_handler(struct ua *ua,
-			     enum ua_event ev,
-			     struct call *call,
-			     const char *prm,
-			     void *arg )
+static void ua_event_handler(struct ua_event_data *evd, void *arg)
 {
 	const struct stream *s;
 	struct le *le;
-	(void)call;
+	(void)arg;
 
-	switch (ev) {
+	switch (evd->ev) {
 
 	case UA_EVENT_CALL_CLOSED:
-		for (le = call_streaml(call)->head;
+		for (le = call_streaml(evd->call)->head;
 		     le;
 		     le = le->next) {
 			s = le->data;
@@ -87,7 +83,9 @@ static void ua_event_handler(struct ua *ua,
 
 static int module_init(void)
 {
-	int err = uag_event_register(ua_event_handler, NULL);
+	int err = uag_event_subscribe(ua_event_handler,
+				      UA_EVENT_MASK(UA_EVENT_CALL_CLOSED),
+				      0, NULL);
 	if (err) {
 		info("Error loading rtcpsummary module: %d", err);
 		return err;
@@ -99,7 +97,7 @@ static int module_init(void)
 static int module_close(void)
 {
 	debug("rtcpsummary: module closing..\n");
-	uag_event_unregister(ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
 	return 0;
 }
 
@@ -31,6 +31,8 @@ struct vidisp_st {
 
 
 static struct vidisp *vid;
+static int video_init(void);
+static struct mod_lazy lazy = MOD_LAZY_INIT("sdl2", video_init);
 
 
 static void event_handler(void *arg);
@@ -143,6 +145,10 @@ static int alloc(struct vidisp_st **stp, const struct vidisp *vd,
 	if (!stp || !vd)
 		return EINVAL;
 
+	err = module_lazy_use(&lazy);
+	if (err)
+		return err;
+
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
@@ -312,16 +318,27 @@ static void hide(struct vidisp_st *st)
 }
 
 
-static int module_init(void)
+static int video_init(void)
 {
-	int err;
-
 	if (SDL_VideoInit(NULL) < 0) {
 		warning("sdl2: unable to init Video: %s\n",
 			SDL_GetError());
 		return ENODEV;
 	}
 
+	return 0;
+}
+
+
+static int module_init(void)
+{
+	int err;
+
+	/* the video subsystem is started on the first display */
+	err = module_lazy_init(&lazy);
+	if (err)
+		return err;
+
 	err = vidisp_register(&vid, baresip_vidispl(),
 			      "sdl2", alloc, NULL, display, hide);
 	if (err)
@@ -335,7 +352,9 @@ static int module_close(void)
 {
 	vid = mem_deref(vid);
 
-	SDL_Quit();
+	if (lazy.done)
+		SDL_Quit();
+	module_lazy_reset(&lazy);
 
 	return 0;
 }
@@ -26,6 +26,7 @@
 struct selfview {
 	struct lock *lock;          /**< Protect frame         */
 	struct vidframe *frame;     /**< Copy of encoded frame */
+	struct vidpool *pool;       /**< Pool of frames        */
 };
 
 struct selfview_enc {
@@ -51,6 +52,7 @@ static void destructor(void *arg)
 	mem_deref(st->frame);
 	lock_rel(st->lock);
 	mem_deref(st->lock);
+	mem_deref(st->pool);
 }
 
 
@@ -91,13 +93,21 @@ static int selfview_alloc(struct selfview **selfviewp, void **ctx)
 
 		err = lock_alloc(&selfview->lock);
 		if (err)
-			return err;
+			goto out;
+
+		err = vidpool_alloc(&selfview->pool, 3);
+		if (err)
+			goto out;
 
 		*ctx = selfview;
 		*selfviewp = selfview;
 	}
 
 	return 0;
+
+ out:
+	mem_deref(selfview);
+	return err;
 }
 
 
@@ -178,32 +188,36 @@ static int encode_pip(struct vidfilt_enc_st *st, struct vidframe *frame,
 {
 	struct selfview_enc *enc = (struct selfview_enc *)st;
 	struct selfview *selfview = enc->selfview;
-	int err = 0;
+	struct vidframe *sv_frame = NULL;
+	struct vidsz sz;
+	int err;
 	(void)timestamp;
 
 	if (!frame)
 		return 0;
 
-	lock_write_get(selfview->lock);
-	if (!selfview->frame) {
-		struct vidsz sz;
-
-		/* Use size if configured, or else 20% of main window */
-		if (selfview_size.w && selfview_size.h) {
-			sz = selfview_size;
-		}
-		else {
-			sz.w = frame->size.w / 5;
-			sz.h = frame->size.h / 5;
-		}
-
-		err = vidframe_alloc(&selfview->frame, VID_FMT_YUV420P, &sz);
+	/* Use size if configured, or else 20% of main window */
+	if (selfview_size.w && selfview_size.h) {
+		sz = selfview_size;
 	}
-	if (!err)
-		vidconv(selfview->frame, frame, NULL);
+	else {
+		sz.w = frame->size.w / 5;
+		sz.h = frame->size.h / 5;
+	}
+
+	/* Convert outside of the lock, and swap in the new frame */
+	err = vidpool_get(selfview->pool, &sv_frame, VID_FMT_YUV420P, &sz);
+	if (err)
+		return err;
+
+	vidconv(sv_frame, frame, NULL);
+
+	lock_write_get(selfview->lock);
+	mem_deref(selfview->frame);
+	selfview->frame = sv_frame;
 	lock_rel(selfview->lock);
 
-	return err;
+	return 0;
 }
 
 
@@ -212,17 +226,23 @@ static int decode_pip(struct vidfilt_dec_st *st, struct vidframe *frame,
 {
 	struct selfview_dec *dec = (struct selfview_dec *)st;
 	struct selfview *sv = dec->selfview;
+	struct vidframe *sv_frame;
 	(void)timestamp;
 
 	if (!frame)
 		return 0;
 
-	lock_read_get(sv->lock);
-	if (sv->frame) {
+	/* The references of the frame are not atomic, and the encoder
+	 * releases the frame from another thread */
+	lock_write_get(sv->lock);
+	sv_frame = mem_ref(sv->frame);
+	lock_rel(sv->lock);
+
+	if (sv_frame) {
 		struct vidrect rect;
 
-		rect.w = min(sv->frame->size.w, frame->size.w/2);
-		rect.h = min(sv->frame->size.h, frame->size.h/2);
+		rect.w = min(sv_frame->size.w, frame->size.w/2);
+		rect.h = min(sv_frame->size.h, frame->size.h/2);
 		if (rect.w <= (frame->size.w - 10))
 			rect.x = frame->size.w - rect.w - 10;
 		else
@@ -232,23 +252,27 @@ static int decode_pip(struct vidfilt_dec_st *st, struct vidframe *frame,
 		else
 			rect.y = frame->size.h/2;
 
-		vidconv(frame, sv->frame, &rect);
+		vidconv(frame, sv_frame, &rect);
 
 		vidframe_draw_rect(frame, rect.x, rect.y, rect.w, rect.h,
 				   127, 127, 127);
+
+		lock_write_get(sv->lock);
+		mem_deref(sv_frame);
+		lock_rel(sv->lock);
 	}
-	lock_rel(sv->lock);
 
 	return 0;
 }
 
 
 static struct vidfilt selfview_win = {
-	LE_INIT, "selfview_window", encode_update, encode_win, NULL, NULL
+	LE_INIT, "selfview_window", encode_update, encode_win, NULL, NULL,
+	false
 };
 static struct vidfilt selfview_pip = {
 	LE_INIT, "selfview_pip",
-	encode_update, encode_pip, decode_update, decode_pip
+	encode_update, encode_pip, decode_update, decode_pip, false
 };
 
 
@@ -256,14 +280,15 @@ static int module_init(void)
 {
 	struct pl pl = PL("pip");
 
-	(void)conf_get(conf_cur(), "video_selfview", &pl);
+	(void)confidx_get(conf_cur_index(), "video_selfview", &pl);
 
 	if (0 == pl_strcasecmp(&pl, "window"))
 		vidfilt_register(baresip_vidfiltl(), &selfview_win);
 	else if (0 == pl_strcasecmp(&pl, "pip"))
 		vidfilt_register(baresip_vidfiltl(), &selfview_pip);
 
-	(void)conf_get_vidsz(conf_cur(), "selfview_size", &selfview_size);
+	(void)confidx_get_vidsz(conf_cur_index(), "selfview_size",
+				&selfview_size);
 
 	return 0;
 }
@@ -5,7 +5,7 @@
 #
 
 MOD		:= sndfile
-$(MOD)_SRCS	+= sndfile.c
+$(MOD)_SRCS	+= sndfile.c rec.c
 $(MOD)_LFLAGS	+= -lsndfile
 
 include mk/mod.mk
@@ -0,0 +1,933 @@
+/**
+ * @file rec.c  Audio dumper using libsndfile -- recording engine
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <sndfile.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "sndfile.h"
+
+
+/*
+ * The audio filter callbacks run on the real-time audio threads, and
+ * only copy the samples into a lock-free ring buffer for each
+ * direction, with a single producer and a single consumer. A pool of
+ * writer threads drains the ring buffers and writes to disk in
+ * batches. If a ring buffer is full the frame is dropped and counted.
+ *
+ * Each frame is placed on a timeline that is shared by both
+ * directions, using the time when the filter got the samples. A gap
+ * in the timeline, such as a late start, a pause in the RTP stream or
+ * a dropped frame, is written as silence, so that the channels of a
+ * stereo file stay aligned.
+ *
+ * The list of recordings is protected by a read-write lock. A writer
+ * thread takes a snapshot of its recordings with the read lock, and
+ * writes to disk without the lock. A recording belongs to one writer,
+ * which also writes the rest of it and closes the files when the call
+ * releases the recording, and then removes it from the list.
+ */
+
+
+enum {
+	MAX_WRITERS = 8,
+	RING_MS     = 2000,   /* ring buffer size in [ms]               */
+	WRITE_MS    = 40,     /* batch interval of the writers in [ms]  */
+	LAG_MS      = 200,    /* max lag between the directions [ms]    */
+	JITTER_MS   = 60,     /* jitter that is not a gap [ms]          */
+	CHUNK_SAMP  = 4096,   /* samples per channel in one write       */
+};
+
+
+/** Lock-free ring buffer with a single producer and a single consumer */
+struct ring {
+	uint8_t *buf;
+	size_t size;          /**< Size in [bytes], power of two        */
+	size_t head;          /**< Write position, set by the producer  */
+	size_t tail;          /**< Read position, set by the consumer   */
+	uint64_t drops;       /**< Dropped frames                       */
+};
+
+/** Header of a frame in the ring buffer */
+struct frame {
+	uint64_t gap;         /**< Silence before the frame [samples]   */
+	uint64_t n;           /**< Samples per channel                  */
+};
+
+/** Timeline of one direction, in samples per channel */
+struct track {
+	uint64_t end;         /**< End of the pushed frames, producer   */
+	uint64_t done;        /**< Position of the consumer             */
+	uint64_t gap;         /**< Silence left before the frame        */
+	uint64_t left;        /**< Samples left in the frame            */
+	uint64_t skip;        /**< Silence written ahead of the track   */
+};
+
+/** Recording of one call, freed by its writer thread */
+struct recording {
+	struct le le;
+	struct le wle;                     /**< Entry in a snapshot     */
+	const struct audio *au;            /**< Recorded audio stream   */
+	unsigned id;                       /**< Recording identifier    */
+	struct ring ringv[REC_DIR_MAX];    /**< Samples per direction   */
+	struct track trackv[REC_DIR_MAX];  /**< Timeline per direction  */
+	uint64_t t0;                       /**< Start of timeline [us]  */
+	uint64_t base;                     /**< Timeline position at t0 */
+	struct aufilt_prm prmv[REC_DIR_MAX];
+	bool dirv[REC_DIR_MAX];            /**< Direction is set up     */
+	bool wdirv[REC_DIR_MAX];           /**< Directions of a writer  */
+	SNDFILE *sfv[REC_DIR_MAX];         /**< Files, one if stereo    */
+	char filev[REC_DIR_MAX][256];      /**< Filenames               */
+	uint64_t framev[REC_DIR_MAX];      /**< Samples written         */
+	bool active;                       /**< Recording is on         */
+	bool opened;                       /**< Files are opened        */
+	bool stereo;                       /**< One file, both dirs     */
+	bool closing;                      /**< Released by the call    */
+	bool wclosing;                     /**< Closing, for the writer */
+	uint8_t *bufv[3];                  /**< Scratch buffers         */
+};
+
+/** Recording of a call, shared by its audio filters */
+struct rec {
+	struct recording *r;
+};
+
+static struct {
+	struct rec_conf conf;
+	struct list recl;                  /**< struct recording        */
+	struct lock *lock;                 /**< Protects the list       */
+	pthread_t threadv[MAX_WRITERS];
+	uint32_t threadc;
+	bool run;
+	unsigned id;
+} eng;
+
+
+static size_t ring_used(const struct ring *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
+
+
+static void ring_copy(struct ring *r, size_t at, const void *p, size_t n)
+{
+	size_t pos  = at & (r->size - 1);
+	size_t part = min(n, r->size - pos);
+
+	memcpy(r->buf + pos, p, part);
+	memcpy(r->buf, (const uint8_t *)p + part, n - part);
+}
+
+
+/* Write a frame header and the samples, or nothing if there is no room */
+static bool ring_write(struct ring *r, const struct frame *f,
+		       const void *p, size_t n)
+{
+	size_t head = r->head;
+	size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	if (r->size - (head - tail) < sizeof(*f) + n)
+		return false;
+
+	ring_copy(r, head, f, sizeof(*f));
+	ring_copy(r, head + sizeof(*f), p, n);
+
+	__atomic_store_n(&r->head, head + sizeof(*f) + n, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+static void ring_read(struct ring *r, void *p, size_t n)
+{
+	size_t pos  = r->tail & (r->size - 1);
+	size_t part = min(n, r->size - pos);
+
+	memcpy(p, r->buf + pos, part);
+	memcpy((uint8_t *)p + part, r->buf, n - part);
+
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+
+/* Samples per channel that can be read from a direction */
+static uint64_t track_used(const struct recording *rec, enum rec_dir dir)
+{
+	const struct track *t = &rec->trackv[dir];
+
+	return __atomic_load_n(&t->end, __ATOMIC_ACQUIRE) - t->done;
+}
+
+
+/*
+ * Read up to n samples per channel from a direction, with the gaps as
+ * silence. Silence that was written ahead of the track, while the
+ * direction was lagging, is taken from the next gap.
+ */
+static size_t track_read(struct recording *rec, enum rec_dir dir,
+			 uint8_t *p, size_t n)
+{
+	const struct aufilt_prm *prm = &rec->prmv[dir];
+	const size_t fsz = prm->ch * aufmt_sample_size(prm->fmt);
+	struct ring *r = &rec->ringv[dir];
+	struct track *t = &rec->trackv[dir];
+	size_t done = 0;
+
+	while (done < n) {
+
+		size_t k;
+
+		if (!t->gap && !t->left) {
+
+			struct frame f;
+
+			if (!track_used(rec, dir))
+				break;
+
+			ring_read(r, &f, sizeof(f));
+
+			k = (size_t)min(f.gap, t->skip);
+
+			t->skip -= k;
+			t->done += k;
+			t->gap   = f.gap - k;
+			t->left  = f.n;
+			continue;
+		}
+
+		if (t->gap) {
+			k = (size_t)min(t->gap, (uint64_t)(n - done));
+			memset(p + done * fsz, 0, k * fsz);
+			t->gap -= k;
+		}
+		else {
+			k = (size_t)min(t->left, (uint64_t)(n - done));
+			ring_read(r, p + done * fsz, k * fsz);
+			t->left -= k;
+		}
+
+		t->done += k;
+		done    += k;
+	}
+
+	return done;
+}
+
+
+/*
+ * Position of a frame on the timeline, from the time of its last
+ * sample. The first frame of either direction starts the timeline.
+ */
+static uint64_t timeline_pos(struct recording *rec, uint64_t ts,
+			     uint32_t srate, uint64_t n)
+{
+	uint64_t t0 = __atomic_load_n(&rec->t0, __ATOMIC_ACQUIRE);
+	uint64_t start = ts - min(ts, n * 1000000 / srate);
+
+	if (!t0) {
+		if (__atomic_compare_exchange_n(&rec->t0, &t0, start, false,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			t0 = start;
+	}
+
+	return __atomic_load_n(&rec->base, __ATOMIC_ACQUIRE) +
+		(start > t0 ? (start - t0) * srate / 1000000 : 0);
+}
+
+
+static int timestamp_print(struct re_printf *pf, const struct tm *tm)
+{
+	if (!tm)
+		return 0;
+
+	return re_hprintf(pf, "%d-%02d-%02d-%02d-%02d-%02d",
+			  1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
+			  tm->tm_hour, tm->tm_min, tm->tm_sec);
+}
+
+
+static int sf_format(enum rec_format format, enum aufmt fmt)
+{
+	switch (format) {
+
+	case REC_FLAC:
+		return SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+
+#ifdef SF_FORMAT_OPUS
+	case REC_OPUS:
+		return SF_FORMAT_OGG | SF_FORMAT_OPUS;
+#endif
+
+	default:
+		break;
+	}
+
+	switch (fmt) {
+
+	case AUFMT_S16LE:  return SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+	case AUFMT_FLOAT:  return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+	default:           return 0;
+	}
+}
+
+
+static const char *file_ext(enum rec_format format)
+{
+	switch (format) {
+
+	case REC_FLAC:  return "flac";
+	case REC_OPUS:  return "opus";
+	default:        return "wav";
+	}
+}
+
+
+static SNDFILE *openfile(struct recording *rec, enum rec_dir dir,
+			 const char *name, uint8_t ch)
+{
+	const struct aufilt_prm *prm = &rec->prmv[dir];
+	char *filename = rec->filev[dir];
+	time_t tnow = time(0);
+	struct tm *tm = localtime(&tnow);
+	SF_INFO sfinfo;
+	SNDFILE *sf;
+
+	(void)re_snprintf(filename, sizeof(rec->filev[dir]),
+			  "%s/dump-%H-%u-%s.%s", eng.conf.path,
+			  timestamp_print, tm, rec->id, name,
+			  file_ext(eng.conf.format));
+
+	sfinfo.samplerate = prm->srate;
+	sfinfo.channels   = ch;
+	sfinfo.format     = sf_format(eng.conf.format, prm->fmt);
+
+	sf = sf_open(filename, SFM_WRITE, &sfinfo);
+	if (!sf) {
+		warning("sndfile: could not open: %s (%s)\n",
+			filename, sf_strerror(NULL));
+		filename[0] = '\0';
+		return NULL;
+	}
+
+	info("sndfile: dumping %s audio to %s\n", name, filename);
+
+	return sf;
+}
+
+
+static bool can_mix(const struct recording *rec)
+{
+	const struct aufilt_prm *enc = &rec->prmv[REC_ENC];
+	const struct aufilt_prm *dec = &rec->prmv[REC_DEC];
+
+	return rec->wdirv[REC_ENC] && rec->wdirv[REC_DEC] &&
+		enc->ch == 1 && dec->ch == 1 &&
+		enc->srate == dec->srate && enc->fmt == dec->fmt;
+}
+
+
+static void open_files(struct recording *rec)
+{
+	unsigned i;
+
+	rec->opened = true;
+
+	if (eng.conf.stereo && can_mix(rec)) {
+
+		rec->stereo = true;
+		rec->sfv[REC_ENC] = openfile(rec, REC_ENC, "call", 2);
+		return;
+	}
+
+	if (eng.conf.stereo) {
+		warning("sndfile: cannot mix the directions,"
+			" using one file for each\n");
+	}
+
+	for (i=0; i<REC_DIR_MAX; i++) {
+		if (rec->wdirv[i]) {
+			rec->sfv[i] = openfile(rec, i,
+					       i == REC_ENC ? "enc" : "dec",
+					       rec->prmv[i].ch);
+		}
+	}
+}
+
+
+static void sf_write_samp(SNDFILE *sf, enum aufmt fmt,
+			  const void *sampv, size_t sampc)
+{
+	if (fmt == AUFMT_FLOAT)
+		(void)sf_write_float(sf, sampv, sampc);
+	else
+		(void)sf_write_short(sf, sampv, sampc);
+}
+
+
+static void write_mono(struct recording *rec, enum rec_dir dir)
+{
+	const struct aufilt_prm *prm = &rec->prmv[dir];
+	size_t n;
+
+	while ((n = track_read(rec, dir, rec->bufv[0],
+			       2 * CHUNK_SAMP / prm->ch))) {
+
+		if (!rec->sfv[dir])
+			continue;
+
+		sf_write_samp(rec->sfv[dir], prm->fmt, rec->bufv[0],
+			      n * prm->ch);
+
+		rec->framev[dir] += n * prm->ch;
+	}
+}
+
+
+/*
+ * Both directions are interleaved into one stereo file. A direction
+ * that has no samples, or that lags behind, is filled with silence.
+ */
+static void write_stereo(struct recording *rec, bool final)
+{
+	enum aufmt fmt = rec->prmv[REC_ENC].fmt;
+	size_t ssz = aufmt_sample_size(fmt);
+	uint64_t lag = rec->prmv[REC_ENC].srate * LAG_MS / 1000;
+	uint64_t a = track_used(rec, REC_ENC);
+	uint64_t b = track_used(rec, REC_DEC);
+	uint64_t n = min(a, b);
+
+	if (final)
+		n = max(a, b);
+	else if (max(a, b) > n + lag)
+		n = max(a, b) - lag;
+
+	while (n) {
+
+		size_t k = (size_t)min(n, (uint64_t)CHUNK_SAMP);
+		size_t ka, kb, i;
+
+		memset(rec->bufv[0], 0, k * ssz);
+		memset(rec->bufv[1], 0, k * ssz);
+
+		ka = track_read(rec, REC_ENC, rec->bufv[0], k);
+		kb = track_read(rec, REC_DEC, rec->bufv[1], k);
+
+		/* the silence is taken from the next gap of the track */
+		rec->trackv[REC_ENC].skip += k - ka;
+		rec->trackv[REC_DEC].skip += k - kb;
+
+		for (i=0; i<k; i++) {
+			memcpy(rec->bufv[2] + (2*i) * ssz,
+			       rec->bufv[0] + i * ssz, ssz);
+			memcpy(rec->bufv[2] + (2*i + 1) * ssz,
+			       rec->bufv[1] + i * ssz, ssz);
+		}
+
+		if (rec->sfv[REC_ENC]) {
+			sf_write_samp(rec->sfv[REC_ENC], fmt,
+				      rec->bufv[2], 2 * k);
+			rec->framev[REC_ENC] += ka;
+			rec->framev[REC_DEC] += kb;
+		}
+
+		n -= k;
+	}
+}
+
+
+static void rec_flush(struct recording *rec, bool final)
+{
+	unsigned i;
+
+	if (!rec->opened) {
+
+		if (!ring_used(&rec->ringv[REC_ENC]) &&
+		    !ring_used(&rec->ringv[REC_DEC]))
+			return;
+
+		open_files(rec);
+	}
+
+	if (rec->stereo) {
+		write_stereo(rec, final);
+		return;
+	}
+
+	for (i=0; i<REC_DIR_MAX; i++) {
+		if (rec->wdirv[i])
+			write_mono(rec, i);
+	}
+}
+
+
+/* The rest is written, and the files are closed */
+static void rec_close(struct recording *rec)
+{
+	unsigned i;
+
+	rec_flush(rec, true);
+
+	for (i=0; i<REC_DIR_MAX; i++) {
+
+		if (rec->sfv[i])
+			sf_close(rec->sfv[i]);
+
+		rec->sfv[i] = NULL;
+
+		if (rec->ringv[i].drops) {
+			warning("sndfile: %s: %llu frames dropped\n",
+				i == REC_ENC ? "enc" : "dec",
+				rec->ringv[i].drops);
+		}
+	}
+}
+
+
+/*
+ * Write the recordings of one writer thread
+ *
+ * @return True if a ring buffer is more than half full
+ */
+static bool writer_pass(unsigned idx)
+{
+	struct list snap = LIST_INIT;
+	bool busy = false;
+	struct le *le;
+
+	/* only this thread references its recordings */
+	lock_read_get(eng.lock);
+
+	for (le = eng.recl.head; le; le = le->next) {
+
+		struct recording *rec = le->data;
+
+		if (rec->id % eng.threadc != idx)
+			continue;
+
+		memcpy(rec->wdirv, rec->dirv, sizeof(rec->wdirv));
+		rec->wclosing = rec->closing;
+
+		list_append(&snap, &rec->wle, mem_ref(rec));
+	}
+
+	lock_rel(eng.lock);
+
+	for (le = snap.head; le; le = le->next) {
+
+		struct recording *rec = le->data;
+		unsigned i;
+
+		if (rec->wclosing) {
+			rec_close(rec);
+
+			lock_write_get(eng.lock);
+			list_unlink(&rec->le);
+			lock_rel(eng.lock);
+
+			mem_deref(rec);
+			continue;
+		}
+
+		/* backpressure: write again without a pause */
+		for (i=0; i<REC_DIR_MAX; i++) {
+			const struct ring *r = &rec->ringv[i];
+
+			if (r->size && ring_used(r) > r->size / 2)
+				busy = true;
+		}
+
+		rec_flush(rec, false);
+	}
+
+	list_flush(&snap);
+
+	return busy;
+}
+
+
+static void *writer_thread(void *arg)
+{
+	unsigned idx = (unsigned)(size_t)arg;
+
+	for (;;) {
+
+		bool run = __atomic_load_n(&eng.run, __ATOMIC_ACQUIRE);
+		bool busy;
+
+		/* the released recordings are closed before exit */
+		busy = writer_pass(idx);
+
+		if (!run)
+			break;
+
+		if (!busy)
+			sys_msleep(WRITE_MS);
+	}
+
+	return NULL;
+}
+
+
+static void recording_destructor(void *arg)
+{
+	struct recording *rec = arg;
+	unsigned i;
+
+	for (i=0; i<REC_DIR_MAX; i++)
+		mem_deref(rec->ringv[i].buf);
+
+	for (i=0; i<ARRAY_SIZE(rec->bufv); i++)
+		mem_deref(rec->bufv[i]);
+}
+
+
+/* The audio threads are stopped, the writer closes the recording */
+static void destructor(void *arg)
+{
+	struct rec *rec = arg;
+
+	if (!rec->r)
+		return;
+
+	lock_write_get(eng.lock);
+	rec->r->closing = true;
+	lock_rel(eng.lock);
+}
+
+
+/**
+ * Allocate a recording for an audio stream
+ *
+ * @param recp Pointer to allocated recording
+ * @param au   Audio stream
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rec_alloc(struct rec **recp, const struct audio *au)
+{
+	struct recording *r;
+	struct rec *rec;
+	unsigned i;
+
+	if (!recp)
+		return EINVAL;
+
+	rec = mem_zalloc(sizeof(*rec), destructor);
+	if (!rec)
+		return ENOMEM;
+
+	r = mem_zalloc(sizeof(*r), recording_destructor);
+	if (!r) {
+		mem_deref(rec);
+		return ENOMEM;
+	}
+
+	r->au     = au;
+	r->id     = ++eng.id;
+	r->active = eng.conf.autostart;
+
+	/* room for one chunk of stereo float samples */
+	for (i=0; i<ARRAY_SIZE(r->bufv); i++) {
+		r->bufv[i] = mem_alloc(2 * CHUNK_SAMP * sizeof(float), NULL);
+		if (!r->bufv[i]) {
+			mem_deref(r);
+			mem_deref(rec);
+			return ENOMEM;
+		}
+	}
+
+	/* the list has the reference, and the writer frees it */
+	lock_write_get(eng.lock);
+	list_append(&eng.recl, &r->le, r);
+	lock_rel(eng.lock);
+
+	rec->r = r;
+	*recp = rec;
+
+	return 0;
+}
+
+
+/**
+ * Set up one direction of a recording
+ *
+ * @param rec Recording
+ * @param dir Direction
+ * @param prm Audio filter parameters of the direction
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rec_dir_init(struct rec *rec, enum rec_dir dir,
+		 const struct aufilt_prm *prm)
+{
+	struct recording *rs;
+	struct ring *r;
+	size_t size = 1;
+	size_t need, ssz;
+
+	if (!rec || dir >= REC_DIR_MAX || !prm || !prm->srate || !prm->ch)
+		return EINVAL;
+
+	ssz = aufmt_sample_size(prm->fmt);
+	if (prm->fmt != AUFMT_S16LE && prm->fmt != AUFMT_FLOAT) {
+		warning("sndfile: sample format not supported (%s)\n",
+			aufmt_name(prm->fmt));
+		return ENOTSUP;
+	}
+
+	rs = rec->r;
+
+	if (rs->dirv[dir])
+		return EALREADY;
+
+	/* the samples and the frame headers */
+	need  = prm->srate * prm->ch * ssz * RING_MS / 1000;
+	need += sizeof(struct frame) * RING_MS / max(prm->ptime, 1U);
+
+	while (size < need)
+		size <<= 1;
+
+	r = &rs->ringv[dir];
+
+	lock_write_get(eng.lock);
+
+	r->buf = mem_alloc(size, NULL);
+	if (r->buf) {
+		r->size = size;
+		rs->prmv[dir] = *prm;
+		rs->dirv[dir] = true;
+	}
+
+	lock_rel(eng.lock);
+
+	return r->buf ? 0 : ENOMEM;
+}
+
+
+/**
+ * Copy audio samples to a recording
+ *
+ * @param rec   Recording
+ * @param dir   Direction
+ * @param sampv Audio samples
+ * @param sampc Number of samples
+ * @param ts    Time of the last sample in [us]
+ *
+ * @note This function has REAL-TIME properties
+ */
+void rec_push(struct rec *rec, enum rec_dir dir,
+	      const void *sampv, size_t sampc, uint64_t ts)
+{
+	const struct aufilt_prm *prm;
+	struct recording *rs;
+	struct track *t;
+	struct ring *r;
+	struct frame f;
+	uint64_t start, tol;
+
+	if (!rec || !rec->r->dirv[dir])
+		return;
+
+	rs = rec->r;
+
+	if (!__atomic_load_n(&rs->active, __ATOMIC_ACQUIRE))
+		return;
+
+	prm = &rs->prmv[dir];
+	r   = &rs->ringv[dir];
+	t   = &rs->trackv[dir];
+
+	f.n = sampc / prm->ch;
+	if (!f.n)
+		return;
+
+	start = timeline_pos(rs, ts, prm->srate, f.n);
+	tol   = prm->srate * JITTER_MS / 1000;
+
+	f.gap = start > t->end + tol ? start - t->end : 0;
+
+	if (!ring_write(r, &f, sampv,
+			f.n * prm->ch * aufmt_sample_size(prm->fmt))) {
+		__atomic_add_fetch(&r->drops, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	__atomic_store_n(&t->end, t->end + f.gap + f.n, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Start or stop the recording of an audio stream
+ *
+ * @param au     Audio stream
+ * @param active True to start, false to stop
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rec_set_active(const struct audio *au, bool active)
+{
+	struct le *le;
+	int err = ENOENT;
+
+	lock_read_get(eng.lock);
+
+	for (le = eng.recl.head; le; le = le->next) {
+
+		struct recording *rec = le->data;
+
+		if (rec->au != au || rec->closing)
+			continue;
+
+		/* the timeline continues after a pause */
+		if (active && !rec->active) {
+
+			const struct track *tv = rec->trackv;
+			uint64_t end;
+
+			end = max(__atomic_load_n(&tv[REC_ENC].end,
+						  __ATOMIC_ACQUIRE),
+				  __atomic_load_n(&tv[REC_DEC].end,
+						  __ATOMIC_ACQUIRE));
+
+			__atomic_store_n(&rec->base, end, __ATOMIC_RELEASE);
+			__atomic_store_n(&rec->t0, 0, __ATOMIC_RELEASE);
+		}
+
+		__atomic_store_n(&rec->active, active, __ATOMIC_RELEASE);
+
+		err = 0;
+		break;
+	}
+
+	lock_rel(eng.lock);
+
+	return err;
+}
+
+
+/**
+ * Print the status of all recordings
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rec_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err;
+
+	(void)unused;
+
+	lock_read_get(eng.lock);
+
+	err = re_hprintf(pf, "--- sndfile: %u recordings, %u writers ---\n",
+			 list_count(&eng.recl), eng.threadc);
+
+	for (le = eng.recl.head; le; le = le->next) {
+
+		const struct recording *rec = le->data;
+		unsigned i;
+
+		err |= re_hprintf(pf, " #%u %s%s\n", rec->id,
+				  rec->active ? "recording" : "stopped",
+				  rec->stereo ? " (stereo)" : "");
+
+		for (i=0; i<REC_DIR_MAX; i++) {
+
+			const struct ring *r = &rec->ringv[i];
+
+			if (!rec->dirv[i])
+				continue;
+
+			err |= re_hprintf(pf, "   %s: %llu samples,"
+					  " ring %zu/%zu bytes,"
+					  " %llu dropped  %s\n",
+					  i == REC_ENC ? "enc" : "dec",
+					  rec->framev[i], ring_used(r),
+					  r->size,
+					  __atomic_load_n(&r->drops,
+							  __ATOMIC_RELAXED),
+					  rec->filev[i]);
+		}
+	}
+
+	lock_rel(eng.lock);
+
+	return err;
+}
+
+
+/**
+ * Start the writer threads
+ *
+ * @param conf Recording configuration
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rec_engine_init(const struct rec_conf *conf)
+{
+	uint32_t i;
+	int err;
+
+	if (!conf)
+		return EINVAL;
+
+	eng.conf = *conf;
+	eng.conf.writers = min(max(conf->writers, 1), MAX_WRITERS);
+
+	err = lock_alloc(&eng.lock);
+	if (err)
+		return err;
+
+	eng.run = true;
+
+	/* the writers wait until the number of threads is known */
+	lock_write_get(eng.lock);
+
+	for (i=0; i<eng.conf.writers; i++) {
+
+		err = pthread_create(&eng.threadv[i], NULL, writer_thread,
+				     (void *)(size_t)i);
+		if (err)
+			break;
+
+		++eng.threadc;
+	}
+
+	lock_rel(eng.lock);
+
+	if (!eng.threadc) {
+		eng.run  = false;
+		eng.lock = mem_deref(eng.lock);
+		return err;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Stop the writer threads
+ */
+void rec_engine_close(void)
+{
+	uint32_t i;
+
+	__atomic_store_n(&eng.run, false, __ATOMIC_RELEASE);
+
+	for (i=0; i<eng.threadc; i++)
+		pthread_join(eng.threadv[i], NULL);
+
+	eng.threadc = 0;
+	eng.lock = mem_deref(eng.lock);
+}
@@ -4,10 +4,10 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <sndfile.h>
-#include <time.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
+#include "sndfile.h"
 
 
 /**
@@ -15,47 +15,48 @@
  *
  * Audio filter that writes audio samples to WAV-file
  *
+ * The samples are copied to a ring buffer on the audio thread, and
+ * written to disk by a pool of writer threads. Both directions can be
+ * mixed into one stereo file, with the transmitted audio on the left
+ * channel and the received audio on the right channel. The channels
+ * are aligned on the time when the samples were sent or received, and
+ * gaps in a direction are filled with silence.
+ *
  * Example Configuration:
  \verbatim
   snd_path 					/tmp/
+  snd_format		wav		# wav, flac, opus
+  snd_stereo		no
+  snd_autostart		yes
+  snd_writers		1
+ \endverbatim
+ *
+ * Commands:
+ *
+ \verbatim
+  sndrec [on|off]     Start or stop recording of the current call
+  sndstat             Call recording status
  \endverbatim
  */
 
 
 struct sndfile_enc {
 	struct aufilt_enc_st af;  /* base class */
-	SNDFILE *enc;
-	enum aufmt fmt;
+	struct rec *rec;
 };
 
 struct sndfile_dec {
 	struct aufilt_dec_st af;  /* base class */
-	SNDFILE *dec;
-	enum aufmt fmt;
+	struct rec *rec;
 };
 
-static char file_path[256] = ".";
-
-
-static int timestamp_print(struct re_printf *pf, const struct tm *tm)
-{
-	if (!tm)
-		return 0;
-
-	return re_hprintf(pf, "%d-%02d-%02d-%02d-%02d-%02d",
-			  1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
-			  tm->tm_hour, tm->tm_min, tm->tm_sec);
-}
-
 
 static void enc_destructor(void *arg)
 {
 	struct sndfile_enc *st = arg;
 
-	if (st->enc)
-		sf_close(st->enc);
-
 	list_unlink(&st->af.le);
+	mem_deref(st->rec);
 }
 
 
@@ -63,60 +64,20 @@ static void dec_destructor(void *arg)
 {
 	struct sndfile_dec *st = arg;
 
-	if (st->dec)
-		sf_close(st->dec);
-
 	list_unlink(&st->af.le);
+	mem_deref(st->rec);
 }
 
 
-static int get_format(enum aufmt fmt)
-{
-	switch (fmt) {
-
-	case AUFMT_S16LE:  return SF_FORMAT_PCM_16;
-	case AUFMT_FLOAT:  return SF_FORMAT_FLOAT;
-	default:           return 0;
-	}
-}
-
-
-static SNDFILE *openfile(const struct aufilt_prm *prm, bool enc)
+/* The encoder and decoder of one call share the recording */
+static int rec_get(struct rec **recp, void **ctx, const struct audio *au)
 {
-	char filename[128];
-	SF_INFO sfinfo;
-	time_t tnow = time(0);
-	struct tm *tm = localtime(&tnow);
-	SNDFILE *sf;
-	int format;
-
-	(void)re_snprintf(filename, sizeof(filename),
-			  "%s/dump-%H-%s.wav",
-				file_path,
-			  timestamp_print, tm, enc ? "enc" : "dec");
-
-	format = get_format(prm->fmt);
-	if (!format) {
-		warning("sndfile: sample format not supported (%s)\n",
-			aufmt_name(prm->fmt));
-		return NULL;
-	}
-
-	sfinfo.samplerate = prm->srate;
-	sfinfo.channels   = prm->ch;
-	sfinfo.format     = SF_FORMAT_WAV | format;
-
-	sf = sf_open(filename, SFM_WRITE, &sfinfo);
-	if (!sf) {
-		warning("sndfile: could not open: %s\n", filename);
-		puts(sf_strerror(NULL));
-		return NULL;
+	if (ctx && *ctx) {
+		*recp = mem_ref(*ctx);
+		return 0;
 	}
 
-	info("sndfile: dumping %s audio to %s\n",
-	     enc ? "encode" : "decode", filename);
-
-	return sf;
+	return rec_alloc(recp, au);
 }
 
 
@@ -125,24 +86,28 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 			 const struct audio *au)
 {
 	struct sndfile_enc *st;
-	int err = 0;
-	(void)ctx;
+	int err;
 	(void)af;
-	(void)au;
 
 	if (!stp || !prm)
 		return EINVAL;
 
 	st = mem_zalloc(sizeof(*st), enc_destructor);
 	if (!st)
-		return EINVAL;
+		return ENOMEM;
 
-	st->fmt = prm->fmt;
+	err = rec_get(&st->rec, ctx, au);
+	if (err)
+		goto out;
 
-	st->enc = openfile(prm, true);
-	if (!st->enc)
-		err = ENOMEM;
+	err = rec_dir_init(st->rec, REC_ENC, prm);
+	if (err)
+		goto out;
+
+	if (ctx)
+		*ctx = st->rec;
 
+ out:
 	if (err)
 		mem_deref(st);
 	else
@@ -157,24 +122,28 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 			 const struct audio *au)
 {
 	struct sndfile_dec *st;
-	int err = 0;
-	(void)ctx;
+	int err;
 	(void)af;
-	(void)au;
 
 	if (!stp || !prm)
 		return EINVAL;
 
 	st = mem_zalloc(sizeof(*st), dec_destructor);
 	if (!st)
-		return EINVAL;
+		return ENOMEM;
 
-	st->fmt = prm->fmt;
+	err = rec_get(&st->rec, ctx, au);
+	if (err)
+		goto out;
+
+	err = rec_dir_init(st->rec, REC_DEC, prm);
+	if (err)
+		goto out;
 
-	st->dec = openfile(prm, false);
-	if (!st->dec)
-		err = ENOMEM;
+	if (ctx)
+		*ctx = st->rec;
 
+ out:
 	if (err)
 		mem_deref(st);
 	else
@@ -187,14 +156,11 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 static int encode(struct aufilt_enc_st *st, void *sampv, size_t *sampc)
 {
 	struct sndfile_enc *sf = (struct sndfile_enc *)st;
-	size_t num_bytes;
 
 	if (!st || !sampv || !sampc)
 		return EINVAL;
 
-	num_bytes = *sampc * aufmt_sample_size(sf->fmt);
-
-	sf_write_raw(sf->enc, sampv, num_bytes);
+	rec_push(sf->rec, REC_ENC, sampv, *sampc, tmr_jiffies_usec());
 
 	return 0;
 }
@@ -203,19 +169,57 @@ static int encode(struct aufilt_enc_st *st, void *sampv, size_t *sampc)
 static int decode(struct aufilt_dec_st *st, void *sampv, size_t *sampc)
 {
 	struct sndfile_dec *sf = (struct sndfile_dec *)st;
-	size_t num_bytes;
 
 	if (!st || !sampv || !sampc)
 		return EINVAL;
 
-	num_bytes = *sampc * aufmt_sample_size(sf->fmt);
-
-	sf_write_raw(sf->dec, sampv, num_bytes);
+	rec_push(sf->rec, REC_DEC, sampv, *sampc, tmr_jiffies_usec());
 
 	return 0;
 }
 
 
+static int cmd_record(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct call *call;
+	bool active;
+	int err;
+
+	call = ua_call(uag_current());
+	if (!call)
+		return re_hprintf(pf, "sndfile: no active call\n");
+
+	if (!str_isset(carg->prm)) {
+		active = true;
+	}
+	else if (0 == str_casecmp(carg->prm, "on")) {
+		active = true;
+	}
+	else if (0 == str_casecmp(carg->prm, "off")) {
+		active = false;
+	}
+	else {
+		return re_hprintf(pf, "usage: sndrec [on|off]\n");
+	}
+
+	err = rec_set_active(call_audio(call), active);
+	if (err) {
+		return re_hprintf(pf, "sndfile: call is not recorded (%m)\n",
+				  err);
+	}
+
+	return re_hprintf(pf, "sndfile: recording %s\n",
+			  active ? "started" : "stopped");
+}
+
+
+static const struct cmd cmdv[] = {
+	{"sndrec",  0, CMD_PRM, "Record current call <on|off>", cmd_record },
+	{"sndstat", 0,       0, "Call recording status",        rec_debug  },
+};
+
+
 static struct aufilt sndfile = {
 	LE_INIT, "sndfile", encode_update, encode, decode_update, decode
 };
@@ -223,11 +227,45 @@ static struct aufilt sndfile = {
 
 static int module_init(void)
 {
-	aufilt_register(baresip_aufiltl(), &sndfile);
+	struct rec_conf conf = {
+		.path      = ".",
+		.format    = REC_WAV,
+		.stereo    = false,
+		.autostart = true,
+		.writers   = 1,
+	};
+	struct pl fmt;
+	int err;
+
+	confidx_get_str(conf_cur_index(), "snd_path",
+			conf.path, sizeof(conf.path));
+	confidx_get_bool(conf_cur_index(), "snd_stereo", &conf.stereo);
+	confidx_get_bool(conf_cur_index(), "snd_autostart", &conf.autostart);
+	confidx_get_u32(conf_cur_index(), "snd_writers", &conf.writers);
+
+	if (0 == confidx_get(conf_cur_index(), "snd_format", &fmt)) {
+
+		if (0 == pl_strcasecmp(&fmt, "flac"))
+			conf.format = REC_FLAC;
+#ifdef SF_FORMAT_OPUS
+		else if (0 == pl_strcasecmp(&fmt, "opus"))
+			conf.format = REC_OPUS;
+#endif
+		else if (pl_strcasecmp(&fmt, "wav"))
+			warning("sndfile: format not supported (%r)\n", &fmt);
+	}
 
-	conf_get_str(conf_cur(), "snd_path", file_path, sizeof(file_path));
+	err = rec_engine_init(&conf);
+	if (err)
+		return err;
 
-	info("sndfile: saving files in %s\n", file_path);
+	err = cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+	if (err)
+		return err;
+
+	aufilt_register(baresip_aufiltl(), &sndfile);
+
+	info("sndfile: saving files in %s\n", conf.path);
 
 	return 0;
 }
@@ -236,6 +274,9 @@ static int module_init(void)
 static int module_close(void)
 {
 	aufilt_unregister(&sndfile);
+	cmd_unregister(baresip_commands(), cmdv);
+	rec_engine_close();
+
 	return 0;
 }
 
@@ -0,0 +1,42 @@
+/**
+ * @file sndfile.h  Audio dumper using libsndfile -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+enum rec_dir {
+	REC_ENC = 0,
+	REC_DEC,
+	REC_DIR_MAX
+};
+
+/** Recording file format */
+enum rec_format {
+	REC_WAV = 0,
+	REC_FLAC,
+	REC_OPUS,
+};
+
+/** Recording configuration */
+struct rec_conf {
+	char path[256];           /**< Directory for the files        */
+	enum rec_format format;   /**< File format                    */
+	bool stereo;              /**< Mix both directions, L=tx R=rx */
+	bool autostart;           /**< Start recording with the call  */
+	uint32_t writers;         /**< Number of writer threads       */
+};
+
+struct rec;
+
+
+/* rec.c */
+int  rec_engine_init(const struct rec_conf *conf);
+void rec_engine_close(void);
+int  rec_alloc(struct rec **recp, const struct audio *au);
+int  rec_dir_init(struct rec *rec, enum rec_dir dir,
+		  const struct aufilt_prm *prm);
+void rec_push(struct rec *rec, enum rec_dir dir,
+	      const void *sampv, size_t sampc, uint64_t ts);
+int  rec_set_active(const struct audio *au, bool active);
+int  rec_debug(struct re_printf *pf, void *unused);
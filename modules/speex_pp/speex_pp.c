@@ -133,11 +133,11 @@ static int encode(struct aufilt_enc_st *st, void *sampv, size_t *sampc)
 }
 
 
-static void config_parse(struct conf *conf)
+static void config_parse(const struct confidx *conf)
 {
 	uint32_t v;
 
-	if (0 == conf_get_u32(conf, "speex_agc_level", &v))
+	if (0 == confidx_get_u32(conf, "speex_agc_level", &v))
 		pp_conf.agc_level = v;
 }
 
@@ -148,7 +148,7 @@ static struct aufilt preproc = {
 
 static int module_init(void)
 {
-	config_parse(conf_cur());
+	config_parse(conf_cur_index());
 	aufilt_register(baresip_aufiltl(), &preproc);
 	return 0;
 }
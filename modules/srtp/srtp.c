@@ -29,7 +29,7 @@ struct menc_st {
 	/* one SRTP session per media line */
 	uint8_t key_tx[32];
 	uint8_t key_rx[32];
-	struct srtp *srtp_tx, *srtp_rx;
+	struct srtpfast *srtp_tx, *srtp_rx;
 	bool use_srtp;
 	bool got_sdp;
 	char *crypto_suite;
@@ -152,17 +152,17 @@ static int start_srtp(struct menc_st *st, const char *suite_name)
 
 	/* allocate and initialize the SRTP session */
 	if (!st->srtp_tx) {
-		err = srtp_alloc(&st->srtp_tx, suite, st->key_tx, len, 0);
+		err = srtpfast_alloc(&st->srtp_tx, suite, st->key_tx, len);
 		if (err) {
-			warning("srtp: srtp_alloc TX failed (%m)\n", err);
+			warning("srtp: srtpfast_alloc TX failed (%m)\n", err);
 			return err;
 		}
 	}
 
 	if (!st->srtp_rx) {
-		err = srtp_alloc(&st->srtp_rx, suite, st->key_rx, len, 0);
+		err = srtpfast_alloc(&st->srtp_rx, suite, st->key_rx, len);
 		if (err) {
-			warning("srtp: srtp_alloc RX failed (%m)\n", err);
+			warning("srtp: srtpfast_alloc RX failed (%m)\n", err);
 			return err;
 		}
 	}
@@ -185,10 +185,10 @@ static bool send_handler(int *err, struct sa *dst, struct mbuf *mb, void *arg)
 		return false;
 
 	if (is_rtcp_packet(mb)) {
-		lerr = srtcp_encrypt(st->srtp_tx, mb);
+		lerr = srtcpfast_encrypt(st->srtp_tx, mb);
 	}
 	else {
-		lerr = srtp_encrypt(st->srtp_tx, mb);
+		lerr = srtpfast_encrypt(st->srtp_tx, mb);
 	}
 
 	if (lerr) {
@@ -218,14 +218,14 @@ static bool recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 		return false;
 
 	if (is_rtcp_packet(mb)) {
-		err = srtcp_decrypt(st->srtp_rx, mb);
+		err = srtcpfast_decrypt(st->srtp_rx, mb);
 		if (err) {
 			warning("srtp: failed to decrypt RTCP packet"
 				" with %zu bytes (%m)\n", len, err);
 		}
 	}
 	else {
-		err = srtp_decrypt(st->srtp_rx, mb);
+		err = srtpfast_decrypt(st->srtp_rx, mb);
 		if (err) {
 			warning("srtp: failed to decrypt RTP packet"
 				" with %zu bytes (%m)\n", len, err);
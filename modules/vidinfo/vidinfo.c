@@ -153,7 +153,8 @@ static int decode(struct vidfilt_dec_st *_st, struct vidframe *frame,
 
 
 static struct vidfilt vidinfo = {
-	LE_INIT, "vidinfo", encode_update, encode, decode_update, decode
+	LE_INIT, "vidinfo", encode_update, encode, decode_update, decode,
+	false
 };
 
 
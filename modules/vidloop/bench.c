@@ -0,0 +1,640 @@
+/**
+ * @file bench.c  Video loop -- headless codec benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "vidloop.h"
+
+
+/*
+ * The benchmark encodes frames from a synthetic video source, and
+ * decodes the packets directly, without a video display. The frames
+ * are encoded as fast as possible, or paced at the frame-rate.
+ *
+ * The results are printed on stdout as one JSON object per codec.
+ */
+
+
+enum {
+	MAX_CODECS  = 16,
+	PSNR_MAX    = 99,
+	DEFAULT_DUR = 10,
+};
+
+
+struct vidbench {
+	struct tmr tmr;                 /**< Frame timer                */
+	struct vidpool *pool;           /**< Frames for PSNR reference  */
+	char *codecv[MAX_CODECS];       /**< Codecs to benchmark        */
+	unsigned n_codec;               /**< Number of codecs           */
+	unsigned ix;                    /**< Current codec              */
+	struct vidsz size;              /**< Source resolution          */
+	double fps;                     /**< Source frame-rate          */
+	unsigned bitrate;               /**< Encoder bitrate [bit/s]    */
+	unsigned n_frames;              /**< Frames per codec           */
+	bool realtime;                  /**< Pace frames at frame-rate  */
+
+	/* state of the current codec */
+	const struct vidcodec *vc_enc;
+	const struct vidcodec *vc_dec;
+	struct videnc_state *enc;
+	struct viddec_state *dec;
+	struct vidframe *src;           /**< Source frame               */
+	struct vidframe *ref;           /**< Reference frame for PSNR   */
+	struct mbuf *mb;                /**< Packet buffer              */
+	uint16_t seq;                   /**< Packet sequence number     */
+	unsigned frame;                 /**< Frames encoded             */
+	unsigned n_dec;                 /**< Frames decoded             */
+	unsigned n_intra;               /**< Key frames decoded         */
+	uint64_t bytes;                 /**< Encoded bytes              */
+	uint64_t t_enc;                 /**< Total encode time [usec]   */
+	uint64_t t_dec;                 /**< Total decode time [usec]   */
+	uint64_t t_dec_frame;           /**< Decode time of frame       */
+	uint32_t *latv;                 /**< Frame latencies [usec]     */
+	double psnr_sum;                /**< Sum of frame PSNR          */
+	unsigned n_psnr;                /**< Frames compared            */
+	uint64_t ts_start;              /**< Start time [usec]          */
+	clock_t cpu_start;              /**< Start CPU time             */
+};
+
+
+static struct vidbench *gbench;
+
+
+static void codec_reset(struct vidbench *vb)
+{
+	tmr_cancel(&vb->tmr);
+
+	vb->enc  = mem_deref(vb->enc);
+	vb->dec  = mem_deref(vb->dec);
+	vb->src  = mem_deref(vb->src);
+	vb->ref  = mem_deref(vb->ref);
+	vb->latv = mem_deref(vb->latv);
+	vb->mb   = mem_deref(vb->mb);
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidbench *vb = arg;
+	unsigned i;
+
+	codec_reset(vb);
+
+	for (i=0; i<vb->n_codec; i++)
+		mem_deref(vb->codecv[i]);
+
+	mem_deref(vb->pool);
+}
+
+
+/* Moving diagonal bars and a moving square, frame n */
+static void synth_frame(struct vidframe *f, unsigned n)
+{
+	const unsigned w = f->size.w, h = f->size.h;
+	const unsigned sq = max(h / 8, 2);
+	const unsigned sx = (4 * n) % max(w - sq, 1);
+	const unsigned sy = (h - sq) / 2;
+	unsigned x, y;
+
+	for (y=0; y<h; y++) {
+
+		uint8_t *p = f->data[0] + y * f->linesize[0];
+
+		for (x=0; x<w; x++) {
+
+			if (x >= sx && x < sx + sq && y >= sy && y < sy + sq)
+				p[x] = 235;
+			else
+				p[x] = 16 + ((x + y + 2 * n) & 0x7f);
+		}
+	}
+
+	for (y=0; y<h/2; y++) {
+
+		uint8_t *u = f->data[1] + y * f->linesize[1];
+		uint8_t *v = f->data[2] + y * f->linesize[2];
+
+		for (x=0; x<w/2; x++) {
+			u[x] = 96 + ((x + n) & 0x3f);
+			v[x] = 96 + ((y + n) & 0x3f);
+		}
+	}
+}
+
+
+/* Luma PSNR of two YUV420P frames of the same size */
+static double psnr_y(const struct vidframe *a, const struct vidframe *b)
+{
+	const unsigned w = a->size.w, h = a->size.h;
+	uint64_t sse = 0;
+	double mse;
+	unsigned x, y;
+
+	for (y=0; y<h; y++) {
+
+		const uint8_t *pa = a->data[0] + y * a->linesize[0];
+		const uint8_t *pb = b->data[0] + y * b->linesize[0];
+
+		for (x=0; x<w; x++) {
+			const int d = pa[x] - pb[x];
+			sse += d * d;
+		}
+	}
+
+	if (!sse)
+		return PSNR_MAX;
+
+	mse = (double)sse / (w * h);
+
+	return min(10.0 * log10(255.0 * 255.0 / mse), PSNR_MAX);
+}
+
+
+static void compare_frame(struct vidbench *vb, const struct vidframe *frame,
+			  uint64_t rtp_ts)
+{
+	struct vidframe *f2 = NULL;
+	uint64_t timestamp;
+	unsigned n;
+
+	if (!vidsz_cmp(&frame->size, &vb->size))
+		return;
+
+	if (frame->fmt != VID_FMT_YUV420P) {
+
+		if (vidpool_get(vb->pool, &f2, VID_FMT_YUV420P, &frame->size))
+			return;
+
+		vidconv(f2, frame, NULL);
+		frame = f2;
+	}
+
+	/* the source is generated again from the frame number */
+	timestamp = video_calc_timebase_timestamp(rtp_ts);
+	n = (unsigned)((double)timestamp * vb->fps / VIDEO_TIMEBASE + 0.5);
+
+	synth_frame(vb->ref, n);
+
+	vb->psnr_sum += psnr_y(vb->ref, frame);
+	++vb->n_psnr;
+
+	mem_deref(f2);
+}
+
+
+static int packet_handler(bool marker, uint64_t rtp_ts,
+			  const uint8_t *hdr, size_t hdr_len,
+			  const uint8_t *pld, size_t pld_len,
+			  void *arg)
+{
+	struct vidbench *vb = arg;
+	struct vidframe frame;
+	uint64_t t0;
+	bool intra = false;
+	int err = 0;
+
+	vb->bytes += hdr_len + pld_len;
+
+	mbuf_rewind(vb->mb);
+	if (hdr_len)
+		err |= mbuf_write_mem(vb->mb, hdr, hdr_len);
+	err |= mbuf_write_mem(vb->mb, pld, pld_len);
+	if (err)
+		return err;
+
+	vb->mb->pos = 0;
+
+	frame.data[0] = NULL;
+
+	t0 = tmr_jiffies_usec();
+	err = vb->vc_dec->dech(vb->dec, &frame, &intra, marker, vb->seq++,
+			       vb->mb);
+	vb->t_dec_frame += tmr_jiffies_usec() - t0;
+
+	if (err) {
+		warning("vidbench: %s: decode error (%m)\n",
+			vb->vc_dec->name, err);
+		return 0;
+	}
+
+	if (intra)
+		++vb->n_intra;
+
+	if (vidframe_isvalid(&frame)) {
+		++vb->n_dec;
+		compare_frame(vb, &frame, rtp_ts);
+	}
+
+	return 0;
+}
+
+
+static int codec_start(struct vidbench *vb)
+{
+	struct list *vidcodecl = baresip_vidcodecl();
+	const char *name = vb->codecv[vb->ix];
+	struct videnc_param prm;
+	int err;
+
+	vb->vc_enc = vidcodec_find_encoder(vidcodecl, name);
+	vb->vc_dec = vidcodec_find_decoder(vidcodecl, name);
+	if (!vb->vc_enc || !vb->vc_dec) {
+		warning("vidbench: codec not found (%s)\n", name);
+		return ENOENT;
+	}
+
+	memset(&prm, 0, sizeof(prm));
+	prm.bitrate = vb->bitrate;
+	prm.pktsize = 1024;
+	prm.fps     = vb->fps;
+	prm.max_fs  = -1;
+
+	err = vb->vc_enc->encupdh(&vb->enc, vb->vc_enc, &prm, NULL,
+				  packet_handler, vb);
+	if (err) {
+		warning("vidbench: %s: encoder failed (%m)\n", name, err);
+		return err;
+	}
+
+	if (vb->vc_dec->decupdh) {
+		err = vb->vc_dec->decupdh(&vb->dec, vb->vc_dec, NULL);
+		if (err) {
+			warning("vidbench: %s: decoder failed (%m)\n",
+				name, err);
+			return err;
+		}
+	}
+
+	err  = vidframe_alloc(&vb->src, VID_FMT_YUV420P, &vb->size);
+	err |= vidframe_alloc(&vb->ref, VID_FMT_YUV420P, &vb->size);
+	if (err)
+		return err;
+
+	vb->latv = mem_zalloc(vb->n_frames * sizeof(*vb->latv), NULL);
+	vb->mb   = mbuf_alloc(2048);
+	if (!vb->latv || !vb->mb)
+		return ENOMEM;
+
+	vb->seq         = 0;
+	vb->frame       = 0;
+	vb->n_dec       = 0;
+	vb->n_intra     = 0;
+	vb->bytes       = 0;
+	vb->t_enc       = 0;
+	vb->t_dec       = 0;
+	vb->psnr_sum    = 0;
+	vb->n_psnr      = 0;
+	vb->ts_start    = tmr_jiffies_usec();
+	vb->cpu_start   = clock();
+
+	info("vidbench: %s: %u x %u, %.2f fps, %u frames (%s)\n",
+	     name, vb->size.w, vb->size.h, vb->fps, vb->n_frames,
+	     vb->realtime ? "real-time" : "fast");
+
+	return 0;
+}
+
+
+static int cmp_u32(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+static double percentile_ms(const uint32_t *v, unsigned n, unsigned pct)
+{
+	if (!n)
+		return 0;
+
+	return v[min((n * pct) / 100, n - 1)] / 1000.0;
+}
+
+
+static int print_result(struct vidbench *vb)
+{
+	struct odict *od = NULL;
+	const double wall = (tmr_jiffies_usec() - vb->ts_start) * 1e-6;
+	const double cpu  = (double)(clock() - vb->cpu_start) / CLOCKS_PER_SEC;
+	const double dur  = vb->frame / vb->fps;
+	const double enc_fps = vb->t_enc ? vb->frame * 1e6 / vb->t_enc : 0;
+	const double dec_fps = vb->t_dec ? vb->n_dec * 1e6 / vb->t_dec : 0;
+	const double psnr = vb->n_psnr ? vb->psnr_sum / vb->n_psnr : 0;
+	const uint64_t bitrate = dur > 0 ? (uint64_t)(8 * vb->bytes / dur) : 0;
+	int err;
+
+	qsort(vb->latv, vb->frame, sizeof(*vb->latv), cmp_u32);
+
+	err = odict_alloc(&od, 32);
+	if (err)
+		return err;
+
+	err |= odict_entry_add(od, "codec", ODICT_STRING, vb->vc_enc->name);
+	err |= odict_entry_add(od, "width", ODICT_INT, (int64_t)vb->size.w);
+	err |= odict_entry_add(od, "height", ODICT_INT, (int64_t)vb->size.h);
+	err |= odict_entry_add(od, "fps", ODICT_DOUBLE, vb->fps);
+	err |= odict_entry_add(od, "realtime", ODICT_BOOL, vb->realtime);
+	err |= odict_entry_add(od, "frames", ODICT_INT, (int64_t)vb->frame);
+	err |= odict_entry_add(od, "decoded", ODICT_INT, (int64_t)vb->n_dec);
+	err |= odict_entry_add(od, "keyframes", ODICT_INT,
+			       (int64_t)vb->n_intra);
+	err |= odict_entry_add(od, "encode_fps", ODICT_DOUBLE, enc_fps);
+	err |= odict_entry_add(od, "decode_fps", ODICT_DOUBLE, dec_fps);
+	err |= odict_entry_add(od, "latency_p50_ms", ODICT_DOUBLE,
+			       percentile_ms(vb->latv, vb->frame, 50));
+	err |= odict_entry_add(od, "latency_p95_ms", ODICT_DOUBLE,
+			       percentile_ms(vb->latv, vb->frame, 95));
+	err |= odict_entry_add(od, "latency_p99_ms", ODICT_DOUBLE,
+			       percentile_ms(vb->latv, vb->frame, 99));
+	err |= odict_entry_add(od, "bitrate", ODICT_INT, (int64_t)bitrate);
+	err |= odict_entry_add(od, "psnr_y", ODICT_DOUBLE, psnr);
+	err |= odict_entry_add(od, "cpu_sec", ODICT_DOUBLE, cpu);
+	err |= odict_entry_add(od, "wall_sec", ODICT_DOUBLE, wall);
+	if (err)
+		goto out;
+
+	info("vidbench: %s: encode %.1f fps, decode %.1f fps,"
+	     " %llu bit/s, PSNR %.2f dB\n",
+	     vb->vc_enc->name, enc_fps, dec_fps, bitrate, psnr);
+
+	err = re_printf("%H\n", json_encode_odict, od);
+
+ out:
+	mem_deref(od);
+
+	return err;
+}
+
+
+static void tmr_handler(void *arg)
+{
+	struct vidbench *vb = arg;
+	uint64_t t0, t1, timestamp, delay = 0;
+	int err;
+
+	if (vb->frame >= vb->n_frames) {
+
+		(void)print_result(vb);
+		codec_reset(vb);
+
+		for (++vb->ix; vb->ix < vb->n_codec; ++vb->ix) {
+
+			if (!codec_start(vb))
+				break;
+
+			codec_reset(vb);
+		}
+
+		if (vb->ix >= vb->n_codec) {
+			info("vidbench: done\n");
+			gbench = mem_deref(gbench);
+			return;
+		}
+
+		goto out;
+	}
+
+	synth_frame(vb->src, vb->frame);
+
+	timestamp = (uint64_t)(vb->frame * VIDEO_TIMEBASE / vb->fps);
+
+	vb->t_dec_frame = 0;
+
+	t0 = tmr_jiffies_usec();
+	err = vb->vc_enc->ench(vb->enc, vb->frame == 0, vb->src, timestamp);
+	t1 = tmr_jiffies_usec();
+
+	if (err) {
+		warning("vidbench: %s: encode error (%m)\n",
+			vb->vc_enc->name, err);
+	}
+
+	/* the packets are decoded from the encoder packet handler */
+	vb->t_enc += (t1 - t0) - min(vb->t_dec_frame, t1 - t0);
+	vb->t_dec += vb->t_dec_frame;
+	vb->latv[vb->frame++] = (uint32_t)(t1 - t0);
+
+	if (vb->realtime) {
+		const uint64_t next = vb->ts_start +
+			(uint64_t)(vb->frame * 1000000.0 / vb->fps);
+
+		if (next > t1)
+			delay = (next - t1) / 1000;
+	}
+
+ out:
+	tmr_start(&vb->tmr, delay, tmr_handler, vb);
+}
+
+
+static int add_codecs(struct vidbench *vb, const struct pl *pl)
+{
+	struct le *le;
+	struct pl val, rest = *pl;
+	int err = 0;
+
+	/* all codecs with an encoder and a decoder */
+	if (0 == pl_strcasecmp(pl, "all")) {
+
+		for (le = list_head(baresip_vidcodecl()); le; le = le->next) {
+
+			const struct vidcodec *vc = le->data;
+			unsigned i;
+
+			if (!vc->encupdh || !vc->dech)
+				continue;
+
+			for (i=0; i<vb->n_codec; i++) {
+				if (!str_casecmp(vb->codecv[i], vc->name))
+					break;
+			}
+
+			if (i < vb->n_codec || vb->n_codec >= MAX_CODECS)
+				continue;
+
+			err = str_dup(&vb->codecv[vb->n_codec++], vc->name);
+			if (err)
+				break;
+		}
+
+		return err;
+	}
+
+	while (!re_regex(rest.p, rest.l, "[^,]+", &val)) {
+
+		if (vb->n_codec >= MAX_CODECS)
+			break;
+
+		err = pl_strdup(&vb->codecv[vb->n_codec++], &val);
+		if (err)
+			break;
+
+		pl_advance(&rest, val.p + val.l - rest.p);
+	}
+
+	return err;
+}
+
+
+static int parse_args(struct vidbench *vb, double *dur, const char *prm)
+{
+	struct pl rest, ws, tok, v1, v2;
+	int err = 0;
+
+	pl_set_str(&rest, prm);
+
+	while (!re_regex(rest.p, rest.l, "[ ]*[^ ]+", &ws, &tok)) {
+
+		if (!re_regex(tok.p, tok.l, "[0-9]+x[0-9]+", &v1, &v2) &&
+		    v1.p == tok.p) {
+			vb->size.w = pl_u32(&v1);
+			vb->size.h = pl_u32(&v2);
+		}
+		else if (!re_regex(tok.p, tok.l, "fps=[0-9.]+", &v1)) {
+			vb->fps = pl_float(&v1);
+		}
+		else if (!re_regex(tok.p, tok.l, "dur=[0-9.]+", &v1)) {
+			*dur = pl_float(&v1);
+		}
+		else if (!re_regex(tok.p, tok.l, "bitrate=[0-9]+", &v1)) {
+			vb->bitrate = pl_u32(&v1);
+		}
+		else if (0 == pl_strcasecmp(&tok, "realtime")) {
+			vb->realtime = true;
+		}
+		else {
+			err = add_codecs(vb, &tok);
+			if (err)
+				return err;
+		}
+
+		pl_advance(&rest, ws.l + tok.l);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Run the headless video codec benchmark
+ *
+ * Usage:
+ *   vidbench <codec>[,<codec>..]|all [WxH] [fps=<n>] [dur=<sec>]
+ *            [bitrate=<bit/s>] [realtime]
+ *
+ * @param pf  Print handler
+ * @param arg Command argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int vidbench_start(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	const struct config *cfg = conf_config();
+	struct vidbench *vb;
+	double dur = DEFAULT_DUR;
+	int err;
+
+	if (gbench)
+		return re_hprintf(pf, "video benchmark already running\n");
+
+	if (!str_isset(carg->prm)) {
+		return re_hprintf(pf, "usage: vidbench <codec>[,<codec>..]"
+				  " [WxH] [fps=<n>] [dur=<sec>]"
+				  " [bitrate=<bit/s>] [realtime]\n");
+	}
+
+	vb = mem_zalloc(sizeof(*vb), destructor);
+	if (!vb)
+		return ENOMEM;
+
+	vb->size.w   = cfg->video.width;
+	vb->size.h   = cfg->video.height;
+	vb->fps      = cfg->video.fps;
+	vb->bitrate  = cfg->video.bitrate;
+
+	err = vidpool_alloc(&vb->pool, 2);
+	if (err)
+		goto out;
+
+	err = parse_args(vb, &dur, carg->prm);
+	if (err)
+		goto out;
+
+	vb->n_frames = (unsigned)(dur * vb->fps);
+
+	if (!vb->n_codec || !vb->size.w || !vb->size.h ||
+	    vb->fps <= 0 || !vb->n_frames) {
+		err = EINVAL;
+		goto out;
+	}
+
+	/* the first codec that can be started */
+	for (vb->ix = 0; vb->ix < vb->n_codec; ++vb->ix) {
+
+		if (!codec_start(vb))
+			break;
+
+		codec_reset(vb);
+	}
+
+	if (vb->ix >= vb->n_codec) {
+		err = ENOENT;
+		goto out;
+	}
+
+	tmr_start(&vb->tmr, 0, tmr_handler, vb);
+
+	gbench = vb;
+
+ out:
+	if (err) {
+		(void)re_hprintf(pf, "vidbench: could not start (%m)\n", err);
+		mem_deref(vb);
+	}
+
+	return err;
+}
+
+
+static int vidbench_stop(struct re_printf *pf, void *arg)
+{
+	(void)arg;
+
+	if (gbench)
+		(void)re_hprintf(pf, "Stop video benchmark\n");
+
+	gbench = mem_deref(gbench);
+
+	return 0;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"vidbench",      0, CMD_PRM, "Video codec benchmark <codec>",
+	 vidbench_start},
+	{"vidbench_stop", 0, 0,       "Stop video codec benchmark",
+	 vidbench_stop },
+};
+
+
+int vidbench_init(void)
+{
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+}
+
+
+void vidbench_close(void)
+{
+	gbench = mem_deref(gbench);
+	cmd_unregister(baresip_commands(), cmdv);
+}
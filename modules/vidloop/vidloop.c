@@ -10,6 +10,7 @@
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
+#include "vidloop.h"
 
 
 /**
@@ -29,6 +30,13 @@
  \verbatim
   baresip -e"/vidloop h264"
  \endverbatim
+ *
+ * Headless codec benchmark with a synthetic video source, printing
+ * the results as JSON on stdout:
+ \verbatim
+  baresip -e"/vidbench vp8,h264 1280x720 fps=30 dur=10"
+  baresip -e"/vidbench all 640x480 fps=25 dur=5 realtime"
+ \endverbatim
  */
 
 
@@ -69,6 +77,7 @@ struct video_loop {
 	struct vidsz disp_size;
 	enum vidfmt src_fmt;
 	struct vidframe *frame;
+	struct vidpool *pool;
 	uint64_t frame_timestamp;
 	struct lock *frame_mutex;
 	bool new_frame;
@@ -173,15 +182,12 @@ static int display(struct video_loop *vl, struct vidframe *frame,
 		/* Some video decoders keeps the displayed video frame
 		 * in memory and we should not write to that frame.
 		 */
-		if (!frame_filt) {
+		if (!frame_filt && !st->vf->dec_rdonly) {
 
-			err = vidframe_alloc(&frame_filt, frame->fmt,
-					     &frame->size);
+			err = vidpool_copy(vl->pool, &frame_filt, frame);
 			if (err)
 				return err;
 
-			vidframe_copy(frame_filt, frame);
-
 			frame = frame_filt;
 		}
 
@@ -197,31 +203,28 @@ static int display(struct video_loop *vl, struct vidframe *frame,
 	vl->disp_size = frame->size;
 	++vl->stats.disp_frames;
 
+	/* The filtered frame is ours, and is displayed without a copy */
+	if (!frame_filt) {
+		err = vidpool_copy(vl->pool, &frame_filt, frame);
+		if (err)
+			return err;
+	}
+
 	lock_write_get(vl->frame_mutex);
 
 	if (vl->frame && ! vidsz_cmp(&vl->frame->size, &frame->size)) {
 
 		info("vidloop: resolution changed:  %u x %u\n",
 		     frame->size.w, frame->size.h);
-
-		vl->frame = mem_deref(vl->frame);
 	}
 
-	if (!vl->frame) {
-		err = vidframe_alloc(&vl->frame, frame->fmt, &frame->size);
-		if (err)
-			goto out;
-	}
-
-	vidframe_copy(vl->frame, frame);
+	mem_deref(vl->frame);
+	vl->frame = frame_filt;
 	vl->frame_timestamp = timestamp;
 	vl->new_frame = true;
 
- out:
 	lock_rel(vl->frame_mutex);
 
-	mem_deref(frame_filt);
-
 	return err;
 }
 
@@ -317,7 +320,8 @@ static void vidsrc_frame_handler(struct vidframe *frame, uint64_t timestamp,
 			vl->need_conv = true;
 		}
 
-		if (vidframe_alloc(&f2, vl->cfg.enc_fmt, &frame->size))
+		if (vidpool_get(vl->pool, &f2, vl->cfg.enc_fmt,
+				&frame->size))
 			return;
 
 		vidconv(f2, frame, 0);
@@ -453,6 +457,25 @@ static int print_stats(struct re_printf *pf, const struct video_loop *vl)
 				  vl->stat.n_intra);
 	}
 
+	/* Frame pool */
+	if (vl->pool) {
+		struct vidpool_stats ps;
+
+		if (!vidpool_stats(vl->pool, &ps)) {
+			err |= re_hprintf(pf,
+					  "* Frame pool\n"
+					  "  frames      %u (busy %u)\n"
+					  "  allocated   %llu\n"
+					  "  reused      %llu\n"
+					  "  copies      %llu\n"
+					  "\n"
+					  ,
+					  ps.n_frames, ps.n_busy,
+					  ps.n_alloc, ps.n_reuse,
+					  ps.n_copy);
+		}
+	}
+
 	/* Display */
 	if (vl->vidisp) {
 		struct vidisp *vd = vidisp_get(vl->vidisp);
@@ -496,6 +519,7 @@ static void vidloop_destructor(void *arg)
 	list_flush(&vl->filtencl);
 	list_flush(&vl->filtdecl);
 	mem_deref(vl->frame_mutex);
+	mem_deref(vl->pool);
 }
 
 
@@ -650,6 +674,10 @@ static int video_loop_alloc(struct video_loop **vlp)
 	if (err)
 		goto out;
 
+	err = vidpool_alloc(&vl->pool, 4);
+	if (err)
+		goto out;
+
 	vl->new_frame = false;
 	vl->frame = NULL;
 
@@ -767,7 +795,13 @@ static const struct cmd cmdv[] = {
 
 static int module_init(void)
 {
-	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+	int err;
+
+	err = cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+	if (err)
+		return err;
+
+	return vidbench_init();
 }
 
 
@@ -775,6 +809,7 @@ static int module_close(void)
 {
 	gvl = mem_deref(gvl);
 	cmd_unregister(baresip_commands(), cmdv);
+	vidbench_close();
 	return 0;
 }
 
@@ -0,0 +1,13 @@
+/**
+ * @file vidloop.h  Video loop -- internal interface
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/*
+ * Video benchmark
+ */
+
+int  vidbench_init(void);
+void vidbench_close(void);
@@ -14,7 +14,56 @@
 
 
 enum {
-	HDR_SIZE = 4,
+	HDR_SIZE    = 4,
+	HDR_SIZE_TL = 6,
+};
+
+
+/* Frame flags for a frame that is not used as a reference */
+#define FLAGS_NOUPD (VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | \
+		     VP8_EFLAG_NO_UPD_ARF)
+
+
+/** One frame in a temporal layer pattern */
+struct tl_frame {
+	uint8_t tid;                  /**< Temporal layer index            */
+	bool ysync;                   /**< Depends only on base layer      */
+	vpx_enc_frame_flags_t flags;  /**< Reference/update flags          */
+};
+
+/** Temporal layer pattern */
+struct tl_pattern {
+	unsigned periodicity;
+	const struct tl_frame *framev;
+	unsigned ratev[VP8_TLAYERS_MAX];    /**< Cumulative rate in [%]   */
+	unsigned decimv[VP8_TLAYERS_MAX];   /**< Framerate decimator      */
+};
+
+
+/*
+ * The higher layers only reference the LAST frame (TL0) or the GOLDEN
+ * frame (TL1), so a receiver can drop them without breaking the
+ * base layer.
+ */
+static const struct tl_frame framev_2l[2] = {
+	{0, false, VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF},
+	{1, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+};
+
+static const struct tl_frame framev_3l[4] = {
+	{0, false, VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF},
+	{2, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+	{1, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_ARF},
+	{2, false, VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+};
+
+static const struct tl_pattern patternv[VP8_TLAYERS_MAX] = {
+	{1, NULL,      {100,   0,   0}, {1, 0, 0}},
+	{2, framev_2l, { 60, 100,   0}, {2, 1, 0}},
+	{4, framev_3l, { 40,  60, 100}, {4, 2, 1}},
 };
 
 
@@ -28,6 +77,12 @@ struct videnc_state {
 	uint16_t picid;
 	videnc_packet_h *pkth;
 	void *arg;
+
+	/* temporal scalability */
+	unsigned tlayers;       /**< Number of encoded temporal layers   */
+	unsigned tlayers_tx;    /**< Number of temporal layers sent      */
+	unsigned tl_idx;        /**< Position in the layer pattern       */
+	uint8_t tl0picidx;      /**< Running index of TL0 pictures       */
 };
 
 
@@ -40,6 +95,22 @@ static void destructor(void *arg)
 }
 
 
+static unsigned active_layers(const struct videnc_state *ves,
+			      unsigned bitrate)
+{
+	const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+	unsigned n;
+
+	for (n = ves->tlayers; n > 1; n--) {
+
+		if (bitrate >= (uint64_t)ves->bitrate * pat->ratev[n-1] / 100)
+			break;
+	}
+
+	return n;
+}
+
+
 int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		      struct videnc_param *prm, const char *fmtp,
 		      videnc_packet_h *pkth, void *arg)
@@ -47,9 +118,8 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 	const struct vp8_vidcodec *vp8 = (struct vp8_vidcodec *)vc;
 	struct videnc_state *ves;
 	uint32_t max_fs;
-	(void)vp8;
 
-	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE + 1))
+	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE_TL + 1))
 		return EINVAL;
 
 	ves = *vesp;
@@ -60,10 +130,29 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		if (!ves)
 			return ENOMEM;
 
-		ves->picid = rand_u16();
+		ves->picid     = rand_u16();
+		ves->tl0picidx = rand_u16() & 0xff;
+		ves->tlayers   = vp8->tlayers ? vp8->tlayers : 1;
 
 		*vesp = ves;
 	}
+	else if (ves->ctxup && ves->tlayers > 1 &&
+		 ves->fps == prm->fps && prm->bitrate <= ves->bitrate) {
+
+		/*
+		 * Lower bitrate with temporal layers: keep the encoder
+		 * running and stop sending the upper layers instead.
+		 */
+		ves->tlayers_tx = active_layers(ves, prm->bitrate);
+		ves->pktsize    = prm->pktsize;
+		ves->pkth       = pkth;
+		ves->arg        = arg;
+
+		debug("vp8: sending %u of %u temporal layers (%u bit/s)\n",
+		      ves->tlayers_tx, ves->tlayers, prm->bitrate);
+
+		goto out;
+	}
 	else {
 		if (ves->ctxup && (ves->bitrate != prm->bitrate ||
 				   ves->fps     != prm->fps)) {
@@ -73,12 +162,14 @@ int vp8_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		}
 	}
 
+	ves->tlayers_tx = ves->tlayers;
 	ves->bitrate = prm->bitrate;
 	ves->pktsize = prm->pktsize;
 	ves->fps     = prm->fps;
 	ves->pkth    = pkth;
 	ves->arg     = arg;
 
+ out:
 	max_fs = vp8_max_fs(fmtp);
 	if (max_fs > 0)
 		prm->max_fs = max_fs * 256;
@@ -111,6 +202,25 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 	cfg.rc_target_bitrate = ves->bitrate;
 	cfg.kf_mode           = VPX_KF_AUTO;
 
+	if (ves->tlayers > 1) {
+		const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+		unsigned i;
+
+		cfg.ts_number_layers = ves->tlayers;
+		cfg.ts_periodicity   = pat->periodicity;
+
+		for (i=0; i<pat->periodicity; i++)
+			cfg.ts_layer_id[i] = pat->framev[i].tid;
+
+		for (i=0; i<ves->tlayers; i++) {
+			cfg.ts_target_bitrate[i] =
+				cfg.rc_target_bitrate * pat->ratev[i] / 100;
+			cfg.ts_rate_decimator[i] = pat->decimv[i];
+		}
+
+		ves->tl_idx = 0;
+	}
+
 	if (ves->ctxup) {
 		debug("vp8: re-opening encoder\n");
 		vpx_codec_destroy(&ves->ctx);
@@ -144,32 +254,48 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 }
 
 
-static inline void hdr_encode(uint8_t hdr[HDR_SIZE], bool noref, bool start,
-			      uint8_t partid, uint16_t picid)
+/*
+ * Encode the VP8 payload descriptor (RFC 7741). The TL0PICIDX and
+ * TID fields are only present if temporal layers are used.
+ */
+static inline size_t hdr_encode(uint8_t hdr[HDR_SIZE_TL], bool noref,
+				bool start, uint8_t partid, uint16_t picid,
+				const struct tl_frame *tl, uint8_t tl0picidx)
 {
 	hdr[0] = 1<<7 | noref<<5 | start<<4 | (partid & 0x7);
-	hdr[1] = 1<<7;
+	hdr[1] = 1<<7 | (tl ? (1<<6 | 1<<5) : 0);
 	hdr[2] = 1<<7 | (picid>>8 & 0x7f);
 	hdr[3] = picid & 0xff;
+
+	if (!tl)
+		return HDR_SIZE;
+
+	hdr[4] = tl0picidx;
+	hdr[5] = (tl->tid & 0x3)<<6 | tl->ysync<<5;
+
+	return HDR_SIZE_TL;
 }
 
 
 static inline int packetize(bool marker, const uint8_t *buf, size_t len,
 			    size_t maxlen, bool noref, uint8_t partid,
-			    uint16_t picid, uint64_t rtp_ts,
+			    uint16_t picid, const struct tl_frame *tl,
+			    uint8_t tl0picidx, uint64_t rtp_ts,
 			    videnc_packet_h *pkth, void *arg)
 {
-	uint8_t hdr[HDR_SIZE];
+	uint8_t hdr[HDR_SIZE_TL];
+	size_t hdr_len;
 	bool start = true;
 	int err = 0;
 
-	maxlen -= sizeof(hdr);
+	maxlen -= tl ? HDR_SIZE_TL : HDR_SIZE;
 
 	while (len > maxlen) {
 
-		hdr_encode(hdr, noref, start, partid, picid);
+		hdr_len = hdr_encode(hdr, noref, start, partid, picid,
+				     tl, tl0picidx);
 
-		err |= pkth(false, rtp_ts, hdr, sizeof(hdr), buf, maxlen,
+		err |= pkth(false, rtp_ts, hdr, hdr_len, buf, maxlen,
 			    arg);
 
 		buf  += maxlen;
@@ -177,9 +303,10 @@ static inline int packetize(bool marker, const uint8_t *buf, size_t len,
 		start = false;
 	}
 
-	hdr_encode(hdr, noref, start, partid, picid);
+	hdr_len = hdr_encode(hdr, noref, start, partid, picid,
+			     tl, tl0picidx);
 
-	err |= pkth(marker, rtp_ts, hdr, sizeof(hdr), buf, len, arg);
+	err |= pkth(marker, rtp_ts, hdr, hdr_len, buf, len, arg);
 
 	return err;
 }
@@ -190,8 +317,10 @@ int vp8_encode(struct videnc_state *ves, bool update,
 {
 	vpx_enc_frame_flags_t flags = 0;
 	vpx_codec_iter_t iter = NULL;
+	const struct tl_frame *tl = NULL;
 	vpx_codec_err_t res;
 	vpx_image_t img;
+	bool sent = false;
 	int err, i;
 
 	if (!ves || !frame || frame->fmt != VID_FMT_YUV420P)
@@ -211,6 +340,30 @@ int vp8_encode(struct videnc_state *ves, bool update,
 		flags |= VPX_EFLAG_FORCE_KF;
 	}
 
+	if (ves->tlayers > 1) {
+		const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+
+		/* restart the pattern on a keyframe */
+		if (update)
+			ves->tl_idx = 0;
+
+		tl = &pat->framev[ves->tl_idx % pat->periodicity];
+		++ves->tl_idx;
+
+		if (!update)
+			flags |= tl->flags;
+
+		if (tl->tid == 0)
+			++ves->tl0picidx;
+
+		res = vpx_codec_control(&ves->ctx, VP8E_SET_TEMPORAL_LAYER_ID,
+					tl->tid);
+		if (res) {
+			warning("vp8: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+
 	memset(&img, 0, sizeof(img));
 
 	img.fmt = VPX_IMG_FMT_I420;
@@ -229,10 +382,8 @@ int vp8_encode(struct videnc_state *ves, bool update,
 		return ENOMEM;
 	}
 
-	++ves->picid;
-
 	for (;;) {
-		bool keyframe = false, marker = true;
+		bool keyframe = false, marker = true, noref;
 		const vpx_codec_cx_pkt_t *pkt;
 		uint8_t partid = 0;
 		uint64_t ts;
@@ -260,10 +411,27 @@ int vp8_encode(struct videnc_state *ves, bool update,
 		 */
 		ts =  video_calc_rtp_timestamp_fix(pkt->data.frame.pts);
 
+		/* upper layers are disabled, drop the frame */
+		if (tl && !keyframe && tl->tid >= ves->tlayers_tx)
+			continue;
+
+		/* one PictureID per frame sent, without gaps */
+		if (!sent) {
+			++ves->picid;
+			sent = true;
+		}
+
+		if (tl)
+			noref = !keyframe && (tl->flags & FLAGS_NOUPD) ==
+				FLAGS_NOUPD;
+		else
+			noref = !keyframe;
+
 		err = packetize(marker,
 				pkt->data.frame.buf,
 				pkt->data.frame.sz,
-				ves->pktsize, !keyframe, partid, ves->picid,
+				ves->pktsize, noref, partid, ves->picid,
+				tl, ves->tl0picidx,
 				ts,
 				ves->pkth, ves->arg);
 		if (err)
@@ -17,6 +17,17 @@
  * This module implements the VP8 video codec that is compatible
  * with the WebRTC standard.
  *
+ * Configuration options:
+ *
+ \verbatim
+  vp8_temporal_layers  {1,2,3}   # Number of temporal layers to encode
+ \endverbatim
+ *
+ * With more than one temporal layer the encoder sends the layer index
+ * in the payload descriptor, so that a receiver or a middlebox can
+ * drop the upper layers. When the encoder bitrate is lowered the
+ * upper layers are not sent.
+ *
  * References:
  *
  *     http://www.webmproject.org/
@@ -35,11 +46,20 @@ static struct vp8_vidcodec vp8 = {
 		.fmtp_ench = vp8_fmtp_enc,
 	},
 	.max_fs   = 3600,
+	.tlayers  = 1,
 };
 
 
 static int module_init(void)
 {
+	confidx_get_u32(conf_cur_index(), "vp8_temporal_layers", &vp8.tlayers);
+
+	if (vp8.tlayers < 1 || vp8.tlayers > VP8_TLAYERS_MAX) {
+		warning("vp8: invalid number of temporal layers (%u)\n",
+			vp8.tlayers);
+		return EINVAL;
+	}
+
 	vidcodec_register(baresip_vidcodecl(), (struct vidcodec *)&vp8);
 
 	return 0;
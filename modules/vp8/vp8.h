@@ -4,9 +4,14 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
+enum {
+	VP8_TLAYERS_MAX = 3,
+};
+
 struct vp8_vidcodec {
 	struct vidcodec vc;
 	uint32_t max_fs;
+	uint32_t tlayers;   /**< Number of temporal layers (1-3) */
 };
 
 /* Encode */
@@ -30,6 +30,11 @@ struct hdr {
 
 	/* extension fields */
 	uint16_t picid;
+	unsigned tid:3;  /* Temporal layer ID                       */
+	unsigned u:1;    /* Switching up point                      */
+	unsigned sid:3;  /* Spatial layer ID                        */
+	unsigned d:1;    /* Inter-layer dependency used             */
+	uint8_t tl0picidx;
 };
 
 struct viddec_state {
@@ -127,10 +132,6 @@ static inline int hdr_decode(struct hdr *hdr, struct mbuf *mb)
 		warning("vp9: decode: P-bit not supported\n");
 		return EPROTO;
 	}
-	if (hdr->l) {
-		warning("vp9: decode: L-bit not supported\n");
-		return EPROTO;
-	}
 	if (hdr->f) {
 		warning("vp9: decode: F-bit not supported\n");
 		return EPROTO;
@@ -160,6 +161,22 @@ static inline int hdr_decode(struct hdr *hdr, struct mbuf *mb)
 		}
 	}
 
+	/* layer indices, followed by TL0PICIDX in non-flexible mode */
+	if (hdr->l) {
+
+		if (mbuf_get_left(mb) < 2)
+			return EBADMSG;
+
+		v = mbuf_read_u8(mb);
+
+		hdr->tid = v>>5 & 0x7;
+		hdr->u   = v>>4 & 0x1;
+		hdr->sid = v>>1 & 0x7;
+		hdr->d   = v    & 0x1;
+
+		hdr->tl0picidx = mbuf_read_u8(mb);
+	}
+
 	return 0;
 }
 
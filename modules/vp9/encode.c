@@ -14,7 +14,51 @@
 
 
 enum {
-	HDR_SIZE = 3,
+	HDR_SIZE    = 3,
+	HDR_SIZE_TL = 5,
+};
+
+
+/* Frame flags for a frame that is not used as a reference */
+#define FLAGS_NOUPD (VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | \
+		     VP8_EFLAG_NO_UPD_ARF)
+
+
+/** One frame in a temporal layer pattern */
+struct tl_frame {
+	uint8_t tid;                  /**< Temporal layer index            */
+	bool upswitch;                /**< Switching up point              */
+	vpx_enc_frame_flags_t flags;  /**< Reference/update flags          */
+};
+
+/** Temporal layer pattern */
+struct tl_pattern {
+	unsigned periodicity;
+	const struct tl_frame *framev;
+	unsigned ratev[VP9_TLAYERS_MAX];    /**< Cumulative rate in [%]   */
+	unsigned decimv[VP9_TLAYERS_MAX];   /**< Framerate decimator      */
+};
+
+
+static const struct tl_frame framev_2l[2] = {
+	{0, false, VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF},
+	{1, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+};
+
+static const struct tl_frame framev_3l[4] = {
+	{0, false, VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF},
+	{2, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+	{1, true,  VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF |
+		   VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_ARF},
+	{2, false, VP8_EFLAG_NO_REF_ARF | FLAGS_NOUPD},
+};
+
+static const struct tl_pattern patternv[VP9_TLAYERS_MAX] = {
+	{1, NULL,      {100,   0,   0}, {1, 0, 0}},
+	{2, framev_2l, { 60, 100,   0}, {2, 1, 0}},
+	{4, framev_3l, { 40,  60, 100}, {4, 2, 1}},
 };
 
 
@@ -32,6 +76,12 @@ struct videnc_state {
 	unsigned n_frames;
 	unsigned n_key_frames;
 	size_t n_bytes;
+
+	/* temporal scalability */
+	unsigned tlayers;       /**< Number of encoded temporal layers   */
+	unsigned tlayers_tx;    /**< Number of temporal layers sent      */
+	unsigned tl_idx;        /**< Position in the layer pattern       */
+	uint8_t tl0picidx;      /**< Running index of TL0 pictures       */
 };
 
 
@@ -52,6 +102,22 @@ static void destructor(void *arg)
 }
 
 
+static unsigned active_layers(const struct videnc_state *ves,
+			      unsigned bitrate)
+{
+	const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+	unsigned n;
+
+	for (n = ves->tlayers; n > 1; n--) {
+
+		if (bitrate >= (uint64_t)ves->bitrate * pat->ratev[n-1] / 100)
+			break;
+	}
+
+	return n;
+}
+
+
 int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		      struct videnc_param *prm, const char *fmtp,
 		      videnc_packet_h *pkth, void *arg)
@@ -59,9 +125,8 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 	const struct vp9_vidcodec *vp9 = (struct vp9_vidcodec *)vc;
 	struct videnc_state *ves;
 	uint32_t max_fs;
-	(void)vp9;
 
-	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE + 1))
+	if (!vesp || !vc || !prm || prm->pktsize < (HDR_SIZE_TL + 1))
 		return EINVAL;
 
 	ves = *vesp;
@@ -72,10 +137,29 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		if (!ves)
 			return ENOMEM;
 
-		ves->picid = rand_u16();
+		ves->picid     = rand_u16();
+		ves->tl0picidx = rand_u16() & 0xff;
+		ves->tlayers   = vp9->tlayers ? vp9->tlayers : 1;
 
 		*vesp = ves;
 	}
+	else if (ves->ctxup && ves->tlayers > 1 &&
+		 ves->fps == prm->fps && prm->bitrate <= ves->bitrate) {
+
+		/*
+		 * Lower bitrate with temporal layers: keep the encoder
+		 * running and stop sending the upper layers instead.
+		 */
+		ves->tlayers_tx = active_layers(ves, prm->bitrate);
+		ves->pktsize    = prm->pktsize;
+		ves->pkth       = pkth;
+		ves->arg        = arg;
+
+		debug("vp9: sending %u of %u temporal layers (%u bit/s)\n",
+		      ves->tlayers_tx, ves->tlayers, prm->bitrate);
+
+		goto out;
+	}
 	else {
 		if (ves->ctxup && (ves->bitrate != prm->bitrate ||
 				   ves->fps     != prm->fps)) {
@@ -85,12 +169,14 @@ int vp9_encode_update(struct videnc_state **vesp, const struct vidcodec *vc,
 		}
 	}
 
+	ves->tlayers_tx = ves->tlayers;
 	ves->bitrate = prm->bitrate;
 	ves->pktsize = prm->pktsize;
 	ves->fps     = prm->fps;
 	ves->pkth    = pkth;
 	ves->arg     = arg;
 
+ out:
 	max_fs = vp9_max_fs(fmtp);
 	if (max_fs > 0)
 		prm->max_fs = max_fs * 256;
@@ -127,6 +213,26 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 	cfg.rc_end_usage      = VPX_VBR;
 	cfg.kf_mode           = VPX_KF_AUTO;
 
+	if (ves->tlayers > 1) {
+		const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+		unsigned i;
+
+		cfg.ss_number_layers = 1;
+		cfg.ts_number_layers = ves->tlayers;
+		cfg.ts_periodicity   = pat->periodicity;
+
+		for (i=0; i<pat->periodicity; i++)
+			cfg.ts_layer_id[i] = pat->framev[i].tid;
+
+		for (i=0; i<ves->tlayers; i++) {
+			cfg.ts_target_bitrate[i] =
+				cfg.rc_target_bitrate * pat->ratev[i] / 100;
+			cfg.ts_rate_decimator[i] = pat->decimv[i];
+		}
+
+		ves->tl_idx = 0;
+	}
+
 	if (ves->ctxup) {
 		debug("vp9: re-opening encoder\n");
 		vpx_codec_destroy(&ves->ctx);
@@ -142,6 +248,14 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 
 	ves->ctxup = true;
 
+	if (ves->tlayers > 1) {
+		res = vpx_codec_control(&ves->ctx, VP9E_SET_SVC, 1);
+		if (res) {
+			warning("vp9: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+
 	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, 8);
 	if (res) {
 		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
@@ -159,12 +273,25 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 }
 
 
-static inline void hdr_encode(uint8_t hdr[HDR_SIZE], bool start, bool end,
-			      uint16_t picid)
+/*
+ * Encode the VP9 payload descriptor in non-flexible mode. The layer
+ * indices and TL0PICIDX are only present if temporal layers are used.
+ */
+static inline size_t hdr_encode(uint8_t hdr[HDR_SIZE_TL], bool start,
+				bool end, uint16_t picid,
+				const struct tl_frame *tl, uint8_t tl0picidx)
 {
-	hdr[0] = 1<<7 | start<<3 | end<<2;
+	hdr[0] = 1<<7 | (tl ? 1<<5 : 0) | start<<3 | end<<2;
 	hdr[1] = 1<<7 | (picid>>8 & 0x7f);
 	hdr[2] = picid & 0xff;
+
+	if (!tl)
+		return HDR_SIZE;
+
+	hdr[3] = (tl->tid & 0x7)<<5 | tl->upswitch<<4;
+	hdr[4] = tl0picidx;
+
+	return HDR_SIZE_TL;
 }
 
 
@@ -183,19 +310,21 @@ static int send_packet(struct videnc_state *ves, bool marker,
 static inline int packetize(struct videnc_state *ves,
 			    bool marker, const uint8_t *buf, size_t len,
 			    size_t maxlen, uint16_t picid,
-			    uint64_t rtp_ts)
+			    const struct tl_frame *tl, uint64_t rtp_ts)
 {
-	uint8_t hdr[HDR_SIZE];
+	uint8_t hdr[HDR_SIZE_TL];
+	size_t hdr_len;
 	bool start = true;
 	int err = 0;
 
-	maxlen -= sizeof(hdr);
+	maxlen -= tl ? HDR_SIZE_TL : HDR_SIZE;
 
 	while (len > maxlen) {
 
-		hdr_encode(hdr, start, false, picid);
+		hdr_len = hdr_encode(hdr, start, false, picid,
+				     tl, ves->tl0picidx);
 
-		err |= send_packet(ves, false, hdr, sizeof(hdr), buf, maxlen,
+		err |= send_packet(ves, false, hdr, hdr_len, buf, maxlen,
 				   rtp_ts);
 
 		buf  += maxlen;
@@ -203,9 +332,9 @@ static inline int packetize(struct videnc_state *ves,
 		start = false;
 	}
 
-	hdr_encode(hdr, start, true, picid);
+	hdr_len = hdr_encode(hdr, start, true, picid, tl, ves->tl0picidx);
 
-	err |= send_packet(ves, marker, hdr, sizeof(hdr), buf, len,
+	err |= send_packet(ves, marker, hdr, hdr_len, buf, len,
 			   rtp_ts);
 
 	return err;
@@ -217,9 +346,11 @@ int vp9_encode(struct videnc_state *ves, bool update,
 {
 	vpx_enc_frame_flags_t flags = 0;
 	vpx_codec_iter_t iter = NULL;
+	const struct tl_frame *tl = NULL;
 	vpx_codec_err_t res;
 	vpx_image_t *img = NULL;
 	vpx_img_fmt_t img_fmt;
+	bool sent = false;
 	int err, i;
 
 	if (!ves || !frame)
@@ -253,6 +384,35 @@ int vp9_encode(struct videnc_state *ves, bool update,
 		flags |= VPX_EFLAG_FORCE_KF;
 	}
 
+	if (ves->tlayers > 1) {
+		const struct tl_pattern *pat = &patternv[ves->tlayers - 1];
+		vpx_svc_layer_id_t layer_id;
+
+		/* restart the pattern on a keyframe */
+		if (update)
+			ves->tl_idx = 0;
+
+		tl = &pat->framev[ves->tl_idx % pat->periodicity];
+		++ves->tl_idx;
+
+		if (!update)
+			flags |= tl->flags;
+
+		if (tl->tid == 0)
+			++ves->tl0picidx;
+
+		memset(&layer_id, 0, sizeof(layer_id));
+		layer_id.spatial_layer_id  = 0;
+		layer_id.temporal_layer_id = tl->tid;
+
+		res = vpx_codec_control(&ves->ctx, VP9E_SET_SVC_LAYER_ID,
+					&layer_id);
+		if (res) {
+			warning("vp9: codec ctrl: %s\n",
+				vpx_codec_err_to_string(res));
+		}
+	}
+
 	img = vpx_img_wrap(NULL, img_fmt, frame->size.w, frame->size.h,
 			   16, NULL);
 	if (!img) {
@@ -274,8 +434,6 @@ int vp9_encode(struct videnc_state *ves, bool update,
 		goto out;
 	}
 
-	++ves->picid;
-
 	for (;;) {
 		bool marker = true;
 		const vpx_codec_cx_pkt_t *pkt;
@@ -298,12 +456,23 @@ int vp9_encode(struct videnc_state *ves, bool update,
 
 		ts = video_calc_rtp_timestamp_fix(pkt->data.frame.pts);
 
+		/* upper layers are disabled, drop the frame */
+		if (tl && !(pkt->data.frame.flags & VPX_FRAME_IS_KEY) &&
+		    tl->tid >= ves->tlayers_tx)
+			continue;
+
+		/* one PictureID per frame sent, without gaps */
+		if (!sent) {
+			++ves->picid;
+			sent = true;
+		}
+
 		err = packetize(ves,
 				marker,
 				pkt->data.frame.buf,
 				pkt->data.frame.sz,
 				ves->pktsize, ves->picid,
-				ts);
+				tl, ts);
 		if (err)
 			return err;
 	}
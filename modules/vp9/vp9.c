@@ -20,6 +20,12 @@
  *
  * Libvpx version 1.3.0 or later is required.
  *
+ * Configuration options:
+ *
+ \verbatim
+  vp9_temporal_layers  {1,2,3}   # Number of temporal layers to encode
+ \endverbatim
+ *
  *
  * References:
  *
@@ -38,12 +44,21 @@ static struct vp9_vidcodec vp9 = {
 		.dech      = vp9_decode,
 		.fmtp_ench = vp9_fmtp_enc,
 	},
-	.max_fs = 3600
+	.max_fs = 3600,
+	.tlayers = 1
 };
 
 
 static int module_init(void)
 {
+	confidx_get_u32(conf_cur_index(), "vp9_temporal_layers", &vp9.tlayers);
+
+	if (vp9.tlayers < 1 || vp9.tlayers > VP9_TLAYERS_MAX) {
+		warning("vp9: invalid number of temporal layers (%u)\n",
+			vp9.tlayers);
+		return EINVAL;
+	}
+
 	vidcodec_register(baresip_vidcodecl(), (struct vidcodec *)&vp9);
 	return 0;
 }
@@ -614,7 +614,7 @@ static int module_init(void)
 	FILE *f;
 	int ret, err;
 
-	(void)conf_get_bool(conf_cur(), "zrtp_hash", &use_sig_hash);
+	(void)confidx_get_bool(conf_cur_index(), "zrtp_hash", &use_sig_hash);
 
 	zrtp_log_set_log_engine(zrtp_log);
 
@@ -73,12 +73,15 @@ enum {
 
  \endverbatim
  *
+ * A source that has the audio already encoded, sends its frames to the
+ * RTP stream directly, without the aubuf, the filters and the encoder.
  */
 struct autx {
 	struct ausrc_st *ausrc;       /**< Audio Source                    */
 	struct ausrc_prm ausrc_prm;   /**< Audio Source parameters         */
 	const struct aucodec *ac;     /**< Current audio encoder           */
 	struct auenc_state *enc;      /**< Audio encoder state (optional)  */
+	char *params;                 /**< Audio encoder parameters        */
 	struct aubuf *aubuf;          /**< Packetize outgoing stream       */
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
@@ -270,6 +273,7 @@ static void audio_destructor(void *arg)
 	stop_rx(&a->rx);
 
 	mem_deref(a->tx.enc);
+	mem_deref(a->tx.params);
 	mem_deref(a->rx.dec);
 	mem_deref(a->tx.aubuf);
 	mem_deref(a->tx.mb);
@@ -460,8 +464,8 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 		err = 0;
 	}
 	else if (err) {
-		warning("audio: %s encode error: %d samples (%m)\n",
-			tx->ac->name, sampc, err);
+		warning_ratelimit("audio: %s encode error: %d samples (%m)\n",
+				  tx->ac->name, sampc, err);
 		goto out;
 	}
 
@@ -682,8 +686,8 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 
 		++tx->stats.aubuf_overrun;
 
-		debug("audio: tx aubuf overrun (total %llu)\n",
-		      tx->stats.aubuf_overrun);
+		debug_ratelimit("audio: tx aubuf overrun (total %llu)\n",
+				tx->stats.aubuf_overrun);
 	}
 
 	(void)aubuf_write(tx->aubuf, sampv, num_bytes);
@@ -707,6 +711,45 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 }
 
 
+/*
+ * Send a frame that was encoded by the audio source
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void ausrc_payload_handler(const uint8_t *buf, size_t len,
+				  uint32_t dur, void *arg)
+{
+	struct audio *a = arg;
+	struct autx *tx = &a->tx;
+	int err;
+
+	if (len && !tx->muted) {
+
+		/* the RTP header is written in front of the payload */
+		tx->mb->pos = tx->mb->end = STREAM_PRESZ;
+
+		err = mbuf_write_mem(tx->mb, buf, len);
+		if (err)
+			goto out;
+
+		tx->mb->pos = STREAM_PRESZ;
+
+		err = stream_send(a->strm, false, tx->marker, -1,
+				  tx->ts_ext & 0xffffffff, tx->mb);
+		if (err)
+			goto out;
+
+		tx->marker = false;
+	}
+
+ out:
+	tx->ts_ext += dur;
+
+	/* Exact timing: send Telephony-Events from here */
+	check_telev(a, tx);
+}
+
+
 static void ausrc_error_handler(int err, const char *str, void *arg)
 {
 	struct audio *a = arg;
@@ -779,8 +822,8 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 	}
 
 	if (err) {
-		warning("audio: %s codec decode %u bytes: %m\n",
-			rx->ac->name, mbuf_get_left(mb), err);
+		warning_ratelimit("audio: %s codec decode %u bytes: %m\n",
+				  rx->ac->name, mbuf_get_left(mb), err);
 		goto out;
 	}
 
@@ -949,10 +992,12 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 
 			delta = ext_last - ext_now;
 
-			warning("audio: [time=%.3f]"
-				" discard old frame (%.3f seconds old)\n",
-				aurx_calc_seconds(rx),
-				audio_calc_seconds(delta, rx->ac->crate));
+			warning_ratelimit("audio: [time=%.3f]"
+					  " discard old frame"
+					  " (%.3f seconds old)\n",
+					  aurx_calc_seconds(rx),
+					  audio_calc_seconds(delta,
+							     rx->ac->crate));
 
 			discard = true;
 		}
@@ -966,9 +1011,9 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	switch (wrap) {
 
 	case -1:
-		warning("audio: rtp timestamp wraps backwards"
-			" (delta = %d) -- discard\n",
-			(int32_t)(rx->ts_recv.last - hdr->ts));
+		warning_ratelimit("audio: rtp timestamp wraps backwards"
+				  " (delta = %d) -- discard\n",
+				  (int32_t)(rx->ts_recv.last - hdr->ts));
 		discard = true;
 		break;
 
@@ -1039,7 +1084,8 @@ static int set_ebuacip_params(struct audio *au, uint32_t ptime)
 	err |= sdp_media_set_lattr(sdp, false, "ebuacip", "jb %i", jb_id);
 
 	/* define jb value in option */
-	if (0 == conf_get_str(conf_cur(), "ebuacip_jb_type",str,sizeof(str))) {
+	if (0 == confidx_get_str(conf_cur_index(), "ebuacip_jb_type",
+				 str, sizeof(str))) {
 
 		if (0 == str_cmp(str, "auto")) {
 
@@ -1227,8 +1273,9 @@ static void *tx_thread(void *arg)
 		else {
 			++tx->stats.aubuf_underrun;
 
-			debug("audio: thread: tx aubuf underrun"
-			      " (total %llu)\n", tx->stats.aubuf_underrun);
+			debug_ratelimit("audio: thread: tx aubuf underrun"
+					" (total %llu)\n",
+					tx->stats.aubuf_underrun);
 		}
 
 		ts += tx->ptime;
@@ -1514,6 +1561,13 @@ static int start_source(struct autx *tx, struct audio *a)
 		prm.ch         = channels_dsp;
 		prm.ptime      = tx->ptime;
 		prm.fmt        = tx->src_fmt;
+		prm.ac         = ac;
+		prm.fmtp       = tx->params;
+		prm.payloadh   = NULL;
+
+		/* encoded frames, if nothing is done with the samples */
+		if (!resamp && !a->level_enabled && list_isempty(&tx->filtl))
+			prm.payloadh = ausrc_payload_handler;
 
 		sz = aufmt_sample_size(tx->src_fmt);
 
@@ -1638,6 +1692,15 @@ void audio_stop(struct audio *a)
 }
 
 
+static bool params_equal(const char *p1, const char *p2)
+{
+	if (!p1 || !p2)
+		return p1 == p2;
+
+	return 0 == str_cmp(p1, p2);
+}
+
+
 int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		      int pt_tx, const char *params)
 {
@@ -1652,6 +1715,24 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 
 	reset = !aucodec_equal(ac, tx->ac);
 
+	/* A source with encoded frames must encode them again */
+	if (tx->ausrc_prm.payloadh &&
+	    (ac != tx->ac || !params_equal(params, tx->params))) {
+		tx->ausrc = mem_deref(tx->ausrc);
+		tx->ausrc_prm.payloadh = NULL;
+	}
+
+	if (!params_equal(params, tx->params)) {
+
+		tx->params = mem_deref(tx->params);
+
+		if (params) {
+			err = str_dup(&tx->params, params);
+			if (err)
+				return err;
+		}
+	}
+
 	if (ac != tx->ac) {
 		info("audio: Set audio encoder: %s %uHz %dch\n",
 		     ac->name, get_srate(ac), get_ch(ac));
@@ -1725,6 +1806,7 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 	}
 
 	stream_set_srate(a->strm, ac->crate, ac->crate);
+	stream_set_codec(a->strm, ac->name);
 
 	if (reset) {
 
@@ -1952,6 +2034,29 @@ static int aucodec_print(struct re_printf *pf, const struct aucodec *ac)
 }
 
 
+/**
+ * Get the audio buffer statistics
+ *
+ * @param au    Audio object
+ * @param stats Pointer to statistics, written on success
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_stats_get(const struct audio *au, struct audio_stats *stats)
+{
+	if (!au || !stats)
+		return EINVAL;
+
+	stats->tx_overrun  = au->tx.stats.aubuf_overrun;
+	stats->tx_underrun = au->tx.stats.aubuf_underrun;
+	stats->rx_overrun  = au->rx.stats.aubuf_overrun;
+	stats->rx_underrun = au->rx.stats.aubuf_underrun;
+	stats->rx_discard  = au->rx.stats.n_discard;
+
+	return 0;
+}
+
+
 int audio_debug(struct re_printf *pf, const struct audio *a)
 {
 	const struct autx *tx;
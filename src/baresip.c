@@ -29,6 +29,7 @@ static struct baresip {
 	struct list vidispl;
 	struct list vidfiltl;
 	struct ui_sub uis;
+	uint64_t ts_start;
 } baresip;
 
 
@@ -73,9 +74,13 @@ static int rmmod_handler(struct re_printf *pf, void *arg)
 
 
 static const struct cmd corecmdv[] = {
-	{"quit", 'q', 0, "Quit",                     cmd_quit             },
-	{"insmod", 0, CMD_PRM, "Load module",        insmod_handler       },
-	{"rmmod",  0, CMD_PRM, "Unload module",      rmmod_handler        },
+	{"quit", 'q', 0,       "Quit",                 cmd_quit             },
+	{"insmod", 0, CMD_PRM, "Load module",          insmod_handler       },
+	{"rmmod",  0, CMD_PRM, "Unload module",        rmmod_handler        },
+	{"regstat", 0, 0,      "Registration status",  reg_sched_debug      },
+	{"evstat",  0, 0,      "Event bus status",     uag_event_debug      },
+	{"logstat", 0, 0,      "Logging status",       log_debug            },
+	{"modprof", 0, 0,      "Module init profile",  module_debug         },
 };
 
 
@@ -95,6 +100,7 @@ int baresip_init(struct config *cfg, bool prefer_ipv6)
 		return EINVAL;
 
 	baresip.net = mem_deref(baresip.net);
+	baresip.ts_start = tmr_jiffies();
 
 	list_init(&baresip.mnatl);
 	list_init(&baresip.mencl);
@@ -155,6 +161,9 @@ void baresip_close(void)
 	baresip.net = mem_deref(baresip.net);
 
 	ui_reset(&baresip.uis);
+
+	module_prof_close();
+	rtprec_close();
 }
 
 
@@ -332,3 +341,14 @@ struct ui_sub *baresip_uis(void)
 {
 	return &baresip.uis;
 }
+
+
+/**
+ * Get the time since baresip was initialised
+ *
+ * @return Uptime in [ms]
+ */
+uint64_t baresip_uptime(void)
+{
+	return baresip.ts_start ? tmr_jiffies() - baresip.ts_start : 0;
+}
@@ -24,6 +24,7 @@
 /** Call constants */
 enum {
 	PTIME           = 20,    /**< Packet time for audio               */
+	INDEX_HASH_SIZE = 1024,  /**< Hash size of the call indexes       */
 };
 
 
@@ -65,6 +66,7 @@ struct call {
 	time_t time_start;        /**< Time when call started               */
 	time_t time_conn;         /**< Time when call initiated             */
 	time_t time_stop;         /**< Time when call stopped               */
+	uint64_t markv[CALL_MARK_MAX]; /**< Call setup timeline [ms]        */
 	bool outgoing;            /**< True if outgoing, false if incoming  */
 	bool got_offer;           /**< Got SDP Offer from Peer              */
 	bool on_hold;             /**< True if call is on hold (local)      */
@@ -82,10 +84,33 @@ struct call {
 
 	uint32_t rtp_timeout_ms;  /**< RTP Timeout in [ms]                  */
 	uint32_t linenum;         /**< Line number from 1 to N              */
+	struct linetab *lines;    /**< Line number table (ref.)             */
+	struct le he_line;        /**< Element in line number index         */
+	struct le he_id;          /**< Element in Call-ID index             */
 	struct list custom_hdrs;  /**< List of custom headers if any        */
+	struct rtprec *rec;       /**< RTP recorder (optional)              */
 };
 
 
+/** Line numbers in use, for one list of calls */
+struct linetab {
+	struct le he;             /**< Element in table index               */
+	const struct list *calls; /**< List of calls                        */
+	uint64_t *bitv;           /**< Bitmap of line numbers in use        */
+	size_t bitc;              /**< Number of words in the bitmap        */
+	size_t hint;              /**< First word with a free line number   */
+};
+
+
+/** Call indexes, allocated while there are calls */
+static struct {
+	struct hash *ht_tab;      /**< Line number tables (struct linetab)  */
+	struct hash *ht_line;     /**< Calls by list and line number        */
+	struct hash *ht_id;       /**< Calls by Call-ID                     */
+	uint32_t n_calls;         /**< Number of indexed calls              */
+} idx;
+
+
 static int send_invite(struct call *call);
 
 
@@ -111,6 +136,37 @@ static void set_state(struct call *call, enum state st)
 }
 
 
+/* RTP is sent from the audio transmit thread, the stream only saves the
+ * timestamp of the first packet and it is picked up from here */
+static uint64_t streams_tx_first(const struct call *call)
+{
+	uint64_t ts = 0;
+	struct le *le;
+
+	FOREACH_STREAM {
+		uint64_t first = stream_tx_first(le->data);
+
+		if (first && (!ts || first < ts))
+			ts = first;
+	}
+
+	return ts;
+}
+
+
+static void mark_rtp_tx(struct call *call)
+{
+	uint64_t ts;
+
+	if (call->markv[CALL_MARK_RTP_TX])
+		return;
+
+	ts = streams_tx_first(call);
+	if (ts)
+		call_mark(call, CALL_MARK_RTP_TX, ts);
+}
+
+
 static void call_stream_start(struct call *call, bool active)
 {
 	const struct sdp_format *sc;
@@ -265,6 +321,8 @@ static void mnat_handler(int err, uint16_t scode, const char *reason,
 
 	info("call: media-nat `%s' established\n", call->acc->mnatid);
 
+	call_mark(call, CALL_MARK_MNAT, tmr_jiffies());
+
 	/* Re-INVITE */
 	if (!call->mnat_wait) {
 		info("call: medianat established -- sending Re-INVITE\n");
@@ -370,6 +428,227 @@ static void print_summary(const struct call *call)
 }
 
 
+static void linetab_destructor(void *arg)
+{
+	struct linetab *lt = arg;
+
+	hash_unlink(&lt->he);
+	mem_deref(lt->bitv);
+}
+
+
+static uint32_t tab_key(const struct list *calls)
+{
+	return (uint32_t)((uintptr_t)calls >> 4);
+}
+
+
+static uint32_t line_key(const struct list *calls, uint32_t linenum)
+{
+	return linenum * 2654435761U ^ (uint32_t)((uintptr_t)calls >> 4);
+}
+
+
+static bool linetab_cmp_handler(struct le *le, void *arg)
+{
+	const struct linetab *lt = le->data;
+
+	return lt->calls == arg;
+}
+
+
+static int linenum_alloc(struct linetab *lt, uint32_t *linenum)
+{
+	const size_t maxc = (CALL_LINENUM_MAX - CALL_LINENUM_MIN + 63) / 64;
+	uint32_t num;
+	unsigned bit;
+	size_t i;
+
+	for (i = lt->hint; i < lt->bitc; i++) {
+		if (lt->bitv[i] != ~(uint64_t)0)
+			break;
+	}
+
+	/* all line numbers in use, grow the bitmap */
+	if (i == lt->bitc) {
+		size_t n = min(max(lt->bitc * 2, (size_t)1), maxc);
+		uint64_t *bitv;
+
+		if (n == lt->bitc)
+			return ENOENT;
+
+		bitv = mem_realloc(lt->bitv, n * sizeof(*bitv));
+		if (!bitv)
+			return ENOMEM;
+
+		memset(&bitv[lt->bitc], 0, (n - lt->bitc) * sizeof(*bitv));
+		lt->bitv = bitv;
+		lt->bitc = n;
+	}
+
+	for (bit=0; bit<64; bit++) {
+		if (!(lt->bitv[i] & (uint64_t)1 << bit))
+			break;
+	}
+
+	num = CALL_LINENUM_MIN + (uint32_t)(i * 64 + bit);
+	if (num >= CALL_LINENUM_MAX)
+		return ENOENT;
+
+	lt->bitv[i] |= (uint64_t)1 << bit;
+	lt->hint = i;
+	*linenum = num;
+
+	return 0;
+}
+
+
+static void linenum_free(struct linetab *lt, uint32_t linenum)
+{
+	size_t i;
+
+	if (!lt || linenum < CALL_LINENUM_MIN)
+		return;
+
+	linenum -= CALL_LINENUM_MIN;
+	i = linenum / 64;
+
+	if (i >= lt->bitc)
+		return;
+
+	lt->bitv[i] &= ~((uint64_t)1 << (linenum % 64));
+	lt->hint = min(lt->hint, i);
+}
+
+
+static int index_alloc(void)
+{
+	int err;
+
+	if (idx.n_calls++)
+		return 0;
+
+	err  = hash_alloc(&idx.ht_tab, 16);
+	err |= hash_alloc(&idx.ht_line, INDEX_HASH_SIZE);
+	err |= hash_alloc(&idx.ht_id, INDEX_HASH_SIZE);
+
+	return err;
+}
+
+
+static void index_release(void)
+{
+	if (!idx.n_calls || --idx.n_calls)
+		return;
+
+	idx.ht_tab  = mem_deref(idx.ht_tab);
+	idx.ht_line = mem_deref(idx.ht_line);
+	idx.ht_id   = mem_deref(idx.ht_id);
+}
+
+
+/*
+ * Assign the lowest free line number of the list of calls, and add
+ * the call to the line number index.
+ */
+static int assign_linenum(struct call *call, const struct list *lst)
+{
+	struct linetab *lt;
+	int err;
+
+	err = index_alloc();
+	if (err) {
+		index_release();
+		return err;
+	}
+
+	lt = list_ledata(hash_lookup(idx.ht_tab, tab_key(lst),
+				     linetab_cmp_handler, (void *)lst));
+	if (lt) {
+		call->lines = mem_ref(lt);
+	}
+	else {
+		lt = mem_zalloc(sizeof(*lt), linetab_destructor);
+		if (!lt) {
+			index_release();
+			return ENOMEM;
+		}
+
+		lt->calls = lst;
+		hash_append(idx.ht_tab, tab_key(lst), &lt->he, lt);
+
+		call->lines = lt;
+	}
+
+	err = linenum_alloc(lt, &call->linenum);
+	if (err)
+		return err;
+
+	hash_append(idx.ht_line, line_key(lst, call->linenum),
+		    &call->he_line, call);
+
+	return 0;
+}
+
+
+static void record_start(struct call *call)
+{
+	static uint32_t n;
+	char file[256];
+	struct le *le;
+	int err;
+
+	if (call->rec || !str_isset(call->config_avt.rec_path))
+		return;
+
+	re_snprintf(file, sizeof(file), "%s/%llu-%u.brec",
+		    call->config_avt.rec_path, (uint64_t)time(NULL), ++n);
+
+	err = rtprec_alloc(&call->rec, file);
+	if (err) {
+		warning("call: could not record RTP (%m)\n", err);
+		return;
+	}
+
+	rtprec_info(call->rec, "local", call->local_uri);
+	rtprec_info(call->rec, "peer", call->peer_uri);
+	rtprec_info(call->rec, "direction",
+		    call->outgoing ? "outgoing" : "incoming");
+
+	FOREACH_STREAM
+		stream_set_recorder(le->data, call->rec);
+}
+
+
+/* The remote SDP is recorded as received */
+static int decode_sdp(struct call *call, struct mbuf *mb, bool offer)
+{
+	rtprec_sdp(call->rec, false, mb);
+
+	return sdp_decode(call->sdp, mb, offer);
+}
+
+
+static int set_id(struct call *call)
+{
+	int err;
+
+	hash_unlink(&call->he_id);
+
+	call->id = mem_deref(call->id);
+	err = str_dup(&call->id,
+		      sip_dialog_callid(sipsess_dialog(call->sess)));
+	if (err)
+		return err;
+
+	hash_append(idx.ht_id, hash_joaat_str(call->id), &call->he_id, call);
+
+	rtprec_info(call->rec, "call-id", call->id);
+
+	return 0;
+}
+
+
 static void call_destructor(void *arg)
 {
 	struct call *call = arg;
@@ -381,6 +660,14 @@ static void call_destructor(void *arg)
 	list_unlink(&call->le);
 	tmr_cancel(&call->tmr_dtmf);
 
+	hash_unlink(&call->he_line);
+	hash_unlink(&call->he_id);
+	if (call->lines) {
+		linenum_free(call->lines, call->linenum);
+		mem_deref(call->lines);
+		index_release();
+	}
+
 	mem_deref(call->sess);
 	mem_deref(call->id);
 	mem_deref(call->local_uri);
@@ -398,6 +685,7 @@ static void call_destructor(void *arg)
 	mem_deref(call->sub);
 	mem_deref(call->not);
 	mem_deref(call->acc);
+	mem_deref(call->rec);
 
 	list_flush(&call->custom_hdrs);
 }
@@ -461,6 +749,9 @@ static void menc_event_handler(const enum menc_event event,
 	struct call *call = arg;
 	MAGIC_CHECK(call);
 
+	if (event == MENC_EVENT_SECURE)
+		call_mark(call, CALL_MARK_SECURE, tmr_jiffies());
+
 	if (strlen(prm) > 0)
 		call_event_handler(call, CALL_EVENT_MENC, "%u,%s", event,
 				   prm);
@@ -485,22 +776,6 @@ static void stream_error_handler(struct stream *strm, int err, void *arg)
 }
 
 
-static int assign_linenum(uint32_t *linenum, const struct list *lst)
-{
-	uint32_t num;
-
-	for (num=CALL_LINENUM_MIN; num<CALL_LINENUM_MAX; num++) {
-
-		if (!call_find_linenum(lst, num)) {
-			*linenum = num;
-			return 0;
-		}
-	}
-
-	return ENOENT;
-}
-
-
 /**
  * Allocate a new Call state object
  *
@@ -555,6 +830,8 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 
 	tmr_init(&call->tmr_inv);
 
+	call->markv[CALL_MARK_START] = tmr_jiffies();
+
 	call->acc    = mem_ref(acc);
 	call->ua     = ua;
 	call->state  = STATE_IDLE;
@@ -670,7 +947,7 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 		call_enable_rtp_timeout(call, cfg->avt.rtp_timeout*1000);
 	}
 
-	err = assign_linenum(&call->linenum, lst);
+	err = assign_linenum(call, lst);
 	if (err) {
 		warning("call: could not assign linenumber\n");
 		goto out;
@@ -758,6 +1035,8 @@ int call_connect(struct call *call, const struct pl *paddr)
 	if (err)
 		return err;
 
+	record_start(call);
+
 	set_state(call, STATE_OUTGOING);
 
 	/* If we are using asyncronous medianat like STUN/TURN, then
@@ -853,8 +1132,10 @@ int call_progress(struct call *call)
 			       desc, "Allow: %s\r\n",
 			       ua_allowed_methods(call->ua));
 
-	if (!err)
+	if (!err) {
+		call_mark(call, CALL_MARK_PROGRESS, tmr_jiffies());
 		call_stream_start(call, false);
+	}
 
 	mem_deref(desc);
 
@@ -885,7 +1166,7 @@ int call_answer(struct call *call, uint16_t scode)
 			return err;
 	}
 
-	err = sdp_encode(&desc, call->sdp, !call->got_offer);
+	err = call_sdp_get(call, &desc, !call->got_offer);
 	if (err)
 		return err;
 
@@ -965,7 +1246,13 @@ int call_hold(struct call *call, bool hold)
 
 int call_sdp_get(const struct call *call, struct mbuf **descp, bool offer)
 {
-	return sdp_encode(descp, call->sdp, offer);
+	int err;
+
+	err = sdp_encode(descp, call->sdp, offer);
+	if (!err)
+		rtprec_sdp(call->rec, true, *descp);
+
+	return err;
 }
 
 
@@ -1021,9 +1308,13 @@ int call_debug(struct re_printf *pf, const struct call *call)
 	err |= re_hprintf(pf, " direction: %s\n",
 			  call->outgoing ? "Outgoing" : "Incoming");
 
+	err |= re_hprintf(pf, " setup:     %H\n", call_timeline, call);
+
 	/* SDP debug */
 	err |= sdp_session_debug(pf, call->sdp);
 
+	err |= rtprec_debug(pf, call->rec);
+
 	return err;
 }
 
@@ -1154,7 +1445,7 @@ static int sipsess_offer_handler(struct mbuf **descp,
 	if (got_offer) {
 
 		/* Decode SDP Offer */
-		err = sdp_decode(call->sdp, msg->mb, true);
+		err = decode_sdp(call, msg->mb, true);
 		if (err) {
 			warning("call: reinvite: could not decode SDP offer:"
 				" %m\n", err);
@@ -1167,7 +1458,7 @@ static int sipsess_offer_handler(struct mbuf **descp,
 	}
 
 	/* Encode SDP Answer */
-	return sdp_encode(descp, call->sdp, !got_offer);
+	return call_sdp_get(call, descp, !got_offer);
 }
 
 
@@ -1183,7 +1474,7 @@ static int sipsess_answer_handler(const struct sip_msg *msg, void *arg)
 	if (msg_ctype_cmp(&msg->ctyp, "multipart", "mixed"))
 		(void)sdp_decode_multipart(&msg->ctyp.params, msg->mb);
 
-	err = sdp_decode(call->sdp, msg->mb, false);
+	err = decode_sdp(call, msg->mb, false);
 	if (err) {
 		warning("call: could not decode SDP answer: %m\n", err);
 		return err;
@@ -1210,6 +1501,8 @@ static void sipsess_estab_handler(const struct sip_msg *msg, void *arg)
 
 	set_state(call, STATE_ESTABLISHED);
 
+	call_mark(call, CALL_MARK_ANSWER, tmr_jiffies());
+
 	call_stream_start(call, true);
 
 	if (call->rtp_timeout_ms) {
@@ -1227,6 +1520,11 @@ static void sipsess_estab_handler(const struct sip_msg *msg, void *arg)
 		(void)call_notify_sipfrag(call, 200, "OK");
 	}
 
+	mark_rtp_tx(call);
+
+	ua_event(call->ua, UA_EVENT_CALL_SETUP, call, "%H",
+		 call_timeline, call);
+
 	/* must be done last, the handler might deref this call */
 	call_event_handler(call, CALL_EVENT_ESTABLISHED, call->peer_uri);
 }
@@ -1426,6 +1724,8 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 	if (!call || !msg)
 		return EINVAL;
 
+	call_mark(call, CALL_MARK_INVITE, tmr_jiffies());
+
 	call->outgoing = false;
 
 	got_offer = (mbuf_get_left(msg->mb) > 0);
@@ -1440,11 +1740,13 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 			return err;
 	}
 
+	record_start(call);
+
 	if (got_offer) {
 		struct sdp_media *m;
 		const struct sa *raddr;
 
-		err = sdp_decode(call->sdp, msg->mb, true);
+		err = decode_sdp(call, msg->mb, true);
 		if (err)
 			return err;
 
@@ -1505,8 +1807,7 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 		return err;
 	}
 
-	err = str_dup(&call->id,
-		      sip_dialog_callid(sipsess_dialog(call->sess)));
+	err = set_id(call);
 	if (err)
 		return err;
 
@@ -1538,6 +1839,8 @@ static void sipsess_progr_handler(const struct sip_msg *msg, void *arg)
 	if (msg->scode <= 100)
 		return;
 
+	call_mark(call, CALL_MARK_PROGRESS, tmr_jiffies());
+
 	/* check for 18x and content-type
 	 *
 	 * 1. start media-stream if application/sdp
@@ -1548,12 +1851,12 @@ static void sipsess_progr_handler(const struct sip_msg *msg, void *arg)
 	 */
 	if (msg_ctype_cmp(&msg->ctyp, "application", "sdp")
 	    && mbuf_get_left(msg->mb)
-	    && !sdp_decode(call->sdp, msg->mb, false)) {
+	    && !decode_sdp(call, msg->mb, false)) {
 		media = true;
 	}
 	else if (msg_ctype_cmp(&msg->ctyp, "multipart", "mixed") &&
 		 !sdp_decode_multipart(&msg->ctyp.params, msg->mb) &&
-		 !sdp_decode(call->sdp, msg->mb, false)) {
+		 !decode_sdp(call, msg->mb, false)) {
 		media = true;
 	}
 	else
@@ -1597,6 +1900,9 @@ static int send_invite(struct call *call)
 	if (err)
 		return err;
 
+	/* the DNS lookup of the peer is part of the INVITE transaction */
+	call_mark(call, CALL_MARK_INVITE, tmr_jiffies());
+
 #if 0
 	info("- - - - - S D P - O f f e r - - - - -\n"
 	     "%b"
@@ -1627,8 +1933,7 @@ static int send_invite(struct call *call)
 		goto out;
 	}
 
-	err = str_dup(&call->id,
-		      sip_dialog_callid(sipsess_dialog(call->sess)));
+	err = set_id(call);
 
 	/* save call setup timer */
 	call->time_conn = time(NULL);
@@ -1672,6 +1977,115 @@ uint32_t call_setup_duration(const struct call *call)
 }
 
 
+/**
+ * Mark a call setup milestone. Only the first time of each milestone
+ * is saved, and added to the setup histograms of the User-Agent.
+ *
+ * @param call Call object
+ * @param mark Call setup milestone
+ * @param ts   Timestamp in [ms], from tmr_jiffies()
+ */
+void call_mark(struct call *call, enum call_mark mark, uint64_t ts)
+{
+	uint64_t start;
+
+	if (!call || mark >= CALL_MARK_MAX || call->markv[mark])
+		return;
+
+	start = call->markv[CALL_MARK_START];
+
+	call->markv[mark] = ts;
+
+	if (mark == CALL_MARK_RTP_RX)
+		mark_rtp_tx(call);
+
+	ua_setup_add(call->ua, mark, ts > start ? (uint32_t)(ts - start) : 0);
+}
+
+
+/**
+ * Get the time from the start of the call to a setup milestone
+ *
+ * @param call Call object
+ * @param mark Call setup milestone
+ *
+ * @return Elapsed time in [ms], or -1 if the milestone is not reached
+ */
+int32_t call_mark_elapsed(const struct call *call, enum call_mark mark)
+{
+	uint64_t ts;
+
+	if (!call || mark >= CALL_MARK_MAX)
+		return -1;
+
+	ts = call->markv[mark];
+
+	if (!ts && mark == CALL_MARK_RTP_TX)
+		ts = streams_tx_first(call);
+
+	if (!ts)
+		return -1;
+
+	return (int32_t)(ts - call->markv[CALL_MARK_START]);
+}
+
+
+/**
+ * Get the name of a call setup milestone
+ *
+ * @param mark Call setup milestone
+ *
+ * @return Name of the milestone
+ */
+const char *call_mark_name(enum call_mark mark)
+{
+	switch (mark) {
+
+	case CALL_MARK_START:    return "start";
+	case CALL_MARK_MNAT:     return "mnat";
+	case CALL_MARK_INVITE:   return "invite";
+	case CALL_MARK_PROGRESS: return "progress";
+	case CALL_MARK_ANSWER:   return "answer";
+	case CALL_MARK_SECURE:   return "secure";
+	case CALL_MARK_RTP_TX:   return "rtp_tx";
+	case CALL_MARK_RTP_RX:   return "rtp_rx";
+	default:                 return "???";
+	}
+}
+
+
+/**
+ * Print the call setup timeline, as the time in [ms] from the start of
+ * the call to each milestone that is reached, e.g. "invite=2,answer=130"
+ *
+ * @param pf   Print handler
+ * @param call Call object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int call_timeline(struct re_printf *pf, const struct call *call)
+{
+	const char *sep = "";
+	int i, err = 0;
+
+	if (!call)
+		return 0;
+
+	for (i=CALL_MARK_START+1; i<CALL_MARK_MAX; i++) {
+
+		int32_t ms = call_mark_elapsed(call, i);
+
+		if (ms < 0)
+			continue;
+
+		err |= re_hprintf(pf, "%s%s=%d", sep, call_mark_name(i), ms);
+		sep = ",";
+	}
+
+	return err;
+}
+
+
 /**
  * Get the audio object for the current call
  *
@@ -1963,14 +2377,58 @@ uint32_t call_linenum(const struct call *call)
 }
 
 
+/**
+ * Find a call by line number
+ *
+ * @param calls   List of calls
+ * @param linenum Line number
+ *
+ * @return Call object if found, otherwise NULL
+ */
 struct call *call_find_linenum(const struct list *calls, uint32_t linenum)
 {
 	struct le *le;
 
-	for (le = list_head(calls); le; le = le->next) {
+	if (!calls)
+		return NULL;
+
+	le = list_head(hash_list(idx.ht_line, line_key(calls, linenum)));
+
+	for (; le; le = le->next) {
 		struct call *call = le->data;
 
-		if (linenum == call->linenum)
+		if (linenum == call->linenum && calls == call->lines->calls)
+			return call;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Find a call by SIP Call-ID
+ *
+ * @param calls List of calls, or NULL to search all calls
+ * @param id    SIP Call-ID
+ *
+ * @return Call object if found, otherwise NULL
+ */
+struct call *call_find_id(const struct list *calls, const char *id)
+{
+	struct le *le;
+
+	if (!str_isset(id))
+		return NULL;
+
+	le = list_head(hash_list(idx.ht_id, hash_joaat_str(id)));
+
+	for (; le; le = le->next) {
+		struct call *call = le->data;
+
+		if (calls && calls != call->lines->calls)
+			continue;
+
+		if (0 == str_cmp(call->id, id))
 			return call;
 	}
 
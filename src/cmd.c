@@ -12,14 +12,41 @@
 
 enum {
 	KEYCODE_DEL = 0x7f,
-	LONG_PREFIX = '/'
+	LONG_PREFIX = '/',
+	LONG_HASH_SIZE = 64,
+	TRIE_ROOT = 0,
 };
 
 
+/*
+ * The commands are indexed, so that a command is found without a scan
+ * of all registered commands. The long commands are in a hash table,
+ * the short commands in a table by key, and the names of the long
+ * commands in a prefix trie for TAB completion. The trie is rebuilt
+ * at the first completion after a change.
+ */
+
+
+struct cmd_ent {
+	struct le he;              /**< Member of the long command hash */
+	const struct cmd *cmd;
+};
+
 struct cmds {
 	struct le le;
+	struct commands *commands;
 	const struct cmd *cmdv;
 	size_t cmdc;
+	struct cmd_ent *entv;      /**< Hash entries, one per command   */
+};
+
+/** Prefix trie node, linked by index as the array may move */
+struct tnode {
+	uint32_t child;            /**< First child, 0 if none          */
+	uint32_t sibling;          /**< Next sibling, 0 if none         */
+	uint32_t count;            /**< Names with this prefix          */
+	const struct cmd *cmd;     /**< Last command with this prefix   */
+	char c;
 };
 
 struct cmd_ctx {
@@ -30,6 +57,12 @@ struct cmd_ctx {
 
 struct commands {
 	struct list cmdl;        /**< List of command blocks (struct cmds) */
+	struct hash *ht_long;    /**< Long commands by name                */
+	const struct cmd *keyv[256]; /**< Short commands by key            */
+	struct tnode *trie;      /**< Prefix trie of the long commands     */
+	uint32_t trie_n;         /**< Number of nodes in the trie          */
+	uint32_t trie_sz;        /**< Allocated nodes in the trie          */
+	bool trie_dirty;         /**< Trie must be rebuilt                 */
 };
 
 
@@ -39,11 +72,52 @@ static int cmd_print_all(struct re_printf *pf,
 			 const char *match, size_t match_len);
 
 
+static const struct cmd *key_scan(const struct commands *commands,
+				  char key)
+{
+	struct le *le;
+
+	for (le = commands->cmdl.tail; le; le = le->prev) {
+
+		struct cmds *cmds = le->data;
+		size_t i;
+
+		for (i=0; i<cmds->cmdc; i++) {
+
+			const struct cmd *cmd = &cmds->cmdv[i];
+
+			if (cmd->key == key && cmd->h)
+				return cmd;
+		}
+	}
+
+	return NULL;
+}
+
+
 static void destructor(void *arg)
 {
 	struct cmds *cmds = arg;
+	struct commands *commands = cmds->commands;
+	size_t i;
 
 	list_unlink(&cmds->le);
+
+	for (i=0; i<cmds->cmdc; i++) {
+
+		const struct cmd *cmd = &cmds->cmdv[i];
+		const uint8_t key = cmd->key;
+
+		if (cmds->entv)
+			hash_unlink(&cmds->entv[i].he);
+
+		if (key && commands->keyv[key] == cmd)
+			commands->keyv[key] = key_scan(commands, cmd->key);
+	}
+
+	commands->trie_dirty = true;
+
+	mem_deref(cmds->entv);
 }
 
 
@@ -60,6 +134,8 @@ static void commands_destructor(void *data)
 	struct commands *commands = data;
 
 	list_flush(&commands->cmdl);
+	mem_deref(commands->ht_long);
+	mem_deref(commands->trie);
 }
 
 
@@ -114,27 +190,132 @@ struct cmds *cmds_find(const struct commands *commands,
 
 static const struct cmd *cmd_find_by_key(const struct commands *commands,
 					 char key)
+{
+	if (!commands || !key)
+		return NULL;
+
+	return commands->keyv[(uint8_t)key];
+}
+
+
+static bool long_cmp_handler(struct le *le, void *arg)
+{
+	const struct cmd_ent *ent = le->data;
+	const struct pl *name = arg;
+
+	return 0 == pl_strcasecmp(name, ent->cmd->name);
+}
+
+
+static const struct cmd *find_long(const struct commands *commands,
+				   const struct pl *name)
 {
 	struct le *le;
 
-	if (!commands)
-		return NULL;
+	le = hash_lookup(commands->ht_long, hash_joaat_ci(name->p, name->l),
+			 long_cmp_handler, (void *)name);
 
-	for (le = commands->cmdl.tail; le; le = le->prev) {
+	return le ? ((struct cmd_ent *)le->data)->cmd : NULL;
+}
 
-		struct cmds *cmds = le->data;
+
+static int trie_alloc(struct commands *commands, uint32_t *ixp)
+{
+	if (commands->trie_n >= commands->trie_sz) {
+
+		uint32_t sz = max(commands->trie_sz * 2, 256);
+		struct tnode *trie;
+
+		trie = mem_realloc(commands->trie, sz * sizeof(*trie));
+		if (!trie)
+			return ENOMEM;
+
+		commands->trie    = trie;
+		commands->trie_sz = sz;
+	}
+
+	*ixp = commands->trie_n++;
+	memset(&commands->trie[*ixp], 0, sizeof(struct tnode));
+
+	return 0;
+}
+
+
+static int trie_node(struct commands *commands, uint32_t *ixp,
+		     uint32_t parent, char c)
+{
+	struct tnode *node;
+	uint32_t ix;
+	int err;
+
+	for (ix = commands->trie[parent].child; ix;
+	     ix = commands->trie[ix].sibling) {
+
+		if (commands->trie[ix].c == c) {
+			*ixp = ix;
+			return 0;
+		}
+	}
+
+	err = trie_alloc(commands, &ix);
+	if (err)
+		return err;
+
+	node = &commands->trie[ix];
+	node->c       = c;
+	node->sibling = commands->trie[parent].child;
+	commands->trie[parent].child = ix;
+
+	*ixp = ix;
+
+	return 0;
+}
+
+
+static int trie_build(struct commands *commands)
+{
+	struct le *le;
+	uint32_t root;
+	int err;
+
+	commands->trie_n = 0;
+
+	err = trie_alloc(commands, &root);
+	if (err)
+		return err;
+
+	for (le = commands->cmdl.head; le; le = le->next) {
+
+		const struct cmds *cmds = le->data;
 		size_t i;
 
 		for (i=0; i<cmds->cmdc; i++) {
 
 			const struct cmd *cmd = &cmds->cmdv[i];
+			const char *p;
+			uint32_t ix = TRIE_ROOT;
 
-			if (cmd->key == key && cmd->h)
-				return cmd;
+			if (!str_isset(cmd->name))
+				continue;
+
+			++commands->trie[ix].count;
+			commands->trie[ix].cmd = cmd;
+
+			for (p = cmd->name; *p; p++) {
+
+				err = trie_node(commands, &ix, ix, *p);
+				if (err)
+					return err;
+
+				++commands->trie[ix].count;
+				commands->trie[ix].cmd = cmd;
+			}
 		}
 	}
 
-	return NULL;
+	commands->trie_dirty = false;
+
+	return 0;
 }
 
 
@@ -157,38 +338,36 @@ static const char *cmd_name(char *buf, size_t sz, const struct cmd *cmd)
 }
 
 
-static size_t get_match_long(const struct commands *commands,
+static size_t get_match_long(struct commands *commands,
 			     const struct cmd **cmdp,
 			     const char *str, size_t len)
 {
-	struct le *le;
-	size_t nmatch = 0;
+	uint32_t ix = TRIE_ROOT;
+	size_t i;
 
 	if (!commands)
 		return 0;
 
-	for (le = commands->cmdl.head; le; le = le->next) {
-
-		struct cmds *cmds = le->data;
-		size_t i;
-
-		for (i=0; i<cmds->cmdc; i++) {
+	if (commands->trie_dirty && trie_build(commands))
+		return 0;
 
-			const struct cmd *cmd = &cmds->cmdv[i];
+	for (i=0; i<len; i++) {
 
-			if (!str_isset(cmd->name))
-				continue;
+		for (ix = commands->trie[ix].child; ix;
+		     ix = commands->trie[ix].sibling) {
 
-			if (str_len(cmd->name) >= len &&
-			    0 == memcmp(cmd->name, str, len)) {
-
-				++nmatch;
-				*cmdp = cmd;
-			}
+			if (commands->trie[ix].c == str[i])
+				break;
 		}
+
+		if (!ix)
+			return 0;
 	}
 
-	return nmatch;
+	if (commands->trie[ix].count)
+		*cmdp = commands->trie[ix].cmd;
+
+	return commands->trie[ix].count;
 }
 
 
@@ -315,11 +494,11 @@ int cmd_process_long(struct commands *commands, const char *str, size_t len,
 {
 	struct cmd_arg arg;
 	const struct cmd *cmd_long;
-	char *name = NULL, *prm = NULL;
+	char *prm = NULL;
 	struct pl pl_name, pl_prm;
 	int err;
 
-	if (!str || !len)
+	if (!commands || !str || !len)
 		return EINVAL;
 
 	memset(&arg, 0, sizeof(arg));
@@ -329,13 +508,13 @@ int cmd_process_long(struct commands *commands, const char *str, size_t len,
 		return err;
 	}
 
-	err = pl_strdup(&name, &pl_name);
-	if (pl_isset(&pl_prm))
-		err |= pl_strdup(&prm, &pl_prm);
-	if (err)
-		goto out;
+	if (pl_isset(&pl_prm)) {
+		err = pl_strdup(&prm, &pl_prm);
+		if (err)
+			goto out;
+	}
 
-	cmd_long = cmd_find_long(commands, name);
+	cmd_long = find_long(commands, &pl_name);
 	if (cmd_long) {
 
 		arg.key      = LONG_PREFIX;
@@ -347,11 +526,11 @@ int cmd_process_long(struct commands *commands, const char *str, size_t len,
 			err = cmd_long->h(pf_resp, &arg);
 	}
 	else {
-		err = re_hprintf(pf_resp, "command not found (%s)\n", name);
+		err = re_hprintf(pf_resp, "command not found (%r)\n",
+				 &pl_name);
 	}
 
  out:
-	mem_deref(name);
 	mem_deref(prm);
 
 	return err;
@@ -453,11 +632,39 @@ int cmd_register(struct commands *commands,
 	if (!cmds)
 		return ENOMEM;
 
+	cmds->commands = commands;
 	cmds->cmdv = cmdv;
 	cmds->cmdc = cmdc;
 
+	cmds->entv = mem_zalloc(cmdc * sizeof(*cmds->entv), NULL);
+	if (!cmds->entv) {
+		mem_deref(cmds);
+		return ENOMEM;
+	}
+
 	list_append(&commands->cmdl, &cmds->le, cmds);
 
+	/* index the commands at the head of their bucket, so the last
+	   registered block wins, and the first command within a block */
+	for (i=cmdc; i--;) {
+		const struct cmd *cmd = &cmdv[i];
+		struct cmd_ent *ent = &cmds->entv[i];
+
+		ent->cmd = cmd;
+
+		if (str_isset(cmd->name) && cmd->h) {
+			list_prepend(hash_list(commands->ht_long,
+					       hash_joaat_ci(cmd->name,
+						     str_len(cmd->name))),
+				     &ent->he, ent);
+		}
+
+		if (cmd->key && cmd->h)
+			commands->keyv[(uint8_t)cmd->key] = cmd;
+	}
+
+	commands->trie_dirty = true;
+
 	return 0;
 }
 
@@ -485,26 +692,14 @@ void cmd_unregister(struct commands *commands, const struct cmd *cmdv)
 const struct cmd *cmd_find_long(const struct commands *commands,
 				const char *name)
 {
-	struct le *le;
+	struct pl pl;
 
 	if (!commands || !name)
 		return NULL;
 
-	for (le = commands->cmdl.tail; le; le = le->prev) {
-
-		struct cmds *cmds = le->data;
-		size_t i;
-
-		for (i=0; i<cmds->cmdc; i++) {
+	pl_set_str(&pl, name);
 
-			const struct cmd *cmd = &cmds->cmdv[i];
-
-			if (0 == str_casecmp(name, cmd->name) && cmd->h)
-				return cmd;
-		}
-	}
-
-	return NULL;
+	return find_long(commands, &pl);
 }
 
 
@@ -752,6 +947,7 @@ int cmd_print(struct re_printf *pf, const struct commands *commands)
 int cmd_init(struct commands **commandsp)
 {
 	struct commands *commands;
+	int err;
 
 	if (!commandsp)
 		return EINVAL;
@@ -761,6 +957,13 @@ int cmd_init(struct commands **commandsp)
 		return ENOMEM;
 
 	list_init(&commands->cmdl);
+	commands->trie_dirty = true;
+
+	err = hash_alloc(&commands->ht_long, LONG_HASH_SIZE);
+	if (err) {
+		mem_deref(commands);
+		return err;
+	}
 
 	*commandsp = commands;
 
@@ -40,7 +40,7 @@
 
 
 static const char *conf_path = NULL;
-static struct conf *conf_obj;
+static struct confidx *conf_idx;
 
 
 /**
@@ -74,42 +74,92 @@ static void print_populated(const char *what, uint32_t n)
 
 
 /**
- * Parse a config file, calling handler for each line
+ * Load a file into memory with a single read
  *
- * @param filename Config file
- * @param ch       Line handler
- * @param arg      Handler argument
+ * @param mbp      Pointer to allocated buffer with the file contents
+ * @param filename File to load
  *
  * @return 0 if success, otherwise errorcode
  */
-int conf_parse(const char *filename, confline_h *ch, void *arg)
+int conf_load(struct mbuf **mbp, const char *filename)
 {
-	struct pl pl, val;
-	struct mbuf *mb;
-	int err = 0, fd = open(filename, O_RDONLY);
+	struct mbuf *mb = NULL;
+	struct stat st;
+	int err = 0, fd;
+
+	if (!mbp || !filename)
+		return EINVAL;
+
+	fd = open(filename, O_RDONLY);
 	if (fd < 0)
 		return errno;
 
-	mb = mbuf_alloc(1024);
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		goto out;
+	}
+
+	mb = mbuf_alloc(st.st_size + 1);
 	if (!mb) {
 		err = ENOMEM;
 		goto out;
 	}
 
+	/* the file may grow while it is read */
 	for (;;) {
-		uint8_t buf[1024];
+		ssize_t n;
+
+		if (mbuf_get_space(mb) == 0) {
+			err = mbuf_resize(mb, mb->size * 2);
+			if (err)
+				goto out;
+		}
 
-		const ssize_t n = read(fd, (void *)buf, sizeof(buf));
+		n = read(fd, mbuf_buf(mb), mbuf_get_space(mb));
 		if (n < 0) {
 			err = errno;
-			break;
+			goto out;
 		}
 		else if (n == 0)
 			break;
 
-		err |= mbuf_write_mem(mb, buf, n);
+		mb->pos += n;
+		mb->end  = mb->pos;
 	}
 
+	mb->pos = 0;
+
+ out:
+	(void)close(fd);
+
+	if (err)
+		mem_deref(mb);
+	else
+		*mbp = mb;
+
+	return err;
+}
+
+
+/**
+ * Parse a config file, calling handler for each line
+ *
+ * @param filename Config file
+ * @param ch       Line handler
+ * @param arg      Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_parse(const char *filename, confline_h *ch, void *arg)
+{
+	struct pl pl, val;
+	struct mbuf *mb = NULL;
+	int err;
+
+	err = conf_load(&mb, filename);
+	if (err)
+		return err;
+
 	pl.p = (const char *)mb->buf;
 	pl.l = mb->end;
 
@@ -126,9 +176,7 @@ int conf_parse(const char *filename, confline_h *ch, void *arg)
 		err = ch(&val, arg);
 	}
 
- out:
 	mem_deref(mb);
-	(void)close(fd);
 
 	return err;
 }
@@ -181,30 +229,37 @@ int conf_path_get(char *path, size_t sz)
 }
 
 
-int conf_get_range(const struct conf *conf, const char *name,
-		   struct range *rng)
+/**
+ * Decode a range config value, e.g. "10000-20000" or "8000"
+ *
+ * @param r    Config value
+ * @param name Config key, for warnings
+ * @param rng  Returned range
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_decode_range(const struct pl *r, const char *name,
+		      struct range *rng)
 {
-	struct pl r, min, max;
-	uint32_t v;
+	struct pl min, max;
 	int err;
 
-	err = conf_get(conf, name, &r);
-	if (err)
-		return err;
+	if (!r || !rng)
+		return EINVAL;
 
-	err = re_regex(r.p, r.l, "[0-9]+-[0-9]+", &min, &max);
+	err = re_regex(r->p, r->l, "[0-9]+-[0-9]+", &min, &max);
 	if (err) {
 		/* fallback to non-range numeric value */
-		err = conf_get_u32(conf, name, &v);
-		if (err) {
+		if (re_regex(r->p, r->l, "[0-9]+", &min) ||
+		    min.p != r->p || min.l != r->l) {
 			warning("conf: %s: could not parse range: (%r)\n",
-				name, &r);
-			return err;
+				name, r);
+			return EINVAL;
 		}
 
-		rng->min = rng->max = v;
+		rng->min = rng->max = pl_u32(r);
 
-		return err;
+		return 0;
 	}
 
 	rng->min = pl_u32(&min);
@@ -220,18 +275,28 @@ int conf_get_range(const struct conf *conf, const char *name,
 }
 
 
-int conf_get_csv(const struct conf *conf, const char *name,
-		 char *str1, size_t sz1, char *str2, size_t sz2)
+/**
+ * Decode a comma separated config value with two strings
+ *
+ * @param r    Config value
+ * @param str1 Buffer for the first string
+ * @param sz1  Size of the first buffer
+ * @param str2 Buffer for the second string
+ * @param sz2  Size of the second buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_decode_csv(const struct pl *r, char *str1, size_t sz1,
+		    char *str2, size_t sz2)
 {
-	struct pl r, pl1, pl2 = pl_null;
+	struct pl pl1, pl2 = pl_null;
 	int err;
 
-	err = conf_get(conf, name, &r);
-	if (err)
-		return err;
+	if (!r)
+		return EINVAL;
 
 	/* note: second value may be quoted */
-	err = re_regex(r.p, r.l, "[^,]+,[~]*", &pl1, &pl2);
+	err = re_regex(r->p, r->l, "[^,]+,[~]*", &pl1, &pl2);
 	if (err)
 		return err;
 
@@ -243,17 +308,26 @@ int conf_get_csv(const struct conf *conf, const char *name,
 }
 
 
-int conf_get_vidsz(const struct conf *conf, const char *name, struct vidsz *sz)
+/**
+ * Decode a video size config value, e.g. "640x480"
+ *
+ * @param r    Config value
+ * @param name Config key, for warnings
+ * @param sz   Returned video size
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_decode_vidsz(const struct pl *r, const char *name,
+		      struct vidsz *sz)
 {
-	struct pl r, w, h;
+	struct pl w, h;
 	int err;
 
-	err = conf_get(conf, name, &r);
-	if (err)
-		return err;
+	if (!r || !sz)
+		return EINVAL;
 
 	w.l = h.l = 0;
-	err = re_regex(r.p, r.l, "[0-9]+x[0-9]+", &w, &h);
+	err = re_regex(r->p, r->l, "[0-9]+x[0-9]+", &w, &h);
 	if (err)
 		return err;
 
@@ -273,6 +347,47 @@ int conf_get_vidsz(const struct conf *conf, const char *name, struct vidsz *sz)
 }
 
 
+int conf_get_range(const struct conf *conf, const char *name,
+		   struct range *rng)
+{
+	struct pl r;
+	int err;
+
+	err = conf_get(conf, name, &r);
+	if (err)
+		return err;
+
+	return conf_decode_range(&r, name, rng);
+}
+
+
+int conf_get_csv(const struct conf *conf, const char *name,
+		 char *str1, size_t sz1, char *str2, size_t sz2)
+{
+	struct pl r;
+	int err;
+
+	err = conf_get(conf, name, &r);
+	if (err)
+		return err;
+
+	return conf_decode_csv(&r, str1, sz1, str2, sz2);
+}
+
+
+int conf_get_vidsz(const struct conf *conf, const char *name, struct vidsz *sz)
+{
+	struct pl r;
+	int err;
+
+	err = conf_get(conf, name, &r);
+	if (err)
+		return err;
+
+	return conf_decode_vidsz(&r, name, sz);
+}
+
+
 int conf_get_sa(const struct conf *conf, const char *name, struct sa *sa)
 {
 	struct pl opt;
@@ -307,6 +422,29 @@ int conf_get_float(const struct conf *conf, const char *name, double *val)
 }
 
 
+/* Apply a config index and make it the current one */
+static int conf_install(struct confidx *idx)
+{
+	struct confidx *old;
+	int err;
+
+	err = config_parse_conf(conf_config(), idx);
+	if (err)
+		return err;
+
+	old = conf_idx;
+	conf_idx = mem_ref(idx);
+
+	/* on reload, notify the users of the keys that changed */
+	if (old)
+		confidx_notify(old, conf_idx);
+
+	mem_deref(old);
+
+	return 0;
+}
+
+
 /**
  * Configure the system with default settings
  *
@@ -315,6 +453,7 @@ int conf_get_float(const struct conf *conf, const char *name, double *val)
 int conf_configure(void)
 {
 	char path[FS_PATH_MAX], file[FS_PATH_MAX];
+	struct confidx *idx = NULL;
 	int err;
 
 #if defined (WIN32)
@@ -339,16 +478,40 @@ int conf_configure(void)
 			goto out;
 	}
 
-	conf_obj = mem_deref(conf_obj);
-	err = conf_alloc(&conf_obj, file);
+	err = confidx_alloc(&idx, file);
 	if (err)
 		goto out;
 
-	err = config_parse_conf(conf_config(), conf_obj);
-	if (err)
-		goto out;
+	err = conf_install(idx);
 
  out:
+	mem_deref(idx);
+
+	return err;
+}
+
+
+/**
+ * Configure the system from a buffer, instead of the config file
+ *
+ * @param buf Buffer with config
+ * @param sz  Size of the buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_configure_buf(const uint8_t *buf, size_t sz)
+{
+	struct confidx *idx = NULL;
+	int err;
+
+	err = confidx_alloc_buf(&idx, buf, sz);
+	if (err)
+		return err;
+
+	err = conf_install(idx);
+
+	mem_deref(idx);
+
 	return err;
 }
 
@@ -364,7 +527,7 @@ int conf_modules(void)
 {
 	int err;
 
-	err = module_init(conf_obj);
+	err = module_init(conf_idx);
 	if (err) {
 		warning("conf: configure module parse error (%m)\n", err);
 		goto out;
@@ -383,7 +546,8 @@ int conf_modules(void)
 
 
 /**
- * Get the current configuration object
+ * Get the current configuration object, for the libre config functions.
+ * Use conf_cur_index() to look up config keys without a file scan.
  *
  * @return Config object
  *
@@ -391,14 +555,30 @@ int conf_modules(void)
  */
 struct conf *conf_cur(void)
 {
-	if (!conf_obj) {
+	if (!conf_idx) {
 		warning("conf: no config object\n");
 	}
-	return conf_obj;
+	return confidx_conf(conf_idx);
+}
+
+
+/**
+ * Get the current configuration index
+ *
+ * @return Config index
+ *
+ * @note It is only available after init and before conf_close()
+ */
+struct confidx *conf_cur_index(void)
+{
+	if (!conf_idx) {
+		warning("conf: no config index\n");
+	}
+	return conf_idx;
 }
 
 
 void conf_close(void)
 {
-	conf_obj = mem_deref(conf_obj);
+	conf_idx = mem_deref(conf_idx);
 }
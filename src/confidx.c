@@ -0,0 +1,748 @@
+/**
+ * @file confidx.c  Configuration index
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page ConfIndex Configuration index
+ *
+ * The configuration index is built with a single pass over the config
+ * file, and maps each key to its value with a hash table. A lookup
+ * does not scan the config file, as conf_get() does.
+ *
+ * The keys and values follow the syntax of the libre config parser:
+ * the first word of a line is the key, and the second word is the
+ * value. As with conf_get(), the value may contain quoted whitespace.
+ * Lines without a value and comment lines are ignored. A key may be
+ * repeated, and confidx_get() returns the first value.
+ *
+ * The core and the modules read their config from the index returned
+ * by conf_cur_index(). conf_cur() returns a libre config object for
+ * the modules that use conf_get(), it is only made when asked for.
+ *
+ * A module can watch a set of keys with conf_watch_alloc(), and is
+ * notified when the config file is reloaded and the value of one of
+ * the keys has changed.
+ */
+
+
+enum {
+	HASH_MIN = 16,
+};
+
+
+/** Configuration index */
+struct confidx {
+	struct mbuf *mb;             /**< Config file contents               */
+	struct hash *ht;             /**< Entries by key (struct confent)    */
+	struct confent *entv;        /**< Entries in file order              */
+	uint32_t entc;               /**< Number of entries                  */
+	struct conf *conf;           /**< Config object, made on demand      */
+};
+
+/** One key and value in the configuration index */
+struct confent {
+	struct le he;
+	struct pl key;
+	struct pl val;
+};
+
+/** Watch of a set of config keys */
+struct conf_watch {
+	struct le le;
+	const char * const *keyv;    /**< Keys, "prefix*" matches a prefix   */
+	size_t keyc;                 /**< Number of keys                     */
+	conf_change_h *h;            /**< Change handler                     */
+	void *arg;                   /**< Handler argument                   */
+};
+
+
+static struct list watchl;
+
+
+static void destructor(void *arg)
+{
+	struct confidx *idx = arg;
+
+	hash_clear(idx->ht);
+	mem_deref(idx->ht);
+	mem_deref(idx->entv);
+	mem_deref(idx->conf);
+	mem_deref(idx->mb);
+}
+
+
+static void watch_destructor(void *arg)
+{
+	struct conf_watch *w = arg;
+
+	list_unlink(&w->le);
+}
+
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static uint32_t key_hash(const struct pl *key)
+{
+	return hash_joaat((const uint8_t *)key->p, key->l);
+}
+
+
+static bool key_cmp_handler(struct le *le, void *arg)
+{
+	const struct confent *ent = le->data;
+
+	return 0 == pl_cmp(&ent->key, arg);
+}
+
+
+static void index_line(struct confidx *idx, const char *p, const char *eol)
+{
+	struct confent *ent;
+	struct pl key, val;
+	bool quote = false;
+
+	while (p < eol && is_space(*p))
+		++p;
+
+	key.p = p;
+	while (p < eol && !is_space(*p))
+		++p;
+	key.l = p - key.p;
+
+	if (!key.l || key.p[0] == '#')
+		return;
+
+	while (p < eol && is_space(*p))
+		++p;
+
+	val.p = p;
+	while (p < eol) {
+
+		if (*p == '"')
+			quote = !quote;
+		else if (!quote && is_space(*p))
+			break;
+
+		++p;
+	}
+	val.l = p - val.p;
+
+	if (!val.l)
+		return;
+
+	ent = &idx->entv[idx->entc++];
+
+	ent->key = key;
+	ent->val = val;
+
+	hash_append(idx->ht, key_hash(&key), &ent->he, ent);
+}
+
+
+static int index_build(struct confidx *idx)
+{
+	const char *p = (const char *)idx->mb->buf;
+	const char *end = p + idx->mb->end;
+	uint32_t n = 1, bsize = HASH_MIN;
+	int err;
+
+	for (; p < end; p++) {
+		if (*p == '\n')
+			++n;
+	}
+
+	while (bsize < n / 2)
+		bsize <<= 1;
+
+	idx->entv = mem_zalloc(n * sizeof(*idx->entv), NULL);
+	if (!idx->entv)
+		return ENOMEM;
+
+	err = hash_alloc(&idx->ht, bsize);
+	if (err)
+		return err;
+
+	p = (const char *)idx->mb->buf;
+
+	while (p < end) {
+
+		const char *eol = memchr(p, '\n', end - p);
+
+		if (!eol)
+			eol = end;
+
+		index_line(idx, p, eol);
+
+		p = eol + 1;
+	}
+
+	return 0;
+}
+
+
+static int index_alloc(struct confidx **idxp, struct mbuf *mb)
+{
+	struct confidx *idx;
+	int err;
+
+	idx = mem_zalloc(sizeof(*idx), destructor);
+	if (!idx)
+		return ENOMEM;
+
+	idx->mb = mem_ref(mb);
+
+	err = index_build(idx);
+
+	if (err)
+		mem_deref(idx);
+	else
+		*idxp = idx;
+
+	return err;
+}
+
+
+/**
+ * Allocate a configuration index from a config file
+ *
+ * @param idxp     Pointer to allocated config index
+ * @param filename Config file
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_alloc(struct confidx **idxp, const char *filename)
+{
+	struct mbuf *mb = NULL;
+	int err;
+
+	if (!idxp || !filename)
+		return EINVAL;
+
+	err = conf_load(&mb, filename);
+	if (err)
+		return err;
+
+	err = index_alloc(idxp, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Allocate a configuration index from a buffer
+ *
+ * @param idxp Pointer to allocated config index
+ * @param buf  Buffer with config
+ * @param sz   Size of the buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_alloc_buf(struct confidx **idxp, const uint8_t *buf, size_t sz)
+{
+	struct mbuf *mb;
+	int err;
+
+	if (!idxp || !buf)
+		return EINVAL;
+
+	mb = mbuf_alloc(sz);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_mem(mb, buf, sz);
+	if (err)
+		goto out;
+
+	err = index_alloc(idxp, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Get the value of a config key
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param val  Returned value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get(const struct confidx *idx, const char *name, struct pl *val)
+{
+	const struct confent *ent;
+	struct pl key;
+
+	if (!idx || !name || !val)
+		return EINVAL;
+
+	pl_set_str(&key, name);
+
+	ent = list_ledata(hash_lookup(idx->ht, key_hash(&key),
+				      key_cmp_handler, &key));
+	if (!ent)
+		return ENOENT;
+
+	*val = ent->val;
+
+	return 0;
+}
+
+
+/**
+ * Get the value of a config key as a string
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param str  Buffer for the value
+ * @param size Size of the buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_str(const struct confidx *idx, const char *name,
+		    char *str, size_t size)
+{
+	struct pl val;
+	int err;
+
+	if (!str || !size)
+		return EINVAL;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	return pl_strcpy(&val, str, size);
+}
+
+
+/**
+ * Get the value of a config key as a number
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param num  Returned number
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_u32(const struct confidx *idx, const char *name,
+		    uint32_t *num)
+{
+	struct pl val;
+	int err;
+
+	if (!num)
+		return EINVAL;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	*num = pl_u32(&val);
+
+	return 0;
+}
+
+
+/**
+ * Get the value of a config key as a boolean
+ *
+ * As with conf_get_bool(), "yes", "true" and "1" are true, and any
+ * other value is false.
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param val  Returned boolean
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_bool(const struct confidx *idx, const char *name,
+		     bool *val)
+{
+	struct pl pl;
+	int err;
+
+	if (!val)
+		return EINVAL;
+
+	err = confidx_get(idx, name, &pl);
+	if (err)
+		return err;
+
+	*val = !pl_strcasecmp(&pl, "yes") || !pl_strcasecmp(&pl, "true") ||
+		!pl_strcasecmp(&pl, "1");
+
+	return 0;
+}
+
+
+/**
+ * Get the value of a config key as a floating point number
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param val  Returned number
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_float(const struct confidx *idx, const char *name,
+		      double *val)
+{
+	struct pl pl;
+	int err;
+
+	if (!val)
+		return EINVAL;
+
+	err = confidx_get(idx, name, &pl);
+	if (err)
+		return err;
+
+	*val = pl_float(&pl);
+
+	return 0;
+}
+
+
+/**
+ * Get the value of a config key as a range, e.g. "10000-20000"
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param rng  Returned range
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_range(const struct confidx *idx, const char *name,
+		      struct range *rng)
+{
+	struct pl val;
+	int err;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	return conf_decode_range(&val, name, rng);
+}
+
+
+/**
+ * Get the value of a config key as two comma separated strings
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param str1 Buffer for the first string
+ * @param sz1  Size of the first buffer
+ * @param str2 Buffer for the second string
+ * @param sz2  Size of the second buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_csv(const struct confidx *idx, const char *name,
+		    char *str1, size_t sz1, char *str2, size_t sz2)
+{
+	struct pl val;
+	int err;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	return conf_decode_csv(&val, str1, sz1, str2, sz2);
+}
+
+
+/**
+ * Get the value of a config key as a video size, e.g. "640x480"
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param sz   Returned video size
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_vidsz(const struct confidx *idx, const char *name,
+		      struct vidsz *sz)
+{
+	struct pl val;
+	int err;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	return conf_decode_vidsz(&val, name, sz);
+}
+
+
+/**
+ * Get the value of a config key as a network address
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param sa   Returned network address
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_get_sa(const struct confidx *idx, const char *name,
+		   struct sa *sa)
+{
+	struct pl val;
+	int err;
+
+	if (!sa)
+		return EINVAL;
+
+	err = confidx_get(idx, name, &val);
+	if (err)
+		return err;
+
+	return sa_decode(sa, val.p, val.l);
+}
+
+
+/**
+ * Call a handler for each value of a config key, in file order
+ *
+ * @param idx  Config index
+ * @param name Config key
+ * @param ch   Value handler
+ * @param arg  Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confidx_apply(const struct confidx *idx, const char *name,
+		  conf_h *ch, void *arg)
+{
+	struct pl key;
+	struct le *le;
+	int err = 0;
+
+	if (!idx || !name || !ch)
+		return EINVAL;
+
+	pl_set_str(&key, name);
+
+	le = list_head(hash_list(idx->ht, key_hash(&key)));
+	for (; le && !err; le = le->next) {
+
+		const struct confent *ent = le->data;
+
+		if (pl_cmp(&ent->key, &key))
+			continue;
+
+		err = ch(&ent->val, arg);
+	}
+
+	return err;
+}
+
+
+/**
+ * Get the number of values in a config index
+ *
+ * @param idx Config index
+ *
+ * @return Number of values
+ */
+uint32_t confidx_count(const struct confidx *idx)
+{
+	return idx ? idx->entc : 0;
+}
+
+
+/* compare all values of one key, in file order */
+static bool key_changed(const struct confidx *old, const struct confidx *idx,
+			const struct pl *key)
+{
+	const uint32_t hash = key_hash(key);
+	struct le *le1 = old ? list_head(hash_list(old->ht, hash)) : NULL;
+	struct le *le2 = idx ? list_head(hash_list(idx->ht, hash)) : NULL;
+
+	for (;;) {
+		const struct confent *e1 = NULL, *e2 = NULL;
+
+		for (; le1 && !e1; le1 = le1->next) {
+			if (!pl_cmp(&((struct confent *)le1->data)->key, key))
+				e1 = le1->data;
+		}
+
+		for (; le2 && !e2; le2 = le2->next) {
+			if (!pl_cmp(&((struct confent *)le2->data)->key, key))
+				e2 = le2->data;
+		}
+
+		if (!e1 && !e2)
+			return false;
+
+		if (!e1 || !e2 || pl_cmp(&e1->val, &e2->val))
+			return true;
+	}
+}
+
+
+static bool prefix_changed(const struct confidx *old,
+			   const struct confidx *idx,
+			   const struct confidx *scan, const struct pl *pfx)
+{
+	uint32_t i;
+
+	if (!scan)
+		return false;
+
+	for (i=0; i<scan->entc; i++) {
+
+		const struct confent *ent = &scan->entv[i];
+
+		if (ent->key.l < pfx->l ||
+		    memcmp(ent->key.p, pfx->p, pfx->l))
+			continue;
+
+		if (key_changed(old, idx, &ent->key))
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Check if the values of a config key are different in two indexes
+ *
+ * @param old  Previous config index, may be NULL
+ * @param idx  New config index, may be NULL
+ * @param key  Config key, or a key prefix ending with '*'
+ *
+ * @return True if the values are different, otherwise false
+ */
+bool confidx_changed(const struct confidx *old, const struct confidx *idx,
+		     const char *key)
+{
+	struct pl pl;
+
+	if (!key)
+		return false;
+
+	pl_set_str(&pl, key);
+
+	if (!pl.l || key[pl.l - 1] != '*')
+		return key_changed(old, idx, &pl);
+
+	--pl.l;
+
+	return prefix_changed(old, idx, old, &pl) ||
+		prefix_changed(old, idx, idx, &pl);
+}
+
+
+/**
+ * Get the libre config object of a config index, for conf_get() and
+ * the other libre config functions
+ *
+ * The object has its own copy of the config, and is made on the first
+ * call. The core and the modules use the config index instead.
+ *
+ * @param idx Config index
+ *
+ * @return Config object
+ */
+struct conf *confidx_conf(struct confidx *idx)
+{
+	int err;
+
+	if (!idx)
+		return NULL;
+
+	if (!idx->conf) {
+		err = conf_alloc_buf(&idx->conf, idx->mb->buf, idx->mb->end);
+		if (err)
+			warning("conf: config object failed (%m)\n", err);
+	}
+
+	return idx->conf;
+}
+
+
+/**
+ * Watch a set of config keys for changes
+ *
+ * The handler is called when the config file is reloaded, and one or
+ * more of the keys have changed. The key vector must be valid as long
+ * as the watch is allocated.
+ *
+ * @param watchp Pointer to allocated watch
+ * @param keyv   Config keys, "prefix*" matches all keys with the prefix
+ * @param keyc   Number of config keys
+ * @param h      Change handler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int conf_watch_alloc(struct conf_watch **watchp,
+		     const char * const *keyv, size_t keyc,
+		     conf_change_h *h, void *arg)
+{
+	struct conf_watch *w;
+
+	if (!watchp || !keyv || !keyc || !h)
+		return EINVAL;
+
+	w = mem_zalloc(sizeof(*w), watch_destructor);
+	if (!w)
+		return ENOMEM;
+
+	w->keyv = keyv;
+	w->keyc = keyc;
+	w->h    = h;
+	w->arg  = arg;
+
+	list_append(&watchl, &w->le, w);
+
+	*watchp = w;
+
+	return 0;
+}
+
+
+/**
+ * Notify the config watches with changed keys
+ *
+ * @param old Previous config index
+ * @param idx New config index
+ */
+void confidx_notify(const struct confidx *old, const struct confidx *idx)
+{
+	struct le *le = watchl.head;
+
+	while (le) {
+		struct conf_watch *w = le->data;
+		size_t i;
+
+		le = le->next;
+
+		for (i=0; i<w->keyc; i++) {
+
+			if (confidx_changed(old, idx, w->keyv[i])) {
+				w->h(idx, w->arg);
+				break;
+			}
+		}
+	}
+}
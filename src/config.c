@@ -32,7 +32,10 @@ static struct config core_config = {
 		16,
 		"",
 		"",
-		""
+		"",
+		0,
+		0,
+		0
 	},
 
 	/** Call config */
@@ -70,6 +73,10 @@ static struct config core_config = {
 		25,
 		true,
 		VID_FMT_YUV420P,
+		0,
+		0,
+		false,
+		false,
 	},
 #endif
 
@@ -155,14 +162,14 @@ static enum aufmt resolve_aufmt(const struct pl *fmt)
 }
 
 
-static int conf_get_aufmt(const struct conf *conf, const char *name,
+static int conf_get_aufmt(const struct confidx *idx, const char *name,
 			  int *fmtp)
 {
 	struct pl pl;
 	int fmt;
 	int err;
 
-	err = conf_get(conf, name, &pl);
+	err = confidx_get(idx, name, &pl);
 	if (err)
 		return err;
 
@@ -180,14 +187,14 @@ static int conf_get_aufmt(const struct conf *conf, const char *name,
 
 
 #ifdef USE_VIDEO
-static int conf_get_vidfmt(const struct conf *conf, const char *name,
+static int conf_get_vidfmt(const struct confidx *idx, const char *name,
 			   int *fmtp)
 {
 	struct pl pl;
 	int fmt;
 	int err;
 
-	err = conf_get(conf, name, &pl);
+	err = confidx_get(idx, name, &pl);
 	if (err)
 		return err;
 
@@ -213,24 +220,25 @@ static int conf_get_vidfmt(const struct conf *conf, const char *name,
  * Parse the core configuration file and update baresip core config
  *
  * @param cfg  Baresip core config to update
- * @param conf Configuration file to parse
+ * @param idx  Configuration index to parse
  *
  * @return 0 if success, otherwise errorcode
  */
-int config_parse_conf(struct config *cfg, const struct conf *conf)
+int config_parse_conf(struct config *cfg, const struct confidx *idx)
 {
 	struct pl pollm, as, ap;
 	enum poll_method method;
+	bool async;
 	struct vidsz size = {0, 0};
 	struct pl txmode;
 	uint32_t v;
 	int err = 0;
 
-	if (!cfg || !conf)
+	if (!cfg || !idx)
 		return EINVAL;
 
 	/* Core */
-	if (0 == conf_get(conf, "poll_method", &pollm)) {
+	if (0 == confidx_get(idx, "poll_method", &pollm)) {
 		if (0 == poll_method_type(&method, &pollm)) {
 			err = poll_method_set(method);
 			if (err) {
@@ -243,48 +251,59 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 		}
 	}
 
+	if (0 == confidx_get_bool(idx, "log_async", &async)) {
+		err = log_enable_async(async);
+		if (err) {
+			warning("config: async logging: %m\n", err);
+		}
+	}
+
 	/* SIP */
-	(void)conf_get_u32(conf, "sip_trans_bsize", &cfg->sip.trans_bsize);
-	(void)conf_get_str(conf, "sip_listen", cfg->sip.local,
-			   sizeof(cfg->sip.local));
-	(void)conf_get_str(conf, "sip_certificate", cfg->sip.cert,
-			   sizeof(cfg->sip.cert));
+	(void)confidx_get_u32(idx, "sip_trans_bsize", &cfg->sip.trans_bsize);
+	(void)confidx_get_str(idx, "sip_listen", cfg->sip.local,
+			      sizeof(cfg->sip.local));
+	(void)confidx_get_str(idx, "sip_certificate", cfg->sip.cert,
+			      sizeof(cfg->sip.cert));
+	(void)confidx_get_u32(idx, "sip_reg_rate", &cfg->sip.reg_rate);
+	(void)confidx_get_u32(idx, "sip_reg_inflight", &cfg->sip.reg_inflight);
+	(void)confidx_get_u32(idx, "sip_reg_window", &cfg->sip.reg_window);
 
 	/* Call */
-	(void)conf_get_u32(conf, "call_local_timeout",
-			   &cfg->call.local_timeout);
-	(void)conf_get_u32(conf, "call_max_calls",
-			   &cfg->call.max_calls);
+	(void)confidx_get_u32(idx, "call_local_timeout",
+			      &cfg->call.local_timeout);
+	(void)confidx_get_u32(idx, "call_max_calls",
+			      &cfg->call.max_calls);
 
 	/* Audio */
-	(void)conf_get_str(conf, "audio_path", cfg->audio.audio_path,
-			   sizeof(cfg->audio.audio_path));
-	(void)conf_get_csv(conf, "audio_player",
-			   cfg->audio.play_mod,
-			   sizeof(cfg->audio.play_mod),
-			   cfg->audio.play_dev,
-			   sizeof(cfg->audio.play_dev));
-
-	(void)conf_get_csv(conf, "audio_source",
-			   cfg->audio.src_mod, sizeof(cfg->audio.src_mod),
-			   cfg->audio.src_dev, sizeof(cfg->audio.src_dev));
-
-	(void)conf_get_csv(conf, "audio_alert",
-			   cfg->audio.alert_mod,
-			   sizeof(cfg->audio.alert_mod),
-			   cfg->audio.alert_dev,
-			   sizeof(cfg->audio.alert_dev));
-
-	(void)conf_get_u32(conf, "ausrc_srate", &cfg->audio.srate_src);
-	(void)conf_get_u32(conf, "auplay_srate", &cfg->audio.srate_play);
-	(void)conf_get_u32(conf, "ausrc_channels", &cfg->audio.channels_src);
-	(void)conf_get_u32(conf, "auplay_channels", &cfg->audio.channels_play);
-
-	if (0 == conf_get(conf, "audio_source", &as) &&
-	    0 == conf_get(conf, "audio_player", &ap))
+	(void)confidx_get_str(idx, "audio_path", cfg->audio.audio_path,
+			      sizeof(cfg->audio.audio_path));
+	(void)confidx_get_csv(idx, "audio_player",
+			      cfg->audio.play_mod,
+			      sizeof(cfg->audio.play_mod),
+			      cfg->audio.play_dev,
+			      sizeof(cfg->audio.play_dev));
+
+	(void)confidx_get_csv(idx, "audio_source",
+			      cfg->audio.src_mod, sizeof(cfg->audio.src_mod),
+			      cfg->audio.src_dev, sizeof(cfg->audio.src_dev));
+
+	(void)confidx_get_csv(idx, "audio_alert",
+			      cfg->audio.alert_mod,
+			      sizeof(cfg->audio.alert_mod),
+			      cfg->audio.alert_dev,
+			      sizeof(cfg->audio.alert_dev));
+
+	(void)confidx_get_u32(idx, "ausrc_srate", &cfg->audio.srate_src);
+	(void)confidx_get_u32(idx, "auplay_srate", &cfg->audio.srate_play);
+	(void)confidx_get_u32(idx, "ausrc_channels", &cfg->audio.channels_src);
+	(void)confidx_get_u32(idx, "auplay_channels",
+			      &cfg->audio.channels_play);
+
+	if (0 == confidx_get(idx, "audio_source", &as) &&
+	    0 == confidx_get(idx, "audio_player", &ap))
 		cfg->audio.src_first = as.p < ap.p;
 
-	if (0 == conf_get(conf, "audio_txmode", &txmode)) {
+	if (0 == confidx_get(idx, "audio_txmode", &txmode)) {
 
 		if (0 == pl_strcasecmp(&txmode, "poll"))
 			cfg->audio.txmode = AUDIO_MODE_POLL;
@@ -295,67 +314,78 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 		}
 	}
 
-	(void)conf_get_bool(conf, "audio_level", &cfg->audio.level);
+	(void)confidx_get_bool(idx, "audio_level", &cfg->audio.level);
 
-	conf_get_aufmt(conf, "ausrc_format", &cfg->audio.src_fmt);
-	conf_get_aufmt(conf, "auplay_format", &cfg->audio.play_fmt);
-	conf_get_aufmt(conf, "auenc_format", &cfg->audio.enc_fmt);
-	conf_get_aufmt(conf, "audec_format", &cfg->audio.dec_fmt);
+	conf_get_aufmt(idx, "ausrc_format", &cfg->audio.src_fmt);
+	conf_get_aufmt(idx, "auplay_format", &cfg->audio.play_fmt);
+	conf_get_aufmt(idx, "auenc_format", &cfg->audio.enc_fmt);
+	conf_get_aufmt(idx, "audec_format", &cfg->audio.dec_fmt);
 
 #ifdef USE_VIDEO
 	/* Video */
-	(void)conf_get_csv(conf, "video_source",
-			   cfg->video.src_mod, sizeof(cfg->video.src_mod),
-			   cfg->video.src_dev, sizeof(cfg->video.src_dev));
-	(void)conf_get_csv(conf, "video_display",
-			   cfg->video.disp_mod, sizeof(cfg->video.disp_mod),
-			   cfg->video.disp_dev, sizeof(cfg->video.disp_dev));
-	if (0 == conf_get_vidsz(conf, "video_size", &size)) {
+	(void)confidx_get_csv(idx, "video_source",
+			      cfg->video.src_mod, sizeof(cfg->video.src_mod),
+			      cfg->video.src_dev, sizeof(cfg->video.src_dev));
+	(void)confidx_get_csv(idx, "video_display",
+			      cfg->video.disp_mod,
+			      sizeof(cfg->video.disp_mod),
+			      cfg->video.disp_dev,
+			      sizeof(cfg->video.disp_dev));
+	if (0 == confidx_get_vidsz(idx, "video_size", &size)) {
 		cfg->video.width  = size.w;
 		cfg->video.height = size.h;
 	}
-	(void)conf_get_u32(conf, "video_bitrate", &cfg->video.bitrate);
-	(void)conf_get_float(conf, "video_fps", &cfg->video.fps);
-	(void)conf_get_bool(conf, "video_fullscreen", &cfg->video.fullscreen);
-
-	conf_get_vidfmt(conf, "videnc_format", &cfg->video.enc_fmt);
+	(void)confidx_get_u32(idx, "video_bitrate", &cfg->video.bitrate);
+	(void)confidx_get_float(idx, "video_fps", &cfg->video.fps);
+	(void)confidx_get_bool(idx, "video_fullscreen",
+			       &cfg->video.fullscreen);
+
+	conf_get_vidfmt(idx, "videnc_format", &cfg->video.enc_fmt);
+	(void)confidx_get_u32(idx, "video_fec_key", &cfg->video.fec_key);
+	(void)confidx_get_u32(idx, "video_fec_delta", &cfg->video.fec_delta);
+	(void)confidx_get_bool(idx, "video_adapt", &cfg->video.adapt);
+	(void)confidx_get_bool(idx, "video_bwe", &cfg->video.bwe);
 #else
 	(void)size;
 #endif
 
 	/* AVT - Audio/Video Transport */
-	if (0 == conf_get_u32(conf, "rtp_tos", &v))
+	if (0 == confidx_get_u32(idx, "rtp_tos", &v))
 		cfg->avt.rtp_tos = v;
-	(void)conf_get_range(conf, "rtp_ports", &cfg->avt.rtp_ports);
-	if (0 == conf_get_range(conf, "rtp_bandwidth",
-				&cfg->avt.rtp_bw)) {
+	(void)confidx_get_range(idx, "rtp_ports", &cfg->avt.rtp_ports);
+	if (0 == confidx_get_range(idx, "rtp_bandwidth",
+				   &cfg->avt.rtp_bw)) {
 		cfg->avt.rtp_bw.min *= 1000;
 		cfg->avt.rtp_bw.max *= 1000;
 	}
-	(void)conf_get_bool(conf, "rtcp_enable", &cfg->avt.rtcp_enable);
-	(void)conf_get_bool(conf, "rtcp_mux", &cfg->avt.rtcp_mux);
-	(void)conf_get_range(conf, "jitter_buffer_delay",
-			     &cfg->avt.jbuf_del);
-	(void)conf_get_bool(conf, "rtp_stats", &cfg->avt.rtp_stats);
-	(void)conf_get_u32(conf, "rtp_timeout", &cfg->avt.rtp_timeout);
+	(void)confidx_get_bool(idx, "rtcp_enable", &cfg->avt.rtcp_enable);
+	(void)confidx_get_bool(idx, "rtcp_mux", &cfg->avt.rtcp_mux);
+	(void)confidx_get_range(idx, "jitter_buffer_delay",
+				&cfg->avt.jbuf_del);
+	(void)confidx_get_bool(idx, "rtp_stats", &cfg->avt.rtp_stats);
+	(void)confidx_get_u32(idx, "rtp_timeout", &cfg->avt.rtp_timeout);
+	(void)confidx_get_str(idx, "rtp_record_path", cfg->avt.rec_path,
+			      sizeof(cfg->avt.rec_path));
+	(void)confidx_get_float(idx, "rtp_mos_threshold",
+				&cfg->avt.mos_threshold);
 
 	if (err) {
 		warning("config: configure parse error (%m)\n", err);
 	}
 
 	/* Network */
-	(void)conf_apply(conf, "dns_server", dns_server_handler, &cfg->net);
-	(void)conf_get_str(conf, "net_interface",
-			   cfg->net.ifname, sizeof(cfg->net.ifname));
+	(void)confidx_apply(idx, "dns_server", dns_server_handler, &cfg->net);
+	(void)confidx_get_str(idx, "net_interface",
+			      cfg->net.ifname, sizeof(cfg->net.ifname));
 
 #ifdef USE_VIDEO
 	/* BFCP */
-	(void)conf_get_str(conf, "bfcp_proto", cfg->bfcp.proto,
-			   sizeof(cfg->bfcp.proto));
+	(void)confidx_get_str(idx, "bfcp_proto", cfg->bfcp.proto,
+			      sizeof(cfg->bfcp.proto));
 #endif
 
 	/* SDP */
-	(void)conf_get_bool(conf, "sdp_ebuacip", &cfg->sdp.ebuacip);
+	(void)confidx_get_bool(idx, "sdp_ebuacip", &cfg->sdp.ebuacip);
 
 	return err;
 }
@@ -382,6 +412,9 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "sip_trans_bsize\t\t%u\n"
 			 "sip_listen\t\t%s\n"
 			 "sip_certificate\t%s\n"
+			 "sip_reg_rate\t\t%u\n"
+			 "sip_reg_inflight\t%u\n"
+			 "sip_reg_window\t\t%u\n"
 			 "\n"
 			 "# Call\n"
 			 "call_local_timeout\t%u\n"
@@ -407,6 +440,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "video_fps\t\t%.2f\n"
 			 "video_fullscreen\t%s\n"
 			 "videnc_format\t\t%s\n"
+			 "video_fec_key\t\t%u\n"
+			 "video_fec_delta\t\t%u\n"
+			 "video_adapt\t\t%s\n"
+			 "video_bwe\t\t%s\n"
 			 "\n"
 #endif
 			 "# AVT\n"
@@ -418,6 +455,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "jitter_buffer_delay\t%H\n"
 			 "rtp_stats\t\t%s\n"
 			 "rtp_timeout\t\t%u # in seconds\n"
+			 "rtp_record_path\t\t%s\n"
+			 "rtp_mos_threshold\t%.2f\n"
 			 "\n"
 			 "# Network\n"
 			 "net_interface\t\t%s\n"
@@ -430,6 +469,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 ,
 
 			 cfg->sip.trans_bsize, cfg->sip.local, cfg->sip.cert,
+			 cfg->sip.reg_rate, cfg->sip.reg_inflight,
+			 cfg->sip.reg_window,
 
 			 cfg->call.local_timeout,
 			 cfg->call.max_calls,
@@ -449,6 +490,9 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->video.bitrate, cfg->video.fps,
 			 cfg->video.fullscreen ? "yes" : "no",
 			 vidfmt_name(cfg->video.enc_fmt),
+			 cfg->video.fec_key, cfg->video.fec_delta,
+			 cfg->video.adapt ? "yes" : "no",
+			 cfg->video.bwe ? "yes" : "no",
 #endif
 
 			 cfg->avt.rtp_tos,
@@ -459,6 +503,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 range_print, &cfg->avt.jbuf_del,
 			 cfg->avt.rtp_stats ? "yes" : "no",
 			 cfg->avt.rtp_timeout,
+			 cfg->avt.rec_path,
+			 cfg->avt.mos_threshold,
 
 			 cfg->net.ifname
 
@@ -550,10 +596,14 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 				", kqueue .."
 #endif
 				"\n"
+			  "#log_async\t\tno\t\t# Log from a writer thread\n"
 			  "\n# SIP\n"
 			  "sip_trans_bsize\t\t128\n"
 			  "#sip_listen\t\t0.0.0.0:5060\n"
 			  "#sip_certificate\tcert.pem\n"
+			  "#sip_reg_rate\t\t50\t\t# REGISTERs per second\n"
+			  "#sip_reg_inflight\t100\n"
+			  "#sip_reg_window\t\t30\t\t# seconds\n"
 			  "\n"
 			  "# Call\n"
 			  "call_local_timeout\t%u\n"
@@ -598,6 +648,10 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "video_fps\t\t%.2f\n"
 			  "video_fullscreen\tyes\n"
 			  "videnc_format\t\t%s\n"
+			  "#video_fec_key\t\t0\t\t# FEC level in percent\n"
+			  "#video_fec_delta\t0\t\t# FEC level in percent\n"
+			  "#video_adapt\t\tno\t\t# Adapt to CPU load\n"
+			  "#video_bwe\t\tno\t\t# Adapt to RTCP feedback\n"
 			  ,
 			  default_video_device(),
 			  default_video_display(),
@@ -616,6 +670,8 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "jitter_buffer_delay\t%u-%u\t\t# frames\n"
 			  "rtp_stats\t\tno\n"
 			  "#rtp_timeout\t\t60\n"
+			  "#rtp_record_path\t/var/spool/baresip\n"
+			  "#rtp_mos_threshold\t3.6 # CALL_QUALITY events\n"
 			  "\n# Network\n"
 			  "#dns_server\t\t10.0.0.1:53\n"
 			  "#net_interface\t\t%H\n",
@@ -740,6 +796,8 @@ int config_write_template(const char *file, const struct config *cfg)
 	modpath = detect_module_path(&modpath_valid);
 	(void)re_fprintf(f, "%smodule_path\t\t%s\n",
 			 modpath_valid ? "" : "#", modpath);
+	(void)re_fprintf(f, "#module_lazy\t\tno\n");
+	(void)re_fprintf(f, "#module_profile\t\tno\n");
 
 	(void)re_fprintf(f, "\n# UI Modules\n");
 #if defined (WIN32)
@@ -889,6 +947,7 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "#module_app\t\t"  MOD_PRE "echo"MOD_EXT"\n");
 	(void)re_fprintf(f, "#module_app\t\t" MOD_PRE "gtk" MOD_EXT "\n");
 	(void)re_fprintf(f, "module_app\t\t"  MOD_PRE "menu"MOD_EXT"\n");
+	(void)re_fprintf(f, "#module_app\t\t" MOD_PRE "loadgen"MOD_EXT"\n");
 	(void)re_fprintf(f, "#module_app\t\t"  MOD_PRE "mwi"MOD_EXT"\n");
 	(void)re_fprintf(f, "#module_app\t\t" MOD_PRE "natbd"MOD_EXT"\n");
 	(void)re_fprintf(f, "#module_app\t\t" MOD_PRE "presence"MOD_EXT"\n");
@@ -913,10 +972,16 @@ int config_write_template(const char *file, const struct config *cfg)
 
 	(void)re_fprintf(f, "\n");
 	(void)re_fprintf(f, "ctrl_tcp_listen\t\t0.0.0.0:4444\n");
+	(void)re_fprintf(f, "#ctrl_tcp_clients\t16\n");
+	(void)re_fprintf(f, "#ctrl_tcp_queue\t\t262144 # [bytes]\n");
+	(void)re_fprintf(f, "#ctrl_tcp_slow\t\tdrop # drop,close\n");
 
 	(void)re_fprintf(f, "\n");
 	(void)re_fprintf(f, "evdev_device\t\t/dev/input/event0\n");
 
+	(void)re_fprintf(f, "\n# Audio file source\n");
+	(void)re_fprintf(f, "#aufile_cache_size\t16384 # [kB]\n");
+
 	(void)re_fprintf(f, "\n# Opus codec parameters\n");
 	(void)re_fprintf(f, "opus_bitrate\t\t28000 # 6000-510000\n");
 	(void)re_fprintf(f, "#opus_stereo\t\tyes\n");
@@ -926,6 +991,11 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "#opus_dtx\t\tno\n");
 	(void)re_fprintf(f, "#opus_mirror\t\tno\n");
 
+	(void)re_fprintf(f,
+			"\n# VP8/VP9 codec parameters\n"
+			"#vp8_temporal_layers\t1 # {1,2,3}\n"
+			"#vp9_temporal_layers\t1 # {1,2,3}\n");
+
 	(void)re_fprintf(f,
 			"\n# Selfview\n"
 			"video_selfview\t\twindow # {window,pip}\n"
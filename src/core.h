@@ -144,7 +144,7 @@ int bfcp_start(struct bfcp *bfcp);
 
 enum {
 	CALL_LINENUM_MIN  =   1,
-	CALL_LINENUM_MAX  = 256
+	CALL_LINENUM_MAX  = 65536
 };
 
 struct call;
@@ -177,6 +177,7 @@ int  call_af(const struct call *call);
 void call_set_xrtpstat(struct call *call);
 struct account *call_account(const struct call *call);
 void call_set_custom_hdrs(struct call *call, const struct list *hdrs);
+void call_mark(struct call *call, enum call_mark mark, uint64_t ts);
 
 
 /*
@@ -194,6 +195,22 @@ int conf_get_range(const struct conf *conf, const char *name,
 int conf_get_csv(const struct conf *conf, const char *name,
 		 char *str1, size_t sz1, char *str2, size_t sz2);
 int conf_get_float(const struct conf *conf, const char *name, double *val);
+int conf_load(struct mbuf **mbp, const char *filename);
+int conf_decode_range(const struct pl *r, const char *name,
+		      struct range *rng);
+int conf_decode_csv(const struct pl *r, char *str1, size_t sz1,
+		    char *str2, size_t sz2);
+int conf_decode_vidsz(const struct pl *r, const char *name,
+		      struct vidsz *sz);
+void confidx_notify(const struct confidx *old, const struct confidx *idx);
+
+
+/*
+ * Event
+ */
+
+void event_flush(void);
+void event_close(void);
 
 
 /*
@@ -250,8 +267,10 @@ double   metric_avg_bitrate(const struct metric *metric);
  * Module
  */
 
-int module_init(const struct conf *conf);
+int module_init(const struct confidx *idx);
 void module_app_unload(void);
+void module_prof_close(void);
+int  module_debug(struct re_printf *pf, void *unused);
 
 
 /*
@@ -267,6 +286,7 @@ void reg_unregister(struct reg *reg);
 bool reg_isok(const struct reg *reg);
 int  reg_debug(struct re_printf *pf, const struct reg *reg);
 int  reg_status(struct re_printf *pf, const struct reg *reg);
+int  reg_sched_debug(struct re_printf *pf, void *unused);
 
 
 /*
@@ -299,6 +319,32 @@ int rtpext_encode(struct mbuf *mb, unsigned id, unsigned len,
 int rtpext_decode(struct rtpext *ext, struct mbuf *mb);
 
 
+/*
+ * Call quality
+ */
+
+/** Quality of a received audio stream, updated every interval */
+struct quality {
+	const char *codec;        /**< Audio codec, NULL if not audio    */
+	double threshold;         /**< MOS alarm threshold, 0 is off     */
+	uint32_t n_lost;          /**< Packets lost, counted by stream   */
+	uint32_t n_bursts;        /**< Runs of lost packets              */
+	uint32_t last_rx;         /**< Counters at the last interval     */
+	uint32_t last_lost;
+	uint32_t last_bursts;
+	uint32_t last_discard;
+	double r;                 /**< R-factor of the last interval     */
+	double mos;               /**< MOS of the last interval          */
+	bool degraded;            /**< MOS is below the threshold        */
+	struct quality_summary sum;
+};
+
+void quality_init(struct quality *q, double threshold);
+bool quality_update(struct quality *q, const struct rtcp_stats *rs,
+		    uint32_t n_rx, uint32_t n_discard);
+int  quality_debug(struct re_printf *pf, const struct quality *q);
+
+
 /*
  * SDP
  */
@@ -348,6 +394,7 @@ struct stream {
 	char *cname;             /**< RTCP Canonical end-point identifier   */
 	uint32_t ssrc_rx;        /**< Incoming syncronizing source          */
 	uint32_t pseq;           /**< Sequence number for incoming RTP      */
+	uint32_t pseq_rx;        /**< Last received sequence number         */
 	int pt_enc;              /**< Payload type for encoding             */
 	bool rtcp;               /**< Enable RTCP                           */
 	bool rtcp_mux;           /**< RTP/RTCP multiplex supported by peer  */
@@ -363,6 +410,13 @@ struct stream {
 	uint32_t rtp_timeout_ms; /**< RTP Timeout value in [ms]             */
 	bool rtp_estab;          /**< True if RTP stream is established     */
 	bool hold;               /**< Stream is on-hold (local)             */
+	uint16_t seq_tx;         /**< Sequence number of last sent RTP pkt  */
+	bool seq_tx_set;         /**< True if seq_tx is set                 */
+	uint64_t ts_tx_first;    /**< Timestamp of first sent RTP packet    */
+	struct rtprec *rec;      /**< RTP recorder (optional)               */
+	int rec_id;              /**< Stream index in the RTP recording     */
+	struct quality quality;  /**< Call quality of the received audio    */
+	struct tmr tmr_quality;  /**< Timer for the call quality            */
 };
 
 int  stream_alloc(struct stream **sp, const struct stream_param *prm,
@@ -379,6 +433,10 @@ int  stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 void stream_update(struct stream *s);
 void stream_update_encoder(struct stream *s, int pt_enc);
 int  stream_jbuf_stat(struct re_printf *pf, const struct stream *s);
+int  stream_seq_tx(const struct stream *s, uint16_t *seq);
+uint64_t stream_tx_first(const struct stream *s);
+void stream_set_recorder(struct stream *s, struct rtprec *rec);
+void stream_set_codec(struct stream *s, const char *codec);
 void stream_hold(struct stream *s, bool hold);
 void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx);
 void stream_send_fir(struct stream *s, bool pli);
@@ -400,6 +458,7 @@ int  stream_jbuf_reset(struct stream *strm,
 struct ua;
 
 void         ua_printf(const struct ua *ua, const char *fmt, ...);
+void         ua_setup_add(struct ua *ua, enum call_mark mark, uint32_t ms);
 
 struct tls  *uag_tls(void);
 const char  *ua_allowed_methods(const struct ua *ua);
@@ -0,0 +1,448 @@
+/**
+ * @file src/evbatch.c  Batching and coalescing of encoded events
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Events are queued per topic. The first event of a topic starts its
+ * window, and when the window expires all events of the topic are sent
+ * as one JSON array. Events with a key are gauges: a newer event with
+ * the same key replaces the queued one, in its place in the queue.
+ * Events stay queued until their message is sent, up to max_pending
+ * per topic; past that the oldest event is dropped. A topic that
+ * failed to send is retried by its timer, with a growing interval.
+ */
+
+
+enum {
+	KEY_HASH_SIZE = 256,
+	MAX_BATCH     = 64,
+	MAX_PENDING   = 1024,
+	MAX_BACKOFF   = 30000,
+};
+
+struct evbatch {
+	struct evbatch_conf conf;
+	struct list topicl;        /* Topics (struct topic)           */
+	struct hash *keyh;         /* Keyed events (struct bitem)     */
+	struct mbuf *mb;           /* Message, reused                 */
+	struct evbatch_stats stats;
+	evbatch_send_h *sendh;
+	void *arg;
+};
+
+struct topic {
+	struct le le;
+	struct evbatch *eb;
+	struct list iteml;         /* Queued events (struct bitem)    */
+	struct tmr tmr;
+	char *name;
+	uint32_t n;                /* Number of queued events         */
+	uint32_t backoff;          /* Retry interval in [ms], if any  */
+};
+
+struct bitem {
+	struct le le;              /* Member of topic's iteml         */
+	struct le he;              /* Member of keyh, if keyed        */
+	struct topic *tp;
+	char *key;
+	char *json;
+	size_t len;
+};
+
+
+static void bitem_destructor(void *arg)
+{
+	struct bitem *it = arg;
+
+	list_unlink(&it->le);
+	hash_unlink(&it->he);
+	mem_deref(it->key);
+	mem_deref(it->json);
+}
+
+
+static void topic_destructor(void *arg)
+{
+	struct topic *tp = arg;
+
+	tmr_cancel(&tp->tmr);
+	list_unlink(&tp->le);
+	list_flush(&tp->iteml);
+	mem_deref(tp->name);
+}
+
+
+static void evbatch_destructor(void *arg)
+{
+	struct evbatch *eb = arg;
+
+	(void)evbatch_flush(eb);
+
+	list_flush(&eb->topicl);
+	mem_deref(eb->keyh);
+	mem_deref(eb->mb);
+}
+
+
+static int send_msg(struct evbatch *eb, const char *topic,
+		    const char *buf, size_t len, uint32_t n)
+{
+	int err;
+
+	err = eb->sendh(topic, buf, len, eb->arg);
+	if (err) {
+		++eb->stats.n_err;
+		return err;
+	}
+
+	++eb->stats.n_msg;
+	eb->stats.n_out += n;
+
+	return 0;
+}
+
+
+static void tmr_handler(void *arg);
+
+
+static int topic_flush(struct topic *tp)
+{
+	struct evbatch *eb = tp->eb;
+	int err = 0;
+
+	tmr_cancel(&tp->tmr);
+
+	while (tp->iteml.head) {
+
+		struct mbuf *mb = eb->mb;
+		struct le *le;
+		uint32_t n = 0;
+
+		mbuf_rewind(mb);
+		err = mbuf_write_u8(mb, '[');
+
+		for (le = tp->iteml.head; le && n < eb->conf.max_batch;
+		     le = le->next) {
+
+			const struct bitem *it = le->data;
+
+			if (n)
+				err |= mbuf_write_u8(mb, ',');
+			err |= mbuf_write_mem(mb, (uint8_t *)it->json,
+					      it->len);
+			++n;
+		}
+
+		err |= mbuf_write_u8(mb, ']');
+		if (err) {
+			++eb->stats.n_err;
+			break;
+		}
+
+		err = send_msg(eb, tp->name, (char *)mb->buf, mb->end, n);
+		if (err)
+			break;
+
+		/* the events are only removed once they are sent */
+		while (n--) {
+			mem_deref(list_ledata(tp->iteml.head));
+			--tp->n;
+			--eb->stats.n_pending;
+		}
+	}
+
+	/* the events that were not sent are retried, backing off */
+	if (err) {
+		tp->backoff = tp->backoff ?
+			min(tp->backoff * 2, MAX_BACKOFF) :
+			max(eb->conf.window, 1);
+		tmr_start(&tp->tmr, tp->backoff, tmr_handler, tp);
+	}
+	else {
+		tp->backoff = 0;
+	}
+
+	return err;
+}
+
+
+static void tmr_handler(void *arg)
+{
+	struct topic *tp = arg;
+	int err;
+
+	err = topic_flush(tp);
+	if (err) {
+		warning("evbatch: %s: failed to send (%m)\n", tp->name, err);
+	}
+}
+
+
+static struct topic *topic_get(struct evbatch *eb, const char *name)
+{
+	struct topic *tp;
+	struct le *le;
+
+	for (le = eb->topicl.head; le; le = le->next) {
+
+		tp = le->data;
+
+		if (!str_cmp(tp->name, name))
+			return tp;
+	}
+
+	tp = mem_zalloc(sizeof(*tp), topic_destructor);
+	if (!tp)
+		return NULL;
+
+	tp->eb = eb;
+
+	if (str_dup(&tp->name, name)) {
+		mem_deref(tp);
+		return NULL;
+	}
+
+	list_append(&eb->topicl, &tp->le, tp);
+
+	return tp;
+}
+
+
+static bool key_cmp_handler(struct le *le, void *arg)
+{
+	const struct bitem *it = le->data;
+	const struct bitem *ref = arg;
+
+	return it->tp == ref->tp && !str_cmp(it->key, ref->key);
+}
+
+
+static int set_json(struct bitem *it, const char *json, size_t len)
+{
+	char *buf;
+
+	buf = mem_alloc(len, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	memcpy(buf, json, len);
+
+	mem_deref(it->json);
+	it->json = buf;
+	it->len  = len;
+
+	return 0;
+}
+
+
+/**
+ * Allocate an event batcher
+ *
+ * @param ebp   Pointer to allocated event batcher
+ * @param conf  Batching configuration
+ * @param sendh Handler that sends one message to a topic
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int evbatch_alloc(struct evbatch **ebp, const struct evbatch_conf *conf,
+		  evbatch_send_h *sendh, void *arg)
+{
+	struct evbatch *eb;
+	int err;
+
+	if (!ebp || !conf || !sendh)
+		return EINVAL;
+
+	eb = mem_zalloc(sizeof(*eb), evbatch_destructor);
+	if (!eb)
+		return ENOMEM;
+
+	eb->conf  = *conf;
+	eb->sendh = sendh;
+	eb->arg   = arg;
+
+	if (!eb->conf.max_batch)
+		eb->conf.max_batch = MAX_BATCH;
+	if (!eb->conf.max_pending)
+		eb->conf.max_pending = MAX_PENDING;
+
+	err = hash_alloc(&eb->keyh, KEY_HASH_SIZE);
+	if (err)
+		goto out;
+
+	eb->mb = mbuf_alloc(4096);
+	if (!eb->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(eb);
+	else
+		*ebp = eb;
+
+	return err;
+}
+
+
+/**
+ * Add an encoded event to a topic
+ *
+ * Without a window the event is sent at once. Otherwise it is queued
+ * until the window of the topic expires, or until the topic has
+ * max_batch events. While a topic is retrying a failed send, the events
+ * are queued until its timer expires.
+ *
+ * @param eb    Event batcher
+ * @param topic Topic of the event
+ * @param key   Key of a gauge-like event, replaces the queued event with
+ *              the same key (optional)
+ * @param json  Encoded event
+ * @param len   Length of the encoded event
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int evbatch_add(struct evbatch *eb, const char *topic, const char *key,
+		const char *json, size_t len)
+{
+	struct bitem *it, ref;
+	struct topic *tp;
+	struct le *le;
+	int err;
+
+	if (!eb || !topic || !json || !len)
+		return EINVAL;
+
+	++eb->stats.n_in;
+
+	if (!eb->conf.window)
+		return send_msg(eb, topic, json, len, 1);
+
+	tp = topic_get(eb, topic);
+	if (!tp)
+		return ENOMEM;
+
+	if (key) {
+		ref.tp  = tp;
+		ref.key = (char *)key;
+
+		le = hash_lookup(eb->keyh, hash_fast_str(key),
+				 key_cmp_handler, &ref);
+		if (le) {
+			++eb->stats.n_coalesced;
+			return set_json(le->data, json, len);
+		}
+	}
+
+	it = mem_zalloc(sizeof(*it), bitem_destructor);
+	if (!it)
+		return ENOMEM;
+
+	it->tp = tp;
+
+	err = set_json(it, json, len);
+	if (key)
+		err |= str_dup(&it->key, key);
+	if (err) {
+		mem_deref(it);
+		return err;
+	}
+
+	list_append(&tp->iteml, &it->le, it);
+	if (key)
+		hash_append(eb->keyh, hash_fast_str(key), &it->he, it);
+
+	++tp->n;
+	++eb->stats.n_pending;
+	eb->stats.max_pending = max(eb->stats.max_pending,
+				    eb->stats.n_pending);
+
+	/* the oldest events are dropped, the newest are kept */
+	while (tp->n > eb->conf.max_pending) {
+		mem_deref(list_ledata(tp->iteml.head));
+		--tp->n;
+		--eb->stats.n_pending;
+		++eb->stats.n_drop;
+	}
+
+	if (tp->backoff)
+		return 0;
+
+	if (tp->n >= eb->conf.max_batch)
+		return topic_flush(tp);
+
+	if (!tmr_isrunning(&tp->tmr))
+		tmr_start(&tp->tmr, eb->conf.window, tmr_handler, tp);
+
+	return 0;
+}
+
+
+/**
+ * Send all queued events now
+ *
+ * @param eb Event batcher
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int evbatch_flush(struct evbatch *eb)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!eb)
+		return EINVAL;
+
+	for (le = eb->topicl.head; le; le = le->next)
+		err |= topic_flush(le->data);
+
+	return err;
+}
+
+
+/**
+ * Get the statistics of an event batcher
+ *
+ * @param eb Event batcher
+ * @param st Pointer to statistics, written on return
+ */
+void evbatch_stats_get(const struct evbatch *eb, struct evbatch_stats *st)
+{
+	if (!st)
+		return;
+
+	if (eb)
+		*st = eb->stats;
+	else
+		memset(st, 0, sizeof(*st));
+}
+
+
+int evbatch_debug(struct re_printf *pf, const struct evbatch *eb)
+{
+	const struct evbatch_stats *st;
+
+	if (!eb)
+		return 0;
+
+	st = &eb->stats;
+
+	return re_hprintf(pf, "evbatch: window=%ums max_batch=%u"
+			  " max_pending=%u"
+			  " in=%llu coalesced=%llu out=%llu msg=%llu err=%llu"
+			  " drop=%llu pending=%u (max %u)\n",
+			  eb->conf.window, eb->conf.max_batch,
+			  eb->conf.max_pending,
+			  st->n_in, st->n_coalesced, st->n_out, st->n_msg,
+			  st->n_err, st->n_drop, st->n_pending,
+			  st->max_pending);
+}
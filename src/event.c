@@ -9,7 +9,14 @@
 #include "core.h"
 
 
-static const char *event_class_name(enum ua_event ev)
+/**
+ * Get the class of the User-Agent event
+ *
+ * @param ev User-Agent event
+ *
+ * @return Class of the event, e.g. "call" or "register"
+ */
+const char *uag_event_class(enum ua_event ev)
 {
 	switch (ev) {
 
@@ -37,6 +44,9 @@ static const char *event_class_name(enum ua_event ev)
 	case UA_EVENT_CALL_DTMF_END:
 	case UA_EVENT_CALL_RTCP:
 	case UA_EVENT_CALL_MENC:
+	case UA_EVENT_CALL_VIDEO_ADAPT:
+	case UA_EVENT_CALL_SETUP:
+	case UA_EVENT_CALL_QUALITY:
 		return "call";
 	case UA_EVENT_VU_RX:
 	case UA_EVENT_VU_TX:
@@ -94,6 +104,33 @@ static int add_rtcp_stats(struct odict *od_parent, const struct rtcp_stats *rs)
 }
 
 
+static const struct stream *event_stream(struct call *call, const char *prm)
+{
+	if (0 == str_casecmp(prm, "audio"))
+		return audio_strm(call_audio(call));
+#ifdef USE_VIDEO
+	else if (0 == str_casecmp(prm, "video"))
+		return video_strm(call_video(call));
+#endif
+
+	return NULL;
+}
+
+
+/**
+ * Encode a User-Agent event into a dictionary
+ *
+ * The event_encode_json() function writes the same JSON without the
+ * dictionary, and should be used where the dictionary is only encoded.
+ *
+ * @param od   Dictionary to add the event to
+ * @param ua   User-Agent (optional)
+ * @param ev   User-Agent event
+ * @param call Call object (optional)
+ * @param prm  Event parameter (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
 int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		      struct call *call, const char *prm)
 {
@@ -105,7 +142,7 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 
 	err |= odict_entry_add(od, "type", ODICT_STRING, event_str);
 	err |= odict_entry_add(od, "class",
-			       ODICT_STRING, event_class_name(ev));
+			       ODICT_STRING, uag_event_class(ev));
 
 	if (ua) {
 		err |= odict_entry_add(od, "accountaor",
@@ -136,14 +173,7 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 	}
 
 	if (ev == UA_EVENT_CALL_RTCP) {
-		struct stream *strm = NULL;
-
-		if (0 == str_casecmp(prm, "audio"))
-			strm = audio_strm(call_audio(call));
-#ifdef USE_VIDEO
-		else if (0 == str_casecmp(prm, "video"))
-			strm = video_strm(call_video(call));
-#endif
+		const struct stream *strm = event_stream(call, prm);
 
 		err = add_rtcp_stats(od, stream_rtcp_stats(strm));
 		if (err)
@@ -156,6 +186,125 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 }
 
 
+/*
+ * The JSON encoder writes the members in the order, and in the format,
+ * of event_encode_dict() and json_encode_odict()
+ */
+
+
+static int print_rtcp_dir(struct re_printf *pf, const char *name,
+			  uint32_t sent, int lost, uint32_t jit)
+{
+	return re_hprintf(pf, "\"%s\":{\"sent\":%lld,\"lost\":%lld,"
+			  "\"jit\":%lld}",
+			  name, (int64_t)sent, (int64_t)lost, (int64_t)jit);
+}
+
+
+static int print_rtcp_stats(struct re_printf *pf,
+			    const struct rtcp_stats *rs)
+{
+	int err;
+
+	if (!rs)
+		return EINVAL;
+
+	err  = re_hprintf(pf, ",\"rtcp_stats\":{");
+	err |= print_rtcp_dir(pf, "tx", rs->tx.sent, rs->tx.lost, rs->tx.jit);
+	err |= re_hprintf(pf, ",");
+	err |= print_rtcp_dir(pf, "rx", rs->rx.sent, rs->rx.lost, rs->rx.jit);
+	err |= re_hprintf(pf, ",\"rtt\":%lld}", (int64_t)rs->rtt);
+
+	return err;
+}
+
+
+/**
+ * Encode the members of a User-Agent event as JSON, without the braces
+ *
+ * @param pf   Print function for the output
+ * @param aor  AOR of the User-Agent (optional)
+ * @param ev   User-Agent event
+ * @param call Call object (optional)
+ * @param prm  Event parameter (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int event_encode_members(struct re_printf *pf, const char *aor,
+			 enum ua_event ev, struct call *call, const char *prm)
+{
+	int err;
+
+	if (!pf)
+		return EINVAL;
+
+	err = re_hprintf(pf, "\"type\":\"%H\",\"class\":\"%H\"",
+			 utf8_encode, uag_event_str(ev),
+			 utf8_encode, uag_event_class(ev));
+
+	if (aor) {
+		err |= re_hprintf(pf, ",\"accountaor\":\"%H\"",
+				  utf8_encode, aor);
+	}
+
+	if (call) {
+		err |= re_hprintf(pf, ",\"direction\":\"%s\","
+				  "\"peeruri\":\"%H\",\"id\":\"%H\"",
+				  call_is_outgoing(call) ? "outgoing"
+				  : "incoming",
+				  utf8_encode, call_peeruri(call),
+				  utf8_encode, call_id(call));
+	}
+
+	if (str_isset(prm)) {
+		err |= re_hprintf(pf, ",\"param\":\"%H\"",
+				  utf8_encode, prm);
+	}
+
+	if (err)
+		return err;
+
+	if (ev == UA_EVENT_CALL_RTCP) {
+		const struct stream *strm = event_stream(call, prm);
+
+		err = print_rtcp_stats(pf, stream_rtcp_stats(strm));
+	}
+
+	return err;
+}
+
+
+/**
+ * Encode a User-Agent event as a JSON object
+ *
+ * The output is the same as event_encode_dict() and json_encode_odict(),
+ * but nothing is allocated.
+ *
+ * @param pf   Print function for the output
+ * @param ua   User-Agent (optional)
+ * @param ev   User-Agent event
+ * @param call Call object (optional)
+ * @param prm  Event parameter (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int event_encode_json(struct re_printf *pf, struct ua *ua, enum ua_event ev,
+		      struct call *call, const char *prm)
+{
+	int err;
+
+	if (!pf)
+		return EINVAL;
+
+	err  = re_hprintf(pf, "{");
+	err |= event_encode_members(pf, ua ? ua_aor(ua) : NULL, ev, call,
+				    prm);
+	err |= re_hprintf(pf, "}");
+
+	return err;
+}
+
+
 /**
  * Get the name of the User-Agent event
  *
@@ -187,6 +336,444 @@ const char *uag_event_str(enum ua_event ev)
 	case UA_EVENT_CALL_MENC:            return "CALL_MENC";
 	case UA_EVENT_VU_TX:                return "VU_TX_REPORT";
 	case UA_EVENT_VU_RX:                return "VU_RX_REPORT";
+	case UA_EVENT_CALL_VIDEO_ADAPT:     return "CALL_VIDEO_ADAPT";
+	case UA_EVENT_CALL_SETUP:           return "CALL_SETUP";
+	case UA_EVENT_CALL_QUALITY:         return "CALL_QUALITY";
 	default: return "?";
 	}
 }
+
+
+/*
+ * Event bus
+ *
+ * The event handlers subscribe to a mask of events. The parameter text
+ * of an event is only formatted when a handler asks for it, and events
+ * that no handler has subscribed to are dropped before formatting.
+ *
+ * Handlers that subscribe with UA_EVENT_ASYNC get the events from a
+ * queue, which is flushed from the main loop. The queue is bounded,
+ * and the oldest events are dropped when it is full. A few events are
+ * delivered per main loop iteration, so that slow handlers do not hold
+ * up the SIP processing.
+ */
+
+
+enum {
+	EVQ_MAX   = 512,   /**< Max number of queued events       */
+	EVQ_BURST = 16,    /**< Max events delivered per main loop */
+};
+
+
+/** Event handler */
+struct ua_eh {
+	struct le le;
+	ua_event_h *h;             /**< Handler with text parameter  */
+	ua_event_data_h *dh;       /**< Handler with event data      */
+	uint64_t mask;             /**< Subscribed events            */
+	int flags;                 /**< Subscription flags           */
+	void *arg;
+};
+
+/** Event data, with the parameter text formatted on demand */
+struct ua_evdata {
+	struct ua_event_data evd;  /**< Public event data, first      */
+	const char *fmt;           /**< Parameter format string       */
+	va_list *ap;               /**< Parameter arguments           */
+	const char *prm;           /**< Formatted parameter           */
+	char buf[256];             /**< Parameter buffer              */
+};
+
+/** Queued event */
+struct ua_evq {
+	struct le le;
+	struct ua *ua;             /**< User-Agent (ref)             */
+	char *aor;                 /**< AOR, also of a closed UA     */
+	struct call *call;         /**< Call object (ref)            */
+	enum ua_event ev;
+	char *prm;
+};
+
+
+static struct {
+	struct list ehl;           /**< Event handlers (struct ua_eh) */
+	uint64_t mask;             /**< Events with sync handlers     */
+	uint64_t mask_async;       /**< Events with async handlers    */
+	struct list evq;           /**< Queued events (struct ua_evq) */
+	struct tmr tmr;            /**< Queue flush timer             */
+	uint64_t n_events;         /**< Events sent                   */
+	uint64_t n_queued;         /**< Events queued                 */
+	uint64_t n_dropped;        /**< Events dropped from the queue */
+} bus;
+
+
+static void update_mask(void)
+{
+	struct le *le;
+
+	bus.mask = bus.mask_async = 0;
+
+	for (le = bus.ehl.head; le; le = le->next) {
+
+		const struct ua_eh *eh = le->data;
+
+		if (eh->flags & UA_EVENT_ASYNC)
+			bus.mask_async |= eh->mask;
+		else
+			bus.mask |= eh->mask;
+	}
+}
+
+
+static void eh_destructor(void *arg)
+{
+	struct ua_eh *eh = arg;
+
+	list_unlink(&eh->le);
+	update_mask();
+}
+
+
+static void evq_destructor(void *arg)
+{
+	struct ua_evq *q = arg;
+
+	list_unlink(&q->le);
+	mem_deref(q->call);
+	mem_deref(q->ua);
+	mem_deref(q->aor);
+	mem_deref(q->prm);
+}
+
+
+static int eh_add(ua_event_h *h, ua_event_data_h *dh, uint64_t mask,
+		  int flags, void *arg)
+{
+	struct ua_eh *eh;
+
+	eh = mem_zalloc(sizeof(*eh), eh_destructor);
+	if (!eh)
+		return ENOMEM;
+
+	eh->h     = h;
+	eh->dh    = dh;
+	eh->mask  = mask;
+	eh->flags = flags;
+	eh->arg   = arg;
+
+	list_append(&bus.ehl, &eh->le, eh);
+	update_mask();
+
+	return 0;
+}
+
+
+/**
+ * Get the parameter text of a User-Agent event. The text is formatted
+ * on the first call.
+ *
+ * @param evd User-Agent event
+ *
+ * @return Parameter text
+ */
+const char *ua_event_prm(struct ua_event_data *evd)
+{
+	struct ua_evdata *ed = (struct ua_evdata *)evd;
+	va_list ap;
+
+	if (!ed)
+		return NULL;
+
+	if (ed->prm)
+		return ed->prm;
+
+	ed->buf[0] = '\0';
+
+	if (ed->fmt && ed->ap) {
+		va_copy(ap, *ed->ap);
+		(void)re_vsnprintf(ed->buf, sizeof(ed->buf), ed->fmt, ap);
+		va_end(ap);
+	}
+
+	ed->prm = ed->buf;
+
+	return ed->prm;
+}
+
+
+static void dispatch(struct ua_event_data *evd, bool async)
+{
+	const uint64_t mask = UA_EVENT_MASK(evd->ev);
+	struct le *le;
+
+	le = bus.ehl.head;
+	while (le) {
+		struct ua_eh *eh = le->data;
+		le = le->next;
+
+		if (!(eh->mask & mask))
+			continue;
+
+		if (async != !!(eh->flags & UA_EVENT_ASYNC))
+			continue;
+
+		if (eh->dh) {
+			eh->dh(evd, eh->arg);
+		}
+		else {
+			eh->h(evd->ua, evd->ev, evd->call,
+			      ua_event_prm(evd), eh->arg);
+		}
+	}
+}
+
+
+/* Deliver the first queued event, return false if the queue is empty */
+static bool evq_deliver(void)
+{
+	struct ua_evq *q = list_ledata(list_head(&bus.evq));
+	struct ua_evdata ed;
+
+	if (!q)
+		return false;
+
+	list_unlink(&q->le);
+
+	ed.evd.ua   = q->ua;
+	ed.evd.aor  = q->aor;
+	ed.evd.call = q->call;
+	ed.evd.ev   = q->ev;
+	ed.fmt      = NULL;
+	ed.ap       = NULL;
+	ed.prm      = q->prm;
+
+	dispatch(&ed.evd, true);
+
+	mem_deref(q);
+
+	return true;
+}
+
+
+static void evq_handler(void *arg)
+{
+	unsigned i;
+	(void)arg;
+
+	for (i=0; i<EVQ_BURST; i++) {
+
+		if (!evq_deliver())
+			return;
+	}
+
+	/* the rest is delivered after the pending network events */
+	if (!list_isempty(&bus.evq))
+		tmr_start(&bus.tmr, 0, evq_handler, NULL);
+}
+
+
+static void evq_push(struct ua_evdata *ed)
+{
+	const struct ua_event_data *evd = &ed->evd;
+	struct ua_evq *q;
+
+	if (list_count(&bus.evq) >= EVQ_MAX) {
+		mem_deref(list_ledata(list_head(&bus.evq)));
+		if (!bus.n_dropped++)
+			warning("event: queue full, dropping events\n");
+	}
+
+	q = mem_zalloc(sizeof(*q), evq_destructor);
+	if (!q)
+		return;
+
+	/* objects in their destructor are not referenced */
+	if (evd->ua && mem_nrefs(evd->ua))
+		q->ua = mem_ref(evd->ua);
+	if (evd->call && mem_nrefs(evd->call))
+		q->call = mem_ref(evd->call);
+
+	q->ev = evd->ev;
+
+	/* the UA may be in its destructor, e.g. for UNREGISTERING */
+	if ((evd->aor && str_dup(&q->aor, evd->aor)) ||
+	    str_dup(&q->prm, ua_event_prm(&ed->evd))) {
+		mem_deref(q);
+		return;
+	}
+
+	list_append(&bus.evq, &q->le, q);
+	++bus.n_queued;
+
+	if (!tmr_isrunning(&bus.tmr))
+		tmr_start(&bus.tmr, 0, evq_handler, NULL);
+}
+
+
+/**
+ * Send a User-Agent event to all subscribed event handlers
+ *
+ * @param ua   User-Agent (optional)
+ * @param ev   User-Agent event
+ * @param call Call object (optional)
+ * @param fmt  Formatted parameter text
+ */
+void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
+	      const char *fmt, ...)
+{
+	struct ua_evdata ed;
+	const uint64_t mask = UA_EVENT_MASK(ev);
+	va_list ap;
+
+	if (!((bus.mask | bus.mask_async) & mask))
+		return;
+
+	ed.evd.ua   = ua;
+	ed.evd.aor  = ua ? ua_aor(ua) : NULL;
+	ed.evd.call = call;
+	ed.evd.ev   = ev;
+	ed.fmt      = fmt;
+	ed.ap       = &ap;
+	ed.prm      = NULL;
+
+	++bus.n_events;
+
+	va_start(ap, fmt);
+
+	if (bus.mask & mask)
+		dispatch(&ed.evd, false);
+
+	if (bus.mask_async & mask)
+		evq_push(&ed);
+
+	va_end(ap);
+}
+
+
+/**
+ * Deliver all queued events to the async event handlers
+ */
+void event_flush(void)
+{
+	tmr_cancel(&bus.tmr);
+
+	while (evq_deliver())
+		;
+}
+
+
+void event_close(void)
+{
+	tmr_cancel(&bus.tmr);
+	list_flush(&bus.evq);
+	list_flush(&bus.ehl);
+}
+
+
+/**
+ * Register an event handler for all User-Agent events
+ *
+ * @param h   Event handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_register(ua_event_h *h, void *arg)
+{
+	if (!h)
+		return EINVAL;
+
+	uag_event_unregister(h);
+
+	return eh_add(h, NULL, UA_EVENT_MASK_ALL, 0, arg);
+}
+
+
+/**
+ * Unregister an event handler
+ *
+ * @param h Event handler
+ */
+void uag_event_unregister(ua_event_h *h)
+{
+	struct le *le;
+
+	for (le = bus.ehl.head; le; le = le->next) {
+
+		struct ua_eh *eh = le->data;
+
+		if (eh->h && eh->h == h) {
+			mem_deref(eh);
+			break;
+		}
+	}
+}
+
+
+/**
+ * Subscribe to a set of User-Agent events
+ *
+ * @param h     Event handler
+ * @param mask  Event mask, see UA_EVENT_MASK()
+ * @param flags Subscription flags (enum ua_event_flags)
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_subscribe(ua_event_data_h *h, uint64_t mask, int flags,
+			void *arg)
+{
+	if (!h || !mask)
+		return EINVAL;
+
+	uag_event_unsubscribe(h);
+
+	return eh_add(NULL, h, mask, flags, arg);
+}
+
+
+/**
+ * Unsubscribe an event handler
+ *
+ * @param h Event handler
+ */
+void uag_event_unsubscribe(ua_event_data_h *h)
+{
+	struct le *le;
+
+	for (le = bus.ehl.head; le; le = le->next) {
+
+		struct ua_eh *eh = le->data;
+
+		if (eh->dh && eh->dh == h) {
+			mem_deref(eh);
+			break;
+		}
+	}
+}
+
+
+/**
+ * Print the status of the event bus
+ *
+ * @param pf     Print handler for debug output
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_debug(struct re_printf *pf, void *unused)
+{
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nEvent bus:\n");
+	err |= re_hprintf(pf, " handlers: %u\n", list_count(&bus.ehl));
+	err |= re_hprintf(pf, " mask:     sync=0x%llx async=0x%llx\n",
+			  bus.mask, bus.mask_async);
+	err |= re_hprintf(pf, " queue:    %u (max %u)\n",
+			  list_count(&bus.evq), EVQ_MAX);
+	err |= re_hprintf(pf, " events=%llu queued=%llu dropped=%llu\n",
+			  bus.n_events, bus.n_queued, bus.n_dropped);
+
+	return err;
+}
@@ -0,0 +1,822 @@
+/**
+ * @file src/fec.c  Forward Error Correction for RTP (RFC 5109)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page FEC Forward Error Correction
+ *
+ * XOR based Forward Error Correction, using the FEC packet format from
+ * RFC 5109 (ULPFEC) with a single protection level. The FEC packets
+ * are sent with their own payload type in the media RTP stream, right
+ * after the media packets they protect.
+ *
+ * The encoder protects a group of consecutive media packets, which is
+ * at most one video frame. For a protection level of N percent the
+ * encoder sends ceil(N * n / 100) FEC packets for a group of n media
+ * packets. The media packets are interleaved over the FEC packets, so
+ * that a burst of lost packets can be recovered.
+ *
+ * The decoder delivers the media packets in sequence. When a packet is
+ * missing, the following packets are held back until the missing
+ * packet is recovered, or until it is clear that it cannot be
+ * recovered.
+ *
+ *<pre>
+ *    0                   1                   2                   3
+ *    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |E|L|P|X|  CC   |M| PT recovery |            SN base            |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                          TS recovery                          |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |        length recovery        |       Protection Length       |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |             mask              | mask cont. (present if L = 1) |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *</pre>
+ */
+
+
+enum {
+	FEC_HDR_SIZE   = 10,      /**< FEC header                         */
+	FEC_ULP_SHORT  = 4,       /**< ULP level header with 16-bit mask  */
+	FEC_ULP_LONG   = 8,       /**< ULP level header with 48-bit mask  */
+	GROUP_MAX      = 48,      /**< Max media packets in one group     */
+	PKT_MAX        = 1500,    /**< Max payload size of a media packet */
+	HIST_SIZE      = 128,     /**< Number of packets in receive window*/
+	HELD_MAX       = 96,      /**< Max number of held packets         */
+};
+
+
+struct fec_media {
+	struct rtp_header hdr;
+	uint16_t len;
+	uint8_t buf[PKT_MAX];
+};
+
+/** FEC Encoder */
+struct fec_enc {
+	struct fec_media pktv[GROUP_MAX];  /**< Media packets in group   */
+	unsigned n;                        /**< Number of packets        */
+	unsigned level;                    /**< Protection level in [%]  */
+	size_t headroom;                   /**< Headroom of FEC packets  */
+	fec_send_h *sendh;                 /**< FEC packet send handler  */
+	void *arg;                         /**< Handler argument         */
+
+	uint64_t n_media;                  /**< Media packets protected  */
+	uint64_t n_fec;                    /**< FEC packets sent         */
+};
+
+
+struct fec_slot {
+	struct rtp_header hdr;             /**< RTP header               */
+	struct mbuf *mb;                   /**< Payload of media packet  */
+	bool used;                         /**< Slot has a packet        */
+	bool fec;                          /**< Packet is a FEC packet   */
+	bool held;                         /**< Waiting for delivery     */
+};
+
+/** FEC Decoder */
+struct fec_dec {
+	struct fec_slot slotv[HIST_SIZE];  /**< Receive window           */
+	uint16_t seq_next;                 /**< Next sequence to deliver */
+	bool started;                      /**< First packet received    */
+	unsigned n_held;                   /**< Number of held packets   */
+	bool last_marker;                  /**< Last delivered had M-bit */
+	uint32_t ts_last;                  /**< Last delivered timestamp */
+	fec_recv_h *recvh;                 /**< Media packet handler     */
+	void *arg;                         /**< Handler argument         */
+
+	uint64_t n_fec;                    /**< FEC packets received     */
+	uint64_t n_recovered;              /**< Media packets recovered  */
+	uint64_t n_lost;                   /**< Unrecoverable packets    */
+};
+
+
+static inline int16_t seq_diff(uint16_t x, uint16_t y)
+{
+	return (int16_t)(y - x);
+}
+
+
+static inline uint8_t hdr_byte0(const struct rtp_header *hdr)
+{
+	return hdr->pad<<5 | hdr->ext<<4 | (hdr->cc & 0x0f);
+}
+
+
+static inline uint8_t hdr_byte1(const struct rtp_header *hdr)
+{
+	return hdr->m<<7 | (hdr->pt & 0x7f);
+}
+
+
+static void xor_mem(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	while (len--)
+		*dst++ ^= *src++;
+}
+
+
+static void enc_destructor(void *arg)
+{
+	struct fec_enc *enc = arg;
+
+	debug("fec: encoder: %llu media packets, %llu fec packets\n",
+	      enc->n_media, enc->n_fec);
+}
+
+
+/**
+ * Allocate a FEC encoder
+ *
+ * @param encp     Pointer to allocated FEC encoder
+ * @param headroom Number of bytes to reserve in front of FEC packets
+ * @param sendh    Handler for sending FEC packets
+ * @param arg      Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_enc_alloc(struct fec_enc **encp, size_t headroom,
+		  fec_send_h *sendh, void *arg)
+{
+	struct fec_enc *enc;
+
+	if (!encp || !sendh)
+		return EINVAL;
+
+	enc = mem_zalloc(sizeof(*enc), enc_destructor);
+	if (!enc)
+		return ENOMEM;
+
+	enc->headroom = headroom;
+	enc->sendh    = sendh;
+	enc->arg      = arg;
+
+	*encp = enc;
+
+	return 0;
+}
+
+
+/**
+ * Set the protection level for the next group of media packets
+ *
+ * @param enc   FEC encoder
+ * @param level Protection level in [%], 0 to disable
+ */
+void fec_enc_set_level(struct fec_enc *enc, unsigned level)
+{
+	if (!enc)
+		return;
+
+	enc->level = min(level, 100);
+}
+
+
+static int send_fec(struct fec_enc *enc, unsigned j, unsigned k)
+{
+	const struct fec_media *first = &enc->pktv[j];
+	uint8_t b0 = 0, b1 = 0;
+	uint32_t ts = 0;
+	uint16_t len = 0, protlen = 0;
+	uint64_t mask = 0;
+	unsigned i, last = j;
+	struct mbuf *mb;
+	bool lmask;
+	int err;
+
+	/* media packets j, j+k, j+2k, .. are protected by FEC packet j */
+	for (i=j; i<enc->n; i+=k) {
+		const struct fec_media *pkt = &enc->pktv[i];
+
+		b0  ^= hdr_byte0(&pkt->hdr);
+		b1  ^= hdr_byte1(&pkt->hdr);
+		ts  ^= pkt->hdr.ts;
+		len ^= pkt->len;
+
+		protlen = max(protlen, pkt->len);
+		mask |= (uint64_t)1 << (47 - (i - j));
+		last = i;
+	}
+
+	lmask = (last - j) > 15;
+
+	mb = mbuf_alloc(enc->headroom + FEC_HDR_SIZE + FEC_ULP_LONG + protlen);
+	if (!mb)
+		return ENOMEM;
+
+	mb->pos = mb->end = enc->headroom;
+
+	err  = mbuf_write_u8(mb, (lmask ? 1<<6 : 0) | b0);
+	err |= mbuf_write_u8(mb, b1);
+	err |= mbuf_write_u16(mb, htons(first->hdr.seq));
+	err |= mbuf_write_u32(mb, htonl(ts));
+	err |= mbuf_write_u16(mb, htons(len));
+	err |= mbuf_write_u16(mb, htons(protlen));
+	err |= mbuf_write_u16(mb, htons((uint16_t)(mask >> 32)));
+	if (lmask)
+		err |= mbuf_write_u32(mb, htonl((uint32_t)mask));
+	if (err)
+		goto out;
+
+	err = mbuf_fill(mb, 0x00, protlen);
+	if (err)
+		goto out;
+
+	for (i=j; i<enc->n; i+=k) {
+		const struct fec_media *pkt = &enc->pktv[i];
+
+		xor_mem(mb->buf + mb->end - protlen, pkt->buf, pkt->len);
+	}
+
+	mb->pos = enc->headroom;
+
+	err = enc->sendh(first->hdr.ts, mb, enc->arg);
+	if (err)
+		goto out;
+
+	++enc->n_fec;
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/**
+ * Send the FEC packets for the current group of media packets
+ *
+ * @param enc FEC encoder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_enc_flush(struct fec_enc *enc)
+{
+	unsigned j, k;
+	int err = 0;
+
+	if (!enc)
+		return EINVAL;
+
+	if (!enc->n)
+		return 0;
+
+	k = (enc->n * enc->level + 99) / 100;
+	k = min(k, enc->n);
+
+	for (j=0; j<k; j++) {
+
+		err = send_fec(enc, j, k);
+		if (err)
+			break;
+	}
+
+	enc->n = 0;
+
+	return err;
+}
+
+
+/**
+ * Add a media packet to the current group of protected packets
+ *
+ * The packet must be added before it is sent, since the payload may be
+ * encrypted in place. A group is ended by a packet with the marker
+ * bit set, and fec_enc_flush() must then be called after the media
+ * packet was sent.
+ *
+ * @param enc FEC encoder
+ * @param hdr RTP header of the media packet
+ * @param pld Media payload
+ * @param len Length of media payload
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_enc_packet(struct fec_enc *enc, const struct rtp_header *hdr,
+		   const uint8_t *pld, size_t len)
+{
+	struct fec_media *pkt;
+	int err = 0;
+
+	if (!enc || !hdr || !pld)
+		return EINVAL;
+
+	/* a group must have consecutive packets from one frame */
+	if (enc->n) {
+		const struct fec_media *prev = &enc->pktv[enc->n - 1];
+
+		if (hdr->seq != (uint16_t)(prev->hdr.seq + 1) ||
+		    hdr->ts != prev->hdr.ts || enc->n >= GROUP_MAX)
+			err = fec_enc_flush(enc);
+	}
+
+	if (len > PKT_MAX || !enc->level)
+		return err;
+
+	pkt = &enc->pktv[enc->n++];
+
+	pkt->hdr = *hdr;
+	pkt->len = (uint16_t)len;
+	memcpy(pkt->buf, pld, len);
+
+	++enc->n_media;
+
+	return err;
+}
+
+
+/**
+ * Print the FEC encoder statistics
+ *
+ * @param pf  Print handler for debug output
+ * @param enc FEC encoder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_enc_debug(struct re_printf *pf, const struct fec_enc *enc)
+{
+	if (!enc)
+		return 0;
+
+	return re_hprintf(pf, " fec tx: level=%u%% media=%llu fec=%llu\n",
+			  enc->level, enc->n_media, enc->n_fec);
+}
+
+
+static void dec_destructor(void *arg)
+{
+	struct fec_dec *dec = arg;
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(dec->slotv); i++)
+		mem_deref(dec->slotv[i].mb);
+}
+
+
+/**
+ * Allocate a FEC decoder
+ *
+ * @param decp  Pointer to allocated FEC decoder
+ * @param recvh Handler for media packets, called in sequence order
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_dec_alloc(struct fec_dec **decp, fec_recv_h *recvh, void *arg)
+{
+	struct fec_dec *dec;
+
+	if (!decp || !recvh)
+		return EINVAL;
+
+	dec = mem_zalloc(sizeof(*dec), dec_destructor);
+	if (!dec)
+		return ENOMEM;
+
+	dec->recvh = recvh;
+	dec->arg   = arg;
+
+	*decp = dec;
+
+	return 0;
+}
+
+
+static struct fec_slot *slot_get(struct fec_dec *dec, uint16_t seq)
+{
+	struct fec_slot *slot = &dec->slotv[seq % HIST_SIZE];
+
+	if (slot->used && slot->hdr.seq == seq)
+		return slot;
+
+	return NULL;
+}
+
+
+static struct fec_slot *slot_store(struct fec_dec *dec,
+				   const struct rtp_header *hdr,
+				   const uint8_t *pld, size_t len, bool fec)
+{
+	struct fec_slot *slot = &dec->slotv[hdr->seq % HIST_SIZE];
+
+	if (slot->used && slot->held)
+		--dec->n_held;
+
+	slot->hdr  = *hdr;
+	slot->used = true;
+	slot->fec  = fec;
+	slot->held = false;
+
+	if (fec)
+		return slot;
+
+	if (!slot->mb) {
+		slot->mb = mbuf_alloc(len);
+		if (!slot->mb) {
+			slot->used = false;
+			return NULL;
+		}
+	}
+
+	mbuf_rewind(slot->mb);
+	if (mbuf_write_mem(slot->mb, pld, len)) {
+		slot->used = false;
+		return NULL;
+	}
+
+	return slot;
+}
+
+
+static void deliver(struct fec_dec *dec, struct fec_slot *slot)
+{
+	dec->last_marker = slot->hdr.m;
+	dec->ts_last     = slot->hdr.ts;
+
+	slot->mb->pos = 0;
+	dec->recvh(&slot->hdr, slot->mb, dec->arg);
+}
+
+
+/* Deliver all held packets that are now in sequence */
+static void flush_held(struct fec_dec *dec)
+{
+	struct fec_slot *slot;
+
+	while (dec->n_held && (slot = slot_get(dec, dec->seq_next))) {
+
+		if (slot->held) {
+			slot->held = false;
+			--dec->n_held;
+
+			deliver(dec, slot);
+		}
+
+		++dec->seq_next;
+	}
+}
+
+
+/* Give up the missing packet at the head of the window */
+static void skip_missing(struct fec_dec *dec)
+{
+	while (dec->n_held && !slot_get(dec, dec->seq_next)) {
+
+		++dec->n_lost;
+		++dec->seq_next;
+	}
+
+	flush_held(dec);
+}
+
+
+/*
+ * The RTP timestamp of the frame with the missing packet. If the last
+ * delivered packet ended a frame, the missing packet belongs to the
+ * frame of the first held packet.
+ */
+static bool hole_timestamp(struct fec_dec *dec, uint32_t *ts)
+{
+	uint16_t seq;
+	unsigned i;
+
+	if (!dec->last_marker) {
+		*ts = dec->ts_last;
+		return true;
+	}
+
+	for (i=0, seq=dec->seq_next; i<HIST_SIZE; i++, seq++) {
+
+		const struct fec_slot *slot = slot_get(dec, seq);
+
+		if (slot) {
+			*ts = slot->hdr.ts;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static void check_held(struct fec_dec *dec, const struct rtp_header *hdr)
+{
+	uint32_t ts;
+
+	if (!dec->n_held)
+		return;
+
+	/*
+	 * The FEC packets of a frame are sent before the next frame,
+	 * so a packet with a different timestamp means that the
+	 * missing packet cannot be recovered anymore.
+	 */
+	while (dec->n_held > HELD_MAX ||
+	       (dec->n_held && hole_timestamp(dec, &ts) && ts != hdr->ts)) {
+
+		skip_missing(dec);
+	}
+}
+
+
+/**
+ * Handle an incoming media packet
+ *
+ * @param dec FEC decoder
+ * @param hdr RTP header
+ * @param mb  RTP payload
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_dec_media(struct fec_dec *dec, const struct rtp_header *hdr,
+		  struct mbuf *mb)
+{
+	struct fec_slot *slot;
+	int16_t d;
+
+	if (!dec || !hdr || !mb)
+		return EINVAL;
+
+	if (!dec->started) {
+		dec->seq_next = hdr->seq;
+		dec->started  = true;
+	}
+
+	d = seq_diff(dec->seq_next, hdr->seq);
+
+	/* late or duplicate packet, or far ahead of the window */
+	if (d < 0 || d >= HIST_SIZE || mbuf_get_left(mb) > PKT_MAX) {
+
+		if (d >= HIST_SIZE) {
+			while (dec->n_held)
+				skip_missing(dec);
+			dec->seq_next = hdr->seq + 1;
+		}
+
+		dec->recvh(hdr, mb, dec->arg);
+		return 0;
+	}
+
+	slot = slot_store(dec, hdr, mbuf_buf(mb), mbuf_get_left(mb), false);
+
+	if (d == 0 && !dec->n_held) {
+
+		++dec->seq_next;
+
+		dec->last_marker = hdr->m;
+		dec->ts_last     = hdr->ts;
+
+		dec->recvh(hdr, mb, dec->arg);
+		return 0;
+	}
+
+	if (!slot)
+		return ENOMEM;
+
+	if (d == 0) {
+		++dec->seq_next;
+		deliver(dec, slot);
+	}
+	else {
+		slot->held = true;
+		++dec->n_held;
+	}
+
+	flush_held(dec);
+	check_held(dec, hdr);
+
+	return 0;
+}
+
+
+static int recover(struct fec_dec *dec, const struct rtp_header *fhdr,
+		   struct mbuf *mb, uint16_t *snbasep)
+{
+	struct rtp_header hdr;
+	struct fec_slot *slot = NULL;
+	uint8_t b0, b1;
+	uint16_t snbase, len, protlen, seq_lost = 0;
+	uint64_t mask;
+	uint8_t *pld = NULL;
+	unsigned i, n_lost = 0, bits;
+	bool lmask;
+	uint32_t ts;
+	int err = 0;
+
+	if (mbuf_get_left(mb) < FEC_HDR_SIZE + FEC_ULP_SHORT)
+		return EBADMSG;
+
+	b0      = mbuf_read_u8(mb);
+	b1      = mbuf_read_u8(mb);
+	snbase  = ntohs(mbuf_read_u16(mb));
+	ts      = ntohl(mbuf_read_u32(mb));
+	len     = ntohs(mbuf_read_u16(mb));
+	protlen = ntohs(mbuf_read_u16(mb));
+	mask    = (uint64_t)ntohs(mbuf_read_u16(mb)) << 32;
+
+	lmask = (b0 >> 6) & 0x1;
+	bits  = lmask ? 48 : 16;
+
+	*snbasep = snbase;
+
+	if (lmask) {
+		if (mbuf_get_left(mb) < 4)
+			return EBADMSG;
+
+		mask |= ntohl(mbuf_read_u32(mb));
+	}
+
+	if (mbuf_get_left(mb) < protlen)
+		return EBADMSG;
+
+	for (i=0; i<bits; i++) {
+
+		const struct fec_slot *s;
+		const uint16_t seq = snbase + i;
+
+		if (!(mask & ((uint64_t)1 << (47 - i))))
+			continue;
+
+		s = slot_get(dec, seq);
+
+		/* a FEC packet does not protect other FEC packets */
+		if (s && s->fec)
+			continue;
+
+		if (!s || !s->mb) {
+			seq_lost = seq;
+			++n_lost;
+		}
+	}
+
+	/* XOR can only recover one missing packet */
+	if (n_lost != 1)
+		return 0;
+
+	/* the missing packet was already given up */
+	if (seq_diff(dec->seq_next, seq_lost) < 0)
+		return 0;
+
+	pld = mem_alloc(protlen, NULL);
+	if (!pld)
+		return ENOMEM;
+
+	memcpy(pld, mbuf_buf(mb), protlen);
+
+	for (i=0; i<bits; i++) {
+
+		const struct fec_slot *s;
+		const uint16_t seq = snbase + i;
+
+		if (!(mask & ((uint64_t)1 << (47 - i))) || seq == seq_lost)
+			continue;
+
+		s = slot_get(dec, seq);
+		if (!s || s->fec || !s->mb)
+			continue;
+
+		b0  ^= hdr_byte0(&s->hdr);
+		b1  ^= hdr_byte1(&s->hdr);
+		ts  ^= s->hdr.ts;
+		len ^= (uint16_t)s->mb->end;
+
+		xor_mem(pld, s->mb->buf, min(s->mb->end, protlen));
+	}
+
+	if (len > protlen) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pad  = (b0 >> 5) & 0x1;
+	hdr.ext  = (b0 >> 4) & 0x1;
+	hdr.cc   = b0 & 0x0f;
+	hdr.m    = (b1 >> 7) & 0x1;
+	hdr.pt   = b1 & 0x7f;
+	hdr.seq  = seq_lost;
+	hdr.ts   = ts;
+	hdr.ssrc = fhdr->ssrc;
+
+	slot = slot_store(dec, &hdr, pld, len, false);
+	if (!slot) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	slot->held = true;
+	++dec->n_held;
+	++dec->n_recovered;
+
+ out:
+	mem_deref(pld);
+
+	return err;
+}
+
+
+/**
+ * Handle an incoming FEC packet
+ *
+ * @param dec FEC decoder
+ * @param hdr RTP header
+ * @param mb  RTP payload with FEC header
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_dec_fec(struct fec_dec *dec, const struct rtp_header *hdr,
+		struct mbuf *mb)
+{
+	uint16_t snbase;
+	uint32_t ts;
+	int16_t d;
+	int err;
+
+	if (!dec || !hdr || !mb)
+		return EINVAL;
+
+	++dec->n_fec;
+
+	if (!dec->started)
+		return 0;
+
+	d = seq_diff(dec->seq_next, hdr->seq);
+	if (d < 0 || d >= HIST_SIZE)
+		return 0;
+
+	/* the FEC packet takes a sequence number */
+	if (!slot_store(dec, hdr, NULL, 0, true))
+		return ENOMEM;
+
+	if (d == 0 && !dec->n_held) {
+		++dec->seq_next;
+		return 0;
+	}
+
+	snbase = dec->seq_next;
+	err = recover(dec, hdr, mb, &snbase);
+
+	if (d == 0)
+		++dec->seq_next;
+
+	flush_held(dec);
+
+	/*
+	 * A missing packet in front of the packets protected by a FEC
+	 * packet of the same frame is either a lost FEC packet, or it
+	 * was not recovered by the FEC packets sent before this one.
+	 */
+	if (dec->n_held && !slot_get(dec, dec->seq_next) &&
+	    seq_diff(dec->seq_next, snbase) > 0 &&
+	    hole_timestamp(dec, &ts) && ts == hdr->ts) {
+
+		skip_missing(dec);
+	}
+
+	check_held(dec, hdr);
+
+	return err;
+}
+
+
+/**
+ * Get the number of media packets recovered by the FEC decoder
+ *
+ * @param dec FEC decoder
+ *
+ * @return Number of recovered packets
+ */
+uint64_t fec_dec_recovered(const struct fec_dec *dec)
+{
+	return dec ? dec->n_recovered : 0;
+}
+
+
+/**
+ * Print the FEC decoder statistics
+ *
+ * @param pf  Print handler for debug output
+ * @param dec FEC decoder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_dec_debug(struct re_printf *pf, const struct fec_dec *dec)
+{
+	if (!dec)
+		return 0;
+
+	return re_hprintf(pf, " fec rx: fec=%llu recovered=%llu lost=%llu"
+			  " held=%u\n",
+			  dec->n_fec, dec->n_recovered, dec->n_lost,
+			  dec->n_held);
+}
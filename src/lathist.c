@@ -0,0 +1,104 @@
+/**
+ * @file lathist.c  Latency histogram
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Bucket N holds the values with N significant bits, i.e. bucket 0
+ * holds 0 ms, bucket 1 holds 1 ms, bucket 2 holds 2-3 ms, bucket 3
+ * holds 4-7 ms and so on. The last bucket holds all larger values.
+ */
+static unsigned bucket_index(uint32_t ms)
+{
+	unsigned i = 0;
+
+	while (ms && i < LATHIST_BUCKETS - 1) {
+		ms >>= 1;
+		++i;
+	}
+
+	return i;
+}
+
+
+/**
+ * Add a latency sample to a histogram
+ *
+ * @param h  Latency histogram
+ * @param ms Latency in [ms]
+ */
+void lathist_add(struct lathist *h, uint32_t ms)
+{
+	if (!h)
+		return;
+
+	++h->bucketv[bucket_index(ms)];
+	++h->n;
+	h->sum += ms;
+	h->max  = max(h->max, ms);
+}
+
+
+/**
+ * Get a percentile of the latency histogram
+ *
+ * @param h   Latency histogram
+ * @param pct Percentile, from 0 to 100
+ *
+ * @return Upper bound of the percentile in [ms]
+ */
+uint32_t lathist_percentile(const struct lathist *h, unsigned pct)
+{
+	uint64_t rank, cnt = 0;
+	unsigned i;
+
+	if (!h || !h->n)
+		return 0;
+
+	rank = ((uint64_t)h->n * min(pct, 100) + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (i=0; i<LATHIST_BUCKETS; i++) {
+
+		cnt += h->bucketv[i];
+
+		if (cnt < rank)
+			continue;
+
+		/* the last bucket has no upper bound */
+		if (i == LATHIST_BUCKETS - 1)
+			break;
+
+		return min((uint32_t)((1ULL << i) - 1), h->max);
+	}
+
+	return h->max;
+}
+
+
+/**
+ * Print a latency histogram summary
+ *
+ * @param pf Print handler
+ * @param h  Latency histogram
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int lathist_debug(struct re_printf *pf, const struct lathist *h)
+{
+	if (!h || !h->n)
+		return re_hprintf(pf, "n=0");
+
+	return re_hprintf(pf, "n=%u avg=%llu p50=%u p95=%u p99=%u max=%u ms",
+			  h->n, h->sum / h->n,
+			  lathist_percentile(h, 50),
+			  lathist_percentile(h, 95),
+			  lathist_percentile(h, 99),
+			  h->max);
+}
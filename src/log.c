@@ -3,24 +3,285 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
-
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <re.h>
 #include <baresip.h>
 
 
+/*
+ * In async mode the messages are formatted by the producer, and put
+ * into a lock-free ring buffer with multiple producers and a single
+ * consumer. A writer thread drains the ring buffer to stdout and to
+ * the log handlers, so that a slow handler does not block real-time
+ * threads. If the ring buffer is full the message is dropped.
+ *
+ * A long message takes several consecutive records, which are reserved
+ * at once, and it is written only when all of its records are there.
+ * The writer sleeps on a condition variable when the ring is empty, and
+ * a producer only takes the mutex to wake it up.
+ */
+#if defined (HAVE_PTHREAD) && defined (__GNUC__)
+#define LOG_ASYNC 1
+#endif
+
+
+enum {
+	RING_SIZE  = 1024,          /* number of records, power of two  */
+	TEXT_SIZE  = 240,           /* text size of one record          */
+	MSG_SIZE   = 4096,          /* maximum size of a message        */
+	RL_INTERVAL = 1000,         /* rate limit interval in [ms]      */
+	RL_BURST   = 5,             /* messages per rate limit interval */
+};
+
+
+#ifdef LOG_ASYNC
+/** One record in the log ring buffer */
+struct log_rec {
+	uint32_t seq;               /**< Sequence number of the slot    */
+	uint8_t level;              /**< Log level                      */
+	uint8_t nrec;               /**< Records of the message         */
+	uint16_t len;               /**< Length of the text             */
+	uint64_t ts;                /**< Time of the message [ms]       */
+	char text[TEXT_SIZE];       /**< Part of the formatted text     */
+};
+
+static struct log_rec ringv[RING_SIZE];
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+
 static struct {
 	struct list logl;
 	bool debug;
 	bool info;
 	bool enable_stdout;
+#ifdef LOG_ASYNC
+	struct lock *lock;          /**< Protects the list of handlers  */
+	pthread_t thread;           /**< Writer thread                  */
+	bool async;                 /**< Async mode is enabled          */
+	bool run;                   /**< Writer thread is running       */
+	bool sleeping;              /**< Writer thread waits for wakeup */
+	uint32_t head;              /**< Next record to write           */
+	uint32_t tail;              /**< Next record to read            */
+	uint64_t written;           /**< Records written by the writer  */
+	uint64_t dropped;           /**< Records dropped, ring was full */
+	uint64_t lag_max;           /**< Max time in the ring [ms]      */
+#endif
+	uint64_t suppressed;        /**< Messages hit by a rate limit   */
 } lg = {
-	LIST_INIT,
-	false,
-	true,
-	true
+	.logl = LIST_INIT,
+	.debug = false,
+	.info = true,
+	.enable_stdout = true,
 };
 
 
+static void log_write(uint32_t level, const char *msg)
+{
+	struct le *le;
+
+	if (lg.enable_stdout) {
+
+		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+
+		(void)re_fprintf(stdout, "%s", msg);
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[;m");
+	}
+
+	le = lg.logl.head;
+
+	while (le) {
+
+		struct log *log = le->data;
+		le = le->next;
+
+		if (log->h)
+			log->h(level, msg);
+	}
+}
+
+
+#ifdef LOG_ASYNC
+static void ring_wakeup(void)
+{
+	/* the records are seen by the writer, or it is seen sleeping */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n(&lg.sleeping, __ATOMIC_RELAXED))
+		return;
+
+	pthread_mutex_lock(&wake_mutex);
+	pthread_cond_signal(&wake_cond);
+	pthread_mutex_unlock(&wake_mutex);
+}
+
+
+static void ring_push(enum log_level level, const char *msg, size_t len)
+{
+	const uint32_t nrec = len ? (uint32_t)((len + TEXT_SIZE - 1) /
+					       TEXT_SIZE) : 1;
+	uint64_t ts = tmr_jiffies();
+	uint32_t pos, i;
+
+	pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+
+	/* the records are free, if the last one is free */
+	for (;;) {
+		struct log_rec *rec;
+		uint32_t seq;
+		int32_t dif;
+
+		rec = &ringv[(pos + nrec - 1) & (RING_SIZE - 1)];
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		dif = (int32_t)(seq - (pos + nrec - 1));
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&lg.head,
+					&pos, pos + nrec, true,
+					__ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0) {
+			__atomic_add_fetch(&lg.dropped, 1,
+					   __ATOMIC_RELAXED);
+			return;
+		}
+		else {
+			pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	for (i=0; i<nrec; i++) {
+
+		struct log_rec *rec = &ringv[(pos + i) & (RING_SIZE - 1)];
+		size_t n = min(len, sizeof(rec->text));
+
+		rec->level = level;
+		rec->nrec  = i ? 0 : nrec;
+		rec->len   = (uint16_t)n;
+		rec->ts    = ts;
+		memcpy(rec->text, msg, n);
+
+		__atomic_store_n(&rec->seq, pos + i + 1, __ATOMIC_RELEASE);
+
+		msg += n;
+		len -= n;
+	}
+
+	ring_wakeup();
+}
+
+
+/* The number of records of the next message, 0 if it is not complete */
+static uint32_t ring_peek(void)
+{
+	const struct log_rec *rec = &ringv[lg.tail & (RING_SIZE - 1)];
+	uint32_t i, nrec;
+
+	if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != lg.tail + 1)
+		return 0;
+
+	nrec = rec->nrec;
+
+	for (i=1; i<nrec; i++) {
+
+		rec = &ringv[(lg.tail + i) & (RING_SIZE - 1)];
+
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) !=
+		    lg.tail + i + 1)
+			return 0;
+	}
+
+	return nrec;
+}
+
+
+static bool ring_pop(void)
+{
+	static char msg[MSG_SIZE];
+	const struct log_rec *rec;
+	uint32_t i, nrec;
+	uint64_t lag;
+	size_t len = 0;
+
+	nrec = ring_peek();
+	if (!nrec)
+		return false;
+
+	rec = &ringv[lg.tail & (RING_SIZE - 1)];
+
+	lag = tmr_jiffies() - rec->ts;
+	lg.lag_max = max(lg.lag_max, lag);
+
+	for (i=0; i<nrec; i++) {
+
+		rec = &ringv[(lg.tail + i) & (RING_SIZE - 1)];
+
+		memcpy(&msg[len], rec->text, rec->len);
+		len += rec->len;
+	}
+
+	msg[len] = '\0';
+
+	lock_read_get(lg.lock);
+	log_write(rec->level, msg);
+	lock_rel(lg.lock);
+
+	for (i=0; i<nrec; i++) {
+
+		struct log_rec *r = &ringv[(lg.tail + i) & (RING_SIZE - 1)];
+
+		__atomic_store_n(&r->seq, lg.tail + i + RING_SIZE,
+				 __ATOMIC_RELEASE);
+	}
+
+	lg.tail += nrec;
+	++lg.written;
+
+	return true;
+}
+
+
+static void *writer_thread(void *arg)
+{
+	bool run = true;
+	(void)arg;
+
+	while (run) {
+
+		if (ring_pop())
+			continue;
+
+		pthread_mutex_lock(&wake_mutex);
+
+		__atomic_store_n(&lg.sleeping, true, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		while (lg.run && !ring_peek())
+			pthread_cond_wait(&wake_cond, &wake_mutex);
+
+		__atomic_store_n(&lg.sleeping, false, __ATOMIC_RELAXED);
+
+		run = lg.run;
+
+		pthread_mutex_unlock(&wake_mutex);
+	}
+
+	return NULL;
+}
+#endif
+
+
 /**
  * Register a log handler
  *
@@ -31,7 +292,17 @@ void log_register_handler(struct log *log)
 	if (!log)
 		return;
 
+#ifdef LOG_ASYNC
+	if (lg.lock)
+		lock_write_get(lg.lock);
+#endif
+
 	list_append(&lg.logl, &log->le, log);
+
+#ifdef LOG_ASYNC
+	if (lg.lock)
+		lock_rel(lg.lock);
+#endif
 }
 
 
@@ -45,7 +316,17 @@ void log_unregister_handler(struct log *log)
 	if (!log)
 		return;
 
+#ifdef LOG_ASYNC
+	if (lg.lock)
+		lock_write_get(lg.lock);
+#endif
+
 	list_unlink(&log->le);
+
+#ifdef LOG_ASYNC
+	if (lg.lock)
+		lock_rel(lg.lock);
+#endif
 }
 
 
@@ -83,43 +364,176 @@ void log_enable_stdout(bool enable)
 
 
 /**
- * Print a message to the logging system
+ * Enable asynchronous logging, where the messages are written to
+ * stdout and the log handlers from a separate writer thread
  *
- * @param level Log level
- * @param fmt   Formatted message
- * @param ap    Variable argument list
+ * @param enable True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Must be called from the main thread
  */
-void vlog(enum log_level level, const char *fmt, va_list ap)
+int log_enable_async(bool enable)
 {
-	char buf[4096];
-	struct le *le;
+#ifdef LOG_ASYNC
+	uint32_t i;
+	int err;
 
-	if (re_vsnprintf(buf, sizeof(buf), fmt, ap) < 0)
-		return;
+	if (enable == lg.async)
+		return 0;
 
-	if (lg.enable_stdout) {
+	if (!enable) {
+		__atomic_store_n(&lg.async, false, __ATOMIC_RELEASE);
 
-		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+		pthread_mutex_lock(&wake_mutex);
+		lg.run = false;
+		pthread_cond_signal(&wake_cond);
+		pthread_mutex_unlock(&wake_mutex);
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+		pthread_join(lg.thread, NULL);
 
-		(void)re_fprintf(stdout, "%s", buf);
+		/* write the remaining records */
+		while (ring_pop())
+			;
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[;m");
+		lg.lock = mem_deref(lg.lock);
+
+		return 0;
 	}
 
-	le = lg.logl.head;
+	for (i=0; i<RING_SIZE; i++)
+		ringv[(lg.tail + i) & (RING_SIZE - 1)].seq = lg.tail + i;
 
-	while (le) {
+	lg.head = lg.tail;
 
-		struct log *log = le->data;
-		le = le->next;
+	err = lock_alloc(&lg.lock);
+	if (err)
+		return err;
 
-		if (log->h)
-			log->h(level, buf);
+	lg.run = true;
+
+	err = pthread_create(&lg.thread, NULL, writer_thread, NULL);
+	if (err) {
+		lg.run  = false;
+		lg.lock = mem_deref(lg.lock);
+		return err;
 	}
+
+	__atomic_store_n(&lg.async, true, __ATOMIC_RELEASE);
+
+	return 0;
+#else
+	return enable ? ENOSYS : 0;
+#endif
+}
+
+
+/**
+ * Check the rate limit of a log call site. At most a few messages per
+ * interval are let through, and the number of suppressed messages is
+ * logged when the next interval starts.
+ *
+ * @param rl    Rate limit state of the call site
+ * @param level Log level of the call site
+ *
+ * @return True if the message should be logged, otherwise false
+ *
+ * @note The counters are not atomic, so they are approximate if the
+ *       call site is used from several threads at the same time
+ */
+bool log_ratelimit(struct log_ratelimit *rl, enum log_level level)
+{
+	uint64_t now = tmr_jiffies();
+
+	if (!rl)
+		return true;
+
+	if (now - rl->ts >= RL_INTERVAL) {
+
+		uint32_t suppressed = rl->suppressed;
+
+		rl->ts         = now;
+		rl->count      = 0;
+		rl->suppressed = 0;
+
+		if (suppressed) {
+			loglv(level, "log: %u similar messages suppressed\n",
+			      suppressed);
+		}
+	}
+
+	if (rl->count < RL_BURST) {
+		++rl->count;
+		return true;
+	}
+
+	++rl->suppressed;
+#ifdef LOG_ASYNC
+	__atomic_add_fetch(&lg.suppressed, 1, __ATOMIC_RELAXED);
+#else
+	++lg.suppressed;
+#endif
+
+	return false;
+}
+
+
+/**
+ * Print the status of the logging system
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int log_debug(struct re_printf *pf, void *unused)
+{
+	int err;
+
+	(void)unused;
+
+	err = re_hprintf(pf, "--- Log ---\n");
+#ifdef LOG_ASYNC
+	err |= re_hprintf(pf, " mode:       %s\n",
+			  lg.async ? "async" : "sync");
+	err |= re_hprintf(pf, " queued:     %u/%u\n",
+			  __atomic_load_n(&lg.head, __ATOMIC_RELAXED)
+			  - lg.tail, RING_SIZE);
+	err |= re_hprintf(pf, " written:    %llu\n", lg.written);
+	err |= re_hprintf(pf, " dropped:    %llu\n",
+			  __atomic_load_n(&lg.dropped, __ATOMIC_RELAXED));
+	err |= re_hprintf(pf, " max lag:    %llu ms\n", lg.lag_max);
+#else
+	err |= re_hprintf(pf, " mode:       sync\n");
+#endif
+	err |= re_hprintf(pf, " suppressed: %llu\n", lg.suppressed);
+
+	return err;
+}
+
+
+/**
+ * Print a message to the logging system
+ *
+ * @param level Log level
+ * @param fmt   Formatted message
+ * @param ap    Variable argument list
+ */
+void vlog(enum log_level level, const char *fmt, va_list ap)
+{
+	char buf[MSG_SIZE];
+
+	if (re_vsnprintf(buf, sizeof(buf), fmt, ap) < 0)
+		return;
+
+#ifdef LOG_ASYNC
+	if (__atomic_load_n(&lg.async, __ATOMIC_ACQUIRE)) {
+		ring_push(level, buf, str_len(buf));
+		return;
+	}
+#endif
+
+	log_write(level, buf);
 }
 
 
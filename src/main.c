@@ -270,6 +270,9 @@ int main(int argc, char *argv[])
 
 	baresip_close();
 
+	/* write the pending log messages to the log handlers */
+	(void)log_enable_async(false);
+
 	/* NOTE: modules must be unloaded after all application
 	 *       activity has stopped.
 	 */
@@ -8,6 +8,74 @@
 #include "core.h"
 
 
+/** Startup profile of one module */
+struct modprof {
+	struct le le;
+	char name[64];       /**< Module name, excluding extension        */
+	uint64_t load_us;    /**< Time spent in load and init [us]        */
+	uint64_t lazy_us;    /**< Time spent in deferred init [us]        */
+	bool lazy;           /**< Deferred init is done                   */
+};
+
+static struct {
+	struct list profl;   /**< List of module profiles (struct modprof) */
+	bool lazy;           /**< Defer expensive module initialization    */
+	bool profile;        /**< Print module init times after startup    */
+	bool loading;        /**< A module is being loaded                 */
+} modc;
+
+
+static void modprof_destructor(void *arg)
+{
+	struct modprof *mp = arg;
+
+	list_unlink(&mp->le);
+}
+
+
+static struct modprof *modprof_find(const struct pl *name)
+{
+	struct pl base;
+	struct le *le;
+
+	if (re_regex(name->p, name->l, "[^.]+", &base))
+		base = *name;
+
+	for (le = modc.profl.head; le; le = le->next) {
+		struct modprof *mp = le->data;
+
+		if (0 == pl_strcasecmp(&base, mp->name))
+			return mp;
+	}
+
+	return NULL;
+}
+
+
+static struct modprof *modprof_get(const struct pl *name)
+{
+	struct modprof *mp;
+	struct pl base;
+
+	mp = modprof_find(name);
+	if (mp)
+		return mp;
+
+	mp = mem_zalloc(sizeof(*mp), modprof_destructor);
+	if (!mp)
+		return NULL;
+
+	if (re_regex(name->p, name->l, "[^.]+", &base))
+		base = *name;
+
+	pl_strcpy(&base, mp->name, sizeof(mp->name));
+
+	list_append(&modc.profl, &mp->le, mp);
+
+	return mp;
+}
+
+
 /*
  * Append module extension, if not exist
  *
@@ -59,11 +127,16 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 	char file[FS_PATH_MAX];
 	char namestr[256];
 	struct mod *m = NULL;
+	struct modprof *mp;
+	uint64_t t0;
 	int err = 0;
 
 	if (!name)
 		return EINVAL;
 
+	t0 = tmr_jiffies_usec();
+	modc.loading = true;
+
 #ifdef STATIC
 	/* Try static first */
 	pl_strcpy(name, namestr, sizeof(namestr));
@@ -90,11 +163,19 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 		goto out;
 
  out:
+	modc.loading = false;
+
 	if (err) {
 		warning("module %r: %m\n", name, err);
 	}
-	else if (modp)
-		*modp = m;
+	else {
+		mp = modprof_get(name);
+		if (mp)
+			mp->load_us = tmr_jiffies_usec() - t0;
+
+		if (modp)
+			*modp = m;
+	}
 
 	return err;
 }
@@ -137,33 +218,203 @@ static int module_app_handler(const struct pl *val, void *arg)
 }
 
 
-int module_init(const struct conf *conf)
+int module_init(const struct confidx *idx)
 {
 	struct pl path;
 	int err;
 
-	if (!conf)
+	if (!idx)
 		return EINVAL;
 
-	if (conf_get(conf, "module_path", &path))
+	if (confidx_get(idx, "module_path", &path))
 		pl_set_str(&path, ".");
 
-	err = conf_apply(conf, "module", module_handler, &path);
+	(void)confidx_get_bool(idx, "module_lazy", &modc.lazy);
+	(void)confidx_get_bool(idx, "module_profile", &modc.profile);
+
+	err = confidx_apply(idx, "module", module_handler, &path);
 	if (err)
 		return err;
 
-	err = conf_apply(conf, "module_tmp", module_tmp_handler, &path);
+	err = confidx_apply(idx, "module_tmp", module_tmp_handler, &path);
 	if (err)
 		return err;
 
-	err = conf_apply(conf, "module_app", module_app_handler, &path);
+	err = confidx_apply(idx, "module_app", module_app_handler, &path);
 	if (err)
 		return err;
 
+	if (modc.profile)
+		info("%H", module_debug, NULL);
+
 	return 0;
 }
 
 
+/**
+ * Free the module profiles
+ */
+void module_prof_close(void)
+{
+	list_flush(&modc.profl);
+}
+
+
+/**
+ * Print the startup profile of all loaded modules
+ *
+ * @param pf     Print handler
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_debug(struct re_printf *pf, void *unused)
+{
+	uint64_t load = 0, lazy = 0;
+	struct le *le;
+	int err;
+
+	(void)unused;
+
+	err = re_hprintf(pf, "--- Module init (%s) ---\n",
+			 modc.lazy ? "lazy" : "eager");
+
+	for (le = modc.profl.head; le; le = le->next) {
+		const struct modprof *mp = le->data;
+
+		load += mp->load_us;
+		lazy += mp->lazy_us;
+
+		err |= re_hprintf(pf, " %-16s %8.3f ms", mp->name,
+				  mp->load_us / 1000.0);
+		if (mp->lazy) {
+			err |= re_hprintf(pf, "  (deferred %.3f ms)",
+					  mp->lazy_us / 1000.0);
+		}
+		err |= re_hprintf(pf, "\n");
+	}
+
+	err |= re_hprintf(pf, " %u modules: load %.3f ms, deferred %.3f ms\n",
+			  list_count(&modc.profl),
+			  load / 1000.0, lazy / 1000.0);
+
+	return err;
+}
+
+
+/**
+ * Check if expensive module initialization is deferred to first use
+ *
+ * @return True if lazy module initialization is enabled
+ */
+bool module_lazy(void)
+{
+	return modc.lazy;
+}
+
+
+/**
+ * Enable or disable lazy module initialization. This is normally set
+ * with the "module_lazy" config item.
+ *
+ * @param enable True to defer expensive module initialization
+ */
+void module_lazy_set(bool enable)
+{
+	modc.lazy = enable;
+}
+
+
+/**
+ * Run the init handler of a lazily initialized module. In eager mode
+ * this is done right away, otherwise it is deferred to the first call
+ * to module_lazy_use(). This is called from the module init function.
+ *
+ * @param ml Lazy init state
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_lazy_init(struct mod_lazy *ml)
+{
+	if (!ml || !ml->inith)
+		return EINVAL;
+
+	if (modc.lazy) {
+		debug("module: %s: init deferred to first use\n", ml->name);
+		return 0;
+	}
+
+	return module_lazy_use(ml);
+}
+
+
+/**
+ * Make sure a lazily initialized module is ready for use. The init
+ * handler is called only once, and the result is cached.
+ *
+ * @param ml Lazy init state
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_lazy_use(struct mod_lazy *ml)
+{
+	struct modprof *mp;
+	struct pl name;
+	uint64_t t0;
+
+	if (!ml || !ml->inith)
+		return EINVAL;
+
+	if (ml->done)
+		return ml->err;
+
+	t0 = tmr_jiffies_usec();
+
+	ml->err  = ml->inith();
+	ml->done = true;
+
+	if (ml->err) {
+		warning("module: %s: init failed (%m)\n", ml->name, ml->err);
+	}
+
+	/* init done while loading is part of the load time */
+	if (modc.loading || !str_isset(ml->name))
+		return ml->err;
+
+	pl_set_str(&name, ml->name);
+
+	mp = modprof_find(&name);
+	if (mp) {
+		mp->lazy_us = tmr_jiffies_usec() - t0;
+		mp->lazy    = true;
+	}
+
+	if (modc.profile) {
+		info("module: %s: deferred init took %.3f ms\n",
+		     ml->name, (tmr_jiffies_usec() - t0) / 1000.0);
+	}
+
+	return ml->err;
+}
+
+
+/**
+ * Reset the state of a lazily initialized module, so that the next
+ * call to module_lazy_use() runs the init handler again. This is
+ * called from the module close function.
+ *
+ * @param ml Lazy init state
+ */
+void module_lazy_reset(struct mod_lazy *ml)
+{
+	if (!ml)
+		return;
+
+	ml->done = false;
+	ml->err  = 0;
+}
+
+
 void module_app_unload(void)
 {
 	struct le *le = list_tail(mod_list());
@@ -220,7 +471,7 @@ int module_load(const char *name)
 
 	pl_set_str(&pl_name, filename);
 
-	if (conf_get(conf_cur(), "module_path", &path))
+	if (confidx_get(conf_cur_index(), "module_path", &path))
 		pl_set_str(&path, ".");
 
 	err = load_module(NULL, &path, &pl_name);
@@ -229,6 +480,31 @@ int module_load(const char *name)
 }
 
 
+/**
+ * Load a module by name from a given path
+ *
+ * @param path Module path
+ * @param name Module name incl/excl extension, excluding module path
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_load_path(const char *path, const char *name)
+{
+	char filename[256];
+	struct pl pl_path, pl_name;
+
+	if (!str_isset(path) || !str_isset(name))
+		return EINVAL;
+
+	append_extension(filename, sizeof(filename), name);
+
+	pl_set_str(&pl_path, path);
+	pl_set_str(&pl_name, filename);
+
+	return load_module(NULL, &pl_path, &pl_name);
+}
+
+
 /**
  * Unload a module by name or by filename
  *
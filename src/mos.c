@@ -61,3 +61,108 @@ double mos_calculate(double *r_factor, double rtt,
 
 	return mos_val;
 }
+
+
+/*
+ * Equipment impairment (Ie) and packet-loss robustness (Bpl) of the
+ * audio codecs, from ITU-T G.113 Appendix I where listed, with packet
+ * loss concealment. Wideband codecs are rated on the narrowband scale.
+ */
+static const struct codec_impairment {
+	const char *name;
+	double ie;
+	double bpl;
+} impairmentv[] = {
+	{"PCMU",     0.0, 25.1},
+	{"PCMA",     0.0, 25.1},
+	{"G722",     0.0, 25.1},
+	{"G7221",    0.0, 25.1},
+	{"G726-32",  7.0, 25.1},
+	{"G726-40",  2.0, 25.1},
+	{"G729",    11.0, 19.0},
+	{"GSM",     20.0, 10.0},
+	{"AMR",      5.0, 10.0},
+	{"iLBC",    10.0, 32.0},
+	{"speex",   10.0, 20.0},
+	{"opus",     0.0, 20.0},
+};
+
+
+static const struct codec_impairment *impairment_find(const char *codec)
+{
+	static const struct codec_impairment unknown = {"", 0.0, 10.0};
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(impairmentv); i++) {
+
+		if (0 == str_casecmp(codec, impairmentv[i].name))
+			return &impairmentv[i];
+	}
+
+	return &unknown;
+}
+
+
+/**
+ * Calculate the MOS of one interval with the E-model
+ *
+ * The R-factor is calculated as in ITU-T G.107, with the default values
+ * for all but the delay and the equipment impairment. The one-way delay
+ * is half the round-trip time, plus the jitter buffer and packetization
+ * delays. The packet loss includes the packets discarded by the receiver,
+ * and its burstiness is taken from the runs of lost packets.
+ *
+ * @param r_factor Pointer to where R-factor is written (optional)
+ * @param codec    Name of the audio codec
+ * @param in       Input of the interval
+ *
+ * @return The calculated MOS value from 1 to 4.5
+ */
+double mos_emodel(double *r_factor, const char *codec,
+		  const struct quality_input *in)
+{
+	const struct codec_impairment *ci = impairment_find(codec);
+	double d, id, ppl = 0.0, burst_r = 1.0, ie_eff;
+	double r;
+
+	if (!in)
+		return 1.0;
+
+	/* delay impairment */
+	d  = in->rtt / 2 + in->jitter * 2 + 10;
+	id = 0.024 * d;
+	if (d > 177.3)
+		id += 0.11 * (d - 177.3);
+
+	/* effective equipment impairment */
+	if (in->expected) {
+
+		const uint32_t lost = min(in->lost + in->discarded,
+					  in->expected);
+
+		ppl = 100.0 * lost / in->expected;
+
+		/* mean run length, relative to random loss */
+		if (in->lost && in->bursts) {
+
+			const double p = (double)in->lost / in->expected;
+
+			burst_r = (double)in->lost / in->bursts * (1 - p);
+			burst_r = max(burst_r, 1.0);
+		}
+	}
+
+	ie_eff = ci->ie + (95 - ci->ie) * ppl / (ppl / burst_r + ci->bpl);
+
+	r = 93.2 - id - ie_eff;
+
+	if (r > 100)
+		r = 100;
+	else if (r < 0)
+		r = 0;
+
+	if (r_factor)
+		*r_factor = r;
+
+	return rfactor_to_mos(r);
+}
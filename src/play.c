@@ -3,15 +3,73 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined (HAVE_UNISTD_H) && !defined (WIN32)
+#define USE_WAVFILE 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #include "core.h"
 
 
-enum {PTIME = 40};
+enum {
+	PTIME = 40,
+	WAV_COPY_MAX = 1048576,  /* files up to this size are copied */
+	READAHEAD = 8192,        /* samples read ahead of a streamed file */
+	READ_BLOCK = 1024,       /* samples read at a time */
+};
+
+
+/** WAV file, shared by all players of the file */
+struct wavfile {
+	struct le le;          /**< Entry in the player's file cache    */
+	char *path;            /**< Full path of the file               */
+	int fd;                /**< File descriptor of a streamed file  */
+	uint8_t *buf;          /**< Contents of a copied file           */
+	size_t size;           /**< Size of the file in [bytes]         */
+	size_t data;           /**< Offset of the audio data            */
+	size_t datasz;         /**< Size of the audio data in [bytes]   */
+	enum aufmt fmt;        /**< Sample format of the audio data     */
+	uint32_t srate;        /**< Sampling rate in [Hz]               */
+	uint8_t ch;            /**< Number of channels                  */
+	uint64_t ino;          /**< Inode number of the file            */
+	uint64_t mtime;        /**< Modification time of the file [ns]  */
+};
+
+/**
+ * Read-ahead of a streamed file. A reader thread reads the file into a
+ * ring of samples, and the player only copies from the ring. The end of
+ * the file is marked in the ring, and the reader continues from the
+ * start of the file.
+ */
+struct readahead {
+	struct wavfile *wf;    /**< Streamed WAV file                   */
+	size_t pos;            /**< Position of the reader in the file  */
+#ifdef HAVE_PTHREAD
+	pthread_t tid;         /**< Reader thread                       */
+	pthread_mutex_t mutex; /**< Protects the ring                   */
+	pthread_cond_t cond;   /**< Signals the reader                  */
+#endif
+	int16_t *sampv;        /**< Ring of samples                     */
+	size_t sampc;          /**< Size of the ring in [samples]       */
+	uint64_t rd;           /**< Samples read by the player          */
+	uint64_t wr;           /**< Samples written by the reader       */
+	uint64_t end;          /**< End of the file in the ring         */
+	bool eof;              /**< The end of the file is in the ring  */
+	bool blocked;          /**< The reader waits for the player     */
+	bool run;              /**< The reader thread is running        */
+};
 
 /** Audio file player */
 struct play {
@@ -19,6 +77,9 @@ struct play {
 	struct play **playp;
 	struct lock *lock;
 	struct mbuf *mb;
+	struct wavfile *wf;
+	struct readahead *ra;
+	size_t pos;
 	struct auplay_st *auplay;
 	struct tmr tmr;
 	int repeat;
@@ -34,6 +95,7 @@ static const char default_play_path[FS_PATH_MAX] = PREFIX "/share/baresip";
 
 struct player {
 	struct list playl;
+	struct list wavl;      /**< Cached WAV files (struct wavfile) */
 	char play_path[FS_PATH_MAX];
 };
 
@@ -66,46 +128,585 @@ static void tmr_polling(void *arg)
 }
 
 
+#ifdef USE_WAVFILE
+static void wavfile_destructor(void *arg)
+{
+	struct wavfile *wf = arg;
+
+	list_unlink(&wf->le);
+
+	if (wf->fd >= 0)
+		(void)close(wf->fd);
+
+	mem_deref(wf->buf);
+	mem_deref(wf->path);
+}
+
+
+static uint32_t read_u32le(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint16_t read_u16le(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+/* Modification time in [ns] */
+static uint64_t stat_mtime(const struct stat *st)
+{
+#ifdef __APPLE__
+	const struct timespec *ts = &st->st_mtimespec;
+#else
+	const struct timespec *ts = &st->st_mtim;
+#endif
+
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+
+/*
+ * Read from a WAV file. The read is short at the end of the file, also
+ * when a streamed file was truncated while it is played.
+ */
+static size_t wavfile_pread(const struct wavfile *wf, size_t off,
+			    uint8_t *p, size_t n)
+{
+	ssize_t ret;
+
+	if (wf->buf) {
+		if (off >= wf->size)
+			return 0;
+
+		n = min(n, wf->size - off);
+		memcpy(p, wf->buf + off, n);
+
+		return n;
+	}
+
+	ret = pread(wf->fd, p, n, (off_t)off);
+
+	return ret > 0 ? (size_t)ret : 0;
+}
+
+
+/* Read and convert samples from the audio data */
+static size_t wavfile_read(const struct wavfile *wf, size_t *posp,
+			   int16_t *sampv, size_t sampc)
+{
+	const size_t ssz = wf->fmt == AUFMT_S16LE ? 2 : 1;
+	size_t done = 0;
+
+	while (done < sampc && *posp < wf->datasz) {
+
+		uint8_t buf[1024];
+		size_t i, n;
+
+		n = min((sampc - done) * ssz, wf->datasz - *posp);
+		n = min(n, sizeof(buf));
+
+		n = wavfile_pread(wf, wf->data + *posp, buf, n) / ssz;
+		if (!n)
+			break;
+
+		switch (wf->fmt) {
+
+		case AUFMT_S16LE:
+			for (i=0; i<n; i++) {
+				sampv[done + i] = (int16_t)(buf[2*i] |
+							    buf[2*i+1] << 8);
+			}
+			break;
+
+		case AUFMT_PCMA:
+			for (i=0; i<n; i++)
+				sampv[done + i] = g711_alaw2pcm(buf[i]);
+			break;
+
+		case AUFMT_PCMU:
+			for (i=0; i<n; i++)
+				sampv[done + i] = g711_ulaw2pcm(buf[i]);
+			break;
+
+		default:
+			return done;
+		}
+
+		*posp += n * ssz;
+		done  += n;
+	}
+
+	return done;
+}
+
+
+/* Find the format and the audio data in the RIFF chunks */
+static int wavfile_parse(struct wavfile *wf)
+{
+	uint8_t hdr[16];
+	size_t pos = 12;
+	bool fmt = false;
+
+	if (wavfile_pread(wf, 0, hdr, 12) < 12 ||
+	    memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4))
+		return EBADMSG;
+
+	while (wavfile_pread(wf, pos, hdr, 8) == 8) {
+
+		const size_t chunk = pos + 8;
+		size_t sz = read_u32le(hdr + 4);
+
+		sz = min(sz, wf->size - chunk);
+
+		if (0 == memcmp(hdr, "fmt ", 4) && sz >= 16) {
+
+			uint16_t tag, bits;
+
+			if (wavfile_pread(wf, chunk, hdr, 16) < 16)
+				return EBADMSG;
+
+			tag  = read_u16le(hdr);
+			bits = read_u16le(hdr + 14);
+
+			wf->ch    = (uint8_t)read_u16le(hdr + 2);
+			wf->srate = read_u32le(hdr + 4);
+
+			if (tag == 1 && bits == 16)
+				wf->fmt = AUFMT_S16LE;
+			else if (tag == 6 && bits == 8)
+				wf->fmt = AUFMT_PCMA;
+			else if (tag == 7 && bits == 8)
+				wf->fmt = AUFMT_PCMU;
+			else
+				return ENOTSUP;
+
+			fmt = true;
+		}
+		else if (0 == memcmp(hdr, "data", 4)) {
+
+			if (!fmt)
+				return EBADMSG;
+
+			wf->data   = chunk;
+			wf->datasz = sz;
+
+			return 0;
+		}
+
+		/* chunks are padded to an even size */
+		pos = chunk + sz + (sz & 1);
+	}
+
+	return EBADMSG;
+}
+
+
+/* Copy a small file to memory, and close it */
+static int wavfile_copy(struct wavfile *wf)
+{
+	size_t n = 0;
+
+	wf->buf = mem_alloc(wf->size + 1, NULL);
+	if (!wf->buf)
+		return ENOMEM;
+
+	while (n < wf->size) {
+
+		ssize_t ret = read(wf->fd, wf->buf + n, wf->size - n);
+
+		if (ret < 0)
+			return errno;
+		if (ret == 0)
+			break;
+
+		n += ret;
+	}
+
+	wf->size = n;
+
+	(void)close(wf->fd);
+	wf->fd = -1;
+
+	return 0;
+}
+
+
+static int wavfile_open(struct wavfile **wfp, const char *path)
+{
+	struct wavfile *wf;
+	struct stat st;
+	int err = 0;
+
+	wf = mem_zalloc(sizeof(*wf), wavfile_destructor);
+	if (!wf)
+		return ENOMEM;
+
+	wf->fd = open(path, O_RDONLY);
+	if (wf->fd < 0) {
+		err = errno;
+		goto out;
+	}
+
+	if (fstat(wf->fd, &st) < 0) {
+		err = errno;
+		goto out;
+	}
+
+	wf->size  = st.st_size;
+	wf->ino   = st.st_ino;
+	wf->mtime = stat_mtime(&st);
+
+	err = str_dup(&wf->path, path);
+	if (err)
+		goto out;
+
+#ifdef HAVE_PTHREAD
+	/* a small file is copied, a large file is streamed */
+	if (wf->size <= WAV_COPY_MAX) {
+		err = wavfile_copy(wf);
+		if (err)
+			goto out;
+	}
+#else
+	/* without a reader thread, all files are copied */
+	err = wavfile_copy(wf);
+	if (err)
+		goto out;
+#endif
+
+	err = wavfile_parse(wf);
+
+ out:
+	if (err)
+		mem_deref(wf);
+	else
+		*wfp = wf;
+
+	return err;
+}
+
+
+/*
+ * Get a WAV file from the cache of the player, or open it. A cached
+ * file is opened again if it was changed or replaced on disk.
+ */
+static int wavfile_get(struct wavfile **wfp, struct player *player,
+		       const char *path)
+{
+	struct wavfile *wf;
+	struct stat st;
+	struct le *le;
+	int err;
+
+	if (stat(path, &st) < 0)
+		return errno;
+
+	for (le = player->wavl.head; le; le = le->next) {
+
+		wf = le->data;
+
+		if (str_cmp(wf->path, path))
+			continue;
+
+		if (wf->ino == (uint64_t)st.st_ino &&
+		    wf->size == (size_t)st.st_size &&
+		    wf->mtime == stat_mtime(&st)) {
+			*wfp = mem_ref(wf);
+			return 0;
+		}
+
+		list_unlink(&wf->le);
+		mem_deref(wf);
+		break;
+	}
+
+	err = wavfile_open(&wf, path);
+	if (err)
+		return err;
+
+	list_append(&player->wavl, &wf->le, wf);
+
+	/* one reference for the cache, one for the caller */
+	*wfp = mem_ref(wf);
+
+	return 0;
+}
+#endif
+
+
+#if defined (USE_WAVFILE) && defined (HAVE_PTHREAD)
+/*
+ * Read the next block of the file into the ring
+ *
+ * @return True if there is more to read, false if the reader must
+ *         wait for the player
+ */
+static bool readahead_fill(struct readahead *ra)
+{
+	int16_t sampv[READ_BLOCK];
+	size_t space, n, i;
+	bool more = true;
+
+	pthread_mutex_lock(&ra->mutex);
+	space = ra->sampc - (size_t)(ra->wr - ra->rd);
+	pthread_mutex_unlock(&ra->mutex);
+
+	/* the file is read without the lock */
+	space = min(space, ARRAY_SIZE(sampv));
+	n = space ? wavfile_read(ra->wf, &ra->pos, sampv, space) : 0;
+
+	pthread_mutex_lock(&ra->mutex);
+
+	for (i=0; i<n; i++)
+		ra->sampv[(ra->wr + i) % ra->sampc] = sampv[i];
+
+	ra->wr += n;
+
+	if (n < space) {
+
+		/* one end of the file at a time */
+		if (ra->eof) {
+			more = false;
+		}
+		else {
+			ra->eof = true;
+			ra->end = ra->wr;
+			ra->pos = 0;
+		}
+	}
+	else if (!space) {
+		more = ra->wr - ra->rd < ra->sampc;
+	}
+
+	ra->blocked = !more;
+
+	pthread_mutex_unlock(&ra->mutex);
+
+	return more;
+}
+
+
+static void *readahead_thread(void *arg)
+{
+	struct readahead *ra = arg;
+	bool run = true;
+
+	while (run) {
+
+		(void)readahead_fill(ra);
+
+		pthread_mutex_lock(&ra->mutex);
+
+		while (ra->run && ra->blocked)
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+
+		run = ra->run;
+
+		pthread_mutex_unlock(&ra->mutex);
+	}
+
+	return NULL;
+}
+
+
+/* Wake up the reader, must be called with the lock */
+static void readahead_wakeup(struct readahead *ra)
+{
+	if (ra->blocked) {
+		ra->blocked = false;
+		pthread_cond_signal(&ra->cond);
+	}
+}
+
+
+/*
+ * Copy samples from the ring. The read is short only at the end of the
+ * file, if the reader is late the rest is silence.
+ *
+ * @note This function has REAL-TIME properties
+ */
+static size_t readahead_read(struct readahead *ra, int16_t *sampv,
+			     size_t sampc)
+{
+	size_t i, n;
+
+	pthread_mutex_lock(&ra->mutex);
+
+	n = (size_t)((ra->eof ? ra->end : ra->wr) - ra->rd);
+	n = min(n, sampc);
+
+	for (i=0; i<n; i++)
+		sampv[i] = ra->sampv[(ra->rd + i) % ra->sampc];
+
+	ra->rd += n;
+
+	if (n < sampc && !ra->eof) {
+		memset(&sampv[n], 0, (sampc - n) * sizeof(int16_t));
+		n = sampc;
+	}
+
+	readahead_wakeup(ra);
+
+	pthread_mutex_unlock(&ra->mutex);
+
+	return n;
+}
+
+
+/* Continue after the end of the file in the ring */
+static void readahead_rewind(struct readahead *ra)
+{
+	pthread_mutex_lock(&ra->mutex);
+
+	if (ra->eof && ra->rd == ra->end)
+		ra->eof = false;
+
+	readahead_wakeup(ra);
+
+	pthread_mutex_unlock(&ra->mutex);
+}
+
+
+static void readahead_destructor(void *arg)
+{
+	struct readahead *ra = arg;
+
+	if (ra->run) {
+		pthread_mutex_lock(&ra->mutex);
+		ra->run = false;
+		pthread_cond_signal(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+
+		pthread_join(ra->tid, NULL);
+	}
+
+	pthread_cond_destroy(&ra->cond);
+	pthread_mutex_destroy(&ra->mutex);
+
+	mem_deref(ra->sampv);
+	mem_deref(ra->wf);
+}
+
+
+/* The ring is filled before the playback starts */
+static int readahead_alloc(struct readahead **rap, struct wavfile *wf)
+{
+	struct readahead *ra;
+	int err;
+
+	ra = mem_zalloc(sizeof(*ra), readahead_destructor);
+	if (!ra)
+		return ENOMEM;
+
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+
+	ra->wf    = mem_ref(wf);
+	ra->sampc = READAHEAD;
+	ra->sampv = mem_alloc(ra->sampc * sizeof(int16_t), NULL);
+	if (!ra->sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	while (readahead_fill(ra))
+		;
+
+	ra->run = true;
+	err = pthread_create(&ra->tid, NULL, readahead_thread, ra);
+	if (err) {
+		ra->run = false;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(ra);
+	else
+		*rap = ra;
+
+	return err;
+}
+#endif
+
+
+static size_t play_read(struct play *play, int16_t *sampv, size_t sampc)
+{
+	size_t n;
+
+#if defined (USE_WAVFILE) && defined (HAVE_PTHREAD)
+	if (play->ra)
+		return readahead_read(play->ra, sampv, sampc);
+#endif
+#ifdef USE_WAVFILE
+	if (play->wf)
+		return wavfile_read(play->wf, &play->pos, sampv, sampc);
+#endif
+
+	n = min(sampc, mbuf_get_left(play->mb) / 2);
+
+	(void)mbuf_read_mem(play->mb, (uint8_t *)sampv, n * 2);
+
+	return n;
+}
+
+
+static void play_rewind(struct play *play)
+{
+#if defined (USE_WAVFILE) && defined (HAVE_PTHREAD)
+	if (play->ra)
+		readahead_rewind(play->ra);
+	else
+#endif
+	if (play->wf)
+		play->pos = 0;
+	else
+		play->mb->pos = 0;
+}
+
+
 /*
  * NOTE: DSP cannot be destroyed inside handler
  */
 static void write_handler(void *sampv, size_t sampc, void *arg)
 {
 	struct play *play = arg;
-	size_t sz = sampc * 2;
+	int16_t *v = sampv;
+	bool rewound = false;
 	size_t pos = 0;
-	size_t left;
-	size_t count;
 
 	lock_write_get(play->lock);
 
 	if (play->eof)
 		goto silence;
 
-	while (pos < sz) {
-		left = mbuf_get_left(play->mb);
-		count = (left > sz - pos) ? sz - pos : left;
+	while (pos < sampc) {
 
-		(void)mbuf_read_mem(play->mb, (uint8_t *)sampv + pos, count);
+		size_t n = play_read(play, v + pos, sampc - pos);
 
-		pos += count;
+		pos += n;
 
-		if (pos < sz) {
+		if (pos < sampc) {
 			if (play->repeat > 0)
 				play->repeat--;
 
-			if (play->repeat == 0) {
+			/* an empty file cannot be repeated */
+			if (play->repeat == 0 || (rewound && !n)) {
 				play->eof = true;
 				goto silence;
 			}
 
-			play->mb->pos = 0;
+			play_rewind(play);
+			rewound = true;
 		}
 	}
 
  silence:
 	if (play->eof)
-		memset((uint8_t *)sampv + pos, 0, sz - pos);
+		memset(v + pos, 0, (sampc - pos) * 2);
 
 	lock_rel(play->lock);
 }
@@ -123,7 +724,9 @@ static void destructor(void *arg)
 	lock_rel(play->lock);
 
 	mem_deref(play->auplay);
+	mem_deref(play->ra);
 	mem_deref(play->mb);
+	mem_deref(play->wf);
 	mem_deref(play->lock);
 
 	if (play->playp)
@@ -145,7 +748,7 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 	while (!err) {
 		uint8_t buf[4096];
 		size_t i, n;
-		int16_t *p = (void *)buf;
+		int16_t *p;
 
 		n = sizeof(buf);
 
@@ -153,29 +756,32 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 		if (err || !n)
 			break;
 
+		/* convert a block at a time, directly into the buffer */
+		err = mbuf_resize(mb, mb->end + 2 * n);
+		if (err)
+			break;
+
+		p = (void *)(mb->buf + mb->end);
+
 		switch (prm.fmt) {
 
 		case AUFMT_S16LE:
 			/* convert from Little-Endian to Native-Endian */
-			for (i=0; i<n/2; i++) {
-				int16_t s = sys_ltohs(*p++);
-				err |= mbuf_write_u16(mb, s);
-			}
-
+			for (i=0; i<n/2; i++)
+				p[i] = (int16_t)(buf[2*i] | buf[2*i+1] << 8);
+			mb->end += n/2 * 2;
 			break;
 
 		case AUFMT_PCMA:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_alaw2pcm(buf[i]));
-			}
+			for (i=0; i<n; i++)
+				p[i] = g711_alaw2pcm(buf[i]);
+			mb->end += n * 2;
 			break;
 
 		case AUFMT_PCMU:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_ulaw2pcm(buf[i]));
-			}
+			for (i=0; i<n; i++)
+				p[i] = g711_ulaw2pcm(buf[i]);
+			mb->end += n * 2;
 			break;
 
 		default:
@@ -197,32 +803,15 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 }
 
 
-/**
- * Play a tone from a PCM buffer
- *
- * @param playp    Pointer to allocated player object
- * @param player   Audio-file player
- * @param tone     PCM buffer to play
- * @param srate    Sampling rate
- * @param ch       Number of channels
- * @param repeat   Number of times to repeat
- *
- * @return 0 if success, otherwise errorcode
- */
-int play_tone(struct play **playp, struct player *player,
-	      struct mbuf *tone, uint32_t srate,
-	      uint8_t ch, int repeat)
+static int play_alloc(struct play **playp, struct player *player,
+		      struct mbuf *tone, struct wavfile *wf,
+		      uint32_t srate, uint8_t ch, int repeat)
 {
 	struct auplay_prm wprm;
 	struct play *play;
 	struct config *cfg;
 	int err;
 
-	if (!player)
-		return EINVAL;
-	if (playp && *playp)
-		return EALREADY;
-
 	cfg = conf_config();
 	if (!cfg)
 		return ENOENT;
@@ -234,11 +823,21 @@ int play_tone(struct play **playp, struct player *player,
 	tmr_init(&play->tmr);
 	play->repeat = repeat;
 	play->mb     = mem_ref(tone);
+	play->wf     = mem_ref(wf);
 
 	err = lock_alloc(&play->lock);
 	if (err)
 		goto out;
 
+#if defined (USE_WAVFILE) && defined (HAVE_PTHREAD)
+	/* a streamed file is not read from the audio thread */
+	if (wf && !wf->buf) {
+		err = readahead_alloc(&play->ra, wf);
+		if (err)
+			goto out;
+	}
+#endif
+
 	wprm.ch         = ch;
 	wprm.srate      = srate;
 	wprm.ptime      = PTIME;
@@ -266,9 +865,62 @@ int play_tone(struct play **playp, struct player *player,
 }
 
 
+#ifdef USE_WAVFILE
+static int play_wavfile(struct play **playp, struct player *player,
+			const char *path, int repeat)
+{
+	struct wavfile *wf;
+	int err;
+
+	err = wavfile_get(&wf, player, path);
+	if (err) {
+		if (err != ENOTSUP)
+			warning("play: %s: %m\n", path, err);
+		return err;
+	}
+
+	err = play_alloc(playp, player, NULL, wf, wf->srate, wf->ch, repeat);
+
+	mem_deref(wf);
+
+	return err;
+}
+#endif
+
+
+/**
+ * Play a tone from a PCM buffer
+ *
+ * @param playp    Pointer to allocated player object
+ * @param player   Audio-file player
+ * @param tone     PCM buffer to play
+ * @param srate    Sampling rate
+ * @param ch       Number of channels
+ * @param repeat   Number of times to repeat
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int play_tone(struct play **playp, struct player *player,
+	      struct mbuf *tone, uint32_t srate,
+	      uint8_t ch, int repeat)
+{
+	if (!player || !tone)
+		return EINVAL;
+	if (playp && *playp)
+		return EALREADY;
+
+	return play_alloc(playp, player, tone, NULL, srate, ch, repeat);
+}
+
+
 /**
  * Play an audio file in WAV format
  *
+ * PCM and G.711 files are cached and shared by all players of the same
+ * file. Small files are copied to memory, larger files are read ahead
+ * by a reader thread as they are played. A cached file is opened again
+ * if it changed on disk.
+ *
  * @param playp    Pointer to allocated player object
  * @param player   Audio-file player
  * @param filename Name of WAV file to play
@@ -294,6 +946,13 @@ int play_file(struct play **playp, struct player *player,
 			player->play_path, filename) < 0)
 		return ENOMEM;
 
+#ifdef USE_WAVFILE
+	/* play directly from the file, if the format is supported */
+	err = play_wavfile(playp, player, path, repeat);
+	if (err != ENOTSUP)
+		return err;
+#endif
+
 	mb = mbuf_alloc(1024);
 	if (!mb)
 		return ENOMEM;
@@ -318,6 +977,7 @@ static void player_destructor(void *data)
 	struct player *player = data;
 
 	list_flush(&player->playl);
+	list_flush(&player->wavl);
 }
 
 
@@ -333,6 +993,7 @@ int play_init(struct player **playerp)
 		return ENOMEM;
 
 	list_init(&player->playl);
+	list_init(&player->wavl);
 
 	str_ncpy(player->play_path, default_play_path,
 		 sizeof(player->play_path));
@@ -0,0 +1,130 @@
+/**
+ * @file src/quality.c  Call quality, E-model per interval
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+enum {
+	HYSTERESIS_CMOS = 10,      /* Recover at threshold + 0.10 */
+};
+
+
+/**
+ * Initialise the quality of a stream
+ *
+ * @param q         Quality state
+ * @param threshold MOS below which the quality is degraded, 0 is off
+ */
+void quality_init(struct quality *q, double threshold)
+{
+	if (!q)
+		return;
+
+	memset(q, 0, sizeof(*q));
+	q->threshold = threshold;
+}
+
+
+static void summary_add(struct quality_summary *sum, double r, double mos)
+{
+	if (!sum->n) {
+		sum->r_min   = sum->r_max   = r;
+		sum->mos_min = sum->mos_max = mos;
+	}
+	else {
+		sum->r_min   = min(sum->r_min, r);
+		sum->r_max   = max(sum->r_max, r);
+		sum->mos_min = min(sum->mos_min, mos);
+		sum->mos_max = max(sum->mos_max, mos);
+	}
+
+	++sum->n;
+
+	/* running average, no sum to overflow */
+	sum->r_avg   += (r - sum->r_avg) / sum->n;
+	sum->mos_avg += (mos - sum->mos_avg) / sum->n;
+}
+
+
+/**
+ * Update the quality at the end of an interval
+ *
+ * @param q         Quality state
+ * @param rs        RTCP statistics of the stream
+ * @param n_rx      Packets received, in total
+ * @param n_discard Packets discarded by the receiver, in total. It may
+ *                  restart from zero, when the jitter buffer is flushed
+ *
+ * @return True if the MOS crossed the threshold
+ */
+bool quality_update(struct quality *q, const struct rtcp_stats *rs,
+		    uint32_t n_rx, uint32_t n_discard)
+{
+	struct quality_input in;
+	bool degraded;
+
+	if (!q || !rs || !q->codec)
+		return false;
+
+	memset(&in, 0, sizeof(in));
+
+	in.lost      = q->n_lost - q->last_lost;
+	in.bursts    = q->n_bursts - q->last_bursts;
+	in.discarded = n_discard >= q->last_discard ?
+		n_discard - q->last_discard : n_discard;
+	in.expected  = n_rx - q->last_rx + in.lost;
+	in.rtt       = rs->rtt / 1000.0;
+	in.jitter    = rs->rx.jit / 1000.0;
+
+	q->last_rx      = n_rx;
+	q->last_lost    = q->n_lost;
+	q->last_bursts  = q->n_bursts;
+	q->last_discard = n_discard;
+
+	/* nothing was received in this interval */
+	if (!in.expected)
+		return false;
+
+	q->mos = mos_emodel(&q->r, q->codec, &in);
+
+	summary_add(&q->sum, q->r, q->mos);
+
+	if (q->threshold <= 0)
+		return false;
+
+	if (q->degraded)
+		degraded = q->mos < q->threshold + HYSTERESIS_CMOS / 100.0;
+	else
+		degraded = q->mos < q->threshold;
+
+	if (degraded == q->degraded)
+		return false;
+
+	q->degraded = degraded;
+
+	return true;
+}
+
+
+int quality_debug(struct re_printf *pf, const struct quality *q)
+{
+	const struct quality_summary *sum;
+
+	if (!q || !q->sum.n)
+		return 0;
+
+	sum = &q->sum;
+
+	return re_hprintf(pf, "%s: R=%.1f MOS=%.2f%s"
+			  " (min/avg/max R=%.1f/%.1f/%.1f"
+			  " MOS=%.2f/%.2f/%.2f over %u intervals)",
+			  q->codec, q->r, q->mos,
+			  q->degraded ? " degraded" : "",
+			  sum->r_min, sum->r_avg, sum->r_max,
+			  sum->mos_min, sum->mos_avg, sum->mos_max, sum->n);
+}
@@ -0,0 +1,261 @@
+/**
+ * @file recmix.c  Decode and mix an RTP recording to a WAV file
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_GETOPT
+#include <getopt.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "Usage: recmix [options] <recording> <file.wav>\n"
+			 "options:\n"
+			 "\t-f <path>        Config path\n"
+			 "\t-m <module>      Load audio codec module\n"
+			 "\t-p <path>        Module path\n"
+			 "\t-r <srate>       Output sample rate, streams at"
+			 " other rates\n"
+			 "\t                 are resampled (default: rate of"
+			 " the first stream)\n"
+			 "\t-s               Stereo, received left and"
+			 " sent right\n"
+			 "\t-h               Help\n");
+}
+
+
+static int read_file(struct mbuf *mb, const char *file)
+{
+	uint8_t buf[4096];
+	FILE *f;
+	size_t n;
+	int err = 0;
+
+	f = fopen(file, "rb");
+	if (!f)
+		return errno;
+
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+
+		err = mbuf_write_mem(mb, buf, n);
+		if (err)
+			break;
+	}
+
+	(void)fclose(f);
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static int write_wav(const struct rtpmix *mix, uint8_t ch,
+		     const char *file)
+{
+	struct aufile_prm prm;
+	struct aufile *af;
+	const int16_t *sampv;
+	size_t framec;
+	int err;
+
+	sampv = rtpmix_sampv(mix, &framec);
+
+	prm.srate    = rtpmix_srate(mix);
+	prm.channels = ch;
+	prm.fmt      = AUFMT_S16LE;
+
+	err = aufile_open(&af, &prm, file, AUFILE_WRITE);
+	if (err)
+		return err;
+
+	err = aufile_write(af, (void *)sampv,
+			   framec * ch * sizeof(int16_t));
+
+	mem_deref(af);
+
+	return err;
+}
+
+
+/* Read the config if there is one, a missing one is not written */
+static int configure(bool *found)
+{
+	char path[256], file[256];
+	int err;
+
+	err = conf_path_get(path, sizeof(path));
+	if (err)
+		return err;
+
+	if (re_snprintf(file, sizeof(file), "%s/config", path) < 0)
+		return ENOMEM;
+
+	*found = conf_fileexist(file);
+	if (!*found)
+		return 0;
+
+	return conf_configure();
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *modv[16] = {"g711"};
+#ifdef MOD_PATH
+	const char *modpath = MOD_PATH;
+#else
+	const char *modpath = ".";
+#endif
+	bool conf_found = false, modpath_set = false;
+	size_t modc = 0, i;
+	struct rtpmix *mix = NULL;
+	struct mbuf *mb = NULL;
+	uint32_t srate = 0;
+	uint8_t ch = 1;
+	int err;
+
+	err = libre_init();
+	if (err)
+		goto out;
+
+#ifdef HAVE_GETOPT
+	for (;;) {
+		const int c = getopt(argc, argv, "f:m:p:r:sh");
+		if (0 > c)
+			break;
+
+		switch (c) {
+
+		case 'f':
+			conf_path_set(optarg);
+			break;
+
+		case 'm':
+			if (modc >= ARRAY_SIZE(modv)) {
+				warning("max %zu modules\n",
+					ARRAY_SIZE(modv));
+				err = EINVAL;
+				goto out;
+			}
+			modv[modc++] = optarg;
+			break;
+
+		case 'p':
+			modpath = optarg;
+			modpath_set = true;
+			break;
+
+		case 'r':
+			srate = atoi(optarg);
+			break;
+
+		case 's':
+			ch = 2;
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			usage();
+			err = EINVAL;
+			goto out;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+#else
+	--argc;
+	++argv;
+#endif
+
+	if (argc != 2) {
+		usage();
+		err = EINVAL;
+		goto out;
+	}
+
+	if (!modc)
+		modc = 1;
+
+	err = configure(&conf_found);
+	if (err)
+		goto out;
+
+	err = baresip_init(conf_config(), false);
+	if (err)
+		goto out;
+
+	for (i=0; i<modc; i++) {
+
+		/* the module path of the config, if there is one */
+		if (conf_found && !modpath_set)
+			err = module_load(modv[i]);
+		else
+			err = module_load_path(modpath, modv[i]);
+		if (err) {
+			warning("recmix: could not load module '%s' (%m)\n",
+				modv[i], err);
+			goto out;
+		}
+	}
+
+	err = rtpmix_alloc(&mix, srate, ch);
+	if (err)
+		goto out;
+
+	mb = mbuf_alloc(65536);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = read_file(mb, argv[0]);
+	if (err) {
+		warning("recmix: %s: %m\n", argv[0], err);
+		goto out;
+	}
+
+	err = rtpmix_decode(mix, mb);
+	if (err) {
+		warning("recmix: %s: invalid recording (%m)\n",
+			argv[0], err);
+		goto out;
+	}
+
+	if (!rtpmix_sampv(mix, NULL)) {
+		warning("recmix: %s: no audio could be decoded (%H)\n",
+			argv[0], rtpmix_debug, mix);
+		err = ENOENT;
+		goto out;
+	}
+
+	err = write_wav(mix, ch, argv[1]);
+	if (err) {
+		warning("recmix: %s: %m\n", argv[1], err);
+		goto out;
+	}
+
+	info("recmix: %s: %H\n", argv[1], rtpmix_debug, mix);
+
+ out:
+	mem_deref(mix);
+	mem_deref(mb);
+
+	conf_close();
+	baresip_close();
+	mod_close();
+
+	libre_close();
+
+	return err;
+}
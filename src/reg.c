@@ -3,18 +3,65 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdlib.h>
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "core.h"
 
 
+/**
+ * \page RegSched Registration scheduler
+ *
+ * The registration scheduler paces the initial REGISTER requests of all
+ * User-Agents, so that thousands of accounts do not register at the same
+ * time at startup or after a network change. It is enabled with one or
+ * more of these config options:
+ *
+ \verbatim
+  sip_reg_rate      Max number of REGISTER requests per second (0=off)
+  sip_reg_inflight  Max number of REGISTER requests in progress (0=off)
+  sip_reg_window    Spread the REGISTER requests over a window [sec]
+ \endverbatim
+ *
+ * Each request is delayed by a random time within the window. The
+ * refreshes are sent by the SIP stack relative to the time of the
+ * first registration, and are spread over the same window. A failed
+ * registration is retried through the queue, and not by the SIP stack.
+ *
+ * On a 5xx response or a timeout the queue is held back, with an
+ * exponential backoff, and the rate is halved. Each successful
+ * registration increases the rate again, up to the configured maximum.
+ */
+
+
+enum {
+	LAT_SIZE    = 1024,   /**< Number of latency samples           */
+	BACKOFF_MIN = 1000,   /**< Initial backoff time [ms]           */
+	BACKOFF_MAX = 64000,  /**< Maximum backoff time [ms]           */
+	INFLIGHT_WAIT = 1000, /**< Recheck a full in-flight limit [ms] */
+	RETRY_MIN   = 30,     /**< First retry of a failure [sec]      */
+	RETRY_MAX   = 1800,   /**< Maximum retry time [sec]            */
+};
+
+
 /** Register client */
 struct reg {
 	struct le le;                /**< Linked list element                */
+	struct le le_sched;          /**< Element in scheduler queue         */
 	struct ua *ua;               /**< Pointer to parent UA object        */
 	struct sipreg *sipreg;       /**< SIP Register client                */
 	int id;                      /**< Registration ID (for SIP outbound) */
 
+	/* pending request: */
+	char *uri;                   /**< Registrar URI                      */
+	char *params;                /**< Contact parameters                 */
+	char *outbound;              /**< Outbound proxy (optional)          */
+	uint32_t regint;             /**< Registration interval [sec]        */
+	uint64_t due;                /**< Scheduled send time [ms]           */
+	uint64_t ts_sent;            /**< Send time, while in progress [ms]  */
+	uint32_t failc;              /**< Failed registrations in a row      */
+
 	/* status: */
 	uint16_t scode;              /**< Registration status code           */
 	char *srv;                   /**< SIP Server id                      */
@@ -22,13 +69,291 @@ struct reg {
 };
 
 
+/** Registration scheduler */
+static struct {
+	struct list queue;           /**< Pending registrations (struct reg) */
+	struct tmr tmr;              /**< Scheduler timer                    */
+	uint32_t inflight;           /**< Registrations in progress          */
+	double rate;                 /**< Current rate [1/sec], 0=unlimited  */
+	double tokens;               /**< Rate limiter tokens                */
+	uint64_t ts_tokens;          /**< Time of last token update [ms]     */
+	uint32_t backoff;            /**< Current backoff time [ms]          */
+	uint64_t hold;               /**< Hold the queue until [ms]          */
+	uint32_t latv[LAT_SIZE];     /**< Latency samples [ms]               */
+	uint32_t latc;               /**< Number of latency samples          */
+	uint64_t n_sent;             /**< REGISTER requests sent             */
+	uint64_t n_ok;               /**< Successful registrations           */
+	uint64_t n_fail;             /**< Failed registrations               */
+	uint64_t n_backoff;          /**< Number of backoffs                 */
+} sched;
+
+
+static int reg_send(struct reg *reg);
+static void sched_poll(void);
+
+
+static const struct config_sip *sched_config(void)
+{
+	const struct config *cfg = conf_config();
+
+	return cfg ? &cfg->sip : NULL;
+}
+
+
+static bool sched_enabled(void)
+{
+	const struct config_sip *cfg = sched_config();
+
+	return cfg && (cfg->reg_rate || cfg->reg_inflight || cfg->reg_window);
+}
+
+
+static void sched_cancel(struct reg *reg)
+{
+	list_unlink(&reg->le_sched);
+
+	if (list_isempty(&sched.queue))
+		tmr_cancel(&sched.tmr);
+
+	/* a request in progress leaves room for the next one */
+	if (reg->ts_sent) {
+		reg->ts_sent = 0;
+		--sched.inflight;
+
+		sched_poll();
+	}
+}
+
+
+static void sched_done(struct reg *reg)
+{
+	if (!reg->ts_sent)
+		return;
+
+	reg->ts_sent = 0;
+	--sched.inflight;
+
+	sched_poll();
+}
+
+
 static void destructor(void *arg)
 {
 	struct reg *reg = arg;
 
 	list_unlink(&reg->le);
+	sched_cancel(reg);
+
 	mem_deref(reg->sipreg);
 	mem_deref(reg->srv);
+	mem_deref(reg->uri);
+	mem_deref(reg->params);
+	mem_deref(reg->outbound);
+}
+
+
+static void sched_tokens(uint64_t now)
+{
+	double burst;
+
+	if (sched.rate <= 0) {
+		sched.ts_tokens = now;
+		return;
+	}
+
+	/* allow a burst of 100 ms worth of requests */
+	burst = max(1.0, sched.rate / 10);
+
+	sched.tokens += sched.rate * (double)(now - sched.ts_tokens) / 1000;
+	sched.tokens  = min(sched.tokens, burst);
+	sched.ts_tokens = now;
+}
+
+
+static void sched_handler(void *arg)
+{
+	const struct config_sip *cfg = sched_config();
+	uint64_t now = tmr_jiffies();
+	uint64_t next = 0;
+	(void)arg;
+
+	sched_tokens(now);
+
+	while (!list_isempty(&sched.queue)) {
+
+		struct reg *reg = list_ledata(list_head(&sched.queue));
+		int err;
+
+		if (now < sched.hold) {
+			next = sched.hold;
+			break;
+		}
+
+		if (now < reg->due) {
+			next = reg->due;
+			break;
+		}
+
+		/* wait for a response, or a cancelled request */
+		if (cfg && cfg->reg_inflight &&
+		    sched.inflight >= cfg->reg_inflight) {
+			next = now + INFLIGHT_WAIT;
+			break;
+		}
+
+		if (sched.rate > 0 && sched.tokens < 1) {
+			next = now + 1 + (uint64_t)((1 - sched.tokens) * 1000 /
+						    sched.rate);
+			break;
+		}
+
+		list_unlink(&reg->le_sched);
+
+		if (sched.rate > 0)
+			sched.tokens -= 1;
+
+		err = reg_send(reg);
+		if (err) {
+			warning("reg: %s: Register: %m\n",
+				ua_aor(reg->ua), err);
+			ua_event(reg->ua, UA_EVENT_REGISTER_FAIL, NULL,
+				 "%m", err);
+		}
+	}
+
+	if (next)
+		tmr_start(&sched.tmr, next - now, sched_handler, NULL);
+}
+
+
+static void sched_poll(void)
+{
+	if (list_isempty(&sched.queue))
+		return;
+
+	tmr_start(&sched.tmr, 0, sched_handler, NULL);
+}
+
+
+static bool sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct reg *reg1 = le1->data;
+	const struct reg *reg2 = le2->data;
+	(void)arg;
+
+	return reg1->due <= reg2->due;
+}
+
+
+static void sched_queue(struct reg *reg, uint64_t due)
+{
+	reg->due = due;
+
+	list_unlink(&reg->le_sched);
+	list_insert_sorted(&sched.queue, sort_handler, NULL,
+			   &reg->le_sched, reg);
+
+	sched_poll();
+}
+
+
+static void sched_add(struct reg *reg)
+{
+	const struct config_sip *cfg = sched_config();
+	uint64_t now = tmr_jiffies();
+	uint64_t due = now;
+
+	if (list_isempty(&sched.queue) && !sched.inflight) {
+		sched.rate   = cfg->reg_rate;
+		sched.tokens = min(1.0, sched.rate);
+		sched.ts_tokens = now;
+	}
+
+	if (cfg->reg_window)
+		due += rand_u32() % (cfg->reg_window * 1000);
+
+	sched_queue(reg, due);
+}
+
+
+/*
+ * Retry a failed registration through the queue. The failed request
+ * is dropped, which also stops the retry timer of the SIP stack.
+ */
+static void sched_retry(struct reg *reg)
+{
+	uint32_t wait;
+
+	if (!sched_enabled() || !reg->uri)
+		return;
+
+	reg->sipreg = mem_deref(reg->sipreg);
+
+	/* randomize the retry time between 50 and 100 percent */
+	wait = min(RETRY_MIN << min(reg->failc, 6), RETRY_MAX) * 1000;
+	wait = wait / 2 + rand_u32() % (wait / 2 + 1);
+	++reg->failc;
+
+	sched_queue(reg, tmr_jiffies() + wait);
+}
+
+
+static void sched_backoff(uint32_t retry_after)
+{
+	const struct config_sip *cfg = sched_config();
+	uint32_t wait;
+
+	sched.backoff = sched.backoff ? min(2 * sched.backoff, BACKOFF_MAX)
+		: BACKOFF_MIN;
+
+	/* randomize the backoff between 50 and 100 percent */
+	wait = sched.backoff / 2 + rand_u32() % (sched.backoff / 2 + 1);
+	wait = max(wait, retry_after * 1000);
+
+	sched.hold = max(sched.hold, tmr_jiffies() + wait);
+	++sched.n_backoff;
+
+	if (cfg && cfg->reg_rate)
+		sched.rate = max(1.0, sched.rate / 2);
+}
+
+
+static void sched_success(void)
+{
+	const struct config_sip *cfg = sched_config();
+
+	sched.backoff = 0;
+
+	if (cfg && cfg->reg_rate)
+		sched.rate = min(sched.rate + 1, (double)cfg->reg_rate);
+}
+
+
+static void sched_latency(const struct reg *reg)
+{
+	if (!reg->ts_sent)
+		return;
+
+	sched.latv[sched.latc++ % LAT_SIZE] =
+		(uint32_t)(tmr_jiffies() - reg->ts_sent);
+}
+
+
+/* The delta-seconds of Retry-After, without comment or parameters */
+static uint32_t sipmsg_retry_after(const struct sip_msg *msg)
+{
+	const struct sip_hdr *hdr;
+	struct pl pl;
+
+	hdr = sip_msg_hdr(msg, SIP_HDR_RETRY_AFTER);
+	if (!hdr)
+		return 0;
+
+	if (re_regex(hdr->val.p, hdr->val.l, "[0-9]+", &pl) ||
+	    pl.p != hdr->val.p)
+		return 0;
+
+	return pl_u32(&pl);
 }
 
 
@@ -103,6 +428,13 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 
 		reg->scode = 999;
 
+		if (reg->ts_sent)
+			++sched.n_fail;
+		if (err == ETIMEDOUT)
+			sched_backoff(0);
+		sched_done(reg);
+		sched_retry(reg);
+
 		ua_event(reg->ua, UA_EVENT_REGISTER_FAIL, NULL, "%m", err);
 		return;
 	}
@@ -131,6 +463,14 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 
 		reg->scode = msg->scode;
 
+		if (reg->ts_sent) {
+			++sched.n_ok;
+			sched_latency(reg);
+		}
+		reg->failc = 0;
+		sched_success();
+		sched_done(reg);
+
 		hdr = sip_msg_hdr_apply(msg, true, SIP_HDR_CONTACT,
 					contact_handler, reg);
 		if (hdr) {
@@ -154,6 +494,16 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 
 		reg->scode = msg->scode;
 
+		if (reg->ts_sent) {
+			++sched.n_fail;
+			sched_latency(reg);
+		}
+
+		if (msg->scode >= 500)
+			sched_backoff(sipmsg_retry_after(msg));
+		sched_done(reg);
+		sched_retry(reg);
+
 		ua_event(reg->ua, UA_EVENT_REGISTER_FAIL, NULL, "%u %r",
 			 msg->scode, &msg->reason);
 	}
@@ -180,39 +530,74 @@ int reg_add(struct list *lst, struct ua *ua, int regid)
 }
 
 
-int reg_register(struct reg *reg, const char *reg_uri, const char *params,
-		 uint32_t regint, const char *outbound)
+static int reg_send(struct reg *reg)
 {
 	struct account *acc;
 	const char *routev[1];
 	int err;
 
-	if (!reg || !reg_uri)
-		return EINVAL;
-
-	reg->scode = 0;
-	routev[0] = outbound;
+	routev[0] = reg->outbound;
 	acc = ua_account(reg->ua);
 
 	reg->sipreg = mem_deref(reg->sipreg);
-	err = sipreg_register(&reg->sipreg, uag_sip(), reg_uri,
+	err = sipreg_register(&reg->sipreg, uag_sip(), reg->uri,
 			      ua_aor(reg->ua),
 			      acc ? acc->dispname : NULL, ua_aor(reg->ua),
-			      regint, ua_local_cuser(reg->ua),
+			      reg->regint, ua_local_cuser(reg->ua),
 			      routev[0] ? routev : NULL,
 			      routev[0] ? 1 : 0,
 			      reg->id,
 			      sip_auth_handler, ua_account(reg->ua), true,
 			      register_handler, reg,
-			      params[0] ? &params[1] : NULL,
+			      reg->params[0] ? &reg->params[1] : NULL,
 			      "Allow: %s\r\n", ua_allowed_methods(reg->ua));
 	if (err)
 		return err;
 
+	if (sched_enabled()) {
+		reg->ts_sent = tmr_jiffies();
+		++sched.inflight;
+		++sched.n_sent;
+	}
+
 	return 0;
 }
 
 
+int reg_register(struct reg *reg, const char *reg_uri, const char *params,
+		 uint32_t regint, const char *outbound)
+{
+	int err;
+
+	if (!reg || !reg_uri)
+		return EINVAL;
+
+	/* the current registration is kept until the new one is sent */
+	sched_cancel(reg);
+	reg->scode = 0;
+	reg->failc = 0;
+
+	reg->uri      = mem_deref(reg->uri);
+	reg->params   = mem_deref(reg->params);
+	reg->outbound = mem_deref(reg->outbound);
+	reg->regint   = regint;
+
+	err  = str_dup(&reg->uri, reg_uri);
+	err |= str_dup(&reg->params, params ? params : "");
+	if (outbound)
+		err |= str_dup(&reg->outbound, outbound);
+	if (err)
+		return err;
+
+	if (sched_enabled()) {
+		sched_add(reg);
+		return 0;
+	}
+
+	return reg_send(reg);
+}
+
+
 void reg_unregister(struct reg *reg)
 {
 	if (!reg)
@@ -221,6 +606,8 @@ void reg_unregister(struct reg *reg)
 	reg->scode = 0;
 	reg->af    = 0;
 
+	sched_cancel(reg);
+
 	reg->sipreg = mem_deref(reg->sipreg);
 }
 
@@ -266,3 +653,61 @@ int reg_status(struct re_printf *pf, const struct reg *reg)
 
 	return re_hprintf(pf, " %s %s", print_scode(reg->scode), reg->srv);
 }
+
+
+static int latency_cmp(const void *p1, const void *p2)
+{
+	const uint32_t l1 = *(const uint32_t *)p1;
+	const uint32_t l2 = *(const uint32_t *)p2;
+
+	return (l1 > l2) - (l1 < l2);
+}
+
+
+/**
+ * Print the status of the registration scheduler
+ *
+ * @param pf     Print handler for debug output
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int reg_sched_debug(struct re_printf *pf, void *unused)
+{
+	const struct config_sip *cfg = sched_config();
+	uint32_t latv[LAT_SIZE];
+	uint32_t n = min(sched.latc, (uint32_t)LAT_SIZE);
+	uint64_t now = tmr_jiffies();
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nRegistration scheduler:\n");
+
+	if (!sched_enabled())
+		return err | re_hprintf(pf, " disabled\n");
+
+	err |= re_hprintf(pf, " config:   rate=%u/s inflight=%u"
+			  " window=%usec\n",
+			  cfg->reg_rate, cfg->reg_inflight, cfg->reg_window);
+	err |= re_hprintf(pf, " queue:    %u\n", list_count(&sched.queue));
+	err |= re_hprintf(pf, " inflight: %u\n", sched.inflight);
+	err |= re_hprintf(pf, " rate:     %.1f/s\n", sched.rate);
+	err |= re_hprintf(pf, " backoff:  %u ms (hold %llu ms)\n",
+			  sched.backoff,
+			  sched.hold > now ? sched.hold - now : 0ULL);
+	err |= re_hprintf(pf, " sent=%llu ok=%llu fail=%llu backoffs=%llu\n",
+			  sched.n_sent, sched.n_ok, sched.n_fail,
+			  sched.n_backoff);
+
+	if (n) {
+		memcpy(latv, sched.latv, n * sizeof(latv[0]));
+		qsort(latv, n, sizeof(latv[0]), latency_cmp);
+
+		err |= re_hprintf(pf, " latency:  p50=%u p95=%u p99=%u"
+				  " max=%u ms (%u samples)\n",
+				  latv[n * 50 / 100], latv[n * 95 / 100],
+				  latv[n * 99 / 100], latv[n - 1], n);
+	}
+
+	return err;
+}
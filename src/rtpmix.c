@@ -0,0 +1,520 @@
+/**
+ * @file rtpmix.c  Decode and mix an RTP recording
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+/*
+ * The audio stream of a recording is decoded with the codecs of the
+ * negotiated SDP, and every RTP source is placed on one timeline by
+ * its RTP timestamp. A source at another sampling rate than the output
+ * is resampled; if the ratio of the rates is not supported, the source
+ * is skipped with a warning.
+ */
+
+
+enum {
+	MAX_PT      = 128,
+	MAX_SAMPC   = 11520,       /* 120 ms at 48000 Hz, stereo        */
+	MAX_SECONDS = 86400,
+};
+
+
+/** Audio codecs of one SDP, by payload type */
+struct ptmap {
+	const struct aucodec *acv[MAX_PT];
+	char fmtpv[MAX_PT][128];
+};
+
+/** One RTP source in the recording */
+struct source {
+	struct le le;
+	const struct aucodec *ac;
+	struct audec_state *dec;
+	struct auresamp resamp;  /**< Resampler to the output rate         */
+	uint32_t ssrc;
+	uint8_t pt;
+	bool tx;
+	bool skip;               /**< Source cannot be decoded             */
+	uint32_t ts0;            /**< First RTP timestamp                  */
+	uint64_t pos0;           /**< Output frame of the first timestamp  */
+};
+
+/** The mixer */
+struct rtpmix {
+	struct ptmap local;      /**< Codecs of the local SDP (receive)    */
+	struct ptmap remote;     /**< Codecs of the remote SDP (send)      */
+	struct list srcl;        /**< RTP sources (struct source)          */
+	int16_t *sampv;          /**< Mixed output                         */
+	size_t framec;           /**< Number of output frames              */
+	size_t maxc;             /**< Allocated output frames              */
+	uint32_t srate;          /**< Output sample rate                   */
+	uint8_t ch;              /**< Output channels, 1 or 2              */
+	int audio;               /**< Index of the audio stream            */
+	uint64_t t0;             /**< Time of the first record [us]        */
+	uint32_t n_pkt;          /**< Number of decoded packets            */
+	uint32_t n_skip;         /**< Number of skipped packets            */
+};
+
+
+static void destructor(void *arg)
+{
+	struct rtpmix *mix = arg;
+
+	list_flush(&mix->srcl);
+	mem_deref(mix->sampv);
+}
+
+
+static void source_destructor(void *arg)
+{
+	struct source *src = arg;
+
+	list_unlink(&src->le);
+	mem_deref(src->dec);
+}
+
+
+static const struct aucodec *find_codec(const struct pl *name,
+					uint32_t crate, uint8_t pch)
+{
+	struct le *le;
+
+	for (le = list_head(baresip_aucodecl()); le; le = le->next) {
+
+		const struct aucodec *ac = le->data;
+
+		if (pl_strcasecmp(name, ac->name))
+			continue;
+
+		if (crate != ac->crate)
+			continue;
+
+		if (ac->pch && pch != ac->pch)
+			continue;
+
+		return ac;
+	}
+
+	return NULL;
+}
+
+
+static const struct aucodec *find_static(uint8_t pt)
+{
+	struct le *le;
+
+	for (le = list_head(baresip_aucodecl()); le; le = le->next) {
+
+		const struct aucodec *ac = le->data;
+
+		if (ac->pt && pt == atoi(ac->pt))
+			return ac;
+	}
+
+	return NULL;
+}
+
+
+/* Map the payload types of the audio media in an SDP to codecs */
+static void sdp_parse(struct ptmap *map, const uint8_t *buf, size_t len)
+{
+	struct pl sdp, line;
+	bool audio = false;
+
+	memset(map, 0, sizeof(*map));
+
+	sdp.p = (const char *)buf;
+	sdp.l = len;
+
+	while (sdp.l) {
+
+		struct pl pt, name, crate, pch, fmtp;
+		const char *nl = pl_strchr(&sdp, '\n');
+		uint32_t n;
+
+		line.p = sdp.p;
+		line.l = nl ? (size_t)(nl - sdp.p) : sdp.l;
+		pl_advance(&sdp, nl ? line.l + 1 : line.l);
+
+		if (line.l && line.p[line.l - 1] == '\r')
+			--line.l;
+
+		if (!pl_strncmp(&line, "m=", 2)) {
+			audio = !pl_strncmp(&line, "m=audio", 7);
+			continue;
+		}
+
+		if (!audio)
+			continue;
+
+		if (!re_regex(line.p, line.l,
+			      "a=rtpmap:[0-9]+ [^/]+/[0-9]+[/]*[0-9]*",
+			      &pt, &name, &crate, NULL, &pch)) {
+
+			n = pl_u32(&pt);
+			if (n >= MAX_PT)
+				continue;
+
+			map->acv[n] = find_codec(&name, pl_u32(&crate),
+						 pl_isset(&pch) ?
+						 pl_u32(&pch) : 1);
+		}
+		else if (!re_regex(line.p, line.l, "a=fmtp:[0-9]+ [^]+",
+				   &pt, &fmtp)) {
+
+			n = pl_u32(&pt);
+			if (n >= MAX_PT)
+				continue;
+
+			(void)pl_strcpy(&fmtp, map->fmtpv[n],
+					sizeof(map->fmtpv[n]));
+		}
+	}
+}
+
+
+static struct source *source_get(struct rtpmix *mix,
+				 const struct rtprec_rec *r)
+{
+	const bool tx = r->flags & RTPREC_TX;
+	const struct ptmap *map, *alt;
+	const struct aucodec *ac;
+	struct source *src;
+	const char *fmtp;
+	struct le *le;
+	int err = 0;
+
+	for (le = mix->srcl.head; le; le = le->next) {
+
+		src = le->data;
+
+		if (src->ssrc == r->ssrc && src->tx == tx &&
+		    src->pt == r->pt)
+			return src;
+	}
+
+	if (r->pt >= MAX_PT)
+		return NULL;
+
+	/* received payload types are ours, sent ones are the peer's */
+	map = tx ? &mix->remote : &mix->local;
+	alt = tx ? &mix->local : &mix->remote;
+
+	ac   = map->acv[r->pt];
+	fmtp = map->fmtpv[r->pt];
+	if (!ac) {
+		ac   = alt->acv[r->pt];
+		fmtp = alt->fmtpv[r->pt];
+	}
+	if (!ac)
+		ac = find_static(r->pt);
+
+	if (!ac || !ac->dech || !ac->crate)
+		return NULL;
+
+	if (!mix->srate)
+		mix->srate = ac->srate;
+
+	src = mem_zalloc(sizeof(*src), source_destructor);
+	if (!src)
+		return NULL;
+
+	src->ac   = ac;
+	src->ssrc = r->ssrc;
+	src->pt   = r->pt;
+	src->tx   = tx;
+	src->ts0  = r->rtp_ts;
+	src->pos0 = (r->ts - mix->t0) * mix->srate / 1000000;
+
+	auresamp_init(&src->resamp);
+
+	/* the source is kept, so that its packets are skipped quietly */
+	list_append(&mix->srcl, &src->le, src);
+
+	err = auresamp_setup(&src->resamp, ac->srate, ac->ch,
+			     mix->srate, ac->ch);
+	if (err) {
+		warning("rtpmix: %s: cannot resample %u Hz to %u Hz (%m)\n",
+			ac->name, ac->srate, mix->srate, err);
+		src->skip = true;
+		return src;
+	}
+
+	if (ac->decupdh)
+		err = ac->decupdh(&src->dec, ac,
+				  str_isset(fmtp) ? fmtp : NULL);
+	if (err) {
+		warning("rtpmix: %s: decoder failed (%m)\n", ac->name, err);
+		src->skip = true;
+	}
+
+	return src;
+}
+
+
+static int mix_grow(struct rtpmix *mix, size_t framec)
+{
+	size_t maxc = mix->maxc ? mix->maxc : mix->srate * 60;
+	int16_t *sampv;
+
+	while (maxc < framec)
+		maxc *= 2;
+
+	sampv = mem_realloc(mix->sampv, maxc * mix->ch * sizeof(int16_t));
+	if (!sampv)
+		return ENOMEM;
+
+	memset(sampv + mix->maxc * mix->ch, 0,
+	       (maxc - mix->maxc) * mix->ch * sizeof(int16_t));
+
+	mix->sampv = sampv;
+	mix->maxc  = maxc;
+
+	return 0;
+}
+
+
+static int16_t saturate(int32_t v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+
+	return v;
+}
+
+
+static void mix_rtp(struct rtpmix *mix, const struct rtprec_rec *r)
+{
+	int16_t decv[MAX_SAMPC], rsv[MAX_SAMPC];
+	size_t sampc = ARRAY_SIZE(decv), framec, i;
+	const int16_t *sampv = decv;
+	struct source *src;
+	int32_t delta;
+	int64_t pos;
+	int err;
+
+	src = source_get(mix, r);
+	if (!src || src->skip) {
+		++mix->n_skip;
+		return;
+	}
+
+	err = src->ac->dech(src->dec, AUFMT_S16LE, decv, &sampc,
+			    r->buf, r->len);
+	if (err) {
+		++mix->n_skip;
+		return;
+	}
+
+	if (src->resamp.resample) {
+
+		size_t rsc = ARRAY_SIZE(rsv);
+
+		err = auresamp(&src->resamp, rsv, &rsc, decv, sampc);
+		if (err) {
+			++mix->n_skip;
+			return;
+		}
+
+		sampv = rsv;
+		sampc = rsc;
+	}
+
+	framec = sampc / src->ac->ch;
+
+	/* place the frame at its RTP timestamp, not at its arrival */
+	delta = (int32_t)(r->rtp_ts - src->ts0);
+	pos = (int64_t)src->pos0 +
+		(int64_t)delta * mix->srate / src->ac->crate;
+
+	if (pos < 0 ||
+	    pos + (int64_t)framec > (int64_t)MAX_SECONDS * mix->srate) {
+		++mix->n_skip;
+		return;
+	}
+
+	if ((size_t)pos + framec > mix->maxc &&
+	    mix_grow(mix, (size_t)pos + framec)) {
+		++mix->n_skip;
+		return;
+	}
+
+	for (i=0; i<framec; i++) {
+
+		int32_t v = sampv[i * src->ac->ch];
+		int16_t *p;
+
+		if (src->ac->ch == 2)
+			v = (v + sampv[i*2 + 1]) / 2;
+
+		p = &mix->sampv[(pos + i) * mix->ch];
+
+		if (mix->ch == 2)
+			p += src->tx;
+
+		*p = saturate(*p + v);
+	}
+
+	mix->framec = max(mix->framec, (size_t)pos + framec);
+	++mix->n_pkt;
+}
+
+
+static int scan_handler(const struct rtprec_rec *r, void *arg)
+{
+	struct rtpmix *mix = arg;
+
+	if (r->ts < mix->t0)
+		mix->t0 = r->ts;
+
+	if (r->type == RTPREC_STREAM && mix->audio < 0 &&
+	    r->len == 5 && !memcmp(r->buf, "audio", 5))
+		mix->audio = r->stream;
+
+	if (r->type == RTPREC_INFO)
+		info("rtpmix: %b\n", r->buf, r->len);
+
+	return 0;
+}
+
+
+static int mix_handler(const struct rtprec_rec *r, void *arg)
+{
+	struct rtpmix *mix = arg;
+
+	switch (r->type) {
+
+	case RTPREC_SDP:
+		sdp_parse(r->flags & RTPREC_LOCAL ? &mix->local : &mix->remote,
+			  r->buf, r->len);
+		break;
+
+	case RTPREC_RTP:
+		if (r->stream == mix->audio)
+			mix_rtp(mix, r);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Allocate a mixer for RTP recordings
+ *
+ * @param mixp  Pointer to allocated mixer
+ * @param srate Output sample rate, 0 for the rate of the first source
+ * @param ch    Output channels, 1 or 2 for received left and sent right
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtpmix_alloc(struct rtpmix **mixp, uint32_t srate, uint8_t ch)
+{
+	struct rtpmix *mix;
+
+	if (!mixp || ch < 1 || ch > 2)
+		return EINVAL;
+
+	mix = mem_zalloc(sizeof(*mix), destructor);
+	if (!mix)
+		return ENOMEM;
+
+	mix->srate = srate;
+	mix->ch    = ch;
+	mix->audio = -1;
+	mix->t0    = UINT64_MAX;
+
+	*mixp = mix;
+
+	return 0;
+}
+
+
+/**
+ * Decode the audio of an RTP recording, and mix it
+ *
+ * @param mix Mixer
+ * @param mb  Buffer with the recording
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Packets that cannot be decoded are skipped and counted
+ */
+int rtpmix_decode(struct rtpmix *mix, const struct mbuf *mb)
+{
+	int err;
+
+	if (!mix || !mb)
+		return EINVAL;
+
+	err = rtprec_decode(mb, scan_handler, mix);
+	if (err)
+		return err;
+
+	return rtprec_decode(mb, mix_handler, mix);
+}
+
+
+/**
+ * Get the mixed audio samples
+ *
+ * @param mix    Mixer
+ * @param framec Returns the number of frames
+ *
+ * @return Interleaved samples in signed 16-bit, or NULL if none
+ */
+const int16_t *rtpmix_sampv(const struct rtpmix *mix, size_t *framec)
+{
+	if (!mix)
+		return NULL;
+
+	if (framec)
+		*framec = mix->framec;
+
+	return mix->framec ? mix->sampv : NULL;
+}
+
+
+/**
+ * Get the output sample rate of a mixer
+ *
+ * @param mix Mixer
+ *
+ * @return Sample rate in [Hz], 0 if not known yet
+ */
+uint32_t rtpmix_srate(const struct rtpmix *mix)
+{
+	return mix ? mix->srate : 0;
+}
+
+
+/**
+ * Print the statistics of a mixer
+ *
+ * @param pf  Print function
+ * @param mix Mixer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtpmix_debug(struct re_printf *pf, const struct rtpmix *mix)
+{
+	if (!mix)
+		return 0;
+
+	return re_hprintf(pf, "%u packets, %u skipped, %.1f seconds"
+			  " at %u Hz", mix->n_pkt, mix->n_skip,
+			  mix->srate ? (double)mix->framec / mix->srate : 0.0,
+			  mix->srate);
+}
@@ -0,0 +1,738 @@
+/**
+ * @file rtprec.c  RTP recorder, in the compressed domain
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * A recording is an append-only file with one record per RTP packet
+ * or signalling event. The media is stored as it was on the wire, so
+ * nothing is decoded while recording. All integers are in network
+ * byte order:
+ *
+ *     file   = "BREC" version(16) reserved(16) *record
+ *     record = type(8) flags(8) stream(8) pt(8) len(32) ts(64) body
+ *     rtp    = ssrc(32) seq(16) reserved(16) rtp_ts(32) payload
+ *
+ * The timestamp is the arrival time in [us], and len is the length of
+ * the body. RTP header extensions are not recorded. The side file
+ * "<file>.idx" has one ts(64) offset(64) entry per second, pointing
+ * at the first record written after that second started.
+ *
+ * The media path appends the records to a buffer per direction and
+ * never waits for it: if the buffer is busy or full the record is
+ * dropped and counted. A writer thread moves the buffers to disk.
+ *
+ * The writer takes a snapshot of the recordings under the lock, and
+ * writes without it. A closed recording is written and closed by the
+ * writer, the owner of the recording only holds a handle.
+ */
+
+
+enum {
+	VERSION       = 1,
+	FILE_HDR_SIZE = 8,
+	REC_HDR_SIZE  = 16,
+	RTP_BODY_SIZE = 12,
+	BUF_SIZE      = 65536,     /* Initial buffer size in bytes      */
+	BUF_MAX       = 1048576,   /* Max pending bytes per direction   */
+	FLUSH_MS      = 20,        /* Writer interval in [ms]           */
+	INDEX_US      = 1000000,   /* Index interval in [us]            */
+};
+
+#ifdef __GNUC__
+#define COUNT(x) __atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED)
+#else
+#define COUNT(x) ++(x)
+#endif
+
+
+/** Pending records for one direction */
+struct recbuf {
+	struct lock *lock;       /**< Protects the buffer               */
+	struct mbuf *mb;         /**< Pending records                   */
+	uint32_t n_drop;         /**< Number of dropped records         */
+};
+
+/** An RTP recording, freed by the writer */
+struct recfile {
+	struct le le;            /**< Member of the writer list         */
+	struct le sle;           /**< Member of a snapshot              */
+	struct recbuf bufv[2];   /**< Pending records, received and sent*/
+	struct mbuf *mbw;        /**< Records being written             */
+	FILE *f;                 /**< Recording                         */
+	FILE *fidx;              /**< Index of the recording            */
+	char *file;              /**< Filename of the recording         */
+	uint64_t offset;         /**< Number of bytes written           */
+	uint64_t ts_idx;         /**< Time of the next index entry [us] */
+	uint64_t n_rec;          /**< Number of records written         */
+	int streamc;             /**< Number of streams                 */
+	int err;                 /**< Write error, if any               */
+	bool closing;            /**< The handle was released           */
+	bool wclosing;           /**< Closing, seen by the writer       */
+};
+
+/** Handle of an RTP recording */
+struct rtprec {
+	struct recfile *rf;
+};
+
+/** The writer, shared by all recordings */
+static struct {
+	struct list recl;        /**< Open recordings (struct recfile)  */
+	struct lock *lock;       /**< Protects the list                 */
+#ifdef HAVE_PTHREAD
+	pthread_t thread;        /**< Writer thread                     */
+	bool run;                /**< Writer thread is running          */
+#else
+	struct tmr tmr;          /**< Writer timer                      */
+#endif
+} wr;
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for (i=7; i>=0; i--) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+
+static void write_buf(struct recfile *rf, const struct mbuf *mb)
+{
+	size_t pos = 0;
+
+	if (!mb->end || rf->err)
+		return;
+
+	while (pos + REC_HDR_SIZE <= mb->end) {
+
+		const uint8_t *p = mb->buf + pos;
+		uint64_t ts = (uint64_t)get_u32(p+8)<<32 | get_u32(p+12);
+
+		if (ts >= rf->ts_idx && rf->fidx) {
+
+			uint8_t ent[16];
+
+			put_u64(ent, ts);
+			put_u64(ent + 8, rf->offset + pos);
+
+			(void)fwrite(ent, sizeof(ent), 1, rf->fidx);
+
+			rf->ts_idx = ts - ts % INDEX_US + INDEX_US;
+		}
+
+		++rf->n_rec;
+		pos += REC_HDR_SIZE + get_u32(p+4);
+	}
+
+	if (1 != fwrite(mb->buf, mb->end, 1, rf->f)) {
+		rf->err = EIO;
+		warning("rtprec: %s: write error\n", rf->file);
+		return;
+	}
+
+	rf->offset += mb->end;
+}
+
+
+static void flush(struct recfile *rf)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(rf->bufv); i++) {
+
+		struct recbuf *rb = &rf->bufv[i];
+		struct mbuf *mb;
+
+		lock_write_get(rb->lock);
+		mb = rb->mb;
+		rb->mb = rf->mbw;
+		lock_rel(rb->lock);
+
+		rf->mbw = mb;
+
+		write_buf(rf, mb);
+		mbuf_rewind(mb);
+	}
+
+	(void)fflush(rf->f);
+	if (rf->fidx)
+		(void)fflush(rf->fidx);
+}
+
+
+/* Write the rest of a recording, and close the files */
+static void recfile_close(struct recfile *rf)
+{
+	if (rf->f) {
+		flush(rf);
+		(void)fclose(rf->f);
+		rf->f = NULL;
+	}
+
+	if (rf->fidx) {
+		(void)fclose(rf->fidx);
+		rf->fidx = NULL;
+	}
+}
+
+
+/* Only the writer references the recordings */
+static void flush_all(void)
+{
+	struct list snap = LIST_INIT;
+	struct le *le;
+
+	lock_read_get(wr.lock);
+
+	for (le = wr.recl.head; le; le = le->next) {
+
+		struct recfile *rf = le->data;
+
+		rf->wclosing = rf->closing;
+		list_append(&snap, &rf->sle, mem_ref(rf));
+	}
+
+	lock_rel(wr.lock);
+
+	for (le = snap.head; le; le = le->next) {
+
+		struct recfile *rf = le->data;
+
+		if (!rf->wclosing) {
+			flush(rf);
+			continue;
+		}
+
+		recfile_close(rf);
+
+		lock_write_get(wr.lock);
+		list_unlink(&rf->le);
+		lock_rel(wr.lock);
+
+		mem_deref(rf);
+	}
+
+	list_flush(&snap);
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+
+	while (__atomic_load_n(&wr.run, __ATOMIC_ACQUIRE)) {
+		sys_msleep(FLUSH_MS);
+		flush_all();
+	}
+
+	/* the closed recordings are written before exit */
+	flush_all();
+
+	return NULL;
+}
+#else
+static void tmr_handler(void *arg)
+{
+	(void)arg;
+
+	tmr_start(&wr.tmr, FLUSH_MS, tmr_handler, NULL);
+
+	flush_all();
+}
+#endif
+
+
+static int writer_start(void)
+{
+	int err;
+
+	if (wr.lock)
+		return 0;
+
+	err = lock_alloc(&wr.lock);
+	if (err)
+		return err;
+
+#ifdef HAVE_PTHREAD
+	wr.run = true;
+	err = pthread_create(&wr.thread, NULL, writer_thread, NULL);
+	if (err) {
+		wr.run = false;
+		wr.lock = mem_deref(wr.lock);
+	}
+#else
+	tmr_start(&wr.tmr, FLUSH_MS, tmr_handler, NULL);
+#endif
+
+	return err;
+}
+
+
+/**
+ * Stop the writer of the RTP recorder
+ */
+void rtprec_close(void)
+{
+	if (!wr.lock)
+		return;
+
+#ifdef HAVE_PTHREAD
+	if (wr.run) {
+		__atomic_store_n(&wr.run, false, __ATOMIC_RELEASE);
+		pthread_join(wr.thread, NULL);
+	}
+#else
+	tmr_cancel(&wr.tmr);
+	flush_all();
+#endif
+
+	wr.lock = mem_deref(wr.lock);
+}
+
+
+static void recfile_destructor(void *arg)
+{
+	struct recfile *rf = arg;
+	size_t i;
+
+	recfile_close(rf);
+
+	for (i=0; i<ARRAY_SIZE(rf->bufv); i++) {
+		mem_deref(rf->bufv[i].mb);
+		mem_deref(rf->bufv[i].lock);
+	}
+
+	mem_deref(rf->mbw);
+	mem_deref(rf->file);
+}
+
+
+/* The writer closes the recording, or here if it is stopped */
+static void destructor(void *arg)
+{
+	struct rtprec *rec = arg;
+
+	if (!rec->rf)
+		return;
+
+	if (!wr.lock) {
+		list_unlink(&rec->rf->le);
+		mem_deref(rec->rf);
+		return;
+	}
+
+	lock_write_get(wr.lock);
+	rec->rf->closing = true;
+	lock_rel(wr.lock);
+}
+
+
+/*
+ * Append one record. The media path does not wait for the buffer,
+ * signalling events do.
+ */
+static void append(struct rtprec *rec, bool tx, bool wait,
+		   const struct rtprec_rec *r)
+{
+	struct recbuf *rb = &rec->rf->bufv[tx];
+	struct mbuf *mb;
+	size_t start, body = r->len;
+	int err = 0;
+
+	if (r->type == RTPREC_RTP)
+		body += RTP_BODY_SIZE;
+
+	if (wait)
+		lock_write_get(rb->lock);
+	else if (lock_write_try(rb->lock)) {
+		COUNT(rb->n_drop);
+		return;
+	}
+
+	mb = rb->mb;
+	start = mb->end;
+
+	if (start + REC_HDR_SIZE + body > BUF_MAX) {
+		err = ENOSPC;
+		goto out;
+	}
+
+	mb->pos = start;
+
+	err |= mbuf_write_u8(mb, r->type);
+	err |= mbuf_write_u8(mb, r->flags);
+	err |= mbuf_write_u8(mb, r->stream);
+	err |= mbuf_write_u8(mb, r->pt);
+	err |= mbuf_write_u32(mb, htonl((uint32_t)body));
+	err |= mbuf_write_u32(mb, htonl((uint32_t)(r->ts >> 32)));
+	err |= mbuf_write_u32(mb, htonl((uint32_t)r->ts));
+
+	if (r->type == RTPREC_RTP) {
+		err |= mbuf_write_u32(mb, htonl(r->ssrc));
+		err |= mbuf_write_u16(mb, htons(r->seq));
+		err |= mbuf_write_u16(mb, 0);
+		err |= mbuf_write_u32(mb, htonl(r->rtp_ts));
+	}
+
+	if (r->len)
+		err |= mbuf_write_mem(mb, r->buf, r->len);
+
+	if (err) {
+		mb->pos = start;
+		mb->end = start;
+	}
+
+ out:
+	if (err)
+		COUNT(rb->n_drop);
+
+	lock_rel(rb->lock);
+}
+
+
+/**
+ * Open a new RTP recording
+ *
+ * @param recp Pointer to allocated RTP recorder
+ * @param file Filename of the recording
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtprec_alloc(struct rtprec **recp, const char *file)
+{
+	static const uint8_t hdr[FILE_HDR_SIZE] = {
+		'B', 'R', 'E', 'C', 0, VERSION, 0, 0
+	};
+	struct recfile *rf = NULL;
+	struct rtprec *rec;
+	char idx[256];
+	size_t i;
+	int err;
+
+	if (!recp || !str_isset(file))
+		return EINVAL;
+
+	rec = mem_zalloc(sizeof(*rec), destructor);
+	if (!rec)
+		return ENOMEM;
+
+	rf = mem_zalloc(sizeof(*rf), recfile_destructor);
+	if (!rf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<ARRAY_SIZE(rf->bufv); i++) {
+
+		err = lock_alloc(&rf->bufv[i].lock);
+		if (err)
+			goto out;
+
+		rf->bufv[i].mb = mbuf_alloc(BUF_SIZE);
+		if (!rf->bufv[i].mb) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	rf->mbw = mbuf_alloc(BUF_SIZE);
+	if (!rf->mbw) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = str_dup(&rf->file, file);
+	if (err)
+		goto out;
+
+	rf->f = fopen(file, "wb");
+	if (!rf->f) {
+		err = errno;
+		warning("rtprec: %s: %m\n", file, err);
+		goto out;
+	}
+
+	if (1 != fwrite(hdr, sizeof(hdr), 1, rf->f)) {
+		err = EIO;
+		goto out;
+	}
+
+	rf->offset = sizeof(hdr);
+
+	/* the recording is still usable without its index */
+	re_snprintf(idx, sizeof(idx), "%s.idx", file);
+	rf->fidx = fopen(idx, "wb");
+	if (!rf->fidx)
+		warning("rtprec: %s: %m\n", idx, errno);
+
+	err = writer_start();
+	if (err)
+		goto out;
+
+	/* the list has the reference, and the writer frees it */
+	lock_write_get(wr.lock);
+	list_append(&wr.recl, &rf->le, rf);
+	lock_rel(wr.lock);
+
+	rec->rf = rf;
+	rf = NULL;
+
+	info("rtprec: recording to %s\n", file);
+
+ out:
+	mem_deref(rf);
+
+	if (err)
+		mem_deref(rec);
+	else
+		*recp = rec;
+
+	return err;
+}
+
+
+/**
+ * Add a media stream to an RTP recording
+ *
+ * @param rec  RTP recorder
+ * @param name SDP media name of the stream
+ *
+ * @return Stream index, or -1 if not recording
+ */
+int rtprec_stream(struct rtprec *rec, const char *name)
+{
+	struct rtprec_rec r;
+
+	if (!rec || !name)
+		return -1;
+
+	memset(&r, 0, sizeof(r));
+	r.type   = RTPREC_STREAM;
+	r.stream = rec->rf->streamc;
+	r.ts     = tmr_jiffies_usec();
+	r.buf    = (const uint8_t *)name;
+	r.len    = str_len(name);
+
+	append(rec, false, true, &r);
+
+	return rec->rf->streamc++;
+}
+
+
+/**
+ * Add call information to an RTP recording
+ *
+ * @param rec   RTP recorder
+ * @param name  Name of the information, e.g. "peer"
+ * @param value Value of the information
+ */
+void rtprec_info(struct rtprec *rec, const char *name, const char *value)
+{
+	struct rtprec_rec r;
+	char buf[512];
+
+	if (!rec || !name)
+		return;
+
+	memset(&r, 0, sizeof(r));
+	r.type = RTPREC_INFO;
+	r.ts   = tmr_jiffies_usec();
+	r.buf  = (const uint8_t *)buf;
+	r.len  = re_snprintf(buf, sizeof(buf), "%s: %s", name, value);
+
+	append(rec, false, true, &r);
+}
+
+
+/**
+ * Add a negotiated SDP to an RTP recording
+ *
+ * @param rec   RTP recorder
+ * @param local True for the local SDP, false for the remote SDP
+ * @param mb    SDP message
+ */
+void rtprec_sdp(struct rtprec *rec, bool local, const struct mbuf *mb)
+{
+	struct rtprec_rec r;
+
+	if (!rec || !mb)
+		return;
+
+	memset(&r, 0, sizeof(r));
+	r.type  = RTPREC_SDP;
+	r.flags = local ? RTPREC_LOCAL : 0;
+	r.ts    = tmr_jiffies_usec();
+	r.buf   = mbuf_buf(mb);
+	r.len   = mbuf_get_left(mb);
+
+	append(rec, false, true, &r);
+}
+
+
+/**
+ * Add an RTP packet to an RTP recording, this never blocks
+ *
+ * @param rec    RTP recorder
+ * @param stream Stream index
+ * @param tx     True for a sent packet, false for a received packet
+ * @param ext    True if the payload starts with a header extension
+ * @param hdr    RTP header
+ * @param mb     RTP payload
+ */
+void rtprec_rtp(struct rtprec *rec, int stream, bool tx, bool ext,
+		const struct rtp_header *hdr, const struct mbuf *mb)
+{
+	struct rtprec_rec r;
+	const uint8_t *p;
+	size_t len;
+
+	if (!rec || stream < 0 || !hdr || !mb)
+		return;
+
+	p   = mbuf_buf(mb);
+	len = mbuf_get_left(mb);
+
+	/* RFC 5285 -- the extension is sent in front of the payload */
+	if (ext) {
+		size_t ext_len;
+
+		if (len < RTPEXT_HDR_SIZE)
+			return;
+
+		ext_len = RTPEXT_HDR_SIZE + (p[2]<<8 | p[3]) * 4;
+		if (len < ext_len)
+			return;
+
+		p   += ext_len;
+		len -= ext_len;
+	}
+
+	r.type   = RTPREC_RTP;
+	r.flags  = (tx ? RTPREC_TX : 0) | (hdr->m ? RTPREC_MARKER : 0);
+	r.stream = stream;
+	r.pt     = hdr->pt;
+	r.ts     = tmr_jiffies_usec();
+	r.ssrc   = hdr->ssrc;
+	r.seq    = hdr->seq;
+	r.rtp_ts = hdr->ts;
+	r.buf    = p;
+	r.len    = len;
+
+	append(rec, tx, false, &r);
+}
+
+
+/**
+ * Print the statistics of an RTP recording
+ *
+ * @param pf  Print function
+ * @param rec RTP recorder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtprec_debug(struct re_printf *pf, const struct rtprec *rec)
+{
+	const struct recfile *rf;
+
+	if (!rec)
+		return 0;
+
+	rf = rec->rf;
+
+	return re_hprintf(pf, " rtprec: %s (%llu records, %llu bytes,"
+			  " dropped rx=%u tx=%u)%s\n",
+			  rf->file, rf->n_rec, rf->offset,
+			  rf->bufv[0].n_drop, rf->bufv[1].n_drop,
+			  rf->err ? " write error" : "");
+}
+
+
+/**
+ * Decode an RTP recording
+ *
+ * @param mb  Buffer with the recording
+ * @param h   Handler called for each record, non-zero return stops
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note A truncated last record is ignored
+ */
+int rtprec_decode(const struct mbuf *mb, rtprec_h *h, void *arg)
+{
+	const uint8_t *p, *end;
+	int err;
+
+	if (!mb || !h)
+		return EINVAL;
+
+	p   = mbuf_buf(mb);
+	end = p + mbuf_get_left(mb);
+
+	if (end - p < FILE_HDR_SIZE || memcmp(p, "BREC", 4))
+		return EBADMSG;
+
+	if ((p[4]<<8 | p[5]) != VERSION)
+		return ENOTSUP;
+
+	p += FILE_HDR_SIZE;
+
+	while (end - p >= REC_HDR_SIZE) {
+
+		struct rtprec_rec r;
+		size_t len = get_u32(p+4);
+
+		if ((size_t)(end - p) - REC_HDR_SIZE < len)
+			break;
+
+		memset(&r, 0, sizeof(r));
+		r.type   = p[0];
+		r.flags  = p[1];
+		r.stream = p[2];
+		r.pt     = p[3];
+		r.ts     = (uint64_t)get_u32(p+8)<<32 | get_u32(p+12);
+		r.buf    = p + REC_HDR_SIZE;
+		r.len    = len;
+
+		if (r.type == RTPREC_RTP) {
+
+			if (len < RTP_BODY_SIZE)
+				return EBADMSG;
+
+			r.ssrc   = get_u32(r.buf);
+			r.seq    = r.buf[4]<<8 | r.buf[5];
+			r.rtp_ts = get_u32(r.buf + 8);
+			r.buf   += RTP_BODY_SIZE;
+			r.len   -= RTP_BODY_SIZE;
+		}
+
+		err = h(&r, arg);
+		if (err)
+			return err;
+
+		p += REC_HDR_SIZE + len;
+	}
+
+	return 0;
+}
@@ -16,9 +16,13 @@ SRCS	+= call.c
 SRCS	+= cmd.c
 SRCS	+= conf.c
 SRCS	+= config.c
+SRCS	+= confidx.c
 SRCS	+= contact.c
 SRCS	+= custom_hdrs.c
+SRCS	+= evbatch.c
 SRCS	+= event.c
+SRCS	+= fec.c
+SRCS	+= lathist.c
 SRCS	+= log.c
 SRCS	+= mediadev.c
 SRCS	+= menc.c
@@ -29,11 +33,15 @@ SRCS	+= module.c
 SRCS	+= mos.c
 SRCS	+= net.c
 SRCS	+= play.c
+SRCS	+= quality.c
 SRCS	+= realtime.c
 SRCS	+= reg.c
 SRCS	+= rtpext.c
+SRCS	+= rtpmix.c
+SRCS	+= rtprec.c
 SRCS	+= sdp.c
 SRCS	+= sipreq.c
+SRCS	+= srtpfast.c
 SRCS	+= stream.c
 SRCS	+= timer.c
 SRCS	+= timestamp.c
@@ -48,6 +56,7 @@ SRCS	+= video.c
 SRCS	+= vidcodec.c
 SRCS	+= vidfilt.c
 SRCS	+= vidisp.c
+SRCS	+= vidpool.c
 SRCS	+= vidsrc.c
 SRCS	+= vidutil.c
 endif
@@ -57,3 +66,5 @@ SRCS	+= static.c
 endif
 
 APP_SRCS += main.c
+
+RECMIX_SRCS += recmix.c
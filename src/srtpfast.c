@@ -0,0 +1,1114 @@
+/**
+ * @file src/srtpfast.c  SRTP fast path, using OpenSSL EVP
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef USE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#endif
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The session keys are derived once, and the AES contexts are keyed
+ * once, so a packet only sets the IV. AES-CTR and AES-GCM use AES-NI
+ * through EVP where the CPU has it. The HMAC-SHA1 inner and outer pads
+ * are hashed once, and copied per packet. The state of each SSRC (ROC,
+ * replay window and SRTCP index) is kept in a hash table, with the last
+ * used SSRC cached in front of it. Packets are processed in place.
+ *
+ * Suites without a fast path, and builds without OpenSSL, use the
+ * SRTP code of libre.
+ */
+
+
+#ifdef USE_OPENSSL
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new  EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+
+enum {
+	SSRC_HASH_SIZE = 16,
+	MAX_STREAMS    = 64,
+	REPLAY_WINDOW  = 64,
+	RTP_HDR_SIZE   = 12,
+	RTCP_HDR_SIZE  = 8,
+	SRTCP_IX_SIZE  = 4,
+	KEY_SIZE       = 16,
+	SALT_SIZE      = 14,
+	SHA1_SIZE      = 20,
+	SHA1_BLOCK     = 64,
+	GCM_TAG_SIZE   = 16,
+	SRTCP_TAG_SIZE = 10,
+};
+
+enum {
+	LABEL_RTP  = 0,
+	LABEL_RTCP = 3,
+};
+
+struct suite {
+	enum srtp_suite id;
+	bool gcm;
+	size_t salt_len;
+	size_t tag_len;            /* SRTP tag, SRTCP is 80 bits   */
+};
+
+static const struct suite suitev[] = {
+	{SRTP_AES_CM_128_HMAC_SHA1_32, false, 14, 4},
+	{SRTP_AES_CM_128_HMAC_SHA1_80, false, 14, 10},
+	{SRTP_AES_128_GCM,             true,  12, GCM_TAG_SIZE},
+};
+
+/* Crypto context of RTP or RTCP */
+struct comp {
+	EVP_CIPHER_CTX *enc;       /* Keyed AES-CTR, or AES-GCM encrypt */
+	EVP_CIPHER_CTX *dec;       /* Keyed AES-GCM decrypt             */
+	EVP_MD_CTX *ipad;          /* HMAC-SHA1 after the inner pad     */
+	EVP_MD_CTX *opad;          /* HMAC-SHA1 after the outer pad     */
+	EVP_MD_CTX *md;            /* HMAC-SHA1 of the packet           */
+	uint8_t k_s[SALT_SIZE];    /* Session salt                      */
+	size_t tag_len;
+};
+
+/* Highest index, and the window of indices seen below it */
+struct replay {
+	uint64_t ix_max;
+	uint64_t bitmap;
+	bool init;
+};
+
+/* State of one SSRC */
+struct sstream {
+	struct le he;
+	struct srtpfast *sf;
+	uint32_t ssrc;
+	struct replay rtp;         /* SRTP index, sent or received      */
+	struct replay rtcp;        /* SRTCP index, received             */
+	uint32_t rtcp_ix;          /* Next SRTCP index to send          */
+};
+
+#endif
+
+
+struct srtpfast {
+	struct srtp *srtp;         /* libre SRTP, if no fast path       */
+#ifdef USE_OPENSSL
+	const struct suite *suite;
+	struct comp rtp;
+	struct comp rtcp;
+	struct hash *streamh;      /* SSRC states (struct sstream)      */
+	struct sstream *mru;       /* Last used SSRC state              */
+	uint32_t n_streams;
+#endif
+};
+
+
+#ifdef USE_OPENSSL
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		(uint32_t)p[2] << 8 | p[3];
+}
+
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+
+static const struct suite *suite_find(enum srtp_suite id)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(suitev); i++) {
+
+		if (suitev[i].id == id)
+			return &suitev[i];
+	}
+
+	return NULL;
+}
+
+
+/* RFC 3711 section 4.3, the AES-CM key derivation function */
+static int derive(uint8_t *out, size_t out_len, uint8_t label,
+		  const uint8_t *key, const uint8_t *salt, size_t salt_len)
+{
+	static const uint8_t zero[SHA1_SIZE];
+	uint8_t x[16];
+	EVP_CIPHER_CTX *ctx;
+	int n, err = 0;
+
+	if (out_len > sizeof(zero) || salt_len > sizeof(x))
+		return EINVAL;
+
+	memset(x, 0, sizeof(x));
+	memcpy(x, salt, salt_len);
+	x[7] ^= label;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+		return ENOMEM;
+
+	if (!EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), NULL, key, x) ||
+	    !EVP_EncryptUpdate(ctx, out, &n, zero, (int)out_len))
+		err = EPROTO;
+
+	EVP_CIPHER_CTX_free(ctx);
+
+	return err;
+}
+
+
+static EVP_MD_CTX *hmac_pad(const uint8_t *k_a, uint8_t pad)
+{
+	uint8_t block[SHA1_BLOCK];
+	EVP_MD_CTX *ctx;
+	size_t i;
+
+	ctx = EVP_MD_CTX_new();
+	if (!ctx)
+		return NULL;
+
+	memset(block, pad, sizeof(block));
+	for (i=0; i<SHA1_SIZE; i++)
+		block[i] ^= k_a[i];
+
+	if (!EVP_DigestInit_ex(ctx, EVP_sha1(), NULL) ||
+	    !EVP_DigestUpdate(ctx, block, sizeof(block))) {
+		EVP_MD_CTX_free(ctx);
+		ctx = NULL;
+	}
+
+	OPENSSL_cleanse(block, sizeof(block));
+
+	return ctx;
+}
+
+
+static int comp_init(struct comp *c, uint8_t label, const struct suite *su,
+		     const uint8_t *key, const uint8_t *salt, size_t tag_len)
+{
+	uint8_t k_e[KEY_SIZE], k_a[SHA1_SIZE];
+	int err;
+
+	c->tag_len = tag_len;
+
+	err  = derive(k_e, sizeof(k_e), label, key, salt, su->salt_len);
+	err |= derive(k_a, sizeof(k_a), label + 1, key, salt, su->salt_len);
+	err |= derive(c->k_s, sizeof(c->k_s), label + 2,
+		      key, salt, su->salt_len);
+	if (err)
+		goto out;
+
+	c->enc = EVP_CIPHER_CTX_new();
+	if (!c->enc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	if (su->gcm) {
+		c->dec = EVP_CIPHER_CTX_new();
+		if (!c->dec) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		if (!EVP_EncryptInit_ex(c->enc, EVP_aes_128_gcm(), NULL,
+					k_e, NULL) ||
+		    !EVP_DecryptInit_ex(c->dec, EVP_aes_128_gcm(), NULL,
+					k_e, NULL)) {
+			err = EPROTO;
+			goto out;
+		}
+	}
+	else {
+		if (!EVP_EncryptInit_ex(c->enc, EVP_aes_128_ctr(), NULL,
+					k_e, NULL)) {
+			err = EPROTO;
+			goto out;
+		}
+
+		c->ipad = hmac_pad(k_a, 0x36);
+		c->opad = hmac_pad(k_a, 0x5c);
+		c->md   = EVP_MD_CTX_new();
+		if (!c->ipad || !c->opad || !c->md) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+ out:
+	OPENSSL_cleanse(k_e, sizeof(k_e));
+	OPENSSL_cleanse(k_a, sizeof(k_a));
+
+	return err;
+}
+
+
+static void comp_reset(struct comp *c)
+{
+	EVP_CIPHER_CTX_free(c->enc);
+	EVP_CIPHER_CTX_free(c->dec);
+	EVP_MD_CTX_free(c->ipad);
+	EVP_MD_CTX_free(c->opad);
+	EVP_MD_CTX_free(c->md);
+
+	OPENSSL_cleanse(c, sizeof(*c));
+}
+
+
+/* HMAC-SHA1 of the packet, and the ROC of an SRTP packet */
+static int comp_hmac(struct comp *c, uint8_t *tag,
+		     const uint8_t *p, size_t len,
+		     const uint8_t *roc, size_t roc_len)
+{
+	uint8_t inner[SHA1_SIZE];
+
+	if (!EVP_MD_CTX_copy_ex(c->md, c->ipad) ||
+	    !EVP_DigestUpdate(c->md, p, len) ||
+	    (roc_len && !EVP_DigestUpdate(c->md, roc, roc_len)) ||
+	    !EVP_DigestFinal_ex(c->md, inner, NULL) ||
+	    !EVP_MD_CTX_copy_ex(c->md, c->opad) ||
+	    !EVP_DigestUpdate(c->md, inner, sizeof(inner)) ||
+	    !EVP_DigestFinal_ex(c->md, tag, NULL))
+		return EPROTO;
+
+	return 0;
+}
+
+
+/* AES-CTR in place, RFC 3711 section 4.1.1 */
+static int comp_ctr(struct comp *c, uint32_t ssrc, uint64_t ix,
+		    uint8_t *p, size_t len)
+{
+	uint8_t iv[16];
+	int n;
+
+	memcpy(iv, c->k_s, SALT_SIZE);
+	iv[14] = iv[15] = 0;
+
+	iv[4]  ^= ssrc >> 24;
+	iv[5]  ^= ssrc >> 16;
+	iv[6]  ^= ssrc >> 8;
+	iv[7]  ^= ssrc;
+	iv[8]  ^= ix >> 40;
+	iv[9]  ^= ix >> 32;
+	iv[10] ^= ix >> 24;
+	iv[11] ^= ix >> 16;
+	iv[12] ^= ix >> 8;
+	iv[13] ^= ix;
+
+	if (!EVP_EncryptInit_ex(c->enc, NULL, NULL, NULL, iv) ||
+	    !EVP_EncryptUpdate(c->enc, p, &n, p, (int)len))
+		return EPROTO;
+
+	return 0;
+}
+
+
+/* RFC 7714 sections 8.1 and 9.1, the SRTCP index has no ROC */
+static void gcm_iv(uint8_t *iv, const struct comp *c, uint32_t ssrc,
+		   uint64_t ix)
+{
+	memcpy(iv, c->k_s, 12);
+
+	iv[2]  ^= ssrc >> 24;
+	iv[3]  ^= ssrc >> 16;
+	iv[4]  ^= ssrc >> 8;
+	iv[5]  ^= ssrc;
+	iv[6]  ^= ix >> 40;
+	iv[7]  ^= ix >> 32;
+	iv[8]  ^= ix >> 24;
+	iv[9]  ^= ix >> 16;
+	iv[10] ^= ix >> 8;
+	iv[11] ^= ix;
+}
+
+
+/* AES-GCM in place, the tag is written after the ciphertext */
+static int comp_gcm_encrypt(struct comp *c, uint32_t ssrc, uint64_t ix,
+			    const uint8_t *aad, size_t aad_len,
+			    const uint8_t *aad2, size_t aad2_len,
+			    uint8_t *p, size_t len)
+{
+	uint8_t iv[12];
+	int n;
+
+	gcm_iv(iv, c, ssrc, ix);
+
+	if (!EVP_EncryptInit_ex(c->enc, NULL, NULL, NULL, iv) ||
+	    !EVP_EncryptUpdate(c->enc, NULL, &n, aad, (int)aad_len) ||
+	    (aad2_len &&
+	     !EVP_EncryptUpdate(c->enc, NULL, &n, aad2, (int)aad2_len)) ||
+	    !EVP_EncryptUpdate(c->enc, p, &n, p, (int)len) ||
+	    !EVP_EncryptFinal_ex(c->enc, p + len, &n) ||
+	    !EVP_CIPHER_CTX_ctrl(c->enc, EVP_CTRL_GCM_GET_TAG,
+				 GCM_TAG_SIZE, p + len))
+		return EPROTO;
+
+	return 0;
+}
+
+
+/* AES-GCM in place, the tag follows the ciphertext */
+static int comp_gcm_decrypt(struct comp *c, uint32_t ssrc, uint64_t ix,
+			    const uint8_t *aad, size_t aad_len,
+			    const uint8_t *aad2, size_t aad2_len,
+			    uint8_t *p, size_t len)
+{
+	uint8_t iv[12];
+	int n;
+
+	gcm_iv(iv, c, ssrc, ix);
+
+	if (!EVP_DecryptInit_ex(c->dec, NULL, NULL, NULL, iv) ||
+	    !EVP_DecryptUpdate(c->dec, NULL, &n, aad, (int)aad_len) ||
+	    (aad2_len &&
+	     !EVP_DecryptUpdate(c->dec, NULL, &n, aad2, (int)aad2_len)) ||
+	    !EVP_DecryptUpdate(c->dec, p, &n, p, (int)len) ||
+	    !EVP_CIPHER_CTX_ctrl(c->dec, EVP_CTRL_GCM_SET_TAG,
+				 GCM_TAG_SIZE, p + len))
+		return EPROTO;
+
+	if (EVP_DecryptFinal_ex(c->dec, p + len, &n) <= 0)
+		return EAUTH;
+
+	return 0;
+}
+
+
+static bool replay_check(const struct replay *r, uint64_t ix)
+{
+	uint64_t delta;
+
+	if (!r->init || ix > r->ix_max)
+		return true;
+
+	delta = r->ix_max - ix;
+	if (delta >= REPLAY_WINDOW)
+		return false;
+
+	return !(r->bitmap & (1ULL << delta));
+}
+
+
+static void replay_update(struct replay *r, uint64_t ix)
+{
+	uint64_t delta;
+
+	if (!r->init) {
+		r->ix_max = ix;
+		r->bitmap = 1;
+		r->init   = true;
+	}
+	else if (ix > r->ix_max) {
+		delta = ix - r->ix_max;
+		r->bitmap = delta < REPLAY_WINDOW ? r->bitmap << delta : 0;
+		r->bitmap |= 1;
+		r->ix_max = ix;
+	}
+	else {
+		r->bitmap |= 1ULL << (r->ix_max - ix);
+	}
+}
+
+
+/* RFC 3711 appendix A, the ROC is guessed from the highest index */
+static uint64_t index_estimate(const struct replay *r, uint16_t seq)
+{
+	uint32_t roc, v;
+	uint16_t s_l;
+
+	if (!r->init)
+		return seq;
+
+	roc = (uint32_t)(r->ix_max >> 16);
+	s_l = (uint16_t)r->ix_max;
+	v   = roc;
+
+	if (s_l < 32768) {
+		if ((int)seq - (int)s_l > 32768 && roc)
+			v = roc - 1;
+	}
+	else {
+		if ((int)s_l - 32768 > (int)seq)
+			v = roc + 1;
+	}
+
+	return (uint64_t)v << 16 | seq;
+}
+
+
+static void sstream_destructor(void *arg)
+{
+	struct sstream *s = arg;
+
+	hash_unlink(&s->he);
+
+	--s->sf->n_streams;
+	if (s->sf->mru == s)
+		s->sf->mru = NULL;
+}
+
+
+static bool ssrc_cmp_handler(struct le *le, void *arg)
+{
+	const struct sstream *s = le->data;
+
+	return s->ssrc == *(uint32_t *)arg;
+}
+
+
+static struct sstream *stream_find(struct srtpfast *sf, uint32_t ssrc)
+{
+	struct le *le;
+
+	if (sf->mru && sf->mru->ssrc == ssrc)
+		return sf->mru;
+
+	le = hash_lookup(sf->streamh, ssrc, ssrc_cmp_handler, &ssrc);
+	if (!le)
+		return NULL;
+
+	sf->mru = le->data;
+
+	return sf->mru;
+}
+
+
+static int stream_add(struct sstream **sp, struct srtpfast *sf,
+		      uint32_t ssrc)
+{
+	struct sstream *s;
+
+	if (sf->n_streams >= MAX_STREAMS)
+		return EOVERFLOW;
+
+	s = mem_zalloc(sizeof(*s), sstream_destructor);
+	if (!s)
+		return ENOMEM;
+
+	s->sf   = sf;
+	s->ssrc = ssrc;
+
+	hash_append(sf->streamh, ssrc, &s->he, s);
+	++sf->n_streams;
+
+	sf->mru = s;
+	*sp = s;
+
+	return 0;
+}
+
+
+static int rtp_hdr_len(size_t *hlen, const uint8_t *p, size_t len)
+{
+	size_t n;
+
+	if (len < RTP_HDR_SIZE || (p[0] >> 6) != 2)
+		return EBADMSG;
+
+	n = RTP_HDR_SIZE + 4 * (p[0] & 0x0f);
+
+	if (p[0] & 0x10) {
+
+		if (len < n + 4)
+			return EBADMSG;
+
+		n += 4 + 4 * (size_t)get_be16(p + n + 2);
+	}
+
+	if (len < n)
+		return EBADMSG;
+
+	*hlen = n;
+
+	return 0;
+}
+
+
+static int mbuf_room(struct mbuf *mb, size_t extra)
+{
+	if (mb->size >= mb->end + extra)
+		return 0;
+
+	return mbuf_resize(mb, mb->end + extra);
+}
+
+
+static int rtp_encrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	struct comp *c = &sf->rtp;
+	const size_t start = mb->pos;
+	const size_t len = mbuf_get_left(mb);
+	struct sstream *s;
+	size_t hlen;
+	uint32_t ssrc;
+	uint64_t ix;
+	uint8_t *p;
+	int err;
+
+	err = rtp_hdr_len(&hlen, mbuf_buf(mb), len);
+	if (err)
+		return err;
+
+	err = mbuf_room(mb, c->tag_len);
+	if (err)
+		return err;
+
+	p = mb->buf + start;
+	ssrc = get_be32(p + 8);
+
+	s = stream_find(sf, ssrc);
+	if (!s) {
+		err = stream_add(&s, sf, ssrc);
+		if (err)
+			return err;
+	}
+
+	ix = index_estimate(&s->rtp, get_be16(p + 2));
+
+	if (sf->suite->gcm) {
+		err = comp_gcm_encrypt(c, ssrc, ix, p, hlen, NULL, 0,
+				       p + hlen, len - hlen);
+		if (err)
+			return err;
+	}
+	else {
+		uint8_t roc[4], tag[SHA1_SIZE];
+
+		put_be32(roc, (uint32_t)(ix >> 16));
+
+		err  = comp_ctr(c, ssrc, ix, p + hlen, len - hlen);
+		err |= comp_hmac(c, tag, p, len, roc, sizeof(roc));
+		if (err)
+			return err;
+
+		memcpy(p + len, tag, c->tag_len);
+	}
+
+	replay_update(&s->rtp, ix);
+
+	mb->end = start + len + c->tag_len;
+	mb->pos = start;
+
+	return 0;
+}
+
+
+static int rtp_decrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	struct comp *c = &sf->rtp;
+	const size_t start = mb->pos;
+	struct sstream *s, tmp;
+	size_t len, hlen;
+	uint32_t ssrc;
+	uint64_t ix;
+	uint8_t *p;
+	int err;
+
+	if (mbuf_get_left(mb) < RTP_HDR_SIZE + c->tag_len)
+		return EBADMSG;
+
+	p   = mbuf_buf(mb);
+	len = mbuf_get_left(mb) - c->tag_len;
+
+	err = rtp_hdr_len(&hlen, p, len);
+	if (err)
+		return err;
+
+	ssrc = get_be32(p + 8);
+
+	/* a new SSRC is only decrypted if it can be kept */
+	s = stream_find(sf, ssrc);
+	if (!s) {
+		if (sf->n_streams >= MAX_STREAMS)
+			return EOVERFLOW;
+
+		memset(&tmp, 0, sizeof(tmp));
+		s = &tmp;
+	}
+
+	ix = index_estimate(&s->rtp, get_be16(p + 2));
+
+	if (!replay_check(&s->rtp, ix))
+		return EALREADY;
+
+	if (sf->suite->gcm) {
+		err = comp_gcm_decrypt(c, ssrc, ix, p, hlen, NULL, 0,
+				       p + hlen, len - hlen);
+		if (err)
+			return err;
+	}
+	else {
+		uint8_t roc[4], tag[SHA1_SIZE];
+
+		put_be32(roc, (uint32_t)(ix >> 16));
+
+		err = comp_hmac(c, tag, p, len, roc, sizeof(roc));
+		if (err)
+			return err;
+
+		if (CRYPTO_memcmp(tag, p + len, c->tag_len))
+			return EAUTH;
+
+		err = comp_ctr(c, ssrc, ix, p + hlen, len - hlen);
+		if (err)
+			return err;
+	}
+
+	/* a new SSRC is kept once it is authenticated */
+	if (s == &tmp) {
+		err = stream_add(&s, sf, ssrc);
+		if (err)
+			return err;
+	}
+
+	replay_update(&s->rtp, ix);
+
+	mb->end = start + len;
+
+	return 0;
+}
+
+
+static int rtcp_encrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	struct comp *c = &sf->rtcp;
+	const size_t start = mb->pos;
+	const size_t len = mbuf_get_left(mb);
+	struct sstream *s;
+	uint8_t eix[SRTCP_IX_SIZE];
+	uint32_t ssrc, ix;
+	uint8_t *p;
+	int err;
+
+	if (len < RTCP_HDR_SIZE)
+		return EBADMSG;
+
+	err = mbuf_room(mb, SRTCP_IX_SIZE + c->tag_len);
+	if (err)
+		return err;
+
+	p = mb->buf + start;
+	ssrc = get_be32(p + 4);
+
+	s = stream_find(sf, ssrc);
+	if (!s) {
+		err = stream_add(&s, sf, ssrc);
+		if (err)
+			return err;
+	}
+
+	ix = s->rtcp_ix;
+	put_be32(eix, 0x80000000 | ix);
+
+	if (sf->suite->gcm) {
+
+		/* header, ciphertext, tag, E-flag and index */
+		err = comp_gcm_encrypt(c, ssrc, ix, p, RTCP_HDR_SIZE,
+				       eix, sizeof(eix),
+				       p + RTCP_HDR_SIZE,
+				       len - RTCP_HDR_SIZE);
+		if (err)
+			return err;
+
+		memcpy(p + len + c->tag_len, eix, sizeof(eix));
+	}
+	else {
+		uint8_t tag[SHA1_SIZE];
+
+		/* header, ciphertext, E-flag and index, tag */
+		err = comp_ctr(c, ssrc, ix, p + RTCP_HDR_SIZE,
+			       len - RTCP_HDR_SIZE);
+		if (err)
+			return err;
+
+		memcpy(p + len, eix, sizeof(eix));
+
+		err = comp_hmac(c, tag, p, len + sizeof(eix), NULL, 0);
+		if (err)
+			return err;
+
+		memcpy(p + len + sizeof(eix), tag, c->tag_len);
+	}
+
+	s->rtcp_ix = (ix + 1) & 0x7fffffff;
+
+	mb->end = start + len + SRTCP_IX_SIZE + c->tag_len;
+	mb->pos = start;
+
+	return 0;
+}
+
+
+static int rtcp_decrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	struct comp *c = &sf->rtcp;
+	const size_t start = mb->pos;
+	struct sstream *s, tmp;
+	const uint8_t *eix;
+	uint32_t ssrc, ix;
+	size_t len;
+	bool encrypted;
+	uint8_t *p;
+	int err;
+
+	if (mbuf_get_left(mb) < RTCP_HDR_SIZE + SRTCP_IX_SIZE + c->tag_len)
+		return EBADMSG;
+
+	p   = mbuf_buf(mb);
+	len = mbuf_get_left(mb) - SRTCP_IX_SIZE - c->tag_len;
+
+	if (sf->suite->gcm)
+		eix = p + len + c->tag_len;
+	else
+		eix = p + len;
+
+	ix        = get_be32(eix) & 0x7fffffff;
+	encrypted = (eix[0] & 0x80) != 0;
+	ssrc      = get_be32(p + 4);
+
+	/* a new SSRC is only decrypted if it can be kept */
+	s = stream_find(sf, ssrc);
+	if (!s) {
+		if (sf->n_streams >= MAX_STREAMS)
+			return EOVERFLOW;
+
+		memset(&tmp, 0, sizeof(tmp));
+		s = &tmp;
+	}
+
+	if (!replay_check(&s->rtcp, ix))
+		return EALREADY;
+
+	if (sf->suite->gcm) {
+
+		if (encrypted) {
+			err = comp_gcm_decrypt(c, ssrc, ix, p, RTCP_HDR_SIZE,
+					       eix, SRTCP_IX_SIZE,
+					       p + RTCP_HDR_SIZE,
+					       len - RTCP_HDR_SIZE);
+		}
+		else {
+			err = comp_gcm_decrypt(c, ssrc, ix, p, len,
+					       eix, SRTCP_IX_SIZE,
+					       p + len, 0);
+		}
+		if (err)
+			return err;
+	}
+	else {
+		uint8_t tag[SHA1_SIZE];
+
+		err = comp_hmac(c, tag, p, len + SRTCP_IX_SIZE, NULL, 0);
+		if (err)
+			return err;
+
+		if (CRYPTO_memcmp(tag, eix + SRTCP_IX_SIZE, c->tag_len))
+			return EAUTH;
+
+		if (encrypted) {
+			err = comp_ctr(c, ssrc, ix, p + RTCP_HDR_SIZE,
+				       len - RTCP_HDR_SIZE);
+			if (err)
+				return err;
+		}
+	}
+
+	if (s == &tmp) {
+		err = stream_add(&s, sf, ssrc);
+		if (err)
+			return err;
+	}
+
+	replay_update(&s->rtcp, ix);
+
+	mb->end = start + len;
+
+	return 0;
+}
+
+#endif
+
+
+static void destructor(void *arg)
+{
+	struct srtpfast *sf = arg;
+
+#ifdef USE_OPENSSL
+	hash_flush(sf->streamh);
+	mem_deref(sf->streamh);
+
+	comp_reset(&sf->rtp);
+	comp_reset(&sf->rtcp);
+#endif
+
+	mem_deref(sf->srtp);
+}
+
+
+#ifdef USE_OPENSSL
+static int fast_init(struct srtpfast *sf, const struct suite *su,
+		     const uint8_t *key, size_t key_bytes)
+{
+	const uint8_t *salt = key + KEY_SIZE;
+	int err;
+
+	if (key_bytes != KEY_SIZE + su->salt_len)
+		return EINVAL;
+
+	sf->suite = su;
+
+	err = hash_alloc(&sf->streamh, SSRC_HASH_SIZE);
+	if (err)
+		return err;
+
+	err = comp_init(&sf->rtp, LABEL_RTP, su, key, salt, su->tag_len);
+	if (err)
+		return err;
+
+	return comp_init(&sf->rtcp, LABEL_RTCP, su, key, salt,
+			 su->gcm ? GCM_TAG_SIZE : SRTCP_TAG_SIZE);
+}
+#endif
+
+
+/**
+ * Allocate an SRTP session, with the fast path if the suite has one
+ *
+ * @param sfp       Pointer to allocated SRTP session
+ * @param suite     SRTP crypto suite
+ * @param key       Master key and master salt
+ * @param key_bytes Length of the master key and master salt
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtpfast_alloc(struct srtpfast **sfp, enum srtp_suite suite,
+		   const uint8_t *key, size_t key_bytes)
+{
+	struct srtpfast *sf;
+#ifdef USE_OPENSSL
+	const struct suite *su = suite_find(suite);
+#endif
+	int err;
+
+	if (!sfp || !key)
+		return EINVAL;
+
+	sf = mem_zalloc(sizeof(*sf), destructor);
+	if (!sf)
+		return ENOMEM;
+
+#ifdef USE_OPENSSL
+	if (su)
+		err = fast_init(sf, su, key, key_bytes);
+	else
+#endif
+		err = srtp_alloc(&sf->srtp, suite, key, key_bytes, 0);
+
+	if (err)
+		mem_deref(sf);
+	else
+		*sfp = sf;
+
+	return err;
+}
+
+
+/**
+ * Encrypt an RTP packet in place, and append its tag
+ *
+ * @param sf SRTP session
+ * @param mb RTP packet, from the current position to the end
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtpfast_encrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	if (!sf || !mb)
+		return EINVAL;
+
+	if (sf->srtp)
+		return srtp_encrypt(sf->srtp, mb);
+
+#ifdef USE_OPENSSL
+	return rtp_encrypt(sf, mb);
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Authenticate and decrypt an SRTP packet in place
+ *
+ * @param sf SRTP session
+ * @param mb SRTP packet, from the current position to the end
+ *
+ * @return 0 if success, EALREADY if replayed, EAUTH if not authentic
+ */
+int srtpfast_decrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	if (!sf || !mb)
+		return EINVAL;
+
+	if (sf->srtp)
+		return srtp_decrypt(sf->srtp, mb);
+
+#ifdef USE_OPENSSL
+	return rtp_decrypt(sf, mb);
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Encrypt an RTCP packet in place, and append its index and tag
+ *
+ * @param sf SRTP session
+ * @param mb RTCP packet, from the current position to the end
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtcpfast_encrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	if (!sf || !mb)
+		return EINVAL;
+
+	if (sf->srtp)
+		return srtcp_encrypt(sf->srtp, mb);
+
+#ifdef USE_OPENSSL
+	return rtcp_encrypt(sf, mb);
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Authenticate and decrypt an SRTCP packet in place
+ *
+ * @param sf SRTP session
+ * @param mb SRTCP packet, from the current position to the end
+ *
+ * @return 0 if success, EALREADY if replayed, EAUTH if not authentic
+ */
+int srtcpfast_decrypt(struct srtpfast *sf, struct mbuf *mb)
+{
+	if (!sf || !mb)
+		return EINVAL;
+
+	if (sf->srtp)
+		return srtcp_decrypt(sf->srtp, mb);
+
+#ifdef USE_OPENSSL
+	return rtcp_decrypt(sf, mb);
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Encrypt a batch of RTP packets in place
+ *
+ * Packets of the same SSRC share the lookup of its state.
+ *
+ * @param sf   SRTP session
+ * @param mbv  RTP packets
+ * @param errv Errorcode of each packet (optional)
+ * @param n    Number of packets
+ *
+ * @return Number of packets encrypted
+ */
+size_t srtpfast_encrypt_batch(struct srtpfast *sf, struct mbuf **mbv,
+			      int *errv, size_t n)
+{
+	size_t i, ok = 0;
+
+	if (!mbv)
+		return 0;
+
+	for (i=0; i<n; i++) {
+
+		int err = srtpfast_encrypt(sf, mbv[i]);
+
+		if (errv)
+			errv[i] = err;
+		if (!err)
+			++ok;
+	}
+
+	return ok;
+}
+
+
+/**
+ * Authenticate and decrypt a batch of SRTP packets in place
+ *
+ * @param sf   SRTP session
+ * @param mbv  SRTP packets
+ * @param errv Errorcode of each packet (optional)
+ * @param n    Number of packets
+ *
+ * @return Number of packets decrypted, the others are to be dropped
+ */
+size_t srtpfast_decrypt_batch(struct srtpfast *sf, struct mbuf **mbv,
+			      int *errv, size_t n)
+{
+	size_t i, ok = 0;
+
+	if (!mbv)
+		return 0;
+
+	for (i=0; i<n; i++) {
+
+		int err = srtpfast_decrypt(sf, mbv[i]);
+
+		if (errv)
+			errv[i] = err;
+		if (!err)
+			++ok;
+	}
+
+	return ok;
+}
+
+
+/**
+ * Get the name of the backend of an SRTP session
+ *
+ * @param sf SRTP session
+ *
+ * @return "evp" for the fast path, otherwise "libre"
+ */
+const char *srtpfast_backend(const struct srtpfast *sf)
+{
+	if (!sf)
+		return NULL;
+
+	return sf->srtp ? "libre" : "evp";
+}
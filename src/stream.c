@@ -17,7 +17,8 @@
 
 enum {
 	RTP_RECV_SIZE = 8192,
-	RTP_CHECK_INTERVAL = 1000  /* how often to check for RTP [ms] */
+	RTP_CHECK_INTERVAL = 1000, /* how often to check for RTP [ms] */
+	QUALITY_INTERVAL = 5000    /* how often to score quality [ms] */
 };
 
 
@@ -103,6 +104,36 @@ static inline int lostcalc(struct stream *s, uint16_t seq)
 }
 
 
+/*
+ * Count the lost packets for the call quality, from the sequence numbers
+ * as they are received. A late packet was counted as lost, and is taken
+ * back. The jitter buffer output is not used, it has gaps on underruns.
+ */
+static void quality_seq(struct stream *s, uint16_t seq)
+{
+	const uint16_t delta = seq - s->pseq_rx;
+
+	if (s->pseq_rx == (uint32_t)-1) {
+		s->pseq_rx = seq;
+		return;
+	}
+
+	if (delta == 0 || delta >= 0xff9c) {
+		/* duplicate or reordered */
+		if (delta && s->quality.n_lost)
+			--s->quality.n_lost;
+		return;
+	}
+
+	if (delta > 1 && delta < 3000) {
+		s->quality.n_lost += delta - 1;
+		++s->quality.n_bursts;
+	}
+
+	s->pseq_rx = seq;
+}
+
+
 static void print_rtp_stats(const struct stream *s)
 {
 	bool started = s->metric_tx.n_packets>0 || s->metric_rx.n_packets>0;
@@ -135,6 +166,45 @@ static void print_rtp_stats(const struct stream *s)
 }
 
 
+/*
+ * Score the call quality of the last interval. The packets that the
+ * jitter buffer discarded, late or on overflow, count as lost.
+ */
+static void quality_handler(void *arg)
+{
+	struct stream *s = arg;
+	struct rtcp_stats rs = s->rtcp_stats;
+	struct jbuf_stat js;
+	uint32_t n_discard = s->quality.last_discard;
+
+	MAGIC_CHECK(s);
+
+	tmr_start(&s->tmr_quality, QUALITY_INTERVAL, quality_handler, s);
+
+	if (!s->quality.codec)
+		return;
+
+	/* the jitter of the received packets is current */
+	if (s->rtp && s->ssrc_rx)
+		(void)rtcp_stats(s->rtp, s->ssrc_rx, &rs);
+
+	if (s->jbuf && !jbuf_stats(s->jbuf, &js))
+		n_discard = js.n_late + js.n_overflow;
+
+	if (quality_update(&s->quality, &rs, s->metric_rx.n_packets,
+			   n_discard)) {
+
+		const struct quality *q = &s->quality;
+
+		ua_event(call_get_ua(s->call), UA_EVENT_CALL_QUALITY,
+			 s->call, "%s %s %.2f",
+			 sdp_media_name(stream_sdpmedia(s)),
+			 q->degraded ? "degraded" : "recovered",
+			 q->mos);
+	}
+}
+
+
 static void stream_destructor(void *arg)
 {
 	struct stream *s = arg;
@@ -142,10 +212,16 @@ static void stream_destructor(void *arg)
 	if (s->cfg.rtp_stats)
 		print_rtp_stats(s);
 
+	if (s->quality.sum.n) {
+		info("stream: %s quality: %H\n", sdp_media_name(s->sdp),
+		     quality_debug, &s->quality);
+	}
+
 	metric_reset(&s->metric_tx);
 	metric_reset(&s->metric_rx);
 
 	tmr_cancel(&s->tmr_rtp);
+	tmr_cancel(&s->tmr_quality);
 	list_unlink(&s->le);
 	mem_deref(s->sdp);
 	mem_deref(s->mes);
@@ -154,6 +230,7 @@ static void stream_destructor(void *arg)
 	mem_deref(s->jbuf);
 	mem_deref(s->rtp);
 	mem_deref(s->cname);
+	mem_deref(s->rec);
 }
 
 
@@ -181,9 +258,9 @@ static void handle_rtp(struct stream *s, const struct rtp_header *hdr,
 
 		ext_len = hdr->x.len*sizeof(uint32_t);
 		if (mb->pos < ext_len) {
-			warning("stream: corrupt rtp packet,"
-				" not enough space for rtpext of %zu bytes\n",
-				ext_len);
+			warning_ratelimit("stream: corrupt rtp packet,"
+					  " not enough space for rtpext"
+					  " of %zu bytes\n", ext_len);
 			return;
 		}
 
@@ -194,8 +271,8 @@ static void handle_rtp(struct stream *s, const struct rtp_header *hdr,
 
 			err = rtpext_decode(&extv[i], mb);
 			if (err) {
-				warning("stream: rtpext_decode failed (%m)\n",
-					err);
+				warning_ratelimit("stream: rtpext_decode"
+						  " failed (%m)\n", err);
 				return;
 			}
 		}
@@ -228,8 +305,14 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 	if (!(sdp_media_ldir(s->sdp) & SDP_RECVONLY))
 		return;
 
+	if (!s->metric_rx.n_packets)
+		call_mark(s->call, CALL_MARK_RTP_RX, s->ts_last);
+
 	metric_add_packet(&s->metric_rx, mbuf_get_left(mb));
 
+	if (s->rec)
+		rtprec_rtp(s->rec, s->rec_id, false, false, hdr, mb);
+
 	if (!s->rtp_estab) {
 		info("stream: incoming rtp for '%s' established"
 		     ", receiving from %J\n",
@@ -246,12 +329,16 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			     mbuf_get_left(mb), src);
 		}
 		s->ssrc_rx = hdr->ssrc;
+		s->pseq_rx = -1;
 	}
 
+	quality_seq(s, hdr->seq);
+
 	if (s->jbuf) {
 
 		struct rtp_header hdr2;
 		void *mb2 = NULL;
+		bool underrun = false;
 
 		/* Put frame in Jitter Buffer */
 		if (flush)
@@ -271,11 +358,13 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 				return;
 
 			memset(&hdr2, 0, sizeof(hdr2));
+			underrun = true;
 		}
 
 		s->jbuf_started = true;
 
-		if (lostcalc(s, hdr2.seq) > 0)
+		/* the zeroed header of an underrun has no sequence number */
+		if (!underrun && lostcalc(s, hdr2.seq) > 0)
 			handle_rtp(s, hdr, NULL);
 
 		handle_rtp(s, &hdr2, mb2);
@@ -380,8 +469,11 @@ int stream_alloc(struct stream **sp, const struct stream_param *prm,
 	s->rtcph = rtcph;
 	s->arg   = arg;
 	s->pseq  = -1;
+	s->pseq_rx = -1;
 	s->rtcp  = s->cfg.rtcp_enable;
 
+	quality_init(&s->quality, cfg->mos_threshold);
+
 	if (prm->use_rtp) {
 		err = stream_sock_alloc(s, call_af(call));
 		if (err) {
@@ -466,6 +558,8 @@ int stream_alloc(struct stream **sp, const struct stream_param *prm,
 
 	list_append(call_streaml(call), &s->le, s);
 
+	tmr_start(&s->tmr_quality, QUALITY_INTERVAL, quality_handler, s);
+
  out:
 	if (err)
 		mem_deref(s);
@@ -497,22 +591,137 @@ int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 	if (s->hold)
 		return 0;
 
+	/* read by the main thread, see stream_tx_first() */
+	if (!__atomic_load_n(&s->ts_tx_first, __ATOMIC_RELAXED))
+		__atomic_store_n(&s->ts_tx_first, tmr_jiffies(),
+				 __ATOMIC_RELEASE);
+
 	metric_add_packet(&s->metric_tx, mbuf_get_left(mb));
 
 	if (pt < 0)
 		pt = s->pt_enc;
 
 	if (pt >= 0) {
+		const size_t pos = mb->pos;
+
+		/* before sending, the payload may be encrypted in place */
+		if (s->rec) {
+			struct rtp_header hdr;
+
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.m    = marker;
+			hdr.pt   = pt;
+			hdr.seq  = s->seq_tx_set ? s->seq_tx + 1 : 0;
+			hdr.ts   = ts;
+			hdr.ssrc = rtp_sess_ssrc(s->rtp);
+
+			rtprec_rtp(s->rec, s->rec_id, true, ext, &hdr, mb);
+		}
+
 		err = rtp_send(s->rtp, sdp_media_raddr(s->sdp), ext,
 			       marker, pt, ts, mb);
 		if (err)
 			s->metric_tx.n_err++;
+
+		/* rtp_send() encodes the RTP header in front of the payload */
+		if (pos >= RTP_HEADER_SIZE) {
+			const uint8_t *p = mb->buf + pos - RTP_HEADER_SIZE;
+
+			s->seq_tx = p[2]<<8 | p[3];
+			s->seq_tx_set = true;
+		}
 	}
 
 	return err;
 }
 
 
+/**
+ * Record the RTP packets of a stream
+ *
+ * @param s   Stream object
+ * @param rec RTP recorder
+ */
+void stream_set_recorder(struct stream *s, struct rtprec *rec)
+{
+	if (!s || !rec || s->rec)
+		return;
+
+	s->rec_id = rtprec_stream(rec, sdp_media_name(s->sdp));
+	s->rec    = mem_ref(rec);
+}
+
+
+/**
+ * Set the codec of the received audio, for the call quality
+ *
+ * @param s     Stream object
+ * @param codec Name of the audio codec
+ */
+void stream_set_codec(struct stream *s, const char *codec)
+{
+	if (!s)
+		return;
+
+	s->quality.codec = codec;
+}
+
+
+/**
+ * Get the call quality summary of a stream
+ *
+ * @param strm Stream object
+ *
+ * @return Quality summary, NULL if the stream has no audio quality
+ */
+const struct quality_summary *stream_quality(const struct stream *strm)
+{
+	if (!strm || !strm->quality.codec)
+		return NULL;
+
+	return &strm->quality.sum;
+}
+
+
+/**
+ * Get the sequence number of the last RTP packet that was sent
+ *
+ * @param s   Stream object
+ * @param seq Pointer to where the sequence number is written
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_seq_tx(const struct stream *s, uint16_t *seq)
+{
+	if (!s || !seq)
+		return EINVAL;
+
+	if (!s->seq_tx_set)
+		return ENOENT;
+
+	*seq = s->seq_tx;
+
+	return 0;
+}
+
+
+/**
+ * Get the time when the first RTP packet was sent on a stream
+ *
+ * @param s Stream object
+ *
+ * @return Timestamp in [ms], or 0 if nothing was sent yet
+ *
+ * @note The timestamp is set from the media transmit thread
+ */
+uint64_t stream_tx_first(const struct stream *s)
+{
+	if (!s)
+		return 0;
+
+	return __atomic_load_n(&s->ts_tx_first, __ATOMIC_ACQUIRE);
+}
+
 static void stream_remote_set(struct stream *s)
 {
 	struct sa rtcp;
@@ -709,6 +918,10 @@ int stream_debug(struct re_printf *pf, const struct stream *s)
 	err |= rtp_debug(pf, s->rtp);
 	err |= jbuf_debug(pf, s->jbuf);
 
+	if (s->quality.sum.n)
+		err |= re_hprintf(pf, " quality: %H\n",
+				  quality_debug, &s->quality);
+
 	return err;
 }
 
@@ -792,6 +1005,26 @@ uint32_t stream_metric_get_rx_n_err(const struct stream *strm)
 }
 
 
+/**
+ * Get the jitter buffer statistics of a stream
+ *
+ * @param strm Stream object
+ * @param stat Pointer to statistics, written on success
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_jbuf_stats(const struct stream *strm, struct jbuf_stat *stat)
+{
+	if (!strm || !stat)
+		return EINVAL;
+
+	if (!strm->jbuf)
+		return ENOENT;
+
+	return jbuf_stats(strm->jbuf, stat);
+}
+
+
 int stream_jbuf_reset(struct stream *strm,
 		      uint32_t frames_min, uint32_t frames_max)
 {
@@ -15,10 +15,30 @@
 #include "magic.h"
 
 
+enum {
+	KEY_HASH_MIN  = 1024,     /* Initial number of key hash buckets */
+	KEY_HASH_MAX  = 1 << 20,
+	KEY_HASH_LOAD = 2,        /* Keys per bucket, before it grows   */
+};
+
+
+/** Lookup keys of a User-Agent */
+enum ua_keytype {
+	KEY_CUSER = 0,
+	KEY_USER,
+	KEY_AOR,
+	KEY_PARAM,
+	KEY_PARAM_VAL,
+};
+
+
 /** Defines a SIP User Agent object */
 struct ua {
 	MAGIC_DECL                   /**< Magic number for struct ua         */
 	struct le le;                /**< Linked list element                */
+	struct le le_catch;          /**< Element in list of catchall UAs    */
+	struct list keyl;            /**< Lookup keys (struct ua_key)        */
+	uint64_t seq;                /**< Allocation order of the UA         */
 	struct account *acc;         /**< Account Parameters                 */
 	struct list regl;            /**< List of Register clients           */
 	struct list calls;           /**< List of active calls (struct call) */
@@ -32,12 +52,7 @@ struct ua {
 	bool catchall;               /**< Catch all inbound requests         */
 	struct list hdr_filter;      /**< Filter for incoming headers        */
 	struct list custom_hdrs;     /**< List of outgoing headers           */
-};
-
-struct ua_eh {
-	struct le le;
-	ua_event_h *h;
-	void *arg;
+	struct lathist setupv[CALL_MARK_MAX]; /**< Call setup latencies      */
 };
 
 struct ua_xhdr_filter {
@@ -45,10 +60,20 @@ struct ua_xhdr_filter {
 	char *hdr_name;
 };
 
+/** Lookup key of a User-Agent, in the global key hashtable */
+struct ua_key {
+	struct le he;                /**< Hash element in uag.keyht          */
+	struct le le;                /**< Element in ua->keyl                */
+	struct ua *ua;               /**< Parent User-Agent (no reference)   */
+	enum ua_keytype type;        /**< Key type                           */
+	uint32_t hash;               /**< Hash value of the key              */
+	struct pl name;              /**< Key or parameter name              */
+	struct pl val;               /**< Parameter value                    */
+};
+
 static struct {
 	struct config_sip *cfg;        /**< SIP configuration               */
 	struct list ual;               /**< List of User-Agents (struct ua) */
-	struct list ehl;               /**< Event handlers (struct ua_eh)   */
 	struct sip *sip;               /**< SIP Stack                       */
 	struct sip_lsnr *lsnr;         /**< SIP Listener                    */
 	struct sipsess_sock *sock;     /**< SIP Session socket              */
@@ -62,13 +87,17 @@ static struct {
 	ua_exit_h *exith;              /**< UA Exit handler                 */
 	void *arg;                     /**< UA Exit handler argument        */
 	char *eprm;                    /**< Extra UA parameters             */
+	struct hash *keyht;            /**< UA lookup keys (struct ua_key)  */
+	uint32_t key_bsize;            /**< Number of key hash buckets      */
+	uint32_t n_keys;               /**< Number of keys in the hash      */
+	struct list catchl;            /**< Catchall UAs (struct ua)        */
+	uint64_t seq;                  /**< UA allocation counter           */
 #ifdef USE_TLS
 	struct tls *tls;               /**< TLS Context                     */
 #endif
 } uag = {
 	NULL,
 	LIST_INIT,
-	LIST_INIT,
 	NULL,
 	NULL,
 	NULL,
@@ -82,6 +111,11 @@ static struct {
 	NULL,
 	NULL,
 	NULL,
+	NULL,
+	0,
+	0,
+	LIST_INIT,
+	0,
 #ifdef USE_TLS
 	NULL,
 #endif
@@ -115,25 +149,41 @@ void ua_printf(const struct ua *ua, const char *fmt, ...)
 }
 
 
-void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
-	      const char *fmt, ...)
+/**
+ * Add a call setup latency to the histograms of a User-Agent
+ *
+ * @param ua   User-Agent
+ * @param mark Call setup milestone
+ * @param ms   Time from call start to the milestone in [ms]
+ */
+void ua_setup_add(struct ua *ua, enum call_mark mark, uint32_t ms)
 {
-	struct le *le;
-	char buf[256];
-	va_list ap;
+	if (!ua || mark >= CALL_MARK_MAX)
+		return;
 
-	va_start(ap, fmt);
-	(void)re_vsnprintf(buf, sizeof(buf), fmt, ap);
-	va_end(ap);
+	lathist_add(&ua->setupv[mark], ms);
+}
 
-	/* send event to all clients */
-	le = uag.ehl.head;
-	while (le) {
-		struct ua_eh *eh = le->data;
-		le = le->next;
 
-		eh->h(ua, ev, call, buf, eh->arg);
+static int print_setup(struct re_printf *pf, const struct ua *ua)
+{
+	int i, err = 0;
+
+	if (!ua->setupv[CALL_MARK_INVITE].n)
+		return 0;
+
+	err |= re_hprintf(pf, " call setup:\n");
+
+	for (i=CALL_MARK_START+1; i<CALL_MARK_MAX; i++) {
+
+		if (!ua->setupv[i].n)
+			continue;
+
+		err |= re_hprintf(pf, "  %-9s %H\n", call_mark_name(i),
+				  lathist_debug, &ua->setupv[i]);
 	}
+
+	return err;
 }
 
 
@@ -498,11 +548,209 @@ static void handle_options(struct ua *ua, const struct sip_msg *msg)
 }
 
 
+static uint32_t key_hash(enum ua_keytype type, const struct pl *name,
+			 const struct pl *val)
+{
+	uint32_t h = hash_joaat_ci(name->p, name->l);
+
+	if (val)
+		h = h * 31 + hash_joaat_ci(val->p, val->l);
+
+	return h * 31 + type;
+}
+
+
+static void key_destructor(void *arg)
+{
+	struct ua_key *key = arg;
+
+	if (key->he.list) {
+		hash_unlink(&key->he);
+		--uag.n_keys;
+	}
+	list_unlink(&key->le);
+}
+
+
+/* keep the hash buckets in allocation order, the first UA wins */
+static bool key_sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct ua_key *key1 = le1->data;
+	const struct ua_key *key2 = le2->data;
+	(void)arg;
+
+	return key1->ua->seq <= key2->ua->seq;
+}
+
+
+static bool ua_sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct ua *ua1 = le1->data;
+	const struct ua *ua2 = le2->data;
+	(void)arg;
+
+	return ua1->seq <= ua2->seq;
+}
+
+
+/*
+ * Double the number of buckets when the keys per bucket exceed the load
+ * factor, so that the lookups stay O(1) for any number of User-Agents.
+ * A new bucket gets the keys of one old bucket, appending them keeps
+ * the allocation order.
+ */
+static int key_grow(void)
+{
+	struct hash *ht;
+	uint32_t bsize = uag.key_bsize * 2;
+	uint32_t i;
+	int err;
+
+	if (!uag.keyht || uag.n_keys < uag.key_bsize * KEY_HASH_LOAD ||
+	    bsize > KEY_HASH_MAX)
+		return 0;
+
+	err = hash_alloc(&ht, bsize);
+	if (err)
+		return err;
+
+	for (i=0; i<uag.key_bsize; i++) {
+
+		struct list *lst = hash_list(uag.keyht, i);
+		struct le *le;
+
+		while ((le = list_head(lst))) {
+
+			struct ua_key *key = le->data;
+
+			list_unlink(le);
+			hash_append(ht, key->hash, le, key);
+		}
+	}
+
+	mem_deref(uag.keyht);
+	uag.keyht     = ht;
+	uag.key_bsize = bsize;
+
+	return 0;
+}
+
+
+static int key_add(struct ua *ua, enum ua_keytype type,
+		   const struct pl *name, const struct pl *val)
+{
+	struct ua_key *key;
+	int err;
+
+	err = key_grow();
+	if (err)
+		return err;
+
+	key = mem_zalloc(sizeof(*key), key_destructor);
+	if (!key)
+		return ENOMEM;
+
+	key->ua   = ua;
+	key->type = type;
+	key->hash = key_hash(type, name, val);
+	key->name = *name;
+	if (val)
+		key->val = *val;
+
+	list_append(&ua->keyl, &key->le, key);
+	list_insert_sorted(hash_list(uag.keyht, key->hash),
+			   key_sort_handler, NULL, &key->he, key);
+	if (key->he.list)
+		++uag.n_keys;
+
+	return 0;
+}
+
+
+static struct ua *key_lookup(enum ua_keytype type, const struct pl *name,
+			     const struct pl *val)
+{
+	struct le *le;
+
+	le = list_head(hash_list(uag.keyht, key_hash(type, name, val)));
+
+	for (; le; le = le->next) {
+
+		const struct ua_key *key = le->data;
+
+		if (key->type != type)
+			continue;
+
+		if (type == KEY_AOR) {
+			if (pl_cmp(&key->name, name))
+				continue;
+		}
+		else if (pl_casecmp(&key->name, name))
+			continue;
+
+		if (val && pl_casecmp(&key->val, val))
+			continue;
+
+		return key->ua;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Index the lookup keys of a User-Agent: the contact user, the user
+ * part of the local URI, the AOR and the address parameters.
+ */
+static int ua_index(struct ua *ua)
+{
+	struct sip_addr *laddr = account_laddr(ua->acc);
+	struct pl cuser, aor, pl, name, val;
+	int err;
+
+	list_flush(&ua->keyl);
+
+	pl_set_str(&cuser, ua->cuser);
+	pl_set_str(&aor, ua->acc->aor);
+
+	err  = key_add(ua, KEY_CUSER, &cuser, NULL);
+	err |= key_add(ua, KEY_USER, &ua->acc->luri.user, NULL);
+	err |= key_add(ua, KEY_AOR, &aor, NULL);
+
+	pl = laddr->params;
+
+	while (!err && 0 == re_regex(pl.p, pl.l,
+				     ";[ \t\r\n]*[^;= \t\r\n]+"
+				     "[ \t\r\n]*[=]*[ \t\r\n]*"
+				     "[^; \t\r\n]*",
+				     NULL, &name, NULL, NULL, NULL, &val)) {
+
+		const char *end = val.l ? val.p + val.l : name.p + name.l;
+
+		pl_advance(&pl, end - pl.p);
+
+		err = key_add(ua, KEY_PARAM, &name, NULL);
+		if (!err && pl_isset(&val))
+			err = key_add(ua, KEY_PARAM_VAL, &name, &val);
+	}
+
+	return err;
+}
+
+
+static void ua_unindex(struct ua *ua)
+{
+	list_flush(&ua->keyl);
+	list_unlink(&ua->le_catch);
+}
+
+
 static void ua_destructor(void *arg)
 {
 	struct ua *ua = arg;
 
 	list_unlink(&ua->le);
+	ua_unindex(ua);
 
 	if (!list_isempty(&ua->regl))
 		ua_event(ua, UA_EVENT_UNREGISTERING, NULL, NULL);
@@ -623,6 +871,7 @@ int ua_alloc(struct ua **uap, const char *aor)
 	MAGIC_INIT(ua);
 
 	list_init(&ua->calls);
+	ua->seq = ++uag.seq;
 
 #if HAVE_INET6
 	ua->af   = uag.prefer_ipv6 ? AF_INET6 : AF_INET;
@@ -671,6 +920,10 @@ int ua_alloc(struct ua **uap, const char *aor)
 
 	list_append(&uag.ual, &ua->le, ua);
 
+	err = ua_index(ua);
+	if (err)
+		goto out;
+
 	if (!uag_current())
 		uag_current_set(ua);
 
@@ -687,6 +940,8 @@ int ua_alloc(struct ua **uap, const char *aor)
 
 int ua_update_account(struct ua *ua)
 {
+	int err;
+
 	if (!ua)
 		return EINVAL;
 
@@ -694,7 +949,11 @@ int ua_update_account(struct ua *ua)
 	ua->extensionc = 0;
 	list_flush(&ua->regl);
 
-	return create_register_clients(ua);
+	err = create_register_clients(ua);
+	if (err)
+		return err;
+
+	return ua_index(ua);
 }
 
 
@@ -1102,6 +1361,8 @@ int ua_debug(struct re_printf *pf, const struct ua *ua)
 	for (le = ua->regl.head; le; le = le->next)
 		err |= reg_debug(pf, le->data);
 
+	err |= print_setup(pf, ua);
+
 	return err;
 }
 
@@ -1413,6 +1674,13 @@ int ua_init(const char *software, bool udp, bool tcp, bool tls,
 
 	list_init(&uag.ual);
 
+	err = hash_alloc(&uag.keyht, KEY_HASH_MIN);
+	if (err)
+		goto out;
+
+	uag.key_bsize = KEY_HASH_MIN;
+	uag.n_keys    = 0;
+
 	err = sip_alloc(&uag.sip, net_dnsc(net), bsize, bsize, bsize,
 			software, exit_handler, NULL);
 	if (err) {
@@ -1465,7 +1733,14 @@ void ua_close(void)
 #endif
 
 	list_flush(&uag.ual);
-	list_flush(&uag.ehl);
+	event_close();
+
+	/* the UAs may still be referenced elsewhere */
+	hash_clear(uag.keyht);
+	list_clear(&uag.catchl);
+	uag.keyht = mem_deref(uag.keyht);
+	uag.key_bsize = 0;
+	uag.n_keys    = 0;
 
 	/* note: must be done before mod_close() */
 	module_app_unload();
@@ -1493,11 +1768,15 @@ void ua_stop_all(bool forced)
 
 		ua_event(ua, UA_EVENT_SHUTDOWN, NULL, NULL);
 
+		/* release the references of queued events */
+		event_flush();
+
 		if (mem_nrefs(ua) > 1) {
 			++ext_ref;
 		}
 
 		list_unlink(&ua->le);
+		ua_unindex(ua);
 		list_flush(&ua->calls);
 		mem_deref(ua);
 	}
@@ -1695,32 +1974,22 @@ struct tls *uag_tls(void)
  */
 struct ua *uag_find(const struct pl *cuser)
 {
-	struct le *le;
+	struct ua *ua;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	if (!cuser)
+		return NULL;
 
-		if (0 == pl_strcasecmp(cuser, ua->cuser))
-			return ua;
-	}
+	ua = key_lookup(KEY_CUSER, cuser, NULL);
+	if (ua)
+		return ua;
 
 	/* Try also matching by AOR, for better interop */
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-
-		if (0 == pl_casecmp(cuser, &ua->acc->luri.user))
-			return ua;
-	}
+	ua = key_lookup(KEY_USER, cuser, NULL);
+	if (ua)
+		return ua;
 
 	/* Last resort, try any catchall UAs */
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-
-		if (ua->catchall)
-			return ua;
-	}
-
-	return NULL;
+	return list_ledata(list_head(&uag.catchl));
 }
 
 
@@ -1733,18 +2002,14 @@ struct ua *uag_find(const struct pl *cuser)
  */
 struct ua *uag_find_aor(const char *aor)
 {
-	struct le *le;
+	struct pl pl;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	if (!str_isset(aor))
+		return list_ledata(list_head(&uag.ual));
 
-		if (str_isset(aor) && str_cmp(ua->acc->aor, aor))
-			continue;
-
-		return ua;
-	}
+	pl_set_str(&pl, aor);
 
-	return NULL;
+	return key_lookup(KEY_AOR, &pl, NULL);
 }
 
 
@@ -1758,28 +2023,19 @@ struct ua *uag_find_aor(const char *aor)
  */
 struct ua *uag_find_param(const char *name, const char *value)
 {
-	struct le *le;
+	struct pl pl_name, pl_val;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-		struct sip_addr *laddr = account_laddr(ua->acc);
-		struct pl val;
+	if (!str_isset(name))
+		return NULL;
 
-		if (value) {
+	pl_set_str(&pl_name, name);
 
-			if (0 == msg_param_decode(&laddr->params, name, &val)
-			    &&
-			    0 == pl_strcasecmp(&val, value)) {
-				return ua;
-			}
-		}
-		else {
-			if (0 == msg_param_exists(&laddr->params, name, &val))
-				return ua;
-		}
+	if (value) {
+		pl_set_str(&pl_val, value);
+		return key_lookup(KEY_PARAM_VAL, &pl_name, &pl_val);
 	}
 
-	return NULL;
+	return key_lookup(KEY_PARAM, &pl_name, NULL);
 }
 
 
@@ -1886,51 +2142,6 @@ struct list *ua_calls(const struct ua *ua)
 }
 
 
-static void eh_destructor(void *arg)
-{
-	struct ua_eh *eh = arg;
-	list_unlink(&eh->le);
-}
-
-
-int uag_event_register(ua_event_h *h, void *arg)
-{
-	struct ua_eh *eh;
-
-	if (!h)
-		return EINVAL;
-
-	uag_event_unregister(h);
-
-	eh = mem_zalloc(sizeof(*eh), eh_destructor);
-	if (!eh)
-		return ENOMEM;
-
-	eh->h = h;
-	eh->arg = arg;
-
-	list_append(&uag.ehl, &eh->le, eh);
-
-	return 0;
-}
-
-
-void uag_event_unregister(ua_event_h *h)
-{
-	struct le *le;
-
-	for (le = uag.ehl.head; le; le = le->next) {
-
-		struct ua_eh *eh = le->data;
-
-		if (eh->h == h) {
-			mem_deref(eh);
-			break;
-		}
-	}
-}
-
-
 void uag_set_sub_handler(sip_msg_h *subh)
 {
 	uag.subh = subh;
@@ -1973,6 +2184,14 @@ void ua_set_catchall(struct ua *ua, bool enabled)
 	if (!ua)
 		return;
 
+	if (enabled && !ua->catchall) {
+		list_insert_sorted(&uag.catchl, ua_sort_handler, NULL,
+				   &ua->le_catch, ua);
+	}
+	else if (!enabled) {
+		list_unlink(&ua->le_catch);
+	}
+
 	ua->catchall = enabled;
 }
 
@@ -29,6 +29,40 @@ enum {
 	RTP_PRESZ       = 4 + RTP_HEADER_SIZE, /**< TURN and RTP header */
 	RTP_TRAILSZ     = 12 + 4,              /**< SRTP/SRTCP trailer  */
 	PICUP_INTERVAL  = 500,
+	POOL_SIZE       = 4,
+};
+
+/** SDP format name of FEC packets (RFC 5109) */
+static const char fec_fmt[] = "ulpfec";
+
+
+/** Encoder CPU load adaptation */
+enum {
+	ADAPT_HIGH     = 85,  /**< Load to step down [%]                */
+	ADAPT_TARGET   = 70,  /**< Max expected load to step up [%]     */
+	ADAPT_SKIP     = 10,  /**< Skipped frames to step down [%]      */
+	ADAPT_UP_COUNT = 2,   /**< Low-load intervals before step up    */
+};
+
+/** Bitrate adaptation to RTCP feedback */
+enum {
+	BWE_LOSS_LOW  =   2,  /**< Loss to step up [%]                  */
+	BWE_LOSS_HIGH =  10,  /**< Loss to step down [%]                */
+	BWE_INCREASE  = 108,  /**< Step up [%]                          */
+	BWE_MIN       =  10,  /**< Lowest bitrate, of the maximum [%]   */
+	BWE_STEP      =   5,  /**< Smallest change to apply [%]         */
+};
+
+/** Adaptation levels, from full quality to lowest */
+static const struct adapt_level {
+	unsigned scale;       /**< Resolution in [%]  */
+	unsigned rate;        /**< Frame-rate in [%]  */
+} adaptv[] = {
+	{100, 100},
+	{ 75, 100},
+	{ 50, 100},
+	{ 50,  50},
+	{ 25,  50},
 };
 
 
@@ -99,6 +133,17 @@ struct vtx {
 	double efps;                       /**< Estimated frame-rate      */
 	uint64_t ts_base;                  /**< First RTP timestamp sent  */
 	uint64_t ts_last;                  /**< Last RTP timestamp sent   */
+	struct fec_enc *fec;               /**< FEC encoder (optional)    */
+	int fec_pt;                        /**< FEC payload type          */
+	unsigned fec_loss;                 /**< Loss reported by peer [%] */
+	unsigned bitrate;                  /**< Encoder bitrate [bit/s]   */
+	uint32_t remb;                     /**< Peer estimate (REMB) [bps]*/
+	unsigned adapt_level;              /**< Current adaptation level  */
+	unsigned adapt_acc;                /**< Frame-rate accumulator    */
+	unsigned adapt_up;                 /**< Intervals with low load   */
+	unsigned skipc_last;               /**< Skipped at last interval  */
+	unsigned enc_frames;               /**< Frames encoded, interval  */
+	uint64_t enc_usec;                 /**< Encode time, interval     */
 
 	/** Statistics */
 	struct {
@@ -142,6 +187,9 @@ struct vrx {
 	unsigned n_intra;                  /**< Intra-frames decoded      */
 	unsigned n_picup;                  /**< Picture updates sent      */
 	struct timestamp_recv ts_recv;     /**< Receive timestamp state   */
+	struct fec_dec *fec;               /**< FEC decoder (optional)    */
+	int fec_pt;                        /**< FEC payload type          */
+	struct vidpool *pool;              /**< Pool of filtered frames   */
 
 	/** Statistics */
 	struct {
@@ -170,6 +218,7 @@ struct vidqent {
 	struct le le;
 	struct sa dst;
 	bool marker;
+	bool picup;
 	uint8_t pt;
 	uint32_t ts;
 	struct mbuf *mb;
@@ -232,6 +281,40 @@ static int vidqent_alloc(struct vidqent **qentp,
 }
 
 
+/*
+ * Add a media packet to the FEC encoder. The sequence number is
+ * known once the first packet of the stream has been sent.
+ */
+static int fec_protect(struct vtx *vtx, const struct vidqent *qent,
+		       const uint8_t *pld, size_t len, bool sent)
+{
+	const struct config_video *cfg = &vtx->video->cfg;
+	struct rtp_header hdr;
+	unsigned level;
+	uint16_t seq;
+	int err;
+
+	err = stream_seq_tx(vtx->video->strm, &seq);
+	if (err)
+		return err;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.m   = qent->marker;
+	hdr.pt  = qent->pt;
+	hdr.seq = sent ? seq : seq + 1;
+	hdr.ts  = qent->ts;
+
+	/* add protection for the packet loss reported by the peer */
+	level = qent->picup ? cfg->fec_key : cfg->fec_delta;
+	if (level)
+		level = min(level + 2 * vtx->fec_loss, 100);
+
+	fec_enc_set_level(vtx->fec, level);
+
+	return fec_enc_packet(vtx->fec, &hdr, pld, len);
+}
+
+
 static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 {
 	size_t burst, sent;
@@ -259,12 +342,34 @@ static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 	while (le) {
 
 		struct vidqent *qent = le->data;
+		struct mbuf *first = NULL;
 
 		sent += mbuf_get_left(qent->mb);
 
+		/* the payload may be encrypted in place, keep a copy */
+		if (vtx->fec &&
+		    ENOENT == fec_protect(vtx, qent, mbuf_buf(qent->mb),
+					  mbuf_get_left(qent->mb), false)) {
+
+			first = mbuf_alloc(mbuf_get_left(qent->mb));
+			if (first)
+				(void)mbuf_write_mem(first, mbuf_buf(qent->mb),
+						     mbuf_get_left(qent->mb));
+		}
+
 		stream_send(vtx->video->strm, false, qent->marker, qent->pt,
 			    qent->ts, qent->mb);
 
+		if (first) {
+			(void)fec_protect(vtx, qent, first->buf, first->end,
+					  true);
+			mem_deref(first);
+		}
+
+		/* the FEC packets are sent after the frame */
+		if (vtx->fec && qent->marker)
+			(void)fec_enc_flush(vtx->fec);
+
 		le = le->next;
 		mem_deref(qent);
 
@@ -304,6 +409,7 @@ static void video_destructor(void *arg)
 	mem_deref(vtx->lock_tx);
 
 	tmr_cancel(&vtx->tmr_rtp);
+	mem_deref(vtx->fec);
 	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock_enc);
 	mem_deref(vtx->frame);
@@ -321,6 +427,8 @@ static void video_destructor(void *arg)
 	list_flush(&vrx->filtl);
 	lock_rel(vrx->lock);
 	mem_deref(vrx->lock);
+	mem_deref(vrx->fec);
+	mem_deref(vrx->pool);
 
 	tmr_cancel(&v->tmr);
 	mem_deref(v->strm);
@@ -342,6 +450,13 @@ static double get_fps(const struct video *v)
 }
 
 
+/* The encoder frame-rate, after frame-rate adaptation */
+static double get_enc_fps(const struct video *v)
+{
+	return get_fps(v) * adaptv[v->vtx.adapt_level].rate / 100;
+}
+
+
 static int packet_handler(bool marker, uint64_t ts,
 			  const uint8_t *hdr, size_t hdr_len,
 			  const uint8_t *pld, size_t pld_len,
@@ -367,6 +482,8 @@ static int packet_handler(bool marker, uint64_t ts,
 	if (err)
 		return err;
 
+	qent->picup = vtx->picup;
+
 	lock_write_get(vtx->lock_tx);
 	qent->dst = *sdp_media_raddr(strm->sdp);
 	list_append(&vtx->sendq, &qent->le, qent);
@@ -376,6 +493,20 @@ static int packet_handler(bool marker, uint64_t ts,
 }
 
 
+/* The encoded size at an adaptation level, in multiples of 8 pixels */
+static void adapt_size(struct vidsz *sz, const struct vidsz *src,
+		       unsigned scale)
+{
+	if (scale >= 100) {
+		*sz = *src;
+		return;
+	}
+
+	sz->w = max((src->w * scale / 100) & ~7u, 16);
+	sz->h = max((src->h * scale / 100) & ~7u, 16);
+}
+
+
 /**
  * Encode video and send via RTP stream
  *
@@ -388,7 +519,11 @@ static int packet_handler(bool marker, uint64_t ts,
 static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			    uint64_t timestamp)
 {
+	const enum vidfmt enc_fmt = vtx->video->cfg.enc_fmt;
+	const struct adapt_level *al;
+	struct vidsz sz;
 	struct le *le;
+	uint64_t t0;
 	int err = 0;
 	bool sendq_empty;
 
@@ -406,16 +541,30 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 
 	lock_write_get(vtx->lock_enc);
 
-	/* Convert image */
-	if (frame->fmt != (enum vidfmt)vtx->video->cfg.enc_fmt) {
+	al = &adaptv[vtx->adapt_level];
+
+	/* Frame-rate adaptation, the frames are dropped evenly */
+	vtx->adapt_acc += al->rate;
+	if (vtx->adapt_acc < 100)
+		goto out;
+
+	vtx->adapt_acc -= 100;
+
+	t0 = tmr_jiffies_usec();
+
+	adapt_size(&sz, &frame->size, al->scale);
+
+	/* Convert and scale image */
+	if (frame->fmt != enc_fmt || !vidsz_cmp(&sz, &frame->size)) {
 
 		vtx->vsrc_size = frame->size;
 
+		if (vtx->frame && !vidsz_cmp(&vtx->frame->size, &sz))
+			vtx->frame = mem_deref(vtx->frame);
+
 		if (!vtx->frame) {
 
-			err = vidframe_alloc(&vtx->frame,
-					     vtx->video->cfg.enc_fmt,
-					     &vtx->vsrc_size);
+			err = vidframe_alloc(&vtx->frame, enc_fmt, &sz);
 			if (err)
 				goto out;
 		}
@@ -443,6 +592,9 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 
 	vtx->picup = false;
 
+	vtx->enc_usec += tmr_jiffies_usec() - t0;
+	++vtx->enc_frames;
+
  out:
 	lock_rel(vtx->lock_enc);
 }
@@ -509,6 +661,8 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	/* The initial value of the timestamp SHOULD be random */
 	vtx->ts_offset = rand_u16();
 
+	vtx->fec_pt = -1;
+
 	str_ncpy(vtx->device, video->cfg.src_dev, sizeof(vtx->device));
 
 	tmr_start(&vtx->tmr_rtp, 1, rtp_tmr_handler, vtx);
@@ -525,8 +679,13 @@ static int vrx_alloc(struct vrx *vrx, struct video *video)
 	if (err)
 		return err;
 
+	err = vidpool_alloc(&vrx->pool, POOL_SIZE);
+	if (err)
+		return err;
+
 	vrx->video  = video;
 	vrx->pt_rx  = -1;
+	vrx->fec_pt = -1;
 	vrx->orient = VIDORIENT_PORTRAIT;
 
 	str_ncpy(vrx->device, video->cfg.disp_dev, sizeof(vrx->device));
@@ -668,24 +827,26 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	vrx->size = frame->size;
 	vrx->fmt  = frame->fmt;
 
-	if (!list_isempty(&vrx->filtl)) {
+	/* Process video frame through all Video Filters */
+	for (le = vrx->filtl.head; le; le = le->next) {
 
-		err = vidframe_alloc(&frame_filt, frame->fmt, &frame->size);
-		if (err)
-			goto out;
+		struct vidfilt_dec_st *st = le->data;
 
-		vidframe_copy(frame_filt, frame);
+		if (!st->vf || !st->vf->dech)
+			continue;
 
-		frame = frame_filt;
-	}
+		/* The decoder keeps the frame, the filters share it
+		 * until one of them modifies it */
+		if (!frame_filt && !st->vf->dec_rdonly) {
 
-	/* Process video frame through all Video Filters */
-	for (le = vrx->filtl.head; le; le = le->next) {
+			err = vidpool_copy(vrx->pool, &frame_filt, frame);
+			if (err)
+				goto out;
 
-		struct vidfilt_dec_st *st = le->data;
+			frame = frame_filt;
+		}
 
-		if (st->vf && st->vf->dech)
-			err |= st->vf->dech(st, frame, &timestamp);
+		err |= st->vf->dech(st, frame, &timestamp);
 	}
 
 	++vrx->stats.disp_frames;
@@ -719,7 +880,7 @@ static int update_payload_type(struct video *v, uint8_t pt_old, uint8_t pt_new)
 	const struct sdp_format *lc;
 
 	lc = sdp_media_lformat(stream_sdpmedia(v->strm), pt_new);
-	if (!lc)
+	if (!lc || !lc->data)
 		return ENOENT;
 
 	if (pt_old != (uint8_t)-1) {
@@ -748,6 +909,17 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	if (!mb)
 		goto out;
 
+	/* Recover lost packets before they are decoded */
+	if (v->vrx.fec) {
+
+		if (hdr->pt == v->vrx.fec_pt)
+			(void)fec_dec_fec(v->vrx.fec, hdr, mb);
+		else
+			(void)fec_dec_media(v->vrx.fec, hdr, mb);
+
+		return;
+	}
+
 	/* Video payload-type changed? */
 	if (hdr->pt == v->vrx.pt_rx)
 		goto out;
@@ -761,6 +933,131 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 }
 
 
+/* Media packets from the FEC decoder, in sequence */
+static void fec_recv_handler(const struct rtp_header *hdr, struct mbuf *mb,
+			     void *arg)
+{
+	struct video *v = arg;
+
+	/* Video payload-type changed? */
+	if (hdr->pt != v->vrx.pt_rx &&
+	    update_payload_type(v, v->vrx.pt_rx, hdr->pt))
+		return;
+
+	(void)video_stream_decode(&v->vrx, hdr, mb);
+}
+
+
+/**
+ * Calculate the encoder bitrate from the feedback of the peer
+ *
+ * The bitrate is decreased in proportion to the loss when it is high,
+ * and increased slowly when there is almost no loss.
+ *
+ * @param bitrate Current bitrate in [bit/s]
+ * @param max     Maximum (configured) bitrate in [bit/s]
+ * @param loss    Fraction lost in [%]
+ * @param remb    Receiver estimated maximum bitrate, or 0 if unknown
+ *
+ * @return New bitrate in [bit/s]
+ */
+uint32_t video_bwe_calc(uint32_t bitrate, uint32_t max, unsigned loss,
+			uint32_t remb)
+{
+	uint64_t rate = bitrate;
+
+	if (loss > BWE_LOSS_HIGH)
+		rate = rate * (200 - min(loss, 100)) / 200;
+	else if (loss < BWE_LOSS_LOW)
+		rate = rate * BWE_INCREASE / 100;
+
+	if (remb && rate > remb)
+		rate = remb;
+
+	rate = min(rate, max);
+	rate = max(rate, (uint64_t)max * BWE_MIN / 100);
+
+	return (uint32_t)rate;
+}
+
+
+/* Re-configure the encoder when the bitrate changes noticeably */
+static void bwe_update(struct video *v, unsigned loss)
+{
+	struct vtx *vtx = &v->vtx;
+	uint32_t cur, rate;
+
+	if (!v->cfg.bwe || !v->cfg.bitrate)
+		return;
+
+	cur  = vtx->bitrate ? vtx->bitrate : v->cfg.bitrate;
+	rate = video_bwe_calc(cur, v->cfg.bitrate, loss, vtx->remb);
+
+	if (rate == cur)
+		return;
+
+	if (rate != v->cfg.bitrate &&
+	    (uint64_t)max(rate, cur) * 100 <
+	    (uint64_t)min(rate, cur) * (100 + BWE_STEP))
+		return;
+
+	(void)video_set_bitrate(v, rate);
+}
+
+
+/* Adapt the FEC level and the bitrate to the loss reported by the peer */
+static void handle_rr(struct video *v, const struct rtcp_rr *rrv, size_t n)
+{
+	struct vtx *vtx = &v->vtx;
+	const uint32_t ssrc = rtp_sess_ssrc(v->strm->rtp);
+	size_t i;
+
+	for (i=0; i<n; i++) {
+
+		unsigned loss;
+
+		if (rrv[i].ssrc != ssrc)
+			continue;
+
+		loss = rrv[i].fraction * 100 / 256;
+
+		vtx->fec_loss = (vtx->fec_loss + loss) / 2;
+
+		bwe_update(v, loss);
+	}
+}
+
+
+/* Receiver Estimated Maximum Bitrate (draft-alvestrand-rmcat-remb) */
+static void handle_remb(struct video *v, const struct mbuf *afb)
+{
+	const uint8_t *p;
+	unsigned exp;
+	uint64_t br;
+
+	if (!afb || mbuf_get_left(afb) < 8)
+		return;
+
+	p = mbuf_buf(afb);
+
+	if (memcmp(p, "REMB", 4))
+		return;
+
+	exp = p[5] >> 2;
+	br  = (uint32_t)(p[5] & 0x03) << 16 | (uint32_t)p[6] << 8 | p[7];
+
+	if (exp > 32)
+		return;
+
+	br <<= exp;
+
+	v->vtx.remb = (uint32_t)min(br, (uint64_t)UINT32_MAX);
+
+	/* apply the cap, without any loss-based step */
+	bwe_update(v, BWE_LOSS_LOW);
+}
+
+
 static void rtcp_handler(struct rtcp_msg *msg, void *arg)
 {
 	struct video *v = arg;
@@ -769,6 +1066,14 @@ static void rtcp_handler(struct rtcp_msg *msg, void *arg)
 
 	switch (msg->hdr.pt) {
 
+	case RTCP_SR:
+		handle_rr(v, msg->r.sr.rrv, msg->hdr.count);
+		break;
+
+	case RTCP_RR:
+		handle_rr(v, msg->r.rr.rrv, msg->hdr.count);
+		break;
+
 	case RTCP_FIR:
 		v->vtx.picup = true;
 		break;
@@ -776,6 +1081,8 @@ static void rtcp_handler(struct rtcp_msg *msg, void *arg)
 	case RTCP_PSFB:
 		if (msg->hdr.count == RTCP_PSFB_PLI)
 			v->vtx.picup = true;
+		else if (msg->hdr.count == RTCP_PSFB_AFB)
+			handle_remb(v, msg->r.fb.fci.afb);
 		break;
 
 	case RTCP_RTPFB:
@@ -917,6 +1224,13 @@ int video_alloc(struct video **vp, const struct stream_param *stream_prm,
 				      "%s", vc->fmtp);
 	}
 
+	/* Forward Error Correction (RFC 5109) */
+	if (v->cfg.fec_key || v->cfg.fec_delta) {
+		err |= sdp_format_add(NULL, stream_sdpmedia(v->strm), false,
+				      NULL, fec_fmt, 90000, 1,
+				      NULL, NULL, NULL, false, NULL);
+	}
+
 	/* Video filters */
 	for (le = list_head(baresip_vidfiltl()); le; le = le->next) {
 		struct vidfilt *vf = le->data;
@@ -1009,6 +1323,121 @@ static int set_encoder_format(struct vtx *vtx, const char *src,
 }
 
 
+static void adapt_set(struct video *v, unsigned level, unsigned load,
+		      unsigned skip)
+{
+	struct vtx *vtx = &v->vtx;
+	const struct adapt_level *al = &adaptv[level];
+	const unsigned rate_prev = adaptv[vtx->adapt_level].rate;
+	struct call *call = v->strm->call;
+	struct vidsz sz;
+	double fps;
+	int err = 0;
+
+	lock_write_get(vtx->lock_enc);
+
+	vtx->adapt_level = level;
+	vtx->adapt_acc   = 0;
+
+	fps = get_enc_fps(v);
+	adapt_size(&sz, &vtx->vsrc_size, al->scale);
+
+	/* the encoder rate-control needs the new frame-rate */
+	if (al->rate != rate_prev && vtx->vc && vtx->enc) {
+		struct videnc_param prm;
+
+		prm.bitrate = vtx->bitrate ? vtx->bitrate : v->cfg.bitrate;
+		prm.pktsize = 1024;
+		prm.fps     = fps;
+		prm.max_fs  = -1;
+
+		err = vtx->vc->encupdh(&vtx->enc, vtx->vc, &prm, NULL,
+				       packet_handler, vtx);
+	}
+
+	lock_rel(vtx->lock_enc);
+
+	if (err)
+		warning("video: adapt: encupdh error: %m\n", err);
+
+	info("video: adapt: level %u, %u x %u at %.2f fps"
+	     " (load %u%%, skipped %u%%)\n",
+	     level, sz.w, sz.h, fps, load, skip);
+
+	if (call) {
+		ua_event(call_get_ua(call), UA_EVENT_CALL_VIDEO_ADAPT, call,
+			 "%ux%u@%.2f", sz.w, sz.h, fps);
+	}
+}
+
+
+/*
+ * Adapt the resolution and frame-rate to the encoder CPU load. The
+ * load is the share of time the video source thread spends in the
+ * encoder, and the level is stepped down when the load is high or
+ * frames are skipped. The level is stepped up again when the expected
+ * load at the upper level is below the target for a few intervals.
+ */
+static void adapt_update(struct video *v, unsigned interval)
+{
+	struct vtx *vtx = &v->vtx;
+	const struct adapt_level *cur, *up;
+	unsigned level, frames, skipc, load, skip;
+	uint64_t usec, expect;
+
+	lock_write_get(vtx->lock_enc);
+
+	usec   = vtx->enc_usec;
+	frames = vtx->enc_frames;
+	level  = vtx->adapt_level;
+
+	vtx->enc_usec   = 0;
+	vtx->enc_frames = 0;
+
+	lock_rel(vtx->lock_enc);
+
+	skipc = vtx->skipc - vtx->skipc_last;
+	vtx->skipc_last = vtx->skipc;
+
+	if (!frames || vtx->muted)
+		return;
+
+	load = (unsigned)(usec / (interval * 10000));
+	skip = 100 * skipc / (frames + skipc);
+
+	if (load > ADAPT_HIGH || skip > ADAPT_SKIP) {
+
+		vtx->adapt_up = 0;
+
+		if (level + 1 < ARRAY_SIZE(adaptv))
+			adapt_set(v, level + 1, load, skip);
+
+		return;
+	}
+
+	if (level == 0)
+		return;
+
+	/* the encoding cost is proportional to pixels per second */
+	cur = &adaptv[level];
+	up  = &adaptv[level - 1];
+
+	expect = (uint64_t)load * up->scale * up->scale * up->rate /
+		(cur->scale * cur->scale * cur->rate);
+
+	if (expect >= ADAPT_TARGET) {
+		vtx->adapt_up = 0;
+		return;
+	}
+
+	if (++vtx->adapt_up >= ADAPT_UP_COUNT) {
+
+		vtx->adapt_up = 0;
+		adapt_set(v, level - 1, load, skip);
+	}
+}
+
+
 enum {TMR_INTERVAL = 5};
 static void tmr_handler(void *arg)
 {
@@ -1024,6 +1453,59 @@ static void tmr_handler(void *arg)
 
 	v->vtx.frames = 0;
 	v->vrx.frames = 0;
+
+	if (v->cfg.adapt)
+		adapt_update(v, TMR_INTERVAL);
+}
+
+
+static int fec_send_handler(uint32_t ts, struct mbuf *mb, void *arg)
+{
+	struct vtx *vtx = arg;
+
+	return stream_send(vtx->video->strm, false, false, vtx->fec_pt,
+			   ts, mb);
+}
+
+
+/* Enable FEC if it was negotiated with the peer */
+static int fec_update(struct video *v)
+{
+	const struct sdp_media *m = stream_sdpmedia(v->strm);
+	const struct sdp_format *rfmt, *lfmt;
+	int err = 0;
+
+	if (!v->cfg.fec_key && !v->cfg.fec_delta)
+		return 0;
+
+	rfmt = sdp_media_rformat(m, fec_fmt);
+	lfmt = sdp_media_format(m, true, NULL, -1, fec_fmt, -1, -1);
+	if (!rfmt || !lfmt) {
+		info("video: fec: not supported by peer\n");
+		return 0;
+	}
+
+	lock_write_get(v->vtx.lock_tx);
+	v->vtx.fec_pt = rfmt->pt;
+	if (!v->vtx.fec) {
+		err = fec_enc_alloc(&v->vtx.fec, RTP_PRESZ,
+				    fec_send_handler, &v->vtx);
+	}
+	lock_rel(v->vtx.lock_tx);
+	if (err)
+		return err;
+
+	v->vrx.fec_pt = lfmt->pt;
+	if (!v->vrx.fec) {
+		err = fec_dec_alloc(&v->vrx.fec, fec_recv_handler, v);
+		if (err)
+			return err;
+	}
+
+	info("video: fec: enabled (tx pt=%d, rx pt=%d)\n",
+	     v->vtx.fec_pt, v->vrx.fec_pt);
+
+	return 0;
 }
 
 
@@ -1044,6 +1526,11 @@ int video_start(struct video *v, const char *peer)
 
 	stream_set_srate(v->strm, VIDEO_SRATE, VIDEO_SRATE);
 
+	err = fec_update(v);
+	if (err) {
+		warning("video: could not enable fec: %m\n", err);
+	}
+
 	if (vidisp_find(baresip_vidispl(), NULL)) {
 		err = set_vidisp(&v->vrx);
 		if (err) {
@@ -1210,7 +1697,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 
 		prm.bitrate = v->cfg.bitrate;
 		prm.pktsize = 1024;
-		prm.fps     = get_fps(v);
+		prm.fps     = get_enc_fps(v);
 		prm.max_fs  = -1;
 
 		info("Set video encoder: %s %s (%u bit/s, %.2f fps)\n",
@@ -1225,6 +1712,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		}
 
 		vtx->vc = vc;
+		vtx->bitrate = prm.bitrate;
 	}
 
 	stream_update_encoder(v->strm, pt_tx);
@@ -1236,6 +1724,60 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 }
 
 
+/**
+ * Set the bitrate of the video encoder
+ *
+ * Encoders with temporal layers use this to enable or disable
+ * the upper layers without re-opening the encoder.
+ *
+ * @param v       Video object
+ * @param bitrate Encoder bitrate in [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_set_bitrate(struct video *v, uint32_t bitrate)
+{
+	struct vtx *vtx;
+	const struct vidcodec *vc;
+	int err = 0;
+
+	if (!v)
+		return EINVAL;
+
+	vtx = &v->vtx;
+
+	lock_write_get(vtx->lock_enc);
+
+	vc = vtx->vc;
+
+	info("video: set bitrate for encoder '%s' to %u bits/s\n",
+	     vc ? vc->name : "?", bitrate);
+
+	if (vc && vc->encupdh) {
+		struct videnc_param prm;
+
+		prm.bitrate = bitrate;
+		prm.pktsize = 1024;
+		prm.fps     = get_enc_fps(v);
+		prm.max_fs  = -1;
+
+		err = vc->encupdh(&vtx->enc, vc, &prm, NULL,
+				  packet_handler, vtx);
+		if (err)
+			warning("video: encupdh error: %m\n", err);
+		else
+			vtx->bitrate = bitrate;
+	}
+	else {
+		info("video: set_bitrate: no video encoder\n");
+	}
+
+	lock_rel(vtx->lock_enc);
+
+	return err;
+}
+
+
 int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 		      const char *fmtp)
 {
@@ -1386,6 +1928,13 @@ static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 			  vtx->stats.src_frames);
 	err |= re_hprintf(pf, "     skipc=%u sendq=%u\n",
 			  vtx->skipc, list_count(&vtx->sendq));
+	if (vtx->video->cfg.adapt) {
+		err |= re_hprintf(pf, "     adapt: level=%u size=%u%%"
+				  " rate=%u%%\n", vtx->adapt_level,
+				  adaptv[vtx->adapt_level].scale,
+				  adaptv[vtx->adapt_level].rate);
+	}
+	err |= fec_enc_debug(pf, vtx->fec);
 
 	if (vtx->ts_base) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1412,6 +1961,8 @@ static int vrx_debug(struct re_printf *pf, const struct vrx *vrx)
 			  vrx->stats.disp_frames);
 	err |= re_hprintf(pf, "     n_intra=%u, n_picup=%u\n",
 			  vrx->n_intra, vrx->n_picup);
+	err |= fec_dec_debug(pf, vrx->fec);
+	err |= vidpool_debug(pf, vrx->pool);
 
 	if (vrx->ts_recv.is_set) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -0,0 +1,327 @@
+/**
+ * @file vidpool.c  Video frame pool
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page VideoPool Video frame pool
+ *
+ * The video frame pool keeps a set of video frames for reuse, so that
+ * the video pipeline does not allocate a new frame for every picture.
+ * The frames are reference counted with mem_ref() and mem_deref(), and
+ * a frame can be passed between the video source, filters, encoder,
+ * decoder and display without copying it.
+ *
+ * A frame is handed out as a small handle that shares the picture of
+ * the pooled frame, and the frame is free again when the last reference
+ * to the handle is released. The handles may be released from any
+ * thread, so the number of users of a frame is counted atomically. The
+ * pool may contain frames with different formats and sizes, and the
+ * least recently used free frame is replaced when the pool is full.
+ */
+
+
+/** Video frame pool */
+struct vidpool {
+	struct list framel;           /**< Frames in the pool          */
+	struct lock *lock;            /**< Protects the pool           */
+	unsigned max;                 /**< Max number of pooled frames */
+	uint64_t n_alloc;             /**< Frames allocated            */
+	uint64_t n_reuse;             /**< Frames reused from the pool */
+	uint64_t n_copy;              /**< Full frame copies           */
+};
+
+struct pool_frame {
+	struct le le;
+	struct vidframe *frame;
+	unsigned refs;                /**< Pool and handles (atomic)   */
+};
+
+/** A pooled frame in use, released with mem_deref() */
+struct pool_handle {
+	struct vidframe frame;        /**< Shares the pooled picture   */
+	struct pool_frame *pf;
+};
+
+
+static void frame_destructor(void *arg)
+{
+	struct pool_frame *pf = arg;
+
+	list_unlink(&pf->le);
+	mem_deref(pf->frame);
+}
+
+
+/* The pool and the handles share the frame, the last one frees it */
+static void frame_release(struct pool_frame *pf)
+{
+	if (__atomic_sub_fetch(&pf->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		mem_deref(pf);
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct vidpool *pool = arg;
+	struct le *le;
+
+	/* frames in use are freed with their last handle */
+	while ((le = list_head(&pool->framel))) {
+		list_unlink(le);
+		frame_release(le->data);
+	}
+
+	mem_deref(pool->lock);
+}
+
+
+static void handle_destructor(void *arg)
+{
+	struct pool_handle *h = arg;
+
+	frame_release(h->pf);
+}
+
+
+static inline bool frame_isfree(const struct pool_frame *pf)
+{
+	return __atomic_load_n(&pf->refs, __ATOMIC_ACQUIRE) == 1;
+}
+
+
+static int frame_handle(struct vidframe **framep, struct pool_frame *pf)
+{
+	struct pool_handle *h;
+
+	h = mem_zalloc(sizeof(*h), handle_destructor);
+	if (!h)
+		return ENOMEM;
+
+	h->frame = *pf->frame;
+	h->pf    = pf;
+
+	__atomic_add_fetch(&pf->refs, 1, __ATOMIC_ACQ_REL);
+
+	*framep = &h->frame;
+
+	return 0;
+}
+
+
+/**
+ * Allocate a video frame pool
+ *
+ * @param poolp Pointer to allocated video frame pool
+ * @param max   Maximum number of frames in the pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_alloc(struct vidpool **poolp, unsigned max)
+{
+	struct vidpool *pool;
+	int err;
+
+	if (!poolp || !max)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), pool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	pool->max = max;
+
+	err = lock_alloc(&pool->lock);
+
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Get a video frame from the pool. The frame must be released with
+ * mem_deref() when it is no longer used.
+ *
+ * @param pool   Video frame pool
+ * @param framep Pointer to returned video frame
+ * @param fmt    Video format
+ * @param sz     Video size
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_get(struct vidpool *pool, struct vidframe **framep,
+		enum vidfmt fmt, const struct vidsz *sz)
+{
+	struct pool_frame *pf, *pf_old = NULL;
+	struct le *le;
+	int err = 0;
+
+	if (!pool || !framep || !sz)
+		return EINVAL;
+
+	lock_write_get(pool->lock);
+
+	for (le = pool->framel.head; le; le = le->next) {
+
+		pf = le->data;
+
+		if (!frame_isfree(pf))
+			continue;
+
+		if (pf->frame->fmt == fmt &&
+		    vidsz_cmp(&pf->frame->size, sz)) {
+
+			/* keep the most recently used frames last */
+			list_unlink(&pf->le);
+			list_append(&pool->framel, &pf->le, pf);
+
+			err = frame_handle(framep, pf);
+			if (!err)
+				++pool->n_reuse;
+			goto out;
+		}
+
+		if (!pf_old)
+			pf_old = pf;
+	}
+
+	if (list_count(&pool->framel) >= pool->max && pf_old) {
+		list_unlink(&pf_old->le);
+		frame_release(pf_old);
+	}
+
+	/* all frames are in use, the frame is not kept in the pool */
+	if (list_count(&pool->framel) >= pool->max) {
+		err = vidframe_alloc(framep, fmt, sz);
+		if (!err)
+			++pool->n_alloc;
+		goto out;
+	}
+
+	pf = mem_zalloc(sizeof(*pf), frame_destructor);
+	if (!pf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pf->refs = 1;
+
+	err = vidframe_alloc(&pf->frame, fmt, sz);
+	if (!err)
+		err = frame_handle(framep, pf);
+	if (err) {
+		mem_deref(pf);
+		goto out;
+	}
+
+	++pool->n_alloc;
+
+	list_append(&pool->framel, &pf->le, pf);
+
+ out:
+	lock_rel(pool->lock);
+
+	return err;
+}
+
+
+/**
+ * Copy a video frame into a new frame from the pool
+ *
+ * @param pool   Video frame pool
+ * @param framep Pointer to returned video frame
+ * @param src    Source video frame
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_copy(struct vidpool *pool, struct vidframe **framep,
+		 const struct vidframe *src)
+{
+	int err;
+
+	if (!pool || !framep || !src)
+		return EINVAL;
+
+	err = vidpool_get(pool, framep, src->fmt, &src->size);
+	if (err)
+		return err;
+
+	vidframe_copy(*framep, src);
+
+	lock_write_get(pool->lock);
+	++pool->n_copy;
+	lock_rel(pool->lock);
+
+	return 0;
+}
+
+
+/**
+ * Get the statistics of a video frame pool
+ *
+ * @param pool  Video frame pool
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_stats(const struct vidpool *pool, struct vidpool_stats *stats)
+{
+	struct le *le;
+
+	if (!pool || !stats)
+		return EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	lock_read_get(pool->lock);
+
+	for (le = pool->framel.head; le; le = le->next) {
+
+		const struct pool_frame *pf = le->data;
+
+		++stats->n_frames;
+		if (!frame_isfree(pf))
+			++stats->n_busy;
+	}
+
+	stats->n_alloc = pool->n_alloc;
+	stats->n_reuse = pool->n_reuse;
+	stats->n_copy  = pool->n_copy;
+
+	lock_rel(pool->lock);
+
+	return 0;
+}
+
+
+/**
+ * Print the video frame pool statistics
+ *
+ * @param pf   Print handler for debug output
+ * @param pool Video frame pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_debug(struct re_printf *pf, const struct vidpool *pool)
+{
+	struct vidpool_stats stats;
+
+	if (vidpool_stats(pool, &stats))
+		return 0;
+
+	return re_hprintf(pf, " pool: frames=%u busy=%u alloc=%llu"
+			  " reuse=%llu copy=%llu\n",
+			  stats.n_frames, stats.n_busy, stats.n_alloc,
+			  stats.n_reuse, stats.n_copy);
+}
@@ -0,0 +1,275 @@
+/**
+ * @file test/aufile.c  Baresip selftest -- aufile prompt cache
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdio.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+#include "../modules/aufile/aufile.h"
+
+
+enum {
+	SRATE = 8000,
+	NUM_SAMPLES = 800,  /* 100 ms */
+};
+
+
+static int write_wav(const char *path, size_t sampc, int16_t offset)
+{
+	struct aufile_prm prm;
+	struct aufile *af = NULL;
+	int16_t sampv[NUM_SAMPLES * 2];
+	size_t i;
+	int err;
+
+	if (sampc > ARRAY_SIZE(sampv))
+		return EINVAL;
+
+	for (i=0; i<sampc; i++)
+		sampv[i] = sys_htols((int16_t)(i + offset));
+
+	prm.srate    = SRATE;
+	prm.channels = 1;
+	prm.fmt      = AUFMT_S16LE;
+
+	err = aufile_open(&af, &prm, path, AUFILE_WRITE);
+	if (err)
+		return err;
+
+	err = aufile_write(af, (uint8_t *)sampv, sampc * 2);
+
+	/* the WAV header is updated when the file is closed */
+	mem_deref(af);
+
+	return err;
+}
+
+
+static bool prompt_check(const struct prompt *p, size_t sampc,
+			 int16_t offset)
+{
+	size_t i;
+
+	if (!p || p->sampc != sampc)
+		return false;
+
+	for (i=0; i<sampc; i++) {
+		if (p->sampv[i] != (int16_t)(i + offset))
+			return false;
+	}
+
+	return true;
+}
+
+
+int test_aufile_cache(void)
+{
+	struct prompt *p1 = NULL, *p2 = NULL, *p3 = NULL, *p4 = NULL;
+	struct ausrc_prm prm;
+	char file1[256], file2[256];
+	int err;
+
+	memset(&prm, 0, sizeof(prm));
+	prm.srate = SRATE;
+	prm.ch    = 1;
+	prm.ptime = 20;
+	prm.fmt   = AUFMT_S16LE;
+
+	re_snprintf(file1, sizeof(file1), "%s/baresip_test_aufile1.wav",
+		    test_tmpdir());
+	re_snprintf(file2, sizeof(file2), "%s/baresip_test_aufile2.wav",
+		    test_tmpdir());
+
+	/* room for one prompt only */
+	err = prompt_cache_init(NUM_SAMPLES * 3);
+	TEST_ERR(err);
+
+	err  = write_wav(file1, NUM_SAMPLES, 0);
+	err |= write_wav(file2, NUM_SAMPLES, 100);
+	TEST_ERR(err);
+
+	/* miss, then hit */
+	err = prompt_get(&p1, file1, &prm);
+	TEST_ERR(err);
+	ASSERT_TRUE(prompt_check(p1, NUM_SAMPLES, 0));
+
+	err = prompt_get(&p2, file1, &prm);
+	TEST_ERR(err);
+	ASSERT_TRUE(p1 == p2);
+	ASSERT_EQ(3, mem_nrefs(p1));
+	p2 = mem_deref(p2);
+
+	/* the format is part of the key */
+	prm.srate = 16000;
+	ASSERT_EQ(ENODEV, prompt_get(&p2, file1, &prm));
+	prm.srate = SRATE;
+
+	/* a changed file is loaded again, the old prompt is still valid */
+	err = write_wav(file1, NUM_SAMPLES * 2, 10);
+	TEST_ERR(err);
+
+	err = prompt_get(&p2, file1, &prm);
+	TEST_ERR(err);
+	ASSERT_TRUE(p1 != p2);
+	ASSERT_TRUE(prompt_check(p2, NUM_SAMPLES * 2, 10));
+	ASSERT_TRUE(prompt_check(p1, NUM_SAMPLES, 0));
+	ASSERT_EQ(1, mem_nrefs(p1));
+	p2 = mem_deref(p2);
+
+	/* the new file is too big for the cache, and not kept */
+	err  = prompt_get(&p2, file1, &prm);
+	err |= prompt_get(&p3, file1, &prm);
+	TEST_ERR(err);
+	ASSERT_TRUE(p2 != p3);
+	ASSERT_EQ(1, mem_nrefs(p2));
+
+	p2 = mem_deref(p2);
+	p3 = mem_deref(p3);
+
+	/* the least recently used prompt is evicted */
+	err = write_wav(file1, NUM_SAMPLES, 0);
+	TEST_ERR(err);
+
+	err = prompt_get(&p2, file1, &prm);
+	TEST_ERR(err);
+	ASSERT_EQ(2, mem_nrefs(p2));
+
+	err = prompt_get(&p3, file2, &prm);
+	TEST_ERR(err);
+	ASSERT_TRUE(prompt_check(p3, NUM_SAMPLES, 100));
+	ASSERT_EQ(2, mem_nrefs(p3));
+	ASSERT_EQ(1, mem_nrefs(p2));
+	ASSERT_TRUE(prompt_check(p2, NUM_SAMPLES, 0));
+
+	/* a missing file */
+	(void)remove(file2);
+	ASSERT_EQ(ENOENT, prompt_get(&p4, file2, &prm));
+
+ out:
+	mem_deref(p1);
+	mem_deref(p2);
+	mem_deref(p3);
+	mem_deref(p4);
+	prompt_cache_close();
+
+	(void)remove(file1);
+	(void)remove(file2);
+
+	return err;
+}
+
+
+/* The frames of the mock codec, a header and the samples in big-endian */
+static bool enc_check(const struct prompt_enc *pe, size_t i, size_t sampc,
+		      int16_t offset)
+{
+	const uint8_t *p;
+	size_t j;
+
+	if (!pe || i >= pe->framec)
+		return false;
+
+	if (pe->offv[i + 1] - pe->offv[i] != 2 + sampc * 2)
+		return false;
+
+	p = pe->mb->buf + pe->offv[i] + 2;
+
+	for (j=0; j<sampc; j++) {
+
+		int16_t v = (int16_t)(p[2*j] << 8 | p[2*j + 1]);
+		int16_t ref = (int16_t)(i * sampc + j + offset);
+
+		/* the last frame is filled up with silence */
+		if (i * sampc + j >= NUM_SAMPLES)
+			ref = 0;
+
+		if (v != ref)
+			return false;
+	}
+
+	return true;
+}
+
+
+int test_aufile_encode(void)
+{
+	struct prompt *p = NULL;
+	struct prompt_enc *pe1 = NULL, *pe2 = NULL, *pe3 = NULL;
+	const struct aucodec *ac;
+	struct ausrc_prm prm;
+	char file[256];
+	int err;
+
+	memset(&prm, 0, sizeof(prm));
+	prm.srate = SRATE;
+	prm.ch    = 1;
+	prm.ptime = 30;
+	prm.fmt   = AUFMT_S16LE;
+
+	mock_aucodec_register();
+
+	ac = aucodec_find(baresip_aucodecl(), "FOO16", 0, 0);
+	ASSERT_TRUE(ac != NULL);
+
+	re_snprintf(file, sizeof(file), "%s/baresip_test_aufile3.wav",
+		    test_tmpdir());
+
+	err = prompt_cache_init(NUM_SAMPLES * 64);
+	TEST_ERR(err);
+
+	err = write_wav(file, NUM_SAMPLES, 50);
+	TEST_ERR(err);
+
+	err = prompt_get(&p, file, &prm);
+	TEST_ERR(err);
+
+	/* 100 ms in frames of 30 ms, the last one is padded */
+	err = prompt_encode(&pe1, p, ac, 30, NULL);
+	TEST_ERR(err);
+	ASSERT_EQ(4, pe1->framec);
+	ASSERT_EQ(240, pe1->dur);
+	ASSERT_TRUE(enc_check(pe1, 0, 240, 50));
+	ASSERT_TRUE(enc_check(pe1, 3, 240, 50));
+
+	/* the frames are encoded once, and shared */
+	err = prompt_encode(&pe2, p, ac, 30, "");
+	TEST_ERR(err);
+	ASSERT_TRUE(pe1 == pe2);
+	ASSERT_EQ(3, mem_nrefs(pe1));
+	pe2 = mem_deref(pe2);
+
+	/* the packet time and parameters are part of the key */
+	err = prompt_encode(&pe2, p, ac, 20, NULL);
+	TEST_ERR(err);
+	ASSERT_TRUE(pe1 != pe2);
+	ASSERT_EQ(5, pe2->framec);
+	ASSERT_TRUE(enc_check(pe2, 4, 160, 50));
+
+	err = prompt_encode(&pe3, p, ac, 30, "mode=1");
+	TEST_ERR(err);
+	ASSERT_TRUE(pe1 != pe3);
+	ASSERT_EQ(3, list_count(&p->encl));
+
+	/* the encoded frames outlive the prompt */
+	p = mem_deref(p);
+	prompt_cache_close();
+
+	ASSERT_EQ(1, mem_nrefs(pe1));
+	ASSERT_TRUE(enc_check(pe1, 1, 240, 50));
+
+ out:
+	mem_deref(pe3);
+	mem_deref(pe2);
+	mem_deref(pe1);
+	mem_deref(p);
+	prompt_cache_close();
+	mock_aucodec_unregister();
+
+	(void)remove(file);
+
+	return err;
+}
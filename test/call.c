@@ -313,6 +313,7 @@ static void event_handler(struct ua *ua, enum ua_event ev,
 int test_call_answer(void)
 {
 	struct fixture fix, *f = &fix;
+	struct call *call;
 	int err = 0;
 
 	fixture_init(f);
@@ -337,6 +338,19 @@ int test_call_answer(void)
 	ASSERT_EQ(1, fix.b.n_established);
 	ASSERT_EQ(0, fix.b.n_closed);
 
+	/* verify the call setup timeline */
+	call = ua_call(f->a.ua);
+	ASSERT_TRUE(call != NULL);
+	ASSERT_TRUE(call_mark_elapsed(call, CALL_MARK_INVITE) >= 0);
+	ASSERT_TRUE(call_mark_elapsed(call, CALL_MARK_ANSWER) >=
+		    call_mark_elapsed(call, CALL_MARK_INVITE));
+	ASSERT_EQ(-1, call_mark_elapsed(call, CALL_MARK_SECURE));
+
+	call = ua_call(f->b.ua);
+	ASSERT_TRUE(call != NULL);
+	ASSERT_TRUE(call_mark_elapsed(call, CALL_MARK_INVITE) >= 0);
+	ASSERT_TRUE(call_mark_elapsed(call, CALL_MARK_ANSWER) >= 0);
+
  out:
 	fixture_close(f);
 
@@ -543,6 +557,26 @@ static bool linenum_are_sequential(const struct ua *ua)
 }
 
 
+/* verify that all calls can be found by line-number and Call-ID */
+static bool calls_are_indexed(const struct ua *ua)
+{
+	struct le *le;
+
+	for (le = list_head(ua_calls(ua)) ; le ; le = le->next) {
+		struct call *call = le->data;
+
+		if (call != call_find_linenum(ua_calls(ua),
+					      call_linenum(call)))
+			return false;
+
+		if (call != call_find_id(ua_calls(ua), call_id(call)))
+			return false;
+	}
+
+	return true;
+}
+
+
 int test_call_multiple(void)
 {
 	struct fixture fix, *f = &fix;
@@ -626,6 +660,15 @@ int test_call_multiple(void)
 	ASSERT_EQ(4, list_count(ua_calls(f->a.ua)));
 	ASSERT_EQ(4, list_count(ua_calls(f->b.ua)));
 
+	/* the free line-numbers are reused */
+	for (i=1; i<=4; i++) {
+		ASSERT_TRUE(NULL != call_find_linenum(ua_calls(f->a.ua), i));
+	}
+	ASSERT_TRUE(NULL == call_find_linenum(ua_calls(f->a.ua), i));
+	ASSERT_TRUE(calls_are_indexed(f->a.ua));
+	ASSERT_TRUE(calls_are_indexed(f->b.ua));
+	ASSERT_TRUE(NULL == call_find_id(NULL, "not-found"));
+
  out:
 	fixture_close(f);
 
@@ -804,6 +847,11 @@ int test_call_video(void)
 	ASSERT_TRUE(call_has_video(ua_call(f->a.ua)));
 	ASSERT_TRUE(call_has_video(ua_call(f->b.ua)));
 
+	/* a new bitrate reaches the encoder */
+	err = video_set_bitrate(call_video(ua_call(f->a.ua)), 256000);
+	TEST_ERR(err);
+	ASSERT_EQ(256000, mock_vidcodec_bitrate());
+
  out:
 	fixture_close(f);
 	mem_deref(vidisp);
@@ -812,6 +860,70 @@ int test_call_video(void)
 
 	return err;
 }
+
+
+int test_call_video_fec(void)
+{
+	struct fixture fix, *f = &fix;
+	struct vidsrc *vidsrc = NULL;
+	struct vidisp *vidisp = NULL;
+	struct mbuf *mb = NULL;
+	struct pl n_media, n_fec;
+	int err = 0;
+
+	conf_config()->video.fps       = 100;
+	conf_config()->video.fec_key   = 100;
+	conf_config()->video.fec_delta = 100;
+
+	fixture_init(f);
+
+	mock_vidcodec_register();
+	err = mock_vidsrc_register(&vidsrc);
+	TEST_ERR(err);
+	err = mock_vidisp_register(&vidisp, mock_vidisp_handler, f);
+	TEST_ERR(err);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->estab_action = ACTION_NOTHING;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_ON);
+	TEST_ERR(err);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	ASSERT_TRUE(call_has_video(ua_call(f->a.ua)));
+
+	/* every media packet sent is protected, from the first one */
+	mb = mbuf_alloc(1024);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_printf(mb, "%H", video_debug, call_video(ua_call(f->a.ua)));
+	TEST_ERR(err);
+
+	err = re_regex((char *)mb->buf, mb->end,
+		       "fec tx: level=[0-9]+% media=[0-9]+ fec=[0-9]+",
+		       NULL, &n_media, &n_fec);
+	TEST_ERR(err);
+	ASSERT_TRUE(pl_u32(&n_media) >= 1);
+	ASSERT_TRUE(pl_u32(&n_fec) >= 1);
+
+ out:
+	fixture_close(f);
+	mem_deref(mb);
+	mem_deref(vidisp);
+	mem_deref(vidsrc);
+	mock_vidcodec_unregister();
+
+	conf_config()->video.fec_key   = 0;
+	conf_config()->video.fec_delta = 0;
+
+	return err;
+}
 #endif
 
 
@@ -108,6 +108,17 @@ static const struct cmd longcmdv[] = {
 };
 
 
+/* the same long name twice in one block */
+static const struct cmd dupcmdv[] = {
+	{ "dup", 0, 0, "First Command",  long_handler},
+	{ "DUP", 0, 0, "Second Command", long_handler},
+};
+
+static const struct cmd dup2cmdv[] = {
+	{ "dup", 0, 0, "Third Command",  long_handler},
+};
+
+
 int test_cmd_long(void)
 {
 	struct commands *commands = NULL;
@@ -155,6 +166,198 @@ int test_cmd_long(void)
 	cmd = cmd_find_long(commands, "test");
 	ASSERT_TRUE(cmd == NULL);
 
+	/* a duplicate long name, the first one of the block is found */
+	err = cmd_register(commands, dupcmdv, ARRAY_SIZE(dupcmdv));
+	ASSERT_EQ(0, err);
+
+	cmd = cmd_find_long(commands, "Dup");
+	ASSERT_TRUE(cmd == &dupcmdv[0]);
+
+	/* a later block can not register the name again */
+	ASSERT_EQ(EINVAL, cmd_register(commands, dup2cmdv,
+				       ARRAY_SIZE(dup2cmdv)));
+	ASSERT_TRUE(cmd_find_long(commands, "dup") == &dupcmdv[0]);
+
+	cmd_unregister(commands, dupcmdv);
+
+	cmd = cmd_find_long(commands, "dup");
+	ASSERT_TRUE(cmd == NULL);
+
+ out:
+	mem_deref(commands);
+	return err;
+}
+
+
+static int handler_null(struct re_printf *pf, void *arg)
+{
+	(void)pf;
+	(void)arg;
+	return 0;
+}
+
+
+static const struct cmd complcmdv[] = {
+	{ "testing", 0, 0, "Another Test Command", handler_null},
+	{ "dial",  'd', 0, "Dial",                 handler_null},
+};
+
+
+int test_cmd_complete(void)
+{
+	struct commands *commands = NULL;
+	struct test test;
+	struct cmd_ctx *ctx = NULL;
+	static const char *input_str = "/dia\t\n/tes\t";
+	size_t i;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+
+	err = cmd_init(&commands);
+	TEST_ERR(err);
+
+	err  = cmd_register(commands, longcmdv, ARRAY_SIZE(longcmdv));
+	err |= cmd_register(commands, complcmdv, ARRAY_SIZE(complcmdv));
+	TEST_ERR(err);
+
+	/* "dia" is completed, "tes" is ambiguous */
+	for (i=0; i<strlen(input_str); i++) {
+
+		err = cmd_process(commands, &ctx, input_str[i],
+				  &pf_null, &test);
+		TEST_ERR(err);
+	}
+
+	/* the indexes follow the unregistered commands */
+	cmd_unregister(commands, complcmdv);
+
+	ASSERT_TRUE(NULL == cmd_find_long(commands, "dial"));
+	ASSERT_TRUE(NULL != cmd_find_long(commands, "TEST"));
+
+	err = cmd_process(commands, &ctx, '\t', &pf_null, &test);
+	TEST_ERR(err);
+
+	/* now "tes" is completed to "test" */
+	input_str = " 123\n";
+	for (i=0; i<strlen(input_str); i++) {
+
+		err = cmd_process(commands, &ctx, input_str[i],
+				  &pf_null, &test);
+		TEST_ERR(err);
+	}
+
+	ASSERT_EQ(1, test.cmd_called);
+	ASSERT_TRUE(NULL == ctx);
+
+	/* a short key is free again */
+	err = cmd_register(commands, complcmdv, ARRAY_SIZE(complcmdv));
+	TEST_ERR(err);
+
+ out:
+	mem_deref(ctx);
+	mem_deref(commands);
+	return err;
+}
+
+
+enum {
+	BENCH_BLOCKS = 32,
+	BENCH_CMDS   = 16,
+	BENCH_LOOKUPS = 100000,
+};
+
+
+/* the dispatch before the indexes, a scan of all blocks */
+static const struct cmd *scan_long(struct cmd *blockv[], size_t n,
+				   const char *name)
+{
+	size_t b, i;
+
+	for (b=n; b>0; b--) {
+
+		for (i=0; i<BENCH_CMDS; i++) {
+
+			const struct cmd *cmd = &blockv[b-1][i];
+
+			if (0 == str_casecmp(name, cmd->name) && cmd->h)
+				return cmd;
+		}
+	}
+
+	return NULL;
+}
+
+
+int test_cmd_bench(void)
+{
+	static struct cmd blockv[BENCH_BLOCKS][BENCH_CMDS];
+	static char namev[BENCH_BLOCKS][BENCH_CMDS][16];
+	struct cmd *blockp[BENCH_BLOCKS];
+	struct commands *commands = NULL;
+	uint64_t t0, t_scan, t_hash;
+	size_t b, i, n;
+	int err;
+
+	err = cmd_init(&commands);
+	TEST_ERR(err);
+
+	for (b=0; b<BENCH_BLOCKS; b++) {
+
+		for (i=0; i<BENCH_CMDS; i++) {
+
+			re_snprintf(namev[b][i], sizeof(namev[b][i]),
+				    "command%02zu_%02zu", b, i);
+
+			blockv[b][i].name = namev[b][i];
+			blockv[b][i].desc = "Benchmark";
+			blockv[b][i].h    = handler_null;
+		}
+
+		blockp[b] = blockv[b];
+
+		err = cmd_register(commands, blockv[b], BENCH_CMDS);
+		TEST_ERR(err);
+	}
+
+	/* both find the same commands */
+	for (b=0; b<BENCH_BLOCKS; b++) {
+		for (i=0; i<BENCH_CMDS; i++) {
+
+			ASSERT_TRUE(&blockv[b][i] ==
+				    cmd_find_long(commands, namev[b][i]));
+			ASSERT_TRUE(&blockv[b][i] ==
+				    scan_long(blockp, BENCH_BLOCKS,
+					      namev[b][i]));
+		}
+	}
+
+	t0 = tmr_jiffies_usec();
+	for (n=0; n<BENCH_LOOKUPS; n++) {
+		b = n % BENCH_BLOCKS;
+		i = (n / BENCH_BLOCKS) % BENCH_CMDS;
+		if (!scan_long(blockp, BENCH_BLOCKS, namev[b][i]))
+			break;
+	}
+	t_scan = tmr_jiffies_usec() - t0;
+
+	t0 = tmr_jiffies_usec();
+	for (n=0; n<BENCH_LOOKUPS; n++) {
+		b = n % BENCH_BLOCKS;
+		i = (n / BENCH_BLOCKS) % BENCH_CMDS;
+		if (!cmd_find_long(commands, namev[b][i]))
+			break;
+	}
+	t_hash = tmr_jiffies_usec() - t0;
+
+	ASSERT_EQ(BENCH_LOOKUPS, n);
+
+	info("cmd: %u commands, %u lookups: scan %llu us, index %llu us\n",
+	     BENCH_BLOCKS * BENCH_CMDS, BENCH_LOOKUPS, t_scan, t_hash);
+
+	/* a miss */
+	ASSERT_TRUE(NULL == cmd_find_long(commands, "command99_99"));
+
  out:
 	mem_deref(commands);
 	return err;
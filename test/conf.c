@@ -0,0 +1,255 @@
+/**
+ * @file test/conf.c  Test the configuration index
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test_conf"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	N_KEYS = 2000,
+};
+
+
+static const char *conf_str =
+	"# comment line\n"
+	"sip_listen\t\t0.0.0.0:5060\n"
+	"  audio_player   aubridge,\"dev 1\"\r\n"
+	"audio_source aufile,/tmp/sound.wav\n"
+	"rtp_ports 10000-20000\n"
+	"rtp_tos 184\n"
+	"jitter_buffer_delay 5-x\n"
+	"video_size \"352x288\"\n"
+	"video_fps 29.97\n"
+	"rtcp_mux yes\n"
+	"rtcp_enable maybe\n"
+	"novalue\n"
+	"dns_server 1.2.3.4:53\n"
+	"dns_server 5.6.7.8:53\n"
+	"#dns_server 9.9.9.9:53\n"
+	;
+
+
+static int apply_handler(const struct pl *val, void *arg)
+{
+	struct mbuf *mb = arg;
+
+	return mbuf_printf(mb, "%r;", val);
+}
+
+
+static int make_conf(struct mbuf *mb, uint32_t n, uint32_t changed)
+{
+	uint32_t i;
+	int err;
+
+	err = mbuf_write_str(mb, conf_str);
+
+	for (i=0; i<n && !err; i++) {
+		err = mbuf_printf(mb, "key_%u value_%u\n", i,
+				  i == changed ? i + 1 : i);
+	}
+
+	return err;
+}
+
+
+int test_conf_index(void)
+{
+	static const char *keyv[] = {
+		"sip_listen", "audio_player", "video_size", "rtcp_enable",
+		"dns_server"
+	};
+	struct confidx *idx = NULL, *idx2 = NULL;
+	struct conf *conf = NULL;
+	struct mbuf *mb, *mb2 = NULL;
+	struct config *cfg;
+	struct range rng;
+	struct pl val;
+	struct sa sa;
+	char str[64], str2[64];
+	uint32_t i, u32;
+	uint64_t t0, t1, t2;
+	double fps;
+	bool b;
+	int err;
+
+	mb  = mbuf_alloc(65536);
+	mb2 = mbuf_alloc(64);
+	cfg = mem_zalloc(sizeof(*cfg), NULL);
+	if (!mb || !mb2 || !cfg) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = make_conf(mb, N_KEYS, N_KEYS);
+	TEST_ERR(err);
+
+	err = confidx_alloc_buf(&idx, mb->buf, mb->end);
+	TEST_ERR(err);
+
+	ASSERT_EQ(N_KEYS + 12, confidx_count(idx));
+
+	/* typed accessors */
+	err = confidx_get_str(idx, "sip_listen", str, sizeof(str));
+	TEST_ERR(err);
+	ASSERT_STREQ("0.0.0.0:5060", str);
+
+	err = confidx_get_csv(idx, "audio_player", str, sizeof(str),
+			      str2, sizeof(str2));
+	TEST_ERR(err);
+	ASSERT_STREQ("aubridge", str);
+	ASSERT_STREQ("\"dev 1\"", str2);
+
+	err = confidx_get_range(idx, "rtp_ports", &rng);
+	TEST_ERR(err);
+	ASSERT_EQ(10000, rng.min);
+	ASSERT_EQ(20000, rng.max);
+
+	err = confidx_get_range(idx, "rtp_tos", &rng);
+	TEST_ERR(err);
+	ASSERT_EQ(184, rng.min);
+	ASSERT_EQ(184, rng.max);
+
+	/* a malformed range is an error */
+	err = confidx_get_range(idx, "jitter_buffer_delay", &rng);
+	ASSERT_EQ(EINVAL, err);
+	err = 0;
+
+	err = confidx_get_u32(idx, "rtp_tos", &u32);
+	TEST_ERR(err);
+	ASSERT_EQ(184, u32);
+
+	err = confidx_get_float(idx, "video_fps", &fps);
+	TEST_ERR(err);
+	ASSERT_DOUBLE_EQ(29.97, fps, 0.001);
+
+	err = confidx_get_bool(idx, "rtcp_mux", &b);
+	TEST_ERR(err);
+	ASSERT_TRUE(b);
+
+	b = true;
+	err = confidx_get_bool(idx, "rtcp_enable", &b);
+	TEST_ERR(err);
+	ASSERT_TRUE(!b);
+
+	err = confidx_get_sa(idx, "dns_server", &sa);
+	TEST_ERR(err);
+	ASSERT_EQ(53, sa_port(&sa));
+
+	ASSERT_EQ(ENOENT, confidx_get(idx, "novalue", &val));
+	ASSERT_EQ(ENOENT, confidx_get(idx, "key", &val));
+	ASSERT_EQ(ENOENT, confidx_get(idx, "#", &val));
+
+	err = confidx_apply(idx, "dns_server", apply_handler, mb2);
+	TEST_ERR(err);
+	TEST_STRCMP("1.2.3.4:53;5.6.7.8:53;", 22, mb2->buf, mb2->end);
+
+	/* the core config */
+	err = config_parse_conf(cfg, idx);
+	TEST_ERR(err);
+	ASSERT_STREQ("aufile", cfg->audio.src_mod);
+	ASSERT_STREQ("/tmp/sound.wav", cfg->audio.src_dev);
+	ASSERT_EQ(10000, cfg->avt.rtp_ports.min);
+	ASSERT_EQ(2, cfg->net.nsc);
+	ASSERT_TRUE(!cfg->audio.src_first);
+
+	/* same values as the libre config parser */
+	err = conf_alloc_buf(&conf, mb->buf, mb->end);
+	TEST_ERR(err);
+
+	for (i=0; i<ARRAY_SIZE(keyv); i++) {
+		struct pl val2;
+
+		err  = conf_get(conf, keyv[i], &val);
+		err |= confidx_get(idx, keyv[i], &val2);
+		TEST_ERR(err);
+
+		ASSERT_EQ(0, pl_cmp(&val, &val2));
+	}
+
+	b = true;
+	err = conf_get_bool(conf, "rtcp_enable", &b);
+	TEST_ERR(err);
+	ASSERT_TRUE(!b);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<N_KEYS; i+=8) {
+		struct pl val2;
+
+		re_snprintf(str, sizeof(str), "key_%u", i);
+
+		err  = conf_get(conf, str, &val);
+		err |= confidx_get(idx, str, &val2);
+		TEST_ERR(err);
+
+		ASSERT_EQ(0, pl_cmp(&val, &val2));
+	}
+
+	t1 = tmr_jiffies();
+
+	for (i=0; i<N_KEYS; i+=8) {
+
+		re_snprintf(str, sizeof(str), "key_%u", i);
+
+		err = confidx_get(idx, str, &val);
+		TEST_ERR(err);
+	}
+
+	t2 = tmr_jiffies();
+
+	/* startup time, from the config file to the core config */
+	for (i=0; i<10; i++) {
+
+		idx = mem_deref(idx);
+
+		err = confidx_alloc_buf(&idx, mb->buf, mb->end);
+		TEST_ERR(err);
+
+		cfg->net.nsc = 0;
+		err = config_parse_conf(cfg, idx);
+		TEST_ERR(err);
+	}
+
+	info("conf: %u keys, %u lookups: conf_get %llu ms,"
+	     " confidx_get %llu ms, index and parse %.1f ms\n",
+	     confidx_count(idx), N_KEYS / 8, t1 - t0, t2 - t1,
+	     (tmr_jiffies() - t2) / 10.0);
+
+	/* changed keys */
+	mbuf_rewind(mb);
+	err = make_conf(mb, N_KEYS - 1, 7);
+	TEST_ERR(err);
+
+	err = confidx_alloc_buf(&idx2, mb->buf, mb->end);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(!confidx_changed(idx, idx2, "sip_listen"));
+	ASSERT_TRUE(!confidx_changed(idx, idx2, "dns_server"));
+	ASSERT_TRUE(!confidx_changed(idx, idx2, "key_6"));
+	ASSERT_TRUE(confidx_changed(idx, idx2, "key_7"));
+	ASSERT_TRUE(confidx_changed(idx, idx2, "key_1999"));
+	ASSERT_TRUE(!confidx_changed(idx, idx2, "sip_*"));
+	ASSERT_TRUE(confidx_changed(idx, idx2, "key_*"));
+	ASSERT_TRUE(confidx_changed(NULL, idx2, "rtp_tos"));
+	ASSERT_TRUE(!confidx_changed(NULL, idx2, "nokey"));
+
+ out:
+	mem_deref(conf);
+	mem_deref(idx2);
+	mem_deref(idx);
+	mem_deref(cfg);
+	mem_deref(mb2);
+	mem_deref(mb);
+
+	return err;
+}
@@ -0,0 +1,466 @@
+/**
+ * @file test/ctrl_tcp.c  Baresip selftest -- TCP control interface
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+extern const struct mod_export exports_ctrl_tcp;
+
+
+enum {
+	QUEUE_SIZE  = 4096,
+	FLOOD_BATCH = 64,
+	FLOOD_MAX   = 100000,
+};
+
+/* A client that reads everything */
+struct client {
+	struct tcp_conn *tc;
+	struct mbuf *rx;
+	struct mbuf *events;       /* Types of the received events */
+	unsigned n_msg;
+	unsigned n_expect;         /* Stop the main loop at this many */
+	bool ok;
+	char token[32];
+	int err;
+};
+
+
+static void client_destructor(void *arg)
+{
+	struct client *cli = arg;
+
+	mem_deref(cli->tc);
+	mem_deref(cli->rx);
+	mem_deref(cli->events);
+}
+
+
+static int client_msg(struct client *cli, const char *p, size_t n)
+{
+	const struct odict_entry *oe;
+	struct odict *od = NULL;
+	int err;
+
+	err = json_decode_odict(&od, 32, p, n, 16);
+	if (err)
+		return err;
+
+	if (odict_lookup(od, "response")) {
+
+		oe = odict_lookup(od, "ok");
+		ASSERT_TRUE(oe != NULL);
+		ASSERT_EQ(ODICT_BOOL, oe->type);
+		cli->ok = oe->u.boolean;
+
+		oe = odict_lookup(od, "token");
+		str_ncpy(cli->token, oe ? oe->u.str : "",
+			 sizeof(cli->token));
+	}
+	else if (odict_lookup(od, "event")) {
+
+		oe = odict_lookup(od, "type");
+		ASSERT_TRUE(oe != NULL);
+		err = mbuf_printf(cli->events, "%s,", oe->u.str);
+	}
+	else {
+		err = EPROTO;
+	}
+
+ out:
+	mem_deref(od);
+
+	return err;
+}
+
+
+/* Decode the complete netstrings, "len:json," */
+static int client_parse(struct client *cli)
+{
+	struct mbuf *rx = cli->rx;
+	int err;
+
+	while (mbuf_get_left(rx)) {
+
+		const char *p = (const char *)mbuf_buf(rx);
+		struct pl len;
+		size_t hdr, n;
+
+		if (re_regex(p, mbuf_get_left(rx), "[0-9]+:", &len))
+			break;
+		if (len.p != p)
+			return EPROTO;
+
+		hdr = len.l + 1;
+		n = pl_u32(&len);
+		if (mbuf_get_left(rx) < hdr + n + 1)
+			break;
+		if (p[hdr + n] != ',')
+			return EPROTO;
+
+		err = client_msg(cli, p + hdr, n);
+		if (err)
+			return err;
+
+		++cli->n_msg;
+		mbuf_advance(rx, hdr + n + 1);
+	}
+
+	if (!mbuf_get_left(rx))
+		mbuf_rewind(rx);
+
+	return 0;
+}
+
+
+static void client_recv_handler(struct mbuf *mb, void *arg)
+{
+	struct client *cli = arg;
+	const size_t pos = cli->rx->pos;
+	int err;
+
+	cli->rx->pos = cli->rx->end;
+	err = mbuf_write_mem(cli->rx, mbuf_buf(mb), mbuf_get_left(mb));
+	cli->rx->pos = pos;
+	if (!err)
+		err = client_parse(cli);
+
+	if (err) {
+		cli->err = err;
+		re_cancel();
+	}
+	else if (cli->n_msg >= cli->n_expect) {
+		re_cancel();
+	}
+}
+
+
+static void client_estab_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static void client_close_handler(int err, void *arg)
+{
+	struct client *cli = arg;
+
+	cli->err = err ? err : ECONNRESET;
+	re_cancel();
+}
+
+
+static int client_alloc(struct client **clip, const struct sa *laddr)
+{
+	struct client *cli;
+	int err;
+
+	cli = mem_zalloc(sizeof(*cli), client_destructor);
+	if (!cli)
+		return ENOMEM;
+
+	cli->rx     = mbuf_alloc(1024);
+	cli->events = mbuf_alloc(256);
+	if (!cli->rx || !cli->events) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = tcp_connect(&cli->tc, laddr, client_estab_handler,
+			  client_recv_handler, client_close_handler, cli);
+	if (err)
+		goto out;
+
+	err = re_main_timeout(5000);
+	if (!err)
+		err = cli->err;
+
+ out:
+	if (err)
+		mem_deref(cli);
+	else
+		*clip = cli;
+
+	return err;
+}
+
+
+/* Send a JSON command, and wait for its response */
+static int client_json(struct client *cli, const char *json)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(512);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_printf(mb, "%zu:%s,", str_len(json), json);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	cli->token[0] = '\0';
+	cli->n_expect = cli->n_msg + 1;
+
+	err = tcp_send(cli->tc, mb);
+	if (err)
+		goto out;
+
+	err = re_main_timeout(5000);
+	if (!err)
+		err = cli->err;
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int client_command(struct client *cli, const char *cmd,
+			  const char *params, const char *token)
+{
+	char json[256];
+
+	if (re_snprintf(json, sizeof(json),
+			"{\"command\":\"%s\",\"params\":\"%s\","
+			"\"token\":\"%s\"}", cmd, params, token) < 0)
+		return ENOMEM;
+
+	return client_json(cli, json);
+}
+
+
+/* Wait for the given number of events */
+static int client_wait(struct client *cli, unsigned n)
+{
+	int err;
+
+	/* the events are flushed from the main loop */
+	cli->n_expect = cli->n_msg + n;
+
+	err = re_main_timeout(5000);
+	if (!err)
+		err = cli->err;
+
+	return err;
+}
+
+
+static void poll_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+/* Run the main loop, until the handlers are idle */
+static void main_poll(void)
+{
+	struct tmr tmr;
+
+	tmr_init(&tmr);
+	tmr_start(&tmr, 1, poll_handler, NULL);
+
+	(void)re_main(NULL);
+
+	tmr_cancel(&tmr);
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	return mbuf_write_mem(arg, (uint8_t *)p, size);
+}
+
+
+/* The number of clients, from the ctrlstat command */
+static unsigned ctrl_clients(void)
+{
+	struct mbuf *mb = mbuf_alloc(512);
+	struct re_printf pf = {print_handler, mb};
+	struct pl n;
+	unsigned clients = 0;
+
+	if (!mb)
+		return 0;
+
+	if (!cmd_process_long(baresip_commands(), "ctrlstat", 8,
+			      &pf, NULL) &&
+	    !re_regex((char *)mb->buf, mb->end, "ctrl_tcp: [0-9]+ of", &n))
+		clients = pl_u32(&n);
+
+	mem_deref(mb);
+
+	return clients;
+}
+
+
+static int listen_addr(struct sa *laddr)
+{
+	struct tcp_sock *ts = NULL;
+	int err;
+
+	/* find a free port */
+	err = sa_set_str(laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = tcp_listen(&ts, laddr, NULL, NULL);
+	if (err)
+		return err;
+
+	err = tcp_sock_local_get(ts, laddr);
+
+	mem_deref(ts);
+
+	return err;
+}
+
+
+static int slow_connect(int *fdp, const struct sa *laddr)
+{
+	int rcvbuf = 1024;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return errno;
+
+	/* a small window, to fill up the queue of the server */
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+			 &rcvbuf, sizeof(rcvbuf));
+
+	if (connect(fd, &laddr->u.sa, laddr->len) < 0) {
+		int err = errno;
+		(void)close(fd);
+		return err;
+	}
+
+	*fdp = fd;
+
+	return 0;
+}
+
+
+int test_ctrl_tcp(void)
+{
+	struct client *cli = NULL;
+	struct ua *ua_a = NULL, *ua_b = NULL;
+	struct mod *mod = NULL;
+	struct sa laddr;
+	char conf[256], filter[128];
+	unsigned i;
+	int fd = -1;
+	int n, err;
+
+	err = listen_addr(&laddr);
+	TEST_ERR(err);
+
+	n = re_snprintf(conf, sizeof(conf),
+			"ctrl_tcp_listen\t%J\n"
+			"ctrl_tcp_queue\t%u\n"
+			"ctrl_tcp_slow\tclose\n",
+			&laddr, QUEUE_SIZE);
+	ASSERT_TRUE(n > 0);
+
+	err = conf_configure_buf((uint8_t *)conf, n);
+	TEST_ERR(err);
+
+	err = mod_add(&mod, &exports_ctrl_tcp);
+	TEST_ERR(err);
+
+	err  = ua_alloc(&ua_a, "A <sip:a@127.0.0.1>;regint=0");
+	err |= ua_alloc(&ua_b, "B <sip:b@127.0.0.1>;regint=0");
+	TEST_ERR(err);
+
+	err = client_alloc(&cli, &laddr);
+	TEST_ERR(err);
+
+	/* the token of a command is echoed in its response */
+	re_snprintf(filter, sizeof(filter), "events=register ua=%s",
+		    ua_aor(ua_a));
+
+	err = client_command(cli, "subscribe", filter, "tok1");
+	TEST_ERR(err);
+	ASSERT_TRUE(cli->ok);
+	ASSERT_STREQ("tok1", cli->token);
+
+	err = client_command(cli, "subscribe", "events=nosuchevent", "tok2");
+	TEST_ERR(err);
+	ASSERT_TRUE(!cli->ok);
+	ASSERT_STREQ("tok2", cli->token);
+
+	/* the call of a command is found by its Call-ID */
+	err = client_json(cli, "{\"command\":\"about\","
+			  "\"callid\":\"nosuchcall\",\"token\":\"tok4\"}");
+	TEST_ERR(err);
+	ASSERT_TRUE(!cli->ok);
+	ASSERT_STREQ("tok4", cli->token);
+
+	/* only the register events of UA A are sent */
+	ua_event(ua_b, UA_EVENT_REGISTERING, NULL, "");
+	ua_event(ua_a, UA_EVENT_MWI_NOTIFY, NULL, "");
+	ua_event(NULL, UA_EVENT_REGISTER_FAIL, NULL, "");
+	ua_event(ua_a, UA_EVENT_REGISTER_OK, NULL, "200 OK");
+	ua_event(ua_b, UA_EVENT_REGISTER_OK, NULL, "200 OK");
+	ua_event(ua_a, UA_EVENT_UNREGISTERING, NULL, "");
+
+	err = client_wait(cli, 2);
+	TEST_ERR(err);
+
+	TEST_STRCMP("REGISTER_OK,UNREGISTERING,", 26,
+		    cli->events->buf, cli->events->end);
+
+	/* a client that does not read is closed */
+	err = slow_connect(&fd, &laddr);
+	TEST_ERR(err);
+
+	for (i=0; i<100 && ctrl_clients() < 2; i++)
+		main_poll();
+	ASSERT_EQ(2, ctrl_clients());
+
+	for (i=1; i<=FLOOD_MAX; i++) {
+
+		ua_event(ua_b, UA_EVENT_REGISTER_OK, NULL, "flood %u", i);
+
+		if (i % FLOOD_BATCH)
+			continue;
+
+		main_poll();
+
+		if (ctrl_clients() < 2)
+			break;
+	}
+
+	/* the other client is still connected */
+	ASSERT_EQ(1, ctrl_clients());
+
+	err = client_command(cli, "unsubscribe", "", "tok3");
+	TEST_ERR(err);
+	ASSERT_TRUE(cli->ok);
+	ASSERT_STREQ("tok3", cli->token);
+
+ out:
+	if (fd >= 0)
+		(void)close(fd);
+	mem_deref(cli);
+	mem_deref(ua_b);
+	mem_deref(ua_a);
+	mem_deref(mod);
+	conf_close();
+
+	return err;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file test/evbatch.c  Baresip selftest -- event batching
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+/* stand-in for the broker, keeps the published messages */
+struct broker {
+	char topicv[8][32];
+	char msgv[8][256];
+	unsigned n_msg;
+	bool cancel;
+	bool fail;
+};
+
+
+static int send_handler(const char *topic, const char *buf, size_t len,
+			void *arg)
+{
+	struct broker *br = arg;
+
+	if (br->fail)
+		return ENOTCONN;
+
+	if (br->n_msg >= ARRAY_SIZE(br->msgv) ||
+	    len >= sizeof(br->msgv[0]))
+		return EOVERFLOW;
+
+	str_ncpy(br->topicv[br->n_msg], topic, sizeof(br->topicv[0]));
+	memcpy(br->msgv[br->n_msg], buf, len);
+	br->msgv[br->n_msg][len] = '\0';
+	++br->n_msg;
+
+	if (br->cancel)
+		re_cancel();
+
+	return 0;
+}
+
+
+static int add(struct evbatch *eb, const char *topic, const char *key,
+	       const char *json)
+{
+	return evbatch_add(eb, topic, key, json, str_len(json));
+}
+
+
+int test_evbatch(void)
+{
+	struct evbatch_conf conf = {0, 3, 0};
+	struct evbatch_stats st;
+	struct evbatch *eb = NULL;
+	struct broker br;
+	int err;
+
+	memset(&br, 0, sizeof(br));
+
+	/* without a window, every event is sent at once */
+	err = evbatch_alloc(&eb, &conf, send_handler, &br);
+	TEST_ERR(err);
+
+	err = add(eb, "/ev", NULL, "{\"a\":1}");
+	TEST_ERR(err);
+	ASSERT_EQ(1, br.n_msg);
+	ASSERT_STREQ("{\"a\":1}", br.msgv[0]);
+
+	eb = mem_deref(eb);
+	memset(&br, 0, sizeof(br));
+
+	/* batched into arrays of max_batch events, per topic */
+	conf.window = 10000;
+	err = evbatch_alloc(&eb, &conf, send_handler, &br);
+	TEST_ERR(err);
+
+	err  = add(eb, "/ev", NULL, "1");
+	err |= add(eb, "/ev", NULL, "2");
+	err |= add(eb, "/st", NULL, "{}");
+	TEST_ERR(err);
+	ASSERT_EQ(0, br.n_msg);
+
+	err  = add(eb, "/ev", NULL, "3");
+	err |= add(eb, "/ev", NULL, "4");
+	TEST_ERR(err);
+	ASSERT_EQ(1, br.n_msg);
+	ASSERT_STREQ("/ev", br.topicv[0]);
+	ASSERT_STREQ("[1,2,3]", br.msgv[0]);
+
+	/* the last value wins, in the place of the first */
+	err  = add(eb, "/ev", "call1/VU_TX", "5");
+	err |= add(eb, "/ev", "call1/VU_TX", "7");
+	TEST_ERR(err);
+	ASSERT_EQ(1, br.n_msg);
+
+	err = add(eb, "/ev", NULL, "6");
+	TEST_ERR(err);
+	ASSERT_EQ(2, br.n_msg);
+	ASSERT_STREQ("/ev", br.topicv[1]);
+	ASSERT_STREQ("[4,7,6]", br.msgv[1]);
+
+	/* the same key on another topic is another gauge */
+	err = add(eb, "/st", "call1/VU_TX", "{\"b\":2}");
+	TEST_ERR(err);
+
+	err = evbatch_flush(eb);
+	TEST_ERR(err);
+	ASSERT_EQ(3, br.n_msg);
+	ASSERT_STREQ("/st", br.topicv[2]);
+	ASSERT_STREQ("[{},{\"b\":2}]", br.msgv[2]);
+
+	evbatch_stats_get(eb, &st);
+	ASSERT_EQ(9, st.n_in);
+	ASSERT_EQ(1, st.n_coalesced);
+	ASSERT_EQ(8, st.n_out);
+	ASSERT_EQ(3, st.n_msg);
+	ASSERT_EQ(0, st.n_err);
+	ASSERT_EQ(0, st.n_pending);
+	ASSERT_EQ(4, st.max_pending);
+
+	eb = mem_deref(eb);
+	memset(&br, 0, sizeof(br));
+
+	/* the window expires */
+	conf.window = 10;
+	err = evbatch_alloc(&eb, &conf, send_handler, &br);
+	TEST_ERR(err);
+
+	err = add(eb, "/ev", "k", "1");
+	TEST_ERR(err);
+	err = add(eb, "/ev", "k", "2");
+	TEST_ERR(err);
+
+	br.cancel = true;
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, br.n_msg);
+	ASSERT_STREQ("[2]", br.msgv[0]);
+
+	eb = mem_deref(eb);
+	memset(&br, 0, sizeof(br));
+
+	/* events are kept until the broker takes them */
+	conf.window = 10000;
+	err = evbatch_alloc(&eb, &conf, send_handler, &br);
+	TEST_ERR(err);
+
+	br.fail = true;
+
+	err  = add(eb, "/ev", NULL, "1");
+	err |= add(eb, "/ev", NULL, "2");
+	TEST_ERR(err);
+	ASSERT_EQ(ENOTCONN, add(eb, "/ev", NULL, "3"));
+	ASSERT_EQ(ENOTCONN, evbatch_flush(eb));
+
+	evbatch_stats_get(eb, &st);
+	ASSERT_EQ(2, st.n_err);
+	ASSERT_EQ(3, st.n_pending);
+	ASSERT_EQ(0, st.n_out);
+
+	br.fail = false;
+
+	err = evbatch_flush(eb);
+	TEST_ERR(err);
+	ASSERT_EQ(1, br.n_msg);
+	ASSERT_STREQ("[1,2,3]", br.msgv[0]);
+
+	evbatch_stats_get(eb, &st);
+	ASSERT_EQ(3, st.n_out);
+	ASSERT_EQ(0, st.n_pending);
+
+	eb = mem_deref(eb);
+	memset(&br, 0, sizeof(br));
+
+	/* a failed topic waits for its retry, the oldest events are dropped */
+	conf.max_pending = 4;
+	err = evbatch_alloc(&eb, &conf, send_handler, &br);
+	TEST_ERR(err);
+
+	br.fail = true;
+
+	err  = add(eb, "/ev", NULL, "1");
+	err |= add(eb, "/ev", NULL, "2");
+	TEST_ERR(err);
+	ASSERT_EQ(ENOTCONN, add(eb, "/ev", NULL, "3"));
+
+	err  = add(eb, "/ev", NULL, "4");
+	err |= add(eb, "/ev", NULL, "5");
+	err |= add(eb, "/ev", NULL, "6");
+	TEST_ERR(err);
+
+	evbatch_stats_get(eb, &st);
+	ASSERT_EQ(1, st.n_err);
+	ASSERT_EQ(2, st.n_drop);
+	ASSERT_EQ(4, st.n_pending);
+
+	br.fail = false;
+
+	err = evbatch_flush(eb);
+	TEST_ERR(err);
+	ASSERT_EQ(2, br.n_msg);
+	ASSERT_STREQ("[3,4,5]", br.msgv[0]);
+	ASSERT_STREQ("[6]", br.msgv[1]);
+
+ out:
+	mem_deref(eb);
+
+	return err;
+}
@@ -53,3 +53,309 @@ int test_event(void)
 
 	return err;
 }
+
+
+struct bus_test {
+	unsigned n_sync;
+	unsigned n_async;
+	enum ua_event evv[4];
+	char prm[64];
+	int err;
+};
+
+
+static void sync_handler(struct ua_event_data *evd, void *arg)
+{
+	struct bus_test *bt = arg;
+	const char *prm;
+	int err = 0;
+
+	ASSERT_EQ(UA_EVENT_REGISTER_OK, evd->ev);
+
+	/* the parameter is formatted once */
+	prm = ua_event_prm(evd);
+	ASSERT_TRUE(prm == ua_event_prm(evd));
+
+	str_ncpy(bt->prm, prm, sizeof(bt->prm));
+	++bt->n_sync;
+
+ out:
+	if (err)
+		bt->err = err;
+}
+
+
+static void async_handler(struct ua_event_data *evd, void *arg)
+{
+	struct bus_test *bt = arg;
+	int err = 0;
+
+	ASSERT_TRUE(bt->n_async < ARRAY_SIZE(bt->evv));
+
+	if (evd->ev == UA_EVENT_VU_TX)
+		ASSERT_STREQ("-12.50", ua_event_prm(evd));
+
+	bt->evv[bt->n_async++] = evd->ev;
+
+ out:
+	if (err)
+		bt->err = err;
+
+	if (err || bt->n_async >= 2)
+		re_cancel();
+}
+
+
+int test_event_bus(void)
+{
+	struct bus_test bt;
+	int err;
+
+	memset(&bt, 0, sizeof(bt));
+
+	err = uag_event_subscribe(sync_handler,
+				  UA_EVENT_MASK(UA_EVENT_REGISTER_OK),
+				  0, &bt);
+	TEST_ERR(err);
+	err = uag_event_subscribe(async_handler, UA_EVENT_MASK_ALL,
+				  UA_EVENT_ASYNC, &bt);
+	TEST_ERR(err);
+
+	ua_event(NULL, UA_EVENT_REGISTER_OK, NULL, "%u %s", 200, "OK");
+	ua_event(NULL, UA_EVENT_VU_TX, NULL, "%.2f", -12.5);
+
+	/* only the subscribed events are delivered */
+	ASSERT_EQ(1, bt.n_sync);
+	ASSERT_STREQ("200 OK", bt.prm);
+	TEST_ERR(bt.err);
+
+	/* the async events are delivered from the main loop */
+	ASSERT_EQ(0, bt.n_async);
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+	TEST_ERR(bt.err);
+
+	ASSERT_EQ(2, bt.n_async);
+	ASSERT_EQ(UA_EVENT_REGISTER_OK, bt.evv[0]);
+	ASSERT_EQ(UA_EVENT_VU_TX, bt.evv[1]);
+
+ out:
+	uag_event_unsubscribe(async_handler);
+	uag_event_unsubscribe(sync_handler);
+
+	return err;
+}
+
+
+struct aor_test {
+	unsigned n;
+	bool has_ua;
+	char aor[64];
+};
+
+
+static void aor_handler(struct ua_event_data *evd, void *arg)
+{
+	struct aor_test *at = arg;
+
+	at->has_ua = evd->ua != NULL;
+	str_ncpy(at->aor, evd->aor ? evd->aor : "", sizeof(at->aor));
+	++at->n;
+
+	re_cancel();
+}
+
+
+/* An event of a closed UA keeps its AOR in the queue */
+int test_event_bus_aor(void)
+{
+	struct aor_test at;
+	struct ua *ua = NULL;
+	int err;
+
+	memset(&at, 0, sizeof(at));
+
+	err = uag_event_subscribe(aor_handler,
+				  UA_EVENT_MASK(UA_EVENT_UNREGISTERING),
+				  UA_EVENT_ASYNC, &at);
+	TEST_ERR(err);
+
+	err = ua_alloc(&ua, "sip:event@127.0.0.1");
+	TEST_ERR(err);
+
+	/* UNREGISTERING is raised from the destructor of the UA */
+	ua = mem_deref(ua);
+
+	err = re_main_timeout(1000);
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, at.n);
+	ASSERT_TRUE(!at.has_ua);
+	ASSERT_STREQ("sip:event@127.0.0.1", at.aor);
+
+ out:
+	mem_deref(ua);
+	uag_event_unsubscribe(aor_handler);
+
+	return err;
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	return mbuf_write_mem(arg, (uint8_t *)p, size);
+}
+
+
+/* Encode with the dictionary and without, the results must be the same */
+static int encode_cmp(struct mbuf *mb_dict, struct mbuf *mb_json,
+		      struct ua *ua, enum ua_event ev, struct call *call,
+		      const char *prm, int exp_err)
+{
+	struct re_printf pf_dict = {print_handler, mb_dict};
+	struct re_printf pf_json = {print_handler, mb_json};
+	struct odict *od = NULL;
+	int err, err_dict, err_json;
+
+	mbuf_rewind(mb_dict);
+	mbuf_rewind(mb_json);
+
+	err = odict_alloc(&od, 8);
+	if (err)
+		return err;
+
+	err_dict = event_encode_dict(od, ua, ev, call, prm);
+	if (!err_dict)
+		err_dict = json_encode_odict(&pf_dict, od);
+
+	err_json = event_encode_json(&pf_json, ua, ev, call, prm);
+
+	/* both fail in the same way, e.g. an RTCP event without a stream */
+	ASSERT_EQ(exp_err, err_dict);
+	ASSERT_EQ(exp_err, err_json);
+	if (exp_err)
+		goto out;
+
+	/* the output is byte-identical */
+	TEST_MEMCMP(mb_dict->buf, mb_dict->end,
+		    mb_json->buf, mb_json->end);
+
+	/* also with only the AOR, as for the events of a closed UA */
+	mbuf_rewind(mb_json);
+
+	err  = mbuf_write_str(mb_json, "{");
+	err |= event_encode_members(&pf_json, ua ? ua_aor(ua) : NULL, ev,
+				    call, prm);
+	err |= mbuf_write_str(mb_json, "}");
+	TEST_ERR(err);
+
+	TEST_MEMCMP(mb_dict->buf, mb_dict->end,
+		    mb_json->buf, mb_json->end);
+
+ out:
+	mem_deref(od);
+
+	return err;
+}
+
+
+int test_event_json(void)
+{
+	struct mbuf *mb_dict = NULL, *mb_json = NULL;
+	const struct odict_entry *entry;
+	struct ua *ua_a = NULL, *ua_b = NULL;
+	struct odict *od = NULL;
+	struct call *call = NULL;
+	struct sa laddr;
+	char buri[64];
+	unsigned ev;
+	size_t i, j;
+	int err;
+
+	static const char *prmv[] = {
+		NULL,
+		"200 OK",
+		"audio",
+		"quote \" backslash \\ newline \n tab \t",
+		"sip:b\xc3\xa6r@example.com",
+	};
+
+	mb_dict = mbuf_alloc(512);
+	mb_json = mbuf_alloc(512);
+	if (!mb_dict || !mb_json) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = ua_init("test", true, false, false, false);
+	TEST_ERR(err);
+
+	mock_aucodec_register();
+
+	err  = ua_alloc(&ua_a, "Foo <sip:json@127.0.0.1>;regint=0");
+	err |= ua_alloc(&ua_b, "Bar <sip:b@127.0.0.1>;regint=0");
+	TEST_ERR(err);
+
+	err = sip_transp_laddr(uag_sip(), &laddr, SIP_TRANSP_UDP, NULL);
+	TEST_ERR(err);
+
+	re_snprintf(buri, sizeof(buri), "sip:b@%J", &laddr);
+
+	/* an outgoing call, with an audio stream */
+	err = ua_connect(ua_a, &call, NULL, buri, VIDMODE_OFF);
+	TEST_ERR(err);
+
+	for (ev=0; ev<UA_EVENT_MAX; ev++) {
+
+		for (i=0; i<ARRAY_SIZE(prmv); i++) {
+
+			for (j=0; j<4; j++) {
+
+				struct ua *ua = j & 1 ? ua_a : NULL;
+				struct call *c = j & 2 ? call : NULL;
+				int exp_err = 0;
+
+				/* only RTCP without a stream fails */
+				if (ev == UA_EVENT_CALL_RTCP &&
+				    !(c && !str_cmp(prmv[i], "audio")))
+					exp_err = EINVAL;
+
+				err = encode_cmp(mb_dict, mb_json, ua, ev, c,
+						 prmv[i], exp_err);
+				TEST_ERR(err);
+			}
+		}
+	}
+
+	/* the RTCP stats of the audio stream are encoded */
+	err = encode_cmp(mb_dict, mb_json, ua_a, UA_EVENT_CALL_RTCP, call,
+			 "audio", 0);
+	TEST_ERR(err);
+
+	err = json_decode_odict(&od, 8, (char *)mb_json->buf, mb_json->end,
+				4);
+	TEST_ERR(err);
+
+	entry = odict_lookup(od, "rtcp_stats");
+	ASSERT_TRUE(entry != NULL);
+	ASSERT_EQ(ODICT_OBJECT, entry->type);
+
+	entry = odict_lookup(od, "id");
+	ASSERT_TRUE(entry != NULL);
+	ASSERT_STREQ(call_id(call), entry->u.str);
+
+ out:
+	mem_deref(od);
+	mem_deref(ua_b);
+	mem_deref(ua_a);
+	mem_deref(mb_json);
+	mem_deref(mb_dict);
+
+	mock_aucodec_unregister();
+
+	ua_stop_all(true);
+	ua_close();
+
+	return err;
+}
@@ -0,0 +1,390 @@
+/**
+ * @file test/fec.c  Baresip selftest -- Forward Error Correction
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	HEADROOM = 16,
+	MAX_PKTS = 64,
+};
+
+
+struct fec_test {
+	struct mbuf *mbv[MAX_PKTS];       /* packets on the wire      */
+	struct rtp_header hdrv[MAX_PKTS];
+	bool fecv[MAX_PKTS];
+	unsigned n_sent;
+	uint16_t seq;
+
+	uint16_t seq_recv[MAX_PKTS];      /* packets from the decoder */
+	unsigned n_recv;
+	int err;
+};
+
+
+static void payload(uint8_t *buf, size_t len, uint16_t seq)
+{
+	size_t i;
+
+	for (i=0; i<len; i++)
+		buf[i] = (uint8_t)(seq * 7 + i);
+}
+
+
+static size_t payload_len(uint16_t seq)
+{
+	return 100 + (seq % 5) * 50;
+}
+
+
+static int fec_send_handler(uint32_t ts, struct mbuf *mb, void *arg)
+{
+	struct fec_test *ft = arg;
+	struct rtp_header *hdr;
+
+	if (ft->n_sent >= MAX_PKTS)
+		return EOVERFLOW;
+
+	hdr = &ft->hdrv[ft->n_sent];
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->ver = RTP_VERSION;
+	hdr->pt  = 127;
+	hdr->seq = ft->seq++;
+	hdr->ts  = ts;
+
+	ft->fecv[ft->n_sent] = true;
+	ft->mbv[ft->n_sent++] = mem_ref(mb);
+
+	return 0;
+}
+
+
+static void fec_recv_handler(const struct rtp_header *hdr, struct mbuf *mb,
+			     void *arg)
+{
+	struct fec_test *ft = arg;
+	uint8_t buf[512];
+	size_t len = payload_len(hdr->seq);
+	int err = 0;
+
+	payload(buf, len, hdr->seq);
+
+	ASSERT_TRUE(ft->n_recv < MAX_PKTS);
+	ASSERT_EQ(100, hdr->pt);
+	TEST_MEMCMP(buf, len, mbuf_buf(mb), mbuf_get_left(mb));
+
+	ft->seq_recv[ft->n_recv++] = hdr->seq;
+
+ out:
+	if (err)
+		ft->err = err;
+}
+
+
+static int send_frame(struct fec_test *ft, struct fec_enc *enc,
+		      uint32_t ts, unsigned n)
+{
+	unsigned i;
+	int err = 0;
+
+	for (i=0; i<n; i++) {
+
+		struct rtp_header *hdr = &ft->hdrv[ft->n_sent];
+		struct mbuf *mb;
+		size_t len;
+
+		if (ft->n_sent >= MAX_PKTS)
+			return EOVERFLOW;
+
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->ver = RTP_VERSION;
+		hdr->m   = (i == n-1);
+		hdr->pt  = 100;
+		hdr->seq = ft->seq++;
+		hdr->ts  = ts;
+
+		len = payload_len(hdr->seq);
+
+		mb = mbuf_alloc(len);
+		if (!mb)
+			return ENOMEM;
+
+		payload(mb->buf, len, hdr->seq);
+		mb->end = len;
+
+		ft->fecv[ft->n_sent] = false;
+		ft->mbv[ft->n_sent++] = mb;
+
+		err = fec_enc_packet(enc, hdr, mb->buf, len);
+		if (err)
+			return err;
+	}
+
+	return fec_enc_flush(enc);
+}
+
+
+int test_fec(void)
+{
+	struct fec_test ft;
+	struct fec_enc *enc = NULL;
+	struct fec_dec *dec = NULL;
+	uint16_t seq_lost, seq_fec_lost = 0;
+	unsigned i, n_media = 0;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+	ft.seq = 65530;  /* test wrap-around */
+
+	err = fec_enc_alloc(&enc, HEADROOM, fec_send_handler, &ft);
+	TEST_ERR(err);
+	err = fec_dec_alloc(&dec, fec_recv_handler, &ft);
+	TEST_ERR(err);
+
+	fec_enc_set_level(enc, 20);
+
+	/* Frame 1: one media packet is lost and recovered */
+	seq_lost = ft.seq + 3;
+	err = send_frame(&ft, enc, 3000, 10);
+	TEST_ERR(err);
+
+	/* Frame 2: the FEC packet is lost */
+	err = send_frame(&ft, enc, 6000, 5);
+	TEST_ERR(err);
+	for (i=0; i<ft.n_sent; i++) {
+		if (ft.fecv[i])
+			seq_fec_lost = ft.hdrv[i].seq;
+	}
+
+	/* Frame 3: no loss */
+	err = send_frame(&ft, enc, 9000, 5);
+	TEST_ERR(err);
+
+	/* 2 + 1 + 1 FEC packets */
+	ASSERT_EQ(24, ft.n_sent);
+
+	for (i=0; i<ft.n_sent; i++) {
+
+		struct mbuf *mb = ft.mbv[i];
+
+		if (!ft.fecv[i])
+			++n_media;
+
+		if (ft.hdrv[i].seq == seq_lost ||
+		    ft.hdrv[i].seq == seq_fec_lost)
+			continue;
+
+		if (ft.fecv[i])
+			err = fec_dec_fec(dec, &ft.hdrv[i], mb);
+		else
+			err = fec_dec_media(dec, &ft.hdrv[i], mb);
+		TEST_ERR(err);
+		ASSERT_EQ(0, ft.err);
+	}
+
+	/* all media packets are delivered, in sequence */
+	ASSERT_EQ(n_media, ft.n_recv);
+	for (i=1; i<ft.n_recv; i++) {
+		ASSERT_TRUE((int16_t)(ft.seq_recv[i] - ft.seq_recv[i-1]) > 0);
+	}
+
+	ASSERT_EQ(1, fec_dec_recovered(dec));
+
+ out:
+	for (i=0; i<ft.n_sent; i++)
+		mem_deref(ft.mbv[i]);
+	mem_deref(dec);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+/* Two media packets of a frame are lost, the FEC packet cannot help */
+int test_fec_unrecoverable(void)
+{
+	struct fec_test ft;
+	struct fec_enc *enc = NULL;
+	struct fec_dec *dec = NULL;
+	uint16_t seq_lost1, seq_lost2;
+	unsigned i, n_media = 0;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+	ft.seq = 200;
+
+	err = fec_enc_alloc(&enc, HEADROOM, fec_send_handler, &ft);
+	TEST_ERR(err);
+	err = fec_dec_alloc(&dec, fec_recv_handler, &ft);
+	TEST_ERR(err);
+
+	/* one FEC packet protects all the packets of a frame */
+	fec_enc_set_level(enc, 20);
+
+	seq_lost1 = ft.seq + 1;
+	seq_lost2 = ft.seq + 3;
+	err = send_frame(&ft, enc, 3000, 5);
+	TEST_ERR(err);
+
+	err = send_frame(&ft, enc, 6000, 5);
+	TEST_ERR(err);
+
+	ASSERT_EQ(12, ft.n_sent);
+
+	for (i=0; i<ft.n_sent; i++) {
+
+		struct mbuf *mb = ft.mbv[i];
+
+		if (!ft.fecv[i])
+			++n_media;
+
+		if (ft.hdrv[i].seq == seq_lost1 ||
+		    ft.hdrv[i].seq == seq_lost2)
+			continue;
+
+		if (ft.fecv[i])
+			err = fec_dec_fec(dec, &ft.hdrv[i], mb);
+		else
+			err = fec_dec_media(dec, &ft.hdrv[i], mb);
+		TEST_ERR(err);
+		ASSERT_EQ(0, ft.err);
+	}
+
+	/* the other media packets are delivered, in sequence */
+	ASSERT_EQ(n_media - 2, ft.n_recv);
+	for (i=1; i<ft.n_recv; i++) {
+		ASSERT_TRUE((int16_t)(ft.seq_recv[i] - ft.seq_recv[i-1]) > 0);
+		ASSERT_TRUE(ft.seq_recv[i] != seq_lost1);
+		ASSERT_TRUE(ft.seq_recv[i] != seq_lost2);
+	}
+
+	ASSERT_EQ(0, fec_dec_recovered(dec));
+
+ out:
+	for (i=0; i<ft.n_sent; i++)
+		mem_deref(ft.mbv[i]);
+	mem_deref(dec);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+static int fec_keep_handler(uint32_t ts, struct mbuf *mb, void *arg)
+{
+	struct mbuf **mbp = arg;
+	(void)ts;
+
+	mem_deref(*mbp);
+	*mbp = mem_ref(mb);
+
+	return 0;
+}
+
+
+static int media_packet(struct mbuf **mbp, struct rtp_header *hdr,
+			uint16_t seq, uint16_t pld_seq)
+{
+	const size_t len = payload_len(pld_seq);
+	struct mbuf *mb;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->ver = RTP_VERSION;
+	hdr->pt  = 100;
+	hdr->seq = seq;
+	hdr->ts  = 3000;
+
+	mb = mbuf_alloc(len);
+	if (!mb)
+		return ENOMEM;
+
+	payload(mb->buf, len, pld_seq);
+	mb->end = len;
+
+	*mbp = mb;
+
+	return 0;
+}
+
+
+/* The mask of a FEC packet covers the sequence number of a FEC packet */
+int test_fec_mask(void)
+{
+	struct fec_test ft;
+	struct fec_enc *enc = NULL;
+	struct fec_dec *dec = NULL;
+	struct mbuf *mb1 = NULL, *mb3 = NULL, *mb4 = NULL, *fec = NULL;
+	struct rtp_header hdr1, hdr2, hdr3, hdr4, fhdr;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+
+	err = fec_enc_alloc(&enc, HEADROOM, fec_keep_handler, &fec);
+	TEST_ERR(err);
+	err = fec_dec_alloc(&dec, fec_recv_handler, &ft);
+	TEST_ERR(err);
+
+	err  = media_packet(&mb1, &hdr1, 1001, 1001);
+	err |= media_packet(&mb3, &hdr3, 1003, 1003);
+	err |= media_packet(&mb4, &hdr4, 1004, 1004);
+	TEST_ERR(err);
+
+	/* a FEC packet for 1001 and 1003, sent as 1001 and 1002 */
+	hdr2 = hdr3;
+	hdr2.seq = 1002;
+
+	fec_enc_set_level(enc, 50);
+	err  = fec_enc_packet(enc, &hdr1, mb1->buf, mb1->end);
+	err |= fec_enc_packet(enc, &hdr2, mb3->buf, mb3->end);
+	err |= fec_enc_flush(enc);
+	TEST_ERR(err);
+	ASSERT_TRUE(fec != NULL);
+
+	memset(&fhdr, 0, sizeof(fhdr));
+	fhdr.ver = RTP_VERSION;
+	fhdr.pt  = 127;
+	fhdr.ts  = 3000;
+
+	/* 1001 is received, 1002 is a FEC packet, 1003 is lost */
+	err = fec_dec_media(dec, &hdr1, mb1);
+	TEST_ERR(err);
+
+	fhdr.seq = 1002;
+	err = fec_dec_fec(dec, &fhdr, fec);
+	TEST_ERR(err);
+	fec->pos = HEADROOM;
+
+	err = fec_dec_media(dec, &hdr4, mb4);
+	TEST_ERR(err);
+
+	/* the mask covers 1001, the FEC packet 1002 and 1003 */
+	fec->buf[HEADROOM + 12] = 0xe0;
+
+	fhdr.seq = 1005;
+	err = fec_dec_fec(dec, &fhdr, fec);
+	TEST_ERR(err);
+	ASSERT_EQ(0, ft.err);
+
+	ASSERT_EQ(1, fec_dec_recovered(dec));
+	ASSERT_EQ(3, ft.n_recv);
+	ASSERT_EQ(1001, ft.seq_recv[0]);
+	ASSERT_EQ(1003, ft.seq_recv[1]);
+	ASSERT_EQ(1004, ft.seq_recv[2]);
+
+ out:
+	mem_deref(fec);
+	mem_deref(mb4);
+	mem_deref(mb3);
+	mem_deref(mb1);
+	mem_deref(dec);
+	mem_deref(enc);
+
+	return err;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file test/httpd.c  Baresip selftest -- HTTP server metrics
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+extern const struct mod_export exports_httpd;
+
+
+struct scrape {
+	struct tcp_conn *tc;
+	struct mbuf *rx;
+	struct http_msg *msg;
+	int err;
+};
+
+
+static void scrape_destructor(void *arg)
+{
+	struct scrape *s = arg;
+
+	mem_deref(s->tc);
+	mem_deref(s->rx);
+	mem_deref(s->msg);
+}
+
+
+static void scrape_estab_handler(void *arg)
+{
+	struct scrape *s = arg;
+
+	s->err = tcp_send(s->tc, s->rx);
+	if (s->err)
+		re_cancel();
+
+	mbuf_rewind(s->rx);
+}
+
+
+static void scrape_recv_handler(struct mbuf *mb, void *arg)
+{
+	struct scrape *s = arg;
+	int err;
+
+	s->rx->pos = s->rx->end;
+	err = mbuf_write_mem(s->rx, mbuf_buf(mb), mbuf_get_left(mb));
+	s->rx->pos = 0;
+	if (err)
+		goto out;
+
+	s->msg = mem_deref(s->msg);
+
+	err = http_msg_decode(&s->msg, s->rx, false);
+	if (err == ENODATA)
+		return;
+	if (err)
+		goto out;
+
+	/* wait for the whole body */
+	if (mbuf_get_left(s->rx) < s->msg->clen) {
+		s->rx->pos = 0;
+		return;
+	}
+
+ out:
+	s->err = err;
+	re_cancel();
+}
+
+
+static void scrape_close_handler(int err, void *arg)
+{
+	struct scrape *s = arg;
+
+	s->err = err ? err : ECONNRESET;
+	re_cancel();
+}
+
+
+/* Get the metrics, the body is left in s->rx */
+static int scrape(struct scrape **sp, const struct sa *laddr)
+{
+	struct scrape *s;
+	int err;
+
+	s = mem_zalloc(sizeof(*s), scrape_destructor);
+	if (!s)
+		return ENOMEM;
+
+	s->rx = mbuf_alloc(8192);
+	if (!s->rx) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_printf(s->rx, "GET /metrics HTTP/1.1\r\n"
+			  "Host: %J\r\n"
+			  "\r\n", laddr);
+	if (err)
+		goto out;
+
+	s->rx->pos = 0;
+
+	err = tcp_connect(&s->tc, laddr, scrape_estab_handler,
+			  scrape_recv_handler, scrape_close_handler, s);
+	if (err)
+		goto out;
+
+	err = re_main_timeout(5000);
+	if (!err)
+		err = s->err;
+
+ out:
+	if (err)
+		mem_deref(s);
+	else
+		*sp = s;
+
+	return err;
+}
+
+
+static bool body_has(const struct scrape *s, const char *line)
+{
+	struct pl body, l;
+
+	body.p = (const char *)mbuf_buf(s->rx);
+	body.l = mbuf_get_left(s->rx);
+
+	while (!re_regex(body.p, body.l, "[^\n]*\n", &l)) {
+
+		if (!pl_strcmp(&l, line))
+			return true;
+
+		pl_advance(&body, l.p + l.l + 1 - body.p);
+	}
+
+	return false;
+}
+
+
+static int listen_addr(struct sa *laddr)
+{
+	struct tcp_sock *ts = NULL;
+	int err;
+
+	/* find a free port */
+	err = sa_set_str(laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = tcp_listen(&ts, laddr, NULL, NULL);
+	if (err)
+		return err;
+
+	err = tcp_sock_local_get(ts, laddr);
+
+	mem_deref(ts);
+
+	return err;
+}
+
+
+int test_httpd_metrics(void)
+{
+	struct scrape *s1 = NULL, *s2 = NULL;
+	struct ua *ua_a = NULL, *ua_b = NULL;
+	struct mod *mod = NULL;
+	struct sa laddr;
+	char conf[128], line[64];
+	int n, err;
+
+	err = listen_addr(&laddr);
+	TEST_ERR(err);
+
+	n = re_snprintf(conf, sizeof(conf), "http_listen\t%J\n", &laddr);
+	ASSERT_TRUE(n > 0);
+
+	err = conf_configure_buf((uint8_t *)conf, n);
+	TEST_ERR(err);
+
+	err = mod_add(&mod, &exports_httpd);
+	TEST_ERR(err);
+
+	err  = ua_alloc(&ua_a, "A <sip:a@127.0.0.1>;regint=0");
+	err |= ua_alloc(&ua_b, "B <sip:b@127.0.0.1>;regint=0");
+	TEST_ERR(err);
+
+	err = scrape(&s1, &laddr);
+	TEST_ERR(err);
+
+	ASSERT_EQ(200, s1->msg->scode);
+	ASSERT_TRUE(NULL != http_msg_hdr(s1->msg, HTTP_HDR_CONTENT_TYPE));
+	ASSERT_EQ(s1->msg->clen, mbuf_get_left(s1->rx));
+
+	ASSERT_TRUE(body_has(s1, "baresip_ua_registered"
+			     "{ua=\"sip:a@127.0.0.1\"} 0"));
+	ASSERT_TRUE(body_has(s1, "baresip_ua_calls"
+			     "{ua=\"sip:b@127.0.0.1\"} 0"));
+	ASSERT_TRUE(body_has(s1, "baresip_calls 0"));
+
+	re_snprintf(line, sizeof(line), "baresip_user_agents %u",
+		    list_count(uag_list()));
+	ASSERT_TRUE(body_has(s1, line));
+
+	/* the last line */
+	ASSERT_TRUE(s1->msg->clen >= 6);
+	ASSERT_TRUE(0 == memcmp(mbuf_buf(s1->rx) + s1->msg->clen - 6,
+				"# EOF\n", 6));
+
+	/* the buffer is reused, a scrape has all of the new state */
+	ua_b = mem_deref(ua_b);
+
+	err = scrape(&s2, &laddr);
+	TEST_ERR(err);
+
+	ASSERT_EQ(200, s2->msg->scode);
+	ASSERT_EQ(s2->msg->clen, mbuf_get_left(s2->rx));
+	ASSERT_TRUE(s2->msg->clen < s1->msg->clen);
+	ASSERT_TRUE(body_has(s2, "baresip_ua_registered"
+			     "{ua=\"sip:a@127.0.0.1\"} 0"));
+	ASSERT_TRUE(!body_has(s2, "baresip_ua_calls"
+			      "{ua=\"sip:b@127.0.0.1\"} 0"));
+
+ out:
+	mem_deref(s2);
+	mem_deref(s1);
+	mem_deref(ua_b);
+	mem_deref(ua_a);
+	mem_deref(mod);
+	conf_close();
+
+	return err;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file test/lathist.c  Baresip selftest -- latency histogram
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+int test_lathist(void)
+{
+	struct lathist h;
+	char buf[128];
+	uint32_t ms;
+	int err = 0;
+
+	memset(&h, 0, sizeof(h));
+
+	/* empty */
+	ASSERT_EQ(0, lathist_percentile(&h, 50));
+	ASSERT_EQ(0, lathist_percentile(NULL, 50));
+	err = re_snprintf(buf, sizeof(buf), "%H", lathist_debug, &h) < 0;
+	TEST_ERR(err);
+	ASSERT_STREQ("n=0", buf);
+
+	/* one sample of 0 ms goes to the first bucket */
+	lathist_add(&h, 0);
+	ASSERT_EQ(1, h.bucketv[0]);
+	ASSERT_EQ(0, lathist_percentile(&h, 100));
+
+	/* 1 .. 100 ms, the upper bound of the bucket is returned */
+	memset(&h, 0, sizeof(h));
+	for (ms=1; ms<=100; ms++)
+		lathist_add(&h, ms);
+
+	ASSERT_EQ(100, h.n);
+	ASSERT_EQ(100, h.max);
+	ASSERT_EQ(1, h.bucketv[1]);
+	ASSERT_EQ(2, h.bucketv[2]);
+	ASSERT_EQ(4, h.bucketv[3]);
+	ASSERT_EQ(37, h.bucketv[7]);
+
+	ASSERT_EQ(1,   lathist_percentile(&h, 0));
+	ASSERT_EQ(1,   lathist_percentile(&h, 1));
+	ASSERT_EQ(63,  lathist_percentile(&h, 50));
+	ASSERT_EQ(63,  lathist_percentile(&h, 63));
+	ASSERT_EQ(100, lathist_percentile(&h, 64));
+	ASSERT_EQ(100, lathist_percentile(&h, 95));
+	ASSERT_EQ(100, lathist_percentile(&h, 200));
+
+	err = re_snprintf(buf, sizeof(buf), "%H", lathist_debug, &h) < 0;
+	TEST_ERR(err);
+	ASSERT_STREQ("n=100 avg=50 p50=63 p95=100 p99=100 max=100 ms", buf);
+
+	/* values beyond the last bucket report the maximum */
+	memset(&h, 0, sizeof(h));
+	lathist_add(&h, 1000000);
+	lathist_add(&h, 200000);
+	ASSERT_EQ(2, h.bucketv[LATHIST_BUCKETS - 1]);
+	ASSERT_EQ(1000000, lathist_percentile(&h, 100));
+	ASSERT_EQ(1000000, lathist_percentile(&h, 50));
+
+	/* NULL is ignored */
+	lathist_add(NULL, 1);
+
+ out:
+	return err;
+}
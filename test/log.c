@@ -0,0 +1,119 @@
+/**
+ * @file test/log.c  Baresip selftest -- logging
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	N_MSG = 2000,
+	N_RATELIMIT = 20,
+};
+
+
+static struct mbuf *log_mb;
+static uint32_t log_count;
+static size_t log_maxlen;
+
+
+static void log_handler(uint32_t level, const char *msg)
+{
+	(void)level;
+
+	++log_count;
+	log_maxlen = max(log_maxlen, str_len(msg));
+	(void)mbuf_write_str(log_mb, msg);
+}
+
+
+static struct log lg = {
+	.h = log_handler,
+};
+
+
+static void log_ratelimited(void)
+{
+	warning_ratelimit("test: rate limited warning\n");
+}
+
+
+int test_log(void)
+{
+	struct mbuf *mb;
+	char longmsg[600];
+	unsigned i;
+	int err = 0;
+
+	log_mb = mbuf_alloc(65536);
+	mb     = mbuf_alloc(65536);
+	if (!log_mb || !mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	log_count = 0;
+	log_enable_stdout(false);
+	log_register_handler(&lg);
+
+	/* at most a few messages per call site and interval */
+	for (i=0; i<N_RATELIMIT; i++)
+		log_ratelimited();
+
+	ASSERT_TRUE(log_count > 0);
+	ASSERT_TRUE(log_count < N_RATELIMIT);
+
+	err = log_enable_async(true);
+	if (err == ENOSYS) {
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	log_count = 0;
+	log_maxlen = 0;
+	mbuf_rewind(log_mb);
+
+	/* long messages are written whole */
+	memset(longmsg, 'x', sizeof(longmsg));
+	longmsg[sizeof(longmsg) - 1] = '\0';
+
+	warning("%s\n", longmsg);
+	err = mbuf_printf(mb, "%s\n", longmsg);
+
+	for (i=0; i<N_MSG; i++) {
+		warning("test: message %u\n", i);
+		err |= mbuf_printf(mb, "test: message %u\n", i);
+	}
+	TEST_ERR(err);
+
+	/* disable writes the pending messages */
+	err = log_enable_async(false);
+	TEST_ERR(err);
+
+	/* the ring buffer may have been full */
+	ASSERT_TRUE(log_count >= 2);
+	ASSERT_EQ(sizeof(longmsg), log_maxlen);
+	ASSERT_TRUE(log_mb->end <= mb->end);
+
+	if (log_mb->end == mb->end) {
+		TEST_MEMCMP(mb->buf, mb->end, log_mb->buf, log_mb->end);
+	}
+	else {
+		/* the first records are always written */
+		TEST_MEMCMP(mb->buf, sizeof(longmsg),
+			    log_mb->buf, sizeof(longmsg));
+	}
+
+ out:
+	log_unregister_handler(&lg);
+	log_enable_stdout(true);
+
+	mem_deref(mb);
+	log_mb = mem_deref(log_mb);
+
+	return err;
+}
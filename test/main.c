@@ -24,6 +24,8 @@ struct test {
 static const struct test tests[] = {
 	TEST(test_account),
 	TEST(test_aulevel),
+	TEST(test_aufile_cache),
+	TEST(test_aufile_encode),
 	TEST(test_call_af_mismatch),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
@@ -42,23 +44,56 @@ static const struct test tests[] = {
 	TEST(test_call_transfer),
 #ifdef USE_VIDEO
 	TEST(test_call_video),
+	TEST(test_call_video_fec),
 	TEST(test_video),
+	TEST(test_video_bwe),
+	TEST(test_vidpool),
 #endif
 	TEST(test_cmd),
+	TEST(test_cmd_bench),
+	TEST(test_cmd_complete),
 	TEST(test_cmd_long),
+	TEST(test_conf_index),
 	TEST(test_contact),
 	TEST(test_cplusplus),
+	TEST(test_ctrl_tcp),
+	TEST(test_evbatch),
 	TEST(test_event),
+	TEST(test_event_bus),
+	TEST(test_event_bus_aor),
+	TEST(test_event_json),
+	TEST(test_fec),
+	TEST(test_fec_mask),
+	TEST(test_fec_unrecoverable),
+	TEST(test_httpd_metrics),
+	TEST(test_lathist),
+	TEST(test_log),
 	TEST(test_message),
+	TEST(test_module_lazy),
 	TEST(test_mos),
+	TEST(test_mos_emodel),
 	TEST(test_network),
 	TEST(test_play),
+	TEST(test_play_file),
+	TEST(test_quality),
+	TEST(test_rtpmix),
+	TEST(test_rtprec),
+#ifdef USE_SNDFILE
+	TEST(test_sndfile_mono),
+	TEST(test_sndfile_stereo),
+#endif
+#ifdef USE_OPENSSL
+	TEST(test_srtpfast),
+	TEST(test_srtpfast_bench),
+#endif
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_register),
 	TEST(test_ua_register_dns),
 	TEST(test_ua_register_auth),
 	TEST(test_ua_register_auth_dns),
+	TEST(test_ua_register_sched),
+	TEST(test_uag_find),
 	TEST(test_uag_find_param),
 };
 
@@ -31,6 +31,9 @@ struct viddec_state {
 };
 
 
+static uint32_t last_bitrate;
+
+
 static int hdr_decode(struct hdr *hdr, struct mbuf *mb)
 {
 	if (mbuf_get_left(mb) < HDR_SIZE)
@@ -78,6 +81,8 @@ static int mock_encode_update(struct videnc_state **vesp,
 	ves->pkth    = pkth;
 	ves->arg     = arg;
 
+	last_bitrate = prm->bitrate;
+
 	return 0;
 }
 
@@ -206,4 +211,12 @@ void mock_vidcodec_register(void)
 void mock_vidcodec_unregister(void)
 {
 	vidcodec_unregister(&vc_dummy);
+	last_bitrate = 0;
+}
+
+
+/* Bitrate of the last encoder update */
+uint32_t mock_vidcodec_bitrate(void)
+{
+	return last_bitrate;
 }
@@ -0,0 +1,82 @@
+/**
+ * @file test/module.c  Baresip selftest -- lazy module init
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+static unsigned n_init;
+static int init_err;
+
+
+static int test_inith(void)
+{
+	++n_init;
+
+	return init_err;
+}
+
+
+static int lazy_test(bool lazy)
+{
+	struct mod_lazy ml = MOD_LAZY_INIT("lazytest", test_inith);
+	int err;
+
+	n_init   = 0;
+	init_err = 0;
+
+	module_lazy_set(lazy);
+	ASSERT_EQ(lazy, module_lazy());
+
+	/* called from module_init */
+	err = module_lazy_init(&ml);
+	TEST_ERR(err);
+	ASSERT_EQ(lazy ? 0 : 1, n_init);
+	ASSERT_EQ(!lazy, ml.done);
+
+	/* first use, and the result is cached */
+	err  = module_lazy_use(&ml);
+	err |= module_lazy_use(&ml);
+	TEST_ERR(err);
+	ASSERT_EQ(1, n_init);
+	ASSERT_TRUE(ml.done);
+
+	/* called from module_close, the next use runs init again */
+	module_lazy_reset(&ml);
+	ASSERT_TRUE(!ml.done);
+
+	init_err = ENODEV;
+	ASSERT_EQ(ENODEV, module_lazy_use(&ml));
+	ASSERT_EQ(ENODEV, module_lazy_use(&ml));
+	ASSERT_EQ(2, n_init);
+
+	module_lazy_reset(&ml);
+	ASSERT_EQ(0, ml.err);
+
+ out:
+	return err;
+}
+
+
+int test_module_lazy(void)
+{
+	struct mod_lazy ml = MOD_LAZY_INIT("lazytest", NULL);
+	int err;
+
+	err = lazy_test(false);
+	TEST_ERR(err);
+
+	err = lazy_test(true);
+	TEST_ERR(err);
+
+	ASSERT_EQ(EINVAL, module_lazy_init(&ml));
+	ASSERT_EQ(EINVAL, module_lazy_use(NULL));
+
+ out:
+	module_lazy_set(false);
+
+	return err;
+}
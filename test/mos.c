@@ -3,8 +3,11 @@
  *
  * Copyright (C) 2010 - 2016 Creytiv.com
  */
+#include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
+#include "../src/core.h"
 #include "test.h"
 
 
@@ -51,3 +54,151 @@ int test_mos(void)
  out:
 	return err;
 }
+
+
+int test_mos_emodel(void)
+{
+	struct quality_input in;
+	double r, r_ref, r_g729, r_prev, r_random, r_bursty;
+	unsigned i;
+	int err = 0;
+
+	memset(&in, 0, sizeof(in));
+
+	/* no impairment but the packetization delay */
+	(void)mos_emodel(&r_ref, "PCMU", &in);
+	ASSERT_DOUBLE_EQ(92.96, r_ref, PRECISION);
+
+	/* a low-bitrate codec has an equipment impairment */
+	(void)mos_emodel(&r_g729, "G729", &in);
+	ASSERT_TRUE(r_g729 < r_ref);
+
+	/* more loss is lower quality */
+	in.expected = 1000;
+	r_prev = r_ref;
+	for (i=1; i<=10; i++) {
+
+		in.lost   = i * 10;
+		in.bursts = in.lost;
+
+		(void)mos_emodel(&r, "PCMU", &in);
+		ASSERT_TRUE(r < r_prev);
+		r_prev = r;
+	}
+
+	/* the same loss in bursts is worse than random loss */
+	in.lost   = 50;
+	in.bursts = 50;
+	(void)mos_emodel(&r_random, "PCMU", &in);
+
+	in.bursts = 5;
+	(void)mos_emodel(&r_bursty, "PCMU", &in);
+	ASSERT_TRUE(r_bursty < r_random);
+
+	/* discarded packets count as lost */
+	in.lost      = 0;
+	in.bursts    = 0;
+	in.discarded = 50;
+	(void)mos_emodel(&r, "PCMU", &in);
+	ASSERT_DOUBLE_EQ(r_random, r, PRECISION);
+
+ out:
+	return err;
+}
+
+
+int test_quality(void)
+{
+	static const struct {
+		uint32_t rx;          /* in this interval */
+		uint32_t lost;
+		uint32_t bursts;
+		uint32_t discard;
+		bool changed;
+		bool degraded;
+	} stepv[] = {
+		{250,   0,  0,  0, false, false},  /* clean              */
+		{  0,   0,  0,  0, false, false},  /* nothing received   */
+		{245,   5,  5,  0, false, false},  /* above threshold    */
+		{150,  60, 20, 40, true,  true },  /* heavy loss         */
+		{245,   5,  5,  0, false, true },  /* within hysteresis  */
+		{250,   0,  0,  0, true,  false},  /* recovered          */
+	};
+	struct rtcp_stats rs;
+	struct quality_input in;
+	struct quality q;
+	uint32_t n_rx = 0, n_discard = 0, n = 0;
+	double r, mos;
+	unsigned i;
+	int err = 0;
+
+	memset(&rs, 0, sizeof(rs));
+	rs.rtt    = 20000;
+	rs.rx.jit = 5000;
+
+	/* the threshold is just below the MOS of the small loss */
+	memset(&in, 0, sizeof(in));
+	in.expected = 250;
+	in.lost     = 5;
+	in.bursts   = 5;
+	in.rtt      = 20;
+	in.jitter   = 5;
+
+	quality_init(&q, mos_emodel(&r, "PCMU", &in) - 0.05);
+
+	/* only audio streams have a quality */
+	ASSERT_TRUE(!quality_update(&q, &rs, 250, 0));
+	ASSERT_EQ(0, q.sum.n);
+
+	q.codec = "PCMU";
+
+	for (i=0; i<ARRAY_SIZE(stepv); i++) {
+
+		bool changed;
+
+		/* the stream keeps the counters over the whole call */
+		n_rx      += stepv[i].rx;
+		n_discard += stepv[i].discard;
+		q.n_lost   += stepv[i].lost;
+		q.n_bursts += stepv[i].bursts;
+
+		changed = quality_update(&q, &rs, n_rx, n_discard);
+
+		ASSERT_EQ(stepv[i].changed, changed);
+		ASSERT_EQ(stepv[i].degraded, q.degraded);
+
+		if (!stepv[i].rx) {
+			ASSERT_EQ(n, q.sum.n);
+			continue;
+		}
+
+		ASSERT_EQ(++n, q.sum.n);
+
+		/* the E-model gets the deltas of this interval */
+		in.expected  = stepv[i].rx + stepv[i].lost;
+		in.lost      = stepv[i].lost;
+		in.bursts    = stepv[i].bursts;
+		in.discarded = stepv[i].discard;
+
+		mos = mos_emodel(&r, "PCMU", &in);
+
+		ASSERT_DOUBLE_EQ(mos, q.mos, PRECISION);
+		ASSERT_DOUBLE_EQ(r, q.r, PRECISION);
+	}
+
+	/* the discards restart from zero, after a jitter buffer flush */
+	n_rx += 250;
+	(void)quality_update(&q, &rs, n_rx, 3);
+
+	memset(&in, 0, sizeof(in));
+	in.expected  = 250;
+	in.discarded = 3;
+	in.rtt       = 20;
+	in.jitter    = 5;
+
+	mos = mos_emodel(&r, "PCMU", &in);
+	ASSERT_DOUBLE_EQ(mos, q.mos, PRECISION);
+
+ out:
+	return err;
+}
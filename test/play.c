@@ -3,8 +3,10 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdio.h>
 #include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -14,6 +16,7 @@
 
 struct test {
 	struct mbuf *mb_samp;
+	uint64_t ts_first;
 };
 
 
@@ -46,6 +49,7 @@ static void sample_handler(const void *sampv, size_t sampc, void *arg)
 	int err = 0;
 
 	if (!test->mb_samp) {
+		test->ts_first = tmr_jiffies_usec();
 		test->mb_samp = mbuf_alloc(bytec);
 		ASSERT_TRUE(test->mb_samp != NULL);
 	}
@@ -97,3 +101,273 @@ int test_play(void)
 	mem_deref(auplay);
 	return err;
 }
+
+
+#define WAV_LONG  600  /* 8000 Hz, 1 channel, 10 minutes, streamed */
+#define WAV_SHORT 1    /* 8000 Hz, 1 channel, 1 second, copied     */
+
+
+static size_t rss_kb(void)
+{
+	char line[256];
+	unsigned long kb = 0;
+	FILE *f;
+
+	f = fopen("/proc/self/status", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (1 == sscanf(line, "VmRSS: %lu kB", &kb))
+			break;
+	}
+
+	(void)fclose(f);
+
+	return kb;
+}
+
+
+static int write_wav(const char *path, uint16_t tag, uint16_t bits,
+		     uint32_t seconds)
+{
+	uint8_t hdr[44] = "RIFF____WAVEfmt ";
+	uint32_t i, datasz = 8000 * seconds * bits / 8;
+	struct mbuf *mb;
+	FILE *f;
+	int err;
+
+	mb = mbuf_alloc(sizeof(hdr) + datasz);
+	if (!mb)
+		return ENOMEM;
+
+	err  = mbuf_write_mem(mb, hdr, 16);
+	err |= mbuf_write_u32(mb, sys_htoll(16));
+	err |= mbuf_write_u16(mb, sys_htols(tag));
+	err |= mbuf_write_u16(mb, sys_htols(1));
+	err |= mbuf_write_u32(mb, sys_htoll(8000));
+	err |= mbuf_write_u32(mb, sys_htoll(8000 * bits / 8));
+	err |= mbuf_write_u16(mb, sys_htols(bits / 8));
+	err |= mbuf_write_u16(mb, sys_htols(bits));
+	err |= mbuf_write_str(mb, "data");
+	err |= mbuf_write_u32(mb, sys_htoll(datasz));
+
+	for (i=0; i<datasz*8/bits; i++) {
+		if (bits == 16)
+			err |= mbuf_write_u16(mb, sys_htols(i));
+		else
+			err |= mbuf_write_u8(mb, i);
+	}
+
+	mb->pos = 4;
+	err |= mbuf_write_u32(mb, sys_htoll(mb->end - 8));
+	if (err)
+		goto out;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		err = errno;
+		goto out;
+	}
+
+	if (1 != fwrite(mb->buf, mb->end, 1, f))
+		err = EIO;
+
+	(void)fclose(f);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int play_wav(struct player *player, const char *file,
+		    uint16_t tag, uint16_t bits, uint32_t seconds)
+{
+	struct play *play = NULL;
+	struct test test = {0};
+	struct auplay *auplay = NULL;
+	int16_t expect[NUM_SAMPLES];
+	char path[256];
+	size_t rss0, rss;
+	uint64_t t0, t1;
+	unsigned i;
+	int err;
+
+	if (re_snprintf(path, sizeof(path), "%s/%s",
+			test_tmpdir(), file) < 0)
+		return ENOMEM;
+
+	err = write_wav(path, tag, bits, seconds);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_SAMPLES; i++) {
+		if (tag == 7)
+			expect[i] = g711_ulaw2pcm((uint8_t)i);
+		else
+			expect[i] = i;
+	}
+
+	err = mock_auplay_register(&auplay, sample_handler, &test);
+	TEST_ERR(err);
+
+	rss0 = rss_kb();
+	t0 = tmr_jiffies_usec();
+
+	err = play_file(&play, player, file, 0);
+	TEST_ERR(err);
+
+	t1 = tmr_jiffies_usec();
+	rss = rss_kb();
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+
+	info("play: %u s WAV (%s): load %.3f ms, first sample %.3f ms,"
+	     " RSS %+d kB\n", seconds, tag == 7 ? "PCMU" : "S16LE",
+	     (t1 - t0) / 1000.0, (test.ts_first - t0) / 1000.0,
+	     (int)(rss - rss0));
+
+	/* verify the audio-samples that was played */
+	TEST_MEMCMP(expect, sizeof(expect),
+		    test.mb_samp->buf, test.mb_samp->end);
+
+ out:
+	mem_deref(test.mb_samp);
+	mem_deref(play);
+	mem_deref(auplay);
+
+	return err;
+}
+
+
+struct trunc {
+	const char *path;
+	struct play **playp;
+	struct tmr tmr;
+	unsigned n;
+	int err;
+};
+
+
+/* Truncate the file, after the first samples were played */
+static void trunc_handler(const void *sampv, size_t sampc, void *arg)
+{
+	struct trunc *tr = arg;
+	FILE *f;
+	(void)sampv;
+	(void)sampc;
+
+	if (tr->n++)
+		return;
+
+	f = fopen(tr->path, "wb");
+	if (!f) {
+		tr->err = errno;
+		re_cancel();
+		return;
+	}
+
+	(void)fclose(f);
+}
+
+
+static void trunc_poll(void *arg)
+{
+	struct trunc *tr = arg;
+
+	if (*tr->playp)
+		tmr_start(&tr->tmr, 10, trunc_poll, tr);
+	else
+		re_cancel();
+}
+
+
+static int play_truncated(struct player *player, const char *file)
+{
+	struct play *play = NULL;
+	struct auplay *auplay = NULL;
+	struct trunc tr;
+	char path[256];
+	int err;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.path  = path;
+	tr.playp = &play;
+
+	if (re_snprintf(path, sizeof(path), "%s/%s",
+			test_tmpdir(), file) < 0)
+		return ENOMEM;
+
+	err = write_wav(path, 1, 16, WAV_LONG);
+	TEST_ERR(err);
+
+	err = mock_auplay_register(&auplay, trunc_handler, &tr);
+	TEST_ERR(err);
+
+	err = play_file(&play, player, file, 0);
+	TEST_ERR(err);
+
+	tmr_start(&tr.tmr, 10, trunc_poll, &tr);
+
+	/* the player must stop at the new end of the file */
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(tr.err);
+
+	ASSERT_TRUE(tr.n > 0);
+	ASSERT_TRUE(play == NULL);
+
+ out:
+	tmr_cancel(&tr.tmr);
+	mem_deref(play);
+	mem_deref(auplay);
+
+	return err;
+}
+
+
+int test_play_file(void)
+{
+	static const char *filev[] = {
+		"baresip_test_play1.wav",
+		"baresip_test_play2.wav",
+		"baresip_test_play3.wav",
+	};
+	struct player *player = NULL;
+	char path[256];
+	size_t i;
+	int err;
+
+	err = play_init(&player);
+	TEST_ERR(err);
+
+	play_set_path(player, test_tmpdir());
+
+	err = play_wav(player, filev[0], 1, 16, WAV_LONG);
+	TEST_ERR(err);
+
+	err = play_wav(player, filev[1], 7, 8, WAV_SHORT);
+	TEST_ERR(err);
+
+	/* the cached file was changed, and must be loaded again */
+	err = play_wav(player, filev[1], 1, 16, WAV_SHORT);
+	TEST_ERR(err);
+
+	/* the file is truncated while it is played */
+	err = play_truncated(player, filev[2]);
+	TEST_ERR(err);
+
+ out:
+	for (i=0; i<ARRAY_SIZE(filev); i++) {
+
+		if (re_snprintf(path, sizeof(path), "%s/%s",
+				test_tmpdir(), filev[i]) > 0)
+			(void)remove(path);
+	}
+
+	mem_deref(player);
+
+	return err;
+}
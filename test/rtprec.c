@@ -0,0 +1,451 @@
+/**
+ * @file test/rtprec.c  Baresip selftest -- RTP recorder
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdio.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test_rtprec"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	N_PACKETS = 1000,
+	PAYLOAD   = 160,
+	EXT_BYTES = 8,
+	MIX_PACKETS = 10,
+	RX_SAMP   = 1000,
+	TX_SAMP   = 2000,
+};
+
+
+struct records {
+	unsigned n_info;
+	unsigned n_stream;
+	unsigned n_sdp;
+	unsigned n_rx;
+	unsigned n_tx;
+	unsigned n_bad;
+	uint64_t ts_last;
+	int seq_last;
+};
+
+
+static int read_file(struct mbuf *mb, const char *file)
+{
+	uint8_t buf[4096];
+	FILE *f;
+	size_t n;
+	int err = 0;
+
+	f = fopen(file, "rb");
+	if (!f)
+		return errno;
+
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+
+		err = mbuf_write_mem(mb, buf, n);
+		if (err)
+			break;
+	}
+
+	(void)fclose(f);
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static int record_handler(const struct rtprec_rec *r, void *arg)
+{
+	struct records *recs = arg;
+
+	switch (r->type) {
+
+	case RTPREC_INFO:
+		if (r->len != 10 || memcmp(r->buf, "peer: test", 10))
+			++recs->n_bad;
+		++recs->n_info;
+		break;
+
+	case RTPREC_STREAM:
+		if (r->stream != 0 || r->len != 5)
+			++recs->n_bad;
+		++recs->n_stream;
+		break;
+
+	case RTPREC_SDP:
+		if (!(r->flags & RTPREC_LOCAL))
+			++recs->n_bad;
+		++recs->n_sdp;
+		break;
+
+	case RTPREC_RTP:
+		if (r->flags & RTPREC_TX) {
+
+			/* the header extension is not recorded */
+			if (r->len != 10 || r->buf[0] != 0xaa)
+				++recs->n_bad;
+			++recs->n_tx;
+			break;
+		}
+
+		/* packets may be dropped, but never reordered */
+		if (r->pt != 0 || r->ssrc != 0x01020304 ||
+		    r->seq <= recs->seq_last || r->rtp_ts != r->seq*PAYLOAD ||
+		    r->len != PAYLOAD || r->buf[0] != (r->seq & 0xff) ||
+		    r->ts < recs->ts_last)
+			++recs->n_bad;
+
+		recs->ts_last  = r->ts;
+		recs->seq_last = r->seq;
+		++recs->n_rx;
+		break;
+
+	default:
+		++recs->n_bad;
+		break;
+	}
+
+	return 0;
+}
+
+
+int test_rtprec(void)
+{
+	struct rtprec *rec = NULL;
+	struct rtp_header hdr;
+	struct records recs;
+	struct mbuf *mb, *sdp, *file;
+	char rec_file[256], idx_file[256];
+	uint64_t t0, t_rec = 0;
+	int id, i;
+	int err;
+
+	memset(&recs, 0, sizeof(recs));
+	recs.seq_last = -1;
+
+	re_snprintf(rec_file, sizeof(rec_file), "%s/baresip_test_rtprec.brec",
+		    test_tmpdir());
+	re_snprintf(idx_file, sizeof(idx_file), "%s.idx", rec_file);
+
+	mb   = mbuf_alloc(PAYLOAD);
+	sdp  = mbuf_alloc(64);
+	file = mbuf_alloc(N_PACKETS * (PAYLOAD + 32));
+	if (!mb || !sdp || !file) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = rtprec_alloc(&rec, rec_file);
+	TEST_ERR(err);
+
+	id = rtprec_stream(rec, "audio");
+	ASSERT_EQ(0, id);
+
+	rtprec_info(rec, "peer", "test");
+
+	err = mbuf_write_str(sdp, "v=0\r\nm=audio 5004 RTP/AVP 0\r\n");
+	TEST_ERR(err);
+	sdp->pos = 0;
+
+	rtprec_sdp(rec, true, sdp);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ssrc = 0x01020304;
+
+	/* the media path, no packet may wait for the writer */
+	for (i=0; i<N_PACKETS; i++) {
+
+		mbuf_rewind(mb);
+		mbuf_fill(mb, i & 0xff, PAYLOAD);
+		mb->pos = 0;
+
+		hdr.seq = i;
+		hdr.ts  = i * PAYLOAD;
+
+		t0 = tmr_jiffies_usec();
+		rtprec_rtp(rec, id, false, false, &hdr, mb);
+		t_rec += tmr_jiffies_usec() - t0;
+
+		/* let the writer run now and then */
+		if (i % 100 == 99)
+			sys_msleep(30);
+	}
+
+	/* a sent packet with a header extension */
+	mbuf_rewind(mb);
+	err  = mbuf_write_u16(mb, htons(0xbede));
+	err |= mbuf_write_u16(mb, htons(EXT_BYTES / 4));
+	err |= mbuf_fill(mb, 0x11, EXT_BYTES);
+	err |= mbuf_fill(mb, 0xaa, 10);
+	TEST_ERR(err);
+	mb->pos = 0;
+
+	rtprec_rtp(rec, id, true, true, &hdr, mb);
+
+	/* the writer writes the rest of the recording, and closes it */
+	rec = mem_deref(rec);
+	rtprec_close();
+
+	err = read_file(file, rec_file);
+	TEST_ERR(err);
+
+	err = rtprec_decode(file, record_handler, &recs);
+	TEST_ERR(err);
+
+	ASSERT_EQ(0, recs.n_bad);
+	ASSERT_EQ(1, recs.n_info);
+	ASSERT_EQ(1, recs.n_stream);
+	ASSERT_EQ(1, recs.n_sdp);
+	ASSERT_TRUE(recs.n_rx >= N_PACKETS * 9 / 10);
+	ASSERT_EQ(1, recs.n_tx);
+
+	/* the index has at least one entry */
+	mbuf_rewind(file);
+	err = read_file(file, idx_file);
+	TEST_ERR(err);
+	ASSERT_TRUE(file->end >= 16 && file->end % 16 == 0);
+
+	/* not a recording */
+	mbuf_rewind(file);
+	err = mbuf_write_str(file, "RIFF....WAVE");
+	TEST_ERR(err);
+	file->pos = 0;
+	ASSERT_EQ(EBADMSG, rtprec_decode(file, record_handler, &recs));
+
+	info("rtprec: %u of %u packets recorded, %.2f us per packet\n",
+	     recs.n_rx, N_PACKETS, (double)t_rec / N_PACKETS);
+
+ out:
+	mem_deref(rec);
+	mem_deref(file);
+	mem_deref(sdp);
+	mem_deref(mb);
+
+	/* stop the writer */
+	rtprec_close();
+
+	(void)remove(rec_file);
+	(void)remove(idx_file);
+
+	return err;
+}
+
+
+/* Linear PCM in network byte order, at any rate */
+static int l16_decode(struct audec_state *st, int fmt, void *sampv,
+		      size_t *sampc, const uint8_t *buf, size_t len)
+{
+	int16_t *p = sampv;
+	size_t i;
+	(void)st;
+
+	if (fmt != AUFMT_S16LE)
+		return ENOTSUP;
+
+	if (*sampc < len / 2)
+		return ENOMEM;
+
+	for (i=0; i<len/2; i++)
+		p[i] = (int16_t)(buf[2*i] << 8 | buf[2*i + 1]);
+
+	*sampc = len / 2;
+
+	return 0;
+}
+
+
+static struct aucodec ac_nb = {
+	.name  = "MIX8",
+	.srate = 8000,
+	.crate = 8000,
+	.ch    = 1,
+	.pch   = 1,
+	.dech  = l16_decode,
+};
+
+static struct aucodec ac_wb = {
+	.name  = "MIX16",
+	.srate = 16000,
+	.crate = 16000,
+	.ch    = 1,
+	.pch   = 1,
+	.dech  = l16_decode,
+};
+
+
+static int rtp_packet(struct mbuf *mb, int16_t v, size_t sampc)
+{
+	size_t i;
+	int err = 0;
+
+	mbuf_rewind(mb);
+
+	for (i=0; i<sampc; i++)
+		err |= mbuf_write_u16(mb, htons(v));
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+/*
+ * Record a call with 20 ms packets, received at 8000 Hz and sent at
+ * 16000 Hz
+ */
+static int mix_record(const char *file)
+{
+	static const char *sdp_str =
+		"v=0\r\n"
+		"m=audio 5004 RTP/AVP 96 97\r\n"
+		"a=rtpmap:96 MIX8/8000\r\n"
+		"a=rtpmap:97 MIX16/16000\r\n";
+	struct rtprec *rec = NULL;
+	struct rtp_header hdr;
+	struct mbuf *mb, *sdp;
+	int id, i;
+	int err;
+
+	mb  = mbuf_alloc(640);
+	sdp = mbuf_alloc(128);
+	if (!mb || !sdp) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_write_str(sdp, sdp_str);
+	if (err)
+		goto out;
+	sdp->pos = 0;
+
+	err = rtprec_alloc(&rec, file);
+	if (err)
+		goto out;
+
+	id = rtprec_stream(rec, "audio");
+
+	rtprec_sdp(rec, true, sdp);
+	rtprec_sdp(rec, false, sdp);
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	for (i=0; i<MIX_PACKETS && !err; i++) {
+
+		hdr.pt   = 96;
+		hdr.ssrc = 1;
+		hdr.seq  = i;
+		hdr.ts   = i * 160;
+
+		err = rtp_packet(mb, RX_SAMP, 160);
+		rtprec_rtp(rec, id, false, false, &hdr, mb);
+
+		hdr.pt   = 97;
+		hdr.ssrc = 2;
+		hdr.ts   = i * 320;
+
+		err |= rtp_packet(mb, TX_SAMP, 320);
+		rtprec_rtp(rec, id, true, false, &hdr, mb);
+	}
+
+ out:
+	mem_deref(rec);
+	mem_deref(sdp);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int test_rtpmix(void)
+{
+	struct rtpmix *mix = NULL;
+	struct mbuf *file = NULL;
+	char rec_file[256], idx_file[256];
+	const int16_t *sampv;
+	size_t framec, i;
+	int err;
+
+	re_snprintf(rec_file, sizeof(rec_file), "%s/baresip_test_rtpmix.brec",
+		    test_tmpdir());
+	re_snprintf(idx_file, sizeof(idx_file), "%s.idx", rec_file);
+
+	aucodec_register(baresip_aucodecl(), &ac_nb);
+	aucodec_register(baresip_aucodecl(), &ac_wb);
+
+	err = mix_record(rec_file);
+	TEST_ERR(err);
+
+	/* the writer closes the recording */
+	rtprec_close();
+
+	file = mbuf_alloc(8192);
+	if (!file) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = read_file(file, rec_file);
+	TEST_ERR(err);
+
+	/* stereo at 8000 Hz, the sent stream is resampled */
+	err = rtpmix_alloc(&mix, 8000, 2);
+	TEST_ERR(err);
+
+	err = rtpmix_decode(mix, file);
+	TEST_ERR(err);
+
+	sampv = rtpmix_sampv(mix, &framec);
+	ASSERT_TRUE(sampv != NULL);
+	ASSERT_TRUE(framec >= MIX_PACKETS * 160);
+	ASSERT_TRUE(framec <= MIX_PACKETS * 160 + 80);
+
+	/* the resampler needs some samples to settle */
+	for (i=100; i<MIX_PACKETS * 160 - 100; i++) {
+		ASSERT_EQ(RX_SAMP, sampv[2*i]);
+		ASSERT_TRUE(sampv[2*i + 1] > TX_SAMP * 9 / 10);
+		ASSERT_TRUE(sampv[2*i + 1] < TX_SAMP * 11 / 10);
+	}
+
+	mix = mem_deref(mix);
+
+	/* the rate of the first stream is the default */
+	err = rtpmix_alloc(&mix, 0, 1);
+	TEST_ERR(err);
+	err = rtpmix_decode(mix, file);
+	TEST_ERR(err);
+	ASSERT_EQ(8000, rtpmix_srate(mix));
+	ASSERT_TRUE(rtpmix_sampv(mix, NULL) != NULL);
+
+	mix = mem_deref(mix);
+
+	/* no stream can be resampled to this rate */
+	err = rtpmix_alloc(&mix, 11025, 1);
+	TEST_ERR(err);
+	err = rtpmix_decode(mix, file);
+	TEST_ERR(err);
+	ASSERT_TRUE(rtpmix_sampv(mix, NULL) == NULL);
+
+ out:
+	mem_deref(mix);
+	mem_deref(file);
+
+	aucodec_unregister(&ac_wb);
+	aucodec_unregister(&ac_nb);
+
+	rtprec_close();
+
+	(void)remove(rec_file);
+	(void)remove(idx_file);
+
+	return err;
+}
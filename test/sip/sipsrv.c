@@ -183,6 +183,60 @@ static bool handle_register(struct sip_server *srv, const struct sip_msg *msg)
 }
 
 
+struct pending {
+	struct le le;
+	struct tmr tmr;
+	struct sip_server *srv;
+	struct sip_msg *msg;
+};
+
+
+static void pending_destructor(void *arg)
+{
+	struct pending *pend = arg;
+
+	list_unlink(&pend->le);
+	tmr_cancel(&pend->tmr);
+	mem_deref(pend->msg);
+}
+
+
+static void pending_handler(void *arg)
+{
+	struct pending *pend = arg;
+	struct sip_server *srv = pend->srv;
+
+	--srv->n_pending;
+
+	if (!handle_register(srv, pend->msg))
+		sip_reply(srv->sip, pend->msg, 503, "Server Error");
+
+	mem_deref(pend);
+}
+
+
+/* Reply to the REGISTER request later, to keep it in progress */
+static int register_delay(struct sip_server *srv, const struct sip_msg *msg)
+{
+	struct pending *pend;
+
+	pend = mem_zalloc(sizeof(*pend), pending_destructor);
+	if (!pend)
+		return ENOMEM;
+
+	pend->srv = srv;
+	pend->msg = mem_ref((struct sip_msg *)msg);
+
+	list_append(&srv->pendl, &pend->le, pend);
+	tmr_start(&pend->tmr, srv->reply_delay, pending_handler, pend);
+
+	++srv->n_pending;
+	srv->max_pending = max(srv->max_pending, srv->n_pending);
+
+	return 0;
+}
+
+
 static bool sip_msg_handler(const struct sip_msg *msg, void *arg)
 {
 	struct sip_server *srv = arg;
@@ -197,6 +251,15 @@ static bool sip_msg_handler(const struct sip_msg *msg, void *arg)
 
 	if (0 == pl_strcmp(&msg->met, "REGISTER")) {
 		++srv->n_register_req;
+
+		srv->ts_register_last = tmr_jiffies();
+		if (!srv->ts_register_first)
+			srv->ts_register_first = srv->ts_register_last;
+
+		if (srv->reply_delay && !srv->terminate &&
+		    !register_delay(srv, msg))
+			goto out;
+
 		if (handle_register(srv, msg))
 			goto out;
 
@@ -231,6 +294,8 @@ static void destructor(void *arg)
 
 	srv->terminate = true;
 
+	list_flush(&srv->pendl);
+
 	sip_close(srv->sip, false);
 	mem_deref(srv->sip);
 
@@ -22,6 +22,13 @@ struct sip_server {
 	unsigned n_register_req;
 	enum sip_transp tp_last;
 
+	uint32_t reply_delay;       /* delay of REGISTER replies [ms] */
+	struct list pendl;          /* delayed REGISTER requests      */
+	unsigned n_pending;
+	unsigned max_pending;
+	uint64_t ts_register_first;
+	uint64_t ts_register_last;
+
 	uint64_t secret;
 	struct hash *ht_dom;
 	struct hash *ht_aor;
@@ -0,0 +1,252 @@
+/**
+ * @file test/sndfile.c  Baresip selftest -- sndfile recording engine
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sndfile.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../modules/sndfile/sndfile.h"
+#include "test.h"
+
+
+enum {
+	SRATE = 8000,
+	FRAME = 160,       /* 20 ms */
+	TICKS = 50,
+	TS0   = 1000000,   /* time of the first frame [us] */
+	ENC_SAMP = 1000,
+	DEC_SAMP = 2000,
+};
+
+
+/* The remote side starts late, and pauses for 200 ms */
+static bool dec_active(unsigned tick)
+{
+	return (tick >= 10 && tick < 20) || tick >= 30;
+}
+
+
+static int rec_run(const char *dir, bool stereo)
+{
+	struct aufilt_prm prm = {SRATE, 1, 20, AUFMT_S16LE};
+	struct rec_conf conf;
+	struct rec *rec = NULL;
+	int16_t enc[FRAME], dec[FRAME];
+	unsigned i;
+	int err;
+
+	memset(&conf, 0, sizeof(conf));
+	str_ncpy(conf.path, dir, sizeof(conf.path));
+	conf.format    = REC_WAV;
+	conf.stereo    = stereo;
+	conf.autostart = true;
+	conf.writers   = 1;
+
+	for (i=0; i<FRAME; i++) {
+		enc[i] = ENC_SAMP;
+		dec[i] = DEC_SAMP;
+	}
+
+	err = rec_engine_init(&conf);
+	if (err)
+		return err;
+
+	err = rec_alloc(&rec, NULL);
+	if (err)
+		goto out;
+
+	err  = rec_dir_init(rec, REC_ENC, &prm);
+	err |= rec_dir_init(rec, REC_DEC, &prm);
+	if (err)
+		goto out;
+
+	/* the writer thread runs while the frames are pushed */
+	for (i=0; i<TICKS; i++) {
+
+		uint64_t ts = TS0 + (i + 1) * 20000;
+
+		rec_push(rec, REC_ENC, enc, FRAME, ts);
+
+		if (dec_active(i))
+			rec_push(rec, REC_DEC, dec, FRAME, ts);
+	}
+
+ out:
+	/* the rest is written when the recording is closed */
+	mem_deref(rec);
+	rec_engine_close();
+
+	return err;
+}
+
+
+/* Open the recorded file with the given name */
+static int dump_open(SNDFILE **sfp, SF_INFO *info, const char *dir,
+		     const char *name)
+{
+	struct dirent *ent;
+	char suffix[32];
+	char path[512];
+	DIR *d;
+	int err = ENOENT;
+
+	re_snprintf(suffix, sizeof(suffix), "-%s.wav", name);
+
+	d = opendir(dir);
+	if (!d)
+		return errno;
+
+	while ((ent = readdir(d))) {
+
+		size_t len = strlen(ent->d_name);
+
+		if (len < strlen(suffix) ||
+		    strcmp(ent->d_name + len - strlen(suffix), suffix))
+			continue;
+
+		re_snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+
+		memset(info, 0, sizeof(*info));
+		*sfp = sf_open(path, SFM_READ, info);
+		err = *sfp ? 0 : EIO;
+		break;
+	}
+
+	(void)closedir(d);
+
+	return err;
+}
+
+
+static void dump_remove(const char *dir)
+{
+	struct dirent *ent;
+	char path[512];
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((ent = readdir(d))) {
+
+		if (strncmp(ent->d_name, "dump-", 5))
+			continue;
+
+		re_snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		(void)remove(path);
+	}
+
+	(void)closedir(d);
+	(void)remove(dir);
+}
+
+
+/* Both directions are aligned in one file, with silence in the gaps */
+int test_sndfile_stereo(void)
+{
+	int16_t sampv[2 * FRAME];
+	SNDFILE *sf = NULL;
+	SF_INFO info;
+	char dir[256];
+	unsigned i, j;
+	int err;
+
+	re_snprintf(dir, sizeof(dir), "%s/baresip_test_sndfile",
+		    test_tmpdir());
+
+	dump_remove(dir);
+
+	err = fs_mkdir(dir, 0700);
+	TEST_ERR(err);
+
+	err = rec_run(dir, true);
+	TEST_ERR(err);
+
+	err = dump_open(&sf, &info, dir, "call");
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, info.channels);
+	ASSERT_EQ(SRATE, info.samplerate);
+	ASSERT_EQ(TICKS * FRAME, info.frames);
+
+	for (i=0; i<TICKS; i++) {
+
+		ASSERT_EQ(FRAME, sf_readf_short(sf, sampv, FRAME));
+
+		for (j=0; j<FRAME; j++) {
+			ASSERT_EQ(ENC_SAMP, sampv[2*j]);
+			ASSERT_EQ(dec_active(i) ? DEC_SAMP : 0,
+				  sampv[2*j + 1]);
+		}
+	}
+
+ out:
+	if (sf)
+		sf_close(sf);
+
+	dump_remove(dir);
+
+	return err;
+}
+
+
+/* Each direction has its own file, on the same timeline */
+int test_sndfile_mono(void)
+{
+	int16_t sampv[FRAME];
+	SNDFILE *sf = NULL;
+	SF_INFO info;
+	char dir[256];
+	unsigned i, j;
+	int err;
+
+	re_snprintf(dir, sizeof(dir), "%s/baresip_test_sndfile",
+		    test_tmpdir());
+
+	dump_remove(dir);
+
+	err = fs_mkdir(dir, 0700);
+	TEST_ERR(err);
+
+	err = rec_run(dir, false);
+	TEST_ERR(err);
+
+	err = dump_open(&sf, &info, dir, "enc");
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, info.channels);
+	ASSERT_EQ(TICKS * FRAME, info.frames);
+
+	sf_close(sf);
+	sf = NULL;
+
+	err = dump_open(&sf, &info, dir, "dec");
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, info.channels);
+	ASSERT_EQ(TICKS * FRAME, info.frames);
+
+	for (i=0; i<TICKS; i++) {
+
+		ASSERT_EQ(FRAME, sf_readf_short(sf, sampv, FRAME));
+
+		for (j=0; j<FRAME; j++) {
+			ASSERT_EQ(dec_active(i) ? DEC_SAMP : 0,
+				  sampv[j]);
+		}
+	}
+
+ out:
+	if (sf)
+		sf_close(sf);
+
+	dump_remove(dir);
+
+	return err;
+}
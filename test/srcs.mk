@@ -10,15 +10,31 @@
 #
 TEST_SRCS	+= account.c
 TEST_SRCS	+= aulevel.c
+TEST_SRCS	+= aufile.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
+TEST_SRCS	+= conf.c
 TEST_SRCS	+= contact.c
 TEST_SRCS	+= cplusplus.c
+TEST_SRCS	+= ctrl_tcp.c
+TEST_SRCS	+= evbatch.c
 TEST_SRCS	+= event.c
+TEST_SRCS	+= fec.c
+TEST_SRCS	+= httpd.c
+TEST_SRCS	+= lathist.c
+TEST_SRCS	+= log.c
 TEST_SRCS	+= message.c
+TEST_SRCS	+= module.c
 TEST_SRCS	+= mos.c
 TEST_SRCS	+= net.c
 TEST_SRCS	+= play.c
+TEST_SRCS	+= rtprec.c
+ifneq ($(USE_SNDFILE),)
+TEST_SRCS	+= sndfile.c
+endif
+ifneq ($(USE_OPENSSL),)
+TEST_SRCS	+= srtp.c
+endif
 TEST_SRCS	+= ua.c
 ifneq ($(USE_VIDEO),)
 TEST_SRCS	+= video.c
@@ -51,6 +67,21 @@ TEST_SRCS	+= mock/mock_vidcodec.c
 TEST_SRCS	+= mock/mock_vidisp.c
 endif
 
+#
+# Modules, built into the selftest
+#
+TEST_MOD_SRCS	+= aufile/prompt.c
+TEST_MOD_SRCS	+= ctrl_tcp/ctrl_tcp.c
+TEST_MOD_SRCS	+= ctrl_tcp/tcp_netstring.c
+TEST_MOD_SRCS	+= ctrl_tcp/netstring/netstring.c
+TEST_MOD_SRCS	+= httpd/httpd.c
+TEST_MOD_SRCS	+= httpd/metrics.c
+ifneq ($(USE_SNDFILE),)
+TEST_MOD_SRCS	+= sndfile/rec.c
+TEST_MOD_LFLAGS	+= -lsndfile
+endif
+
+
 TEST_SRCS	+= test.c
 
 TEST_SRCS	+= main.c
@@ -0,0 +1,398 @@
+/**
+ * @file test/srtp.c  Baresip selftest -- SRTP fast path
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SSRC          = 0xdeadbeef,
+	PAYLOAD_SIZE  = 160,
+	BATCH_SIZE    = 16,
+	BENCH_PACKETS = 20000,
+	MAX_SSRC      = 64,
+};
+
+
+static const struct {
+	enum srtp_suite suite;
+	const char *name;
+	size_t key_len;
+} suitev[] = {
+	{SRTP_AES_CM_128_HMAC_SHA1_80, "AES_CM_128_HMAC_SHA1_80", 16+14},
+	{SRTP_AES_CM_128_HMAC_SHA1_32, "AES_CM_128_HMAC_SHA1_32", 16+14},
+	{SRTP_AES_128_GCM,             "AEAD_AES_128_GCM",        16+12},
+};
+
+/* master key and salt, from RFC 3711 appendix B.3 */
+static const uint8_t master_key[30] = {
+	0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+	0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+	0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+	0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+
+static int rtp_packet(struct mbuf *mb, uint16_t seq)
+{
+	size_t i;
+	int err;
+
+	mbuf_rewind(mb);
+
+	err  = mbuf_write_u8(mb, 0x80);
+	err |= mbuf_write_u8(mb, 0x00);
+	err |= mbuf_write_u16(mb, htons(seq));
+	err |= mbuf_write_u32(mb, htonl(seq * 160));
+	err |= mbuf_write_u32(mb, htonl(SSRC));
+
+	for (i=0; i<PAYLOAD_SIZE; i++)
+		err |= mbuf_write_u8(mb, (uint8_t)(i + seq));
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static int rtcp_packet(struct mbuf *mb)
+{
+	size_t i;
+	int err;
+
+	mbuf_rewind(mb);
+
+	err  = mbuf_write_u8(mb, 0x80);
+	err |= mbuf_write_u8(mb, 200);
+	err |= mbuf_write_u16(mb, htons(6));
+	err |= mbuf_write_u32(mb, htonl(SSRC));
+
+	for (i=0; i<20; i++)
+		err |= mbuf_write_u8(mb, (uint8_t)i);
+
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static bool mbuf_equal(const struct mbuf *a, const struct mbuf *b)
+{
+	return mbuf_get_left(a) == mbuf_get_left(b) &&
+		0 == memcmp(mbuf_buf(a), mbuf_buf(b), mbuf_get_left(a));
+}
+
+
+static int test_suite(enum srtp_suite suite, size_t key_len)
+{
+	static const uint16_t seqv[] = {65534, 65535, 0, 1};
+	struct srtpfast *fast_tx = NULL, *fast_rx = NULL;
+	struct srtp *re_tx = NULL, *re_rx = NULL;
+	struct mbuf *mb = mbuf_alloc(256);
+	struct mbuf *ref = mbuf_alloc(256);
+	struct mbuf *mbv[BATCH_SIZE];
+	int errv[BATCH_SIZE];
+	size_t i;
+	int err;
+
+	memset(mbv, 0, sizeof(mbv));
+
+	if (!mb || !ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = srtpfast_alloc(&fast_tx, suite, master_key, key_len);
+	err |= srtpfast_alloc(&fast_rx, suite, master_key, key_len);
+	err |= srtp_alloc(&re_tx, suite, master_key, key_len, 0);
+	err |= srtp_alloc(&re_rx, suite, master_key, key_len, 0);
+	TEST_ERR(err);
+
+	ASSERT_STREQ("evp", srtpfast_backend(fast_tx));
+
+	/* both ways with libre, across a wrap of the sequence number */
+	for (i=0; i<ARRAY_SIZE(seqv); i++) {
+
+		err  = rtp_packet(ref, seqv[i]);
+		err |= rtp_packet(mb, seqv[i]);
+		TEST_ERR(err);
+
+		err = srtpfast_encrypt(fast_tx, mb);
+		TEST_ERR(err);
+		ASSERT_TRUE(!mbuf_equal(ref, mb));
+
+		err = srtp_decrypt(re_rx, mb);
+		TEST_ERR(err);
+		ASSERT_TRUE(mbuf_equal(ref, mb));
+
+		err = rtp_packet(mb, seqv[i]);
+		TEST_ERR(err);
+
+		err = srtp_encrypt(re_tx, mb);
+		TEST_ERR(err);
+
+		err = srtpfast_decrypt(fast_rx, mb);
+		TEST_ERR(err);
+		ASSERT_TRUE(mbuf_equal(ref, mb));
+	}
+
+	/* a replayed packet */
+	err = rtp_packet(mb, 1);
+	TEST_ERR(err);
+	err = srtp_encrypt(re_tx, mb);
+	TEST_ERR(err);
+	ASSERT_EQ(EALREADY, srtpfast_decrypt(fast_rx, mb));
+
+	/* a modified packet */
+	err = rtp_packet(mb, 2);
+	TEST_ERR(err);
+	err = srtpfast_encrypt(fast_tx, mb);
+	TEST_ERR(err);
+	mb->buf[20] ^= 0x01;
+	ASSERT_EQ(EAUTH, srtpfast_decrypt(fast_rx, mb));
+
+	/* RTCP */
+	for (i=0; i<2; i++) {
+
+		err  = rtcp_packet(ref);
+		err |= rtcp_packet(mb);
+		TEST_ERR(err);
+
+		err = srtcpfast_encrypt(fast_tx, mb);
+		TEST_ERR(err);
+
+		err = srtcp_decrypt(re_rx, mb);
+		TEST_ERR(err);
+		ASSERT_TRUE(mbuf_equal(ref, mb));
+
+		err = rtcp_packet(mb);
+		TEST_ERR(err);
+
+		err = srtcp_encrypt(re_tx, mb);
+		TEST_ERR(err);
+
+		err = srtcpfast_decrypt(fast_rx, mb);
+		TEST_ERR(err);
+		ASSERT_TRUE(mbuf_equal(ref, mb));
+	}
+
+	/* a batch */
+	for (i=0; i<BATCH_SIZE; i++) {
+
+		mbv[i] = mbuf_alloc(256);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = rtp_packet(mbv[i], (uint16_t)(10 + i));
+		TEST_ERR(err);
+	}
+
+	ASSERT_EQ(BATCH_SIZE, srtpfast_encrypt_batch(fast_tx, mbv, errv,
+						     BATCH_SIZE));
+	ASSERT_EQ(BATCH_SIZE, srtpfast_decrypt_batch(fast_rx, mbv, errv,
+						     BATCH_SIZE));
+
+	for (i=0; i<BATCH_SIZE; i++) {
+
+		ASSERT_EQ(0, errv[i]);
+
+		err = rtp_packet(ref, (uint16_t)(10 + i));
+		TEST_ERR(err);
+		ASSERT_TRUE(mbuf_equal(ref, mbv[i]));
+	}
+
+ out:
+	for (i=0; i<ARRAY_SIZE(mbv); i++)
+		mem_deref(mbv[i]);
+	mem_deref(fast_tx);
+	mem_deref(fast_rx);
+	mem_deref(re_tx);
+	mem_deref(re_rx);
+	mem_deref(mb);
+	mem_deref(ref);
+
+	return err;
+}
+
+
+static void set_ssrc(struct mbuf *mb, size_t pos, uint32_t ssrc)
+{
+	ssrc = htonl(ssrc);
+	memcpy(mb->buf + pos, &ssrc, 4);
+}
+
+
+/* A new SSRC over the limit is rejected, and is not decrypted */
+static int test_overflow(enum srtp_suite suite, size_t key_len)
+{
+	struct srtpfast *tx = NULL, *tx2 = NULL, *rx = NULL;
+	struct mbuf *mb = mbuf_alloc(256);
+	struct mbuf *ref = mbuf_alloc(256);
+	uint32_t i;
+	int err;
+
+	if (!mb || !ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = srtpfast_alloc(&tx, suite, master_key, key_len);
+	err |= srtpfast_alloc(&tx2, suite, master_key, key_len);
+	err |= srtpfast_alloc(&rx, suite, master_key, key_len);
+	TEST_ERR(err);
+
+	for (i=0; i<MAX_SSRC; i++) {
+
+		err = rtp_packet(mb, 1);
+		TEST_ERR(err);
+		set_ssrc(mb, 8, i + 1);
+
+		err  = srtpfast_encrypt(tx, mb);
+		err |= srtpfast_decrypt(rx, mb);
+		TEST_ERR(err);
+	}
+
+	err = rtp_packet(mb, 1);
+	TEST_ERR(err);
+	set_ssrc(mb, 8, SSRC);
+
+	err = srtpfast_encrypt(tx2, mb);
+	TEST_ERR(err);
+
+	err = mbuf_write_mem(ref, mbuf_buf(mb), mbuf_get_left(mb));
+	TEST_ERR(err);
+	ref->pos = 0;
+
+	ASSERT_EQ(EOVERFLOW, srtpfast_decrypt(rx, mb));
+	ASSERT_TRUE(mbuf_equal(ref, mb));
+
+	/* the same for RTCP */
+	err = rtcp_packet(mb);
+	TEST_ERR(err);
+
+	err = srtcpfast_encrypt(tx2, mb);
+	TEST_ERR(err);
+
+	mbuf_rewind(ref);
+	err = mbuf_write_mem(ref, mbuf_buf(mb), mbuf_get_left(mb));
+	TEST_ERR(err);
+	ref->pos = 0;
+
+	ASSERT_EQ(EOVERFLOW, srtcpfast_decrypt(rx, mb));
+	ASSERT_TRUE(mbuf_equal(ref, mb));
+
+ out:
+	mem_deref(tx);
+	mem_deref(tx2);
+	mem_deref(rx);
+	mem_deref(mb);
+	mem_deref(ref);
+
+	return err;
+}
+
+
+int test_srtpfast(void)
+{
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(suitev); i++) {
+
+		err  = test_suite(suitev[i].suite, suitev[i].key_len);
+		err |= test_overflow(suitev[i].suite, suitev[i].key_len);
+		if (err) {
+			warning("srtp: %s failed (%m)\n", suitev[i].name, err);
+			break;
+		}
+	}
+
+	return err;
+}
+
+
+/* Encrypt and decrypt BENCH_PACKETS packets, with libre or the fast path */
+static int bench(uint64_t *usec, enum srtp_suite suite, size_t key_len,
+		 bool fast)
+{
+	struct srtpfast *fast_tx = NULL, *fast_rx = NULL;
+	struct srtp *re_tx = NULL, *re_rx = NULL;
+	struct mbuf *mb = mbuf_alloc(256);
+	uint64_t t0;
+	uint32_t n;
+	int err;
+
+	if (!mb)
+		return ENOMEM;
+
+	if (fast) {
+		err  = srtpfast_alloc(&fast_tx, suite, master_key, key_len);
+		err |= srtpfast_alloc(&fast_rx, suite, master_key, key_len);
+	}
+	else {
+		err  = srtp_alloc(&re_tx, suite, master_key, key_len, 0);
+		err |= srtp_alloc(&re_rx, suite, master_key, key_len, 0);
+	}
+	if (err)
+		goto out;
+
+	t0 = tmr_jiffies_usec();
+
+	for (n=0; n<BENCH_PACKETS && !err; n++) {
+
+		err = rtp_packet(mb, (uint16_t)n);
+		if (err)
+			break;
+
+		if (fast) {
+			err  = srtpfast_encrypt(fast_tx, mb);
+			err |= srtpfast_decrypt(fast_rx, mb);
+		}
+		else {
+			err  = srtp_encrypt(re_tx, mb);
+			err |= srtp_decrypt(re_rx, mb);
+		}
+	}
+
+	*usec = tmr_jiffies_usec() - t0;
+
+ out:
+	mem_deref(fast_tx);
+	mem_deref(fast_rx);
+	mem_deref(re_tx);
+	mem_deref(re_rx);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int test_srtpfast_bench(void)
+{
+	uint64_t t_re, t_fast;
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(suitev); i++) {
+
+		err  = bench(&t_re, suitev[i].suite, suitev[i].key_len,
+			     false);
+		err |= bench(&t_fast, suitev[i].suite, suitev[i].key_len,
+			     true);
+		TEST_ERR(err);
+
+		info("srtp: %-24s %u packets of %u bytes:"
+		     " libre %llu us, fast %llu us\n",
+		     suitev[i].name, BENCH_PACKETS, PAYLOAD_SIZE,
+		     t_re, t_fast);
+	}
+
+ out:
+	return err;
+}
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <math.h>
 #include <re.h>
 #include <baresip.h>
@@ -38,6 +39,30 @@ int re_main_timeout(uint32_t timeout_ms)
 }
 
 
+/**
+ * Get the directory for temporary test files, from TMPDIR or the
+ * system default
+ *
+ * @return Directory path, without a trailing separator
+ */
+const char *test_tmpdir(void)
+{
+	const char *dir = getenv("TMPDIR");
+
+#ifdef WIN32
+	if (!str_isset(dir))
+		dir = getenv("TEMP");
+	if (!str_isset(dir))
+		dir = ".";
+#else
+	if (!str_isset(dir))
+		dir = "/tmp";
+#endif
+
+	return dir;
+}
+
+
 bool test_cmp_double(double a, double b, double precision)
 {
 	return fabs(a - b) < precision;
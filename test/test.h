@@ -92,6 +92,7 @@
 /* helpers */
 
 int re_main_timeout(uint32_t timeout_ms);
+const char *test_tmpdir(void);
 bool test_cmp_double(double a, double b, double precision);
 void test_hexdump_dual(FILE *f,
 		       const void *ep, size_t elen,
@@ -172,6 +173,7 @@ int mock_vidsrc_register(struct vidsrc **vidsrcp);
 
 void mock_vidcodec_register(void);
 void mock_vidcodec_unregister(void);
+uint32_t mock_vidcodec_bitrate(void);
 
 
 /*
@@ -192,21 +194,53 @@ int mock_vidisp_register(struct vidisp **vidispp,
 
 int test_account(void);
 int test_aulevel(void);
+int test_aufile_cache(void);
+int test_aufile_encode(void);
 int test_cmd(void);
 int test_cmd_long(void);
+int test_cmd_complete(void);
+int test_cmd_bench(void);
+int test_ctrl_tcp(void);
+int test_evbatch(void);
 int test_event(void);
+int test_event_bus(void);
+int test_event_bus_aor(void);
+int test_event_json(void);
+int test_fec(void);
+int test_fec_mask(void);
+int test_fec_unrecoverable(void);
+int test_httpd_metrics(void);
+int test_lathist(void);
+int test_log(void);
 int test_contact(void);
+int test_conf_index(void);
 int test_ua_alloc(void);
+int test_uag_find(void);
 int test_uag_find_param(void);
 int test_ua_register(void);
 int test_ua_register_dns(void);
 int test_ua_register_auth(void);
 int test_ua_register_auth_dns(void);
+int test_ua_register_sched(void);
 int test_ua_options(void);
 int test_message(void);
+int test_module_lazy(void);
 int test_mos(void);
+int test_mos_emodel(void);
 int test_network(void);
 int test_play(void);
+int test_play_file(void);
+int test_quality(void);
+int test_rtpmix(void);
+int test_rtprec(void);
+#ifdef USE_SNDFILE
+int test_sndfile_mono(void);
+int test_sndfile_stereo(void);
+#endif
+#ifdef USE_OPENSSL
+int test_srtpfast(void);
+int test_srtpfast_bench(void);
+#endif
 
 int test_call_answer(void);
 int test_call_reject(void);
@@ -218,6 +252,7 @@ int test_call_multiple(void);
 int test_call_max(void);
 int test_call_dtmf(void);
 int test_call_video(void);
+int test_call_video_fec(void);
 int test_call_aulevel(void);
 int test_call_progress(void);
 int test_call_format_float(void);
@@ -228,6 +263,8 @@ int test_call_transfer(void);
 
 #ifdef USE_VIDEO
 int test_video(void);
+int test_video_bwe(void);
+int test_vidpool(void);
 #endif
 
 
@@ -209,6 +209,169 @@ int test_ua_alloc(void)
 }
 
 
+static int uav_alloc(struct ua ***uavp, unsigned n)
+{
+	struct ua **uav;
+	char buf[64];
+	unsigned i;
+	int err = 0;
+
+	uav = mem_zalloc(n * sizeof(*uav), NULL);
+	if (!uav)
+		return ENOMEM;
+
+	for (i=0; i<n; i++) {
+
+		re_snprintf(buf, sizeof(buf),
+			    "<sip:user%u@127.0.0.1>;regint=0;idx=%u", i, i);
+
+		err = ua_alloc(&uav[i], buf);
+		if (err)
+			break;
+	}
+
+	*uavp = uav;
+
+	return err;
+}
+
+
+static void uav_free(struct ua **uav, unsigned n)
+{
+	unsigned i;
+
+	if (!uav)
+		return;
+
+	for (i=0; i<n; i++)
+		mem_deref(uav[i]);
+	mem_deref(uav);
+}
+
+
+/* The same number of lookups, for a growing number of UAs */
+static int uag_find_bench(unsigned n)
+{
+	enum { LOOKUPS = 400000 };
+	struct ua **uav = NULL;
+	struct pl pl;
+	uint64_t t0, t1;
+	unsigned i;
+	int err;
+
+	err = uav_alloc(&uav, n);
+	TEST_ERR(err);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<LOOKUPS/4; i++) {
+
+		const unsigned idx = (i * 7919) % n;
+		struct ua *ua = uav[idx];
+		char val[16];
+
+		pl_set_str(&pl, ua_local_cuser(ua));
+		ASSERT_TRUE(ua == uag_find(&pl));
+
+		pl = account_laddr(ua_account(ua))->uri.user;
+		ASSERT_TRUE(ua == uag_find(&pl));
+
+		ASSERT_TRUE(ua == uag_find_aor(ua_aor(ua)));
+
+		re_snprintf(val, sizeof(val), "%u", idx);
+		ASSERT_TRUE(ua == uag_find_param("idx", val));
+	}
+
+	t1 = tmr_jiffies();
+
+	info("ua: %6u UAs, %u lookups in %llu ms\n",
+	     n, LOOKUPS, t1 - t0);
+
+ out:
+	uav_free(uav, n);
+
+	return err;
+}
+
+
+int test_uag_find(void)
+{
+	enum { N_UA = 1000 };
+	static const unsigned benchv[] = {1000, 10000, 20000};
+	struct ua **uav = NULL;
+	struct ua *ua_dup = NULL;
+	struct pl pl;
+	unsigned i;
+	int err = 0;
+
+	err = uav_alloc(&uav, N_UA);
+	TEST_ERR(err);
+
+	/* the first UA wins on duplicate keys */
+	err = ua_alloc(&ua_dup, "<sip:user7@127.0.0.1>;regint=0;idx=7");
+	TEST_ERR(err);
+
+	pl_set_str(&pl, "USER7");
+	ASSERT_TRUE(uav[7] == uag_find(&pl));
+	ASSERT_TRUE(uav[7] == uag_find_aor("sip:user7@127.0.0.1"));
+	ASSERT_TRUE(uav[7] == uag_find_param("idx", "7"));
+	ASSERT_TRUE(uav[0] == uag_find_param("idx", NULL));
+
+	pl_set_str(&pl, "nobody");
+	ASSERT_TRUE(NULL == uag_find(&pl));
+	ASSERT_TRUE(NULL == uag_find_param("idx", "nobody"));
+
+	/* the keys are removed with the UA */
+	ua_dup = mem_deref(ua_dup);
+	ASSERT_TRUE(uav[7] == uag_find_aor("sip:user7@127.0.0.1"));
+
+	ua_set_catchall(uav[N_UA-1], true);
+	ua_set_catchall(uav[N_UA-2], true);
+	ASSERT_TRUE(uav[N_UA-2] == uag_find(&pl));
+	ua_set_catchall(uav[N_UA-2], false);
+	ASSERT_TRUE(uav[N_UA-1] == uag_find(&pl));
+	ua_set_catchall(uav[N_UA-1], false);
+	ASSERT_TRUE(NULL == uag_find(&pl));
+
+	/* the keys are kept when the account is updated */
+	err = ua_update_account(uav[3]);
+	TEST_ERR(err);
+
+	for (i=0; i<N_UA; i++) {
+
+		struct ua *ua = uav[i];
+		char val[16];
+
+		pl_set_str(&pl, ua_local_cuser(ua));
+		ASSERT_TRUE(ua == uag_find(&pl));
+
+		pl = account_laddr(ua_account(ua))->uri.user;
+		ASSERT_TRUE(ua == uag_find(&pl));
+
+		ASSERT_TRUE(ua == uag_find_aor(ua_aor(ua)));
+
+		re_snprintf(val, sizeof(val), "%u", i);
+		ASSERT_TRUE(ua == uag_find_param("idx", val));
+	}
+
+	uav_free(uav, N_UA);
+	uav = NULL;
+
+	/* the lookup time does not grow with the number of UAs */
+	for (i=0; i<ARRAY_SIZE(benchv); i++) {
+
+		err = uag_find_bench(benchv[i]);
+		TEST_ERR(err);
+	}
+
+ out:
+	mem_deref(ua_dup);
+	uav_free(uav, N_UA);
+
+	return err;
+}
+
+
 int test_uag_find_param(void)
 {
 	struct ua *ua1 = NULL, *ua2 = NULL;
@@ -649,6 +812,153 @@ int test_ua_register_auth_dns(void)
 }
 
 
+enum {
+	SCHED_UAS = 5,
+};
+
+struct sched_test {
+	struct sip_server *srv;
+	struct ua *uav[SCHED_UAS];
+	unsigned n_ok;
+	int err;
+};
+
+
+static void sched_event_handler(struct ua *ua, enum ua_event ev,
+				struct call *call, const char *prm, void *arg)
+{
+	struct sched_test *st = arg;
+	(void)ua;
+	(void)call;
+	(void)prm;
+
+	if (ev == UA_EVENT_REGISTER_OK) {
+		if (++st->n_ok == SCHED_UAS)
+			re_cancel();
+	}
+	else if (ev == UA_EVENT_REGISTER_FAIL) {
+		st->err = EAUTH;
+		re_cancel();
+	}
+}
+
+
+/* Register SCHED_UAS accounts with the registration scheduler */
+static int reg_sched(struct sched_test *st, uint32_t rate,
+		     uint32_t inflight, uint32_t window, uint32_t delay)
+{
+	struct config_sip *cfg = &conf_config()->sip;
+	struct sa laddr;
+	unsigned i;
+	int err;
+
+	memset(st, 0, sizeof(*st));
+
+	cfg->reg_rate     = rate;
+	cfg->reg_inflight = inflight;
+	cfg->reg_window   = window;
+
+	err = sip_server_alloc(&st->srv, sip_server_exit_handler, NULL);
+	TEST_ERR(err);
+
+	st->srv->reply_delay = delay;
+
+	err = sip_transp_laddr(st->srv->sip, &laddr, SIP_TRANSP_UDP, NULL);
+	TEST_ERR(err);
+
+	err = uag_event_register(sched_event_handler, st);
+	TEST_ERR(err);
+
+	for (i=0; i<SCHED_UAS; i++) {
+		char aor[256];
+
+		if (re_snprintf(aor, sizeof(aor), "<sip:sched%u@%J>",
+				i, &laddr) < 0) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = ua_alloc(&st->uav[i], aor);
+		TEST_ERR(err);
+
+		err = ua_register(st->uav[i]);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(st->err);
+
+	ASSERT_EQ(SCHED_UAS, st->n_ok);
+	ASSERT_EQ(SCHED_UAS, st->srv->n_register_req);
+
+ out:
+	uag_event_unregister(sched_event_handler);
+
+	cfg->reg_rate     = 0;
+	cfg->reg_inflight = 0;
+	cfg->reg_window   = 0;
+
+	return err;
+}
+
+
+static void sched_test_reset(struct sched_test *st)
+{
+	unsigned i;
+
+	for (i=0; i<SCHED_UAS; i++)
+		mem_deref(st->uav[i]);
+	mem_deref(st->srv);
+
+	memset(st, 0, sizeof(*st));
+}
+
+
+int test_ua_register_sched(void)
+{
+	struct sched_test st;
+	uint64_t duration;
+	int err;
+
+	memset(&st, 0, sizeof(st));
+
+	err = ua_init("test", true, true, true, false);
+	TEST_ERR(err);
+
+	/* rate: 10 requests per second, one at a time */
+	err = reg_sched(&st, 10, 0, 0, 0);
+	TEST_ERR(err);
+
+	duration = st.srv->ts_register_last - st.srv->ts_register_first;
+	ASSERT_TRUE(duration >= (SCHED_UAS - 1) * 100 - 50);
+	sched_test_reset(&st);
+
+	/* in-flight: the next request waits for a reply */
+	err = reg_sched(&st, 0, 2, 0, 100);
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, st.srv->max_pending);
+	duration = st.srv->ts_register_last - st.srv->ts_register_first;
+	ASSERT_TRUE(duration >= (SCHED_UAS - 1) / 2 * 100 - 50);
+	sched_test_reset(&st);
+
+	/* window: the requests are spread over one second */
+	err = reg_sched(&st, 0, 0, 1, 0);
+	TEST_ERR(err);
+
+	duration = st.srv->ts_register_last - st.srv->ts_register_first;
+	ASSERT_TRUE(duration > 0);
+	ASSERT_TRUE(duration < 1000);
+
+ out:
+	sched_test_reset(&st);
+	ua_close();
+
+	return err;
+}
+
+
 static void options_resp_handler(int err, const struct sip_msg *msg, void *arg)
 {
 	struct test *t = arg;
@@ -4,7 +4,9 @@
  * Copyright (C) 2010 - 2017 Creytiv.com
  */
 
+#include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -31,3 +33,122 @@ int test_video(void)
  out:
 	return err;
 }
+
+
+int test_video_bwe(void)
+{
+	const uint32_t max = 1000000;
+	uint32_t rate;
+	int err = 0;
+
+	/* no loss, step up but not above the maximum */
+	ASSERT_EQ(540000, video_bwe_calc(500000, max, 0, 0));
+	ASSERT_EQ(max,    video_bwe_calc(max, max, 0, 0));
+
+	/* moderate loss, hold */
+	ASSERT_EQ(500000, video_bwe_calc(500000, max, 5, 0));
+
+	/* high loss, step down in proportion */
+	ASSERT_EQ(400000, video_bwe_calc(500000, max, 40, 0));
+
+	/* never below the minimum */
+	ASSERT_EQ(100000, video_bwe_calc(100000, max, 90, 0));
+
+	/* capped by the peer estimate */
+	ASSERT_EQ(300000, video_bwe_calc(500000, max, 0, 300000));
+	ASSERT_EQ(300000, video_bwe_calc(500000, max, 5, 300000));
+
+	/* converges to the maximum without loss */
+	rate = 100000;
+	while (rate < max) {
+		uint32_t next = video_bwe_calc(rate, max, 0, 0);
+
+		ASSERT_TRUE(next > rate);
+		rate = next;
+	}
+	ASSERT_EQ(max, rate);
+
+ out:
+	return err;
+}
+
+
+int test_vidpool(void)
+{
+	struct vidpool *pool = NULL;
+	struct vidframe *f1 = NULL, *f2 = NULL, *f3 = NULL, *f4 = NULL;
+	struct vidpool_stats stats;
+	struct vidsz sz = {320, 240};
+	struct vidsz sz2 = {160, 120};
+	uint8_t *data;
+	int err;
+
+	err = vidpool_alloc(&pool, 2);
+	TEST_ERR(err);
+
+	err = vidpool_get(pool, &f1, VID_FMT_YUV420P, &sz);
+	TEST_ERR(err);
+	ASSERT_TRUE(vidframe_isvalid(f1));
+	ASSERT_TRUE(vidsz_cmp(&sz, &f1->size));
+
+	/* a released frame is reused */
+	data = f1->data[0];
+	f1 = mem_deref(f1);
+	err = vidpool_get(pool, &f1, VID_FMT_YUV420P, &sz);
+	TEST_ERR(err);
+	ASSERT_TRUE(f1->data[0] == data);
+
+	/* a reference to the frame keeps it in use */
+	f2 = mem_ref(f1);
+	err = vidpool_stats(pool, &stats);
+	TEST_ERR(err);
+	ASSERT_EQ(1, stats.n_busy);
+	f2 = mem_deref(f2);
+	err = vidpool_stats(pool, &stats);
+	TEST_ERR(err);
+	ASSERT_EQ(1, stats.n_busy);
+
+	/* a frame in use is not reused, the copy shares nothing */
+	vidframe_fill(f1, 255, 0, 0);
+	f2 = NULL;
+	err = vidpool_copy(pool, &f2, f1);
+	TEST_ERR(err);
+	ASSERT_TRUE(f2 != f1);
+	TEST_MEMCMP(f1->data[0], sz.w * sz.h, f2->data[0], sz.w * sz.h);
+
+	/* the pool is full, the frame is allocated outside of the pool */
+	err = vidpool_get(pool, &f3, VID_FMT_YUV420P, &sz);
+	TEST_ERR(err);
+
+	err = vidpool_stats(pool, &stats);
+	TEST_ERR(err);
+	ASSERT_EQ(2, stats.n_frames);
+	ASSERT_EQ(2, stats.n_busy);
+	ASSERT_EQ(3, stats.n_alloc);
+	ASSERT_EQ(1, stats.n_reuse);
+	ASSERT_EQ(1, stats.n_copy);
+
+	/* a free frame is replaced by a frame with a new size */
+	f2 = mem_deref(f2);
+	err = vidpool_get(pool, &f4, VID_FMT_YUV420P, &sz2);
+	TEST_ERR(err);
+	ASSERT_TRUE(vidsz_cmp(&sz2, &f4->size));
+
+	err = vidpool_stats(pool, &stats);
+	TEST_ERR(err);
+	ASSERT_EQ(2, stats.n_frames);
+	ASSERT_EQ(2, stats.n_busy);
+
+	/* frames stay valid after the pool is destroyed */
+	pool = mem_deref(pool);
+	vidframe_fill(f4, 0, 0, 255);
+
+ out:
+	mem_deref(f4);
+	mem_deref(f3);
+	mem_deref(f2);
+	mem_deref(f1);
+	mem_deref(pool);
+
+	return err;
+}